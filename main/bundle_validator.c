@@ -0,0 +1,581 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "bundle_validator.h"
+#include "common/crypto/iss/normalize.h"
+#include "common/crypto/iss/v1/iss_kerl.h"
+#include "common/crypto/kerl/kerl.h"
+#include "hash_set.h"
+#include "tx_view.h"
+#include "wallet_http.h"
+#include "wallet_mem.h"
+
+static const char *TAG = "bundle_val";
+
+#define SIG_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define SIG_MAX_FRAGMENTS 3
+#define ESSENCE_LEN 486 /* address, value, obsolete tag, timestamp, current index and last index */
+#define FRAGMENT_TRYTES (NUM_TRYTES_HASH / 3)
+#define IOTA_SUPPLY 2779530283277761LL
+#define BUNDLE_BATCH_MAX_HASHES 512 /*!< findTransactions results batched, more are walked */
+#define BUNDLE_BATCH_KEEP (2 * CONFIG_BUNDLE_VALIDATOR_BATCH_MAX) /*!< fetched transactions waiting for the walk */
+
+typedef struct validation_s validation_t;
+
+typedef struct {
+  validation_t *val;
+  flex_trit_t address[FLEX_TRIT_SIZE_243];
+  size_t fragments;
+  flex_trit_t sig[SIG_MAX_FRAGMENTS][FLEX_TRIT_SIZE_6561];
+} sig_job_t;
+
+struct validation_s {
+  Kerl kerl; /*!< the bundle hash of essences so far */
+  flex_trit_t bundle_hash[FLEX_TRIT_SIZE_243];
+  int64_t last_index;
+  int64_t value_sum;
+  bundle_status_t status;
+  sig_job_t *job;          /*!< the input which is collecting signature fragments */
+  size_t jobs;             /*!< jobs sent to workers */
+  SemaphoreHandle_t done;  /*!< given by workers for each job */
+  portMUX_TYPE mux;        /*!< fields below are written by workers */
+  bool sig_failed;
+  int64_t sign_us;
+};
+
+static QueueHandle_t sig_queue = NULL;
+
+// sig is a buffer of NUM_TRITS_SIGNATURE trits for a fragment being hashed.
+static bool sig_verify(sig_job_t *job, trit_t *sig) {
+  Kerl kerl;
+  trit_t hash[NUM_TRITS_HASH];
+  byte_t normalized[NUM_TRYTES_HASH];
+  trit_t digests[SIG_MAX_FRAGMENTS * NUM_TRITS_HASH];
+  trit_t address[NUM_TRITS_HASH];
+  trit_t expected[NUM_TRITS_HASH];
+
+  flex_trits_to_trits(hash, NUM_TRITS_HASH, job->val->bundle_hash, NUM_TRITS_HASH, NUM_TRITS_HASH);
+  normalize_hash(hash, normalized);
+  for (size_t i = 0; i < job->fragments; i++) {
+    flex_trits_to_trits(sig, NUM_TRITS_SIGNATURE, job->sig[i], NUM_TRITS_SIGNATURE, NUM_TRITS_SIGNATURE);
+    kerl_init(&kerl);
+    iss_kerl_sig_digest(digests + i * NUM_TRITS_HASH, normalized + (i % 3) * FRAGMENT_TRYTES, sig,
+                        NUM_TRITS_SIGNATURE, &kerl);
+  }
+  kerl_init(&kerl);
+  iss_kerl_address(digests, address, job->fragments * NUM_TRITS_HASH, &kerl);
+  flex_trits_to_trits(expected, NUM_TRITS_HASH, job->address, NUM_TRITS_HASH, NUM_TRITS_HASH);
+  return memcmp(address, expected, NUM_TRITS_HASH) == 0;
+}
+
+static void sig_worker(void *arg) {
+  trit_t *sig = (trit_t *)arg;
+  sig_job_t *job = NULL;
+  while (1) {
+    xQueueReceive(sig_queue, &job, portMAX_DELAY);
+    validation_t *val = job->val;
+    int64_t start = esp_timer_get_time();
+    bool valid = sig_verify(job, sig);
+    int64_t elapsed = esp_timer_get_time() - start;
+    free(job);
+
+    portENTER_CRITICAL(&val->mux);
+    val->sig_failed |= !valid;
+    val->sign_us += elapsed;
+    portEXIT_CRITICAL(&val->mux);
+    xSemaphoreGive(val->done);
+  }
+}
+
+void bundle_validator_init() {
+  sig_queue = xQueueCreate(CONFIG_BUNDLE_VALIDATOR_WORKERS, sizeof(sig_job_t *));
+  if (sig_queue == NULL) {
+    ESP_LOGE(TAG, "create queue failed, signatures are checked inline");
+    return;
+  }
+  for (int i = 0; i < CONFIG_BUNDLE_VALIDATOR_WORKERS; i++) {
+    // fragments are hashed in internal RAM
+    trit_t *sig = wallet_mem_hot(NUM_TRITS_SIGNATURE);
+    if (sig == NULL || xTaskCreatePinnedToCore(sig_worker, "sig_check", CONFIG_BUNDLE_VALIDATOR_TASK_STACK, sig,
+                                               SIG_TASK_PRIORITY, NULL, i % portNUM_PROCESSORS) != pdPASS) {
+      ESP_LOGE(TAG, "create worker %d failed", i);
+      free(sig);
+      if (i == 0) {
+        vQueueDelete(sig_queue);
+        sig_queue = NULL;
+      }
+      return;
+    }
+  }
+}
+
+static void job_submit(validation_t *val) {
+  sig_job_t *job = val->job;
+  val->job = NULL;
+  val->jobs++;
+  // the queue holds a job per worker, a full queue holds back fetching.
+  if (sig_queue == NULL || xQueueSend(sig_queue, &job, portMAX_DELAY) != pdTRUE) {
+    trit_t *sig = wallet_mem_hot(NUM_TRITS_SIGNATURE);
+    bool valid = sig && sig_verify(job, sig);
+    free(sig);
+    free(job);
+    val->sig_failed |= !valid;
+    xSemaphoreGive(val->done);
+  }
+}
+
+static validation_t *validation_new() {
+  validation_t *val = malloc(sizeof(validation_t));
+  if (val == NULL) {
+    return NULL;
+  }
+  memset(val, 0, sizeof(validation_t));
+  if ((val->done = xSemaphoreCreateCounting(UINT16_MAX, 0)) == NULL) {
+    free(val);
+    return NULL;
+  }
+  vPortCPUInitializeMutex(&val->mux);
+  kerl_init(&val->kerl);
+  val->status = BUNDLE_INCOMPLETE;
+  return val;
+}
+
+// wait for in-flight signature checks, workers hold the validation until they are done.
+static void validation_wait(validation_t *val) {
+  for (size_t i = 0; i < val->jobs; i++) {
+    xSemaphoreTake(val->done, portMAX_DELAY);
+  }
+  val->jobs = 0;
+}
+
+static void validation_free(validation_t *val) {
+  validation_wait(val);
+  free(val->job);
+  vSemaphoreDelete(val->done);
+  free(val);
+}
+
+static bool sig_failed(validation_t *val) {
+  portENTER_CRITICAL(&val->mux);
+  bool failed = val->sig_failed;
+  portEXIT_CRITICAL(&val->mux);
+  return failed;
+}
+
+// Cheap checks of the transaction at the index, returns false if the bundle is rejected.
+static bool validation_add(validation_t *val, size_t index, tx_view_t *tx) {
+  flex_trit_t essence[NUM_FLEX_TRITS_FOR_TRITS(ESSENCE_LEN)];
+  trit_t essence_trits[ESSENCE_LEN];
+  int64_t value = tx_view_value(tx);
+  if (index == 0) {
+    val->last_index = tx_view_last_index(tx);
+    memcpy(val->bundle_hash, tx_view_bundle(tx), FLEX_TRIT_SIZE_243);
+  }
+  if (tx_view_current_index(tx) != index || tx_view_last_index(tx) != val->last_index ||
+      memcmp(tx_view_bundle(tx), val->bundle_hash, FLEX_TRIT_SIZE_243) != 0) {
+    val->status = BUNDLE_INVALID_TX;
+    return false;
+  }
+  if (value > IOTA_SUPPLY || value < -IOTA_SUPPLY || llabs(val->value_sum + value) > IOTA_SUPPLY) {
+    val->status = BUNDLE_INVALID_VALUE;
+    return false;
+  }
+  val->value_sum += value;
+
+  tx_view_essence(tx, essence);
+  flex_trits_to_trits(essence_trits, ESSENCE_LEN, essence, ESSENCE_LEN, ESSENCE_LEN);
+  kerl_absorb(&val->kerl, essence_trits, ESSENCE_LEN);
+
+  // signature fragments of an input follow it with the same address and no value.
+  if (val->job && (value != 0 || val->job->fragments == SIG_MAX_FRAGMENTS ||
+                   memcmp(val->job->address, tx_view_address(tx), FLEX_TRIT_SIZE_243) != 0)) {
+    job_submit(val);
+  }
+  if (value < 0) {
+    // the address of an input is from Kerl, the last trit is 0.
+    if (essence_trits[NUM_TRITS_HASH - 1] != 0) {
+      val->status = BUNDLE_INVALID_INPUT_ADDRESS;
+      return false;
+    }
+    if ((val->job = wallet_mem_cold(sizeof(sig_job_t))) == NULL) {
+      val->status = BUNDLE_NOT_INITIALIZED;
+      return false;
+    }
+    val->job->val = val;
+    val->job->fragments = 0;
+    memcpy(val->job->address, tx_view_address(tx), FLEX_TRIT_SIZE_243);
+  }
+  if (val->job) {
+    tx_view_signature(tx, val->job->sig[val->job->fragments++]);
+  }
+  if (sig_failed(val)) {
+    val->status = BUNDLE_INVALID_SIGNATURE;
+    return false;
+  }
+  return true;
+}
+
+static void validation_finish(validation_t *val) {
+  flex_trit_t hash[FLEX_TRIT_SIZE_243];
+  trit_t hash_trits[NUM_TRITS_HASH];
+
+  if (val->job) {
+    job_submit(val);
+  }
+  if (val->value_sum != 0) {
+    val->status = BUNDLE_INVALID_VALUE;
+    return;
+  }
+  kerl_squeeze(&val->kerl, hash_trits, NUM_TRITS_HASH);
+  flex_trits_from_trits(hash, NUM_TRITS_HASH, hash_trits, NUM_TRITS_HASH, NUM_TRITS_HASH);
+  if (memcmp(hash, val->bundle_hash, FLEX_TRIT_SIZE_243) != 0) {
+    val->status = BUNDLE_INVALID_HASH;
+    return;
+  }
+  validation_wait(val);
+  val->status = val->sig_failed ? BUNDLE_INVALID_SIGNATURE : BUNDLE_VALID;
+}
+
+static retcode_t fetch_trytes(iota_client_service_t const *const serv, flex_trit_t const *hash, flex_trit_t *trytes) {
+  retcode_t ret = RC_OOM;
+  get_trytes_req_t *req = get_trytes_req_new();
+  get_trytes_res_t *res = get_trytes_res_new();
+  if (req && res && (ret = hash243_queue_push(&req->hashes, hash)) == RC_OK &&
+      (ret = wallet_http_get_trytes(serv, req, res)) == RC_OK) {
+    if (hash8019_queue_count(res->trytes) == 1) {
+      memcpy(trytes, hash8019_queue_at(res->trytes, 0), FLEX_TRIT_SIZE_8019);
+    } else {
+      ret = RC_ERROR;
+    }
+  }
+  get_trytes_req_free(&req);
+  get_trytes_res_free(&res);
+  return ret;
+}
+
+// Hashes of the bundle from findTransactions, fetched by getTrytes in chunks of CONFIG_BUNDLE_VALIDATOR_BATCH_MAX.
+// Transactions of the attachment of the tail are kept until the walk reaches them, BUNDLE_BATCH_KEEP at most.
+// Others are walked.
+typedef struct {
+  flex_trit_t attach[FLEX_TRIT_SIZE_243]; /*!< branch of the tail, the trunk tip of the attachment */
+  uint64_t last_index;
+  flex_trit_t *hashes; /*!< FLEX_TRIT_SIZE_243 each, all but the tail */
+  bool *fetched;
+  size_t count;
+  flex_trit_t *kept_hashes;
+  flex_trit_t *kept_trytes;
+  size_t kept;
+  size_t taken; /*!< the kept transaction returned last, its slot is reused at the next call */
+} batch_t;
+
+static void batch_free(batch_t **batch) {
+  if (*batch) {
+    free((*batch)->hashes);
+    free((*batch)->fetched);
+    free((*batch)->kept_hashes);
+    free((*batch)->kept_trytes);
+    free(*batch);
+    *batch = NULL;
+  }
+}
+
+// Hashes of the bundle but the tail by findTransactions, the batch is NULL if the bundle has more than
+// BUNDLE_BATCH_MAX_HASHES, e.g. it was reattached many times.
+static retcode_t batch_open(iota_client_service_t const *const serv, tx_view_t *const tail_tx,
+                            flex_trit_t const *tail, batch_t **batch, bundle_val_stats_t *const stats) {
+  retcode_t ret = RC_OOM;
+  find_transactions_req_t *find_req = find_transactions_req_new();
+  find_transactions_res_t *find_res = find_transactions_res_new();
+  int64_t start = esp_timer_get_time();
+  hash_set_t seen;
+  batch_t *b = NULL;
+
+  hash_set_init(&seen);
+  *batch = NULL;
+  if (!find_req || !find_res || (ret = hash243_queue_push(&find_req->bundles, tx_view_bundle(tail_tx))) != RC_OK) {
+    goto done;
+  }
+  ret = wallet_http_find_transactions(serv, find_req, find_res);
+  stats->round_trips++;
+  if (ret != RC_OK) {
+    goto done;
+  }
+
+  size_t found = hash243_queue_count(find_res->hashes);
+  if (found == 0) {
+    goto done;
+  }
+  if (found > BUNDLE_BATCH_MAX_HASHES) {
+    ESP_LOGW(TAG, "%zu transactions in the bundle, walking trunk transactions", found);
+    goto done;
+  }
+  uint64_t last_index = tx_view_last_index(tail_tx);
+  if ((b = calloc(1, sizeof(batch_t))) == NULL || (b->hashes = wallet_mem_cold(found * FLEX_TRIT_SIZE_243)) == NULL ||
+      (b->fetched = calloc(found, sizeof(bool))) == NULL ||
+      (b->kept_hashes = wallet_mem_cold(BUNDLE_BATCH_KEEP * FLEX_TRIT_SIZE_243)) == NULL ||
+      (b->kept_trytes = wallet_mem_cold(BUNDLE_BATCH_KEEP * FLEX_TRIT_SIZE_8019)) == NULL) {
+    ret = RC_OOM;
+    goto done;
+  }
+  memcpy(b->attach, tx_view_branch(tail_tx), FLEX_TRIT_SIZE_243);
+  b->last_index = last_index;
+  b->taken = BUNDLE_BATCH_KEEP;
+
+  for (size_t i = 0; i < found; i++) {
+    flex_trit_t const *hash = hash243_queue_at(find_res->hashes, i);
+    bool added = false;
+    if (memcmp(hash, tail, FLEX_TRIT_SIZE_243) == 0) {
+      continue;
+    }
+    // a hash listed twice is fetched once
+    if ((ret = hash_set_add(&seen, hash, &added)) != RC_OK) {
+      goto done;
+    }
+    if (added) {
+      memcpy(b->hashes + b->count++ * FLEX_TRIT_SIZE_243, hash, FLEX_TRIT_SIZE_243);
+    }
+  }
+  if (b->count > 0) {
+    *batch = b;
+    b = NULL;
+  }
+
+done:
+  stats->fetch_us += esp_timer_get_time() - start;
+  hash_set_free(&seen);
+  batch_free(&b);
+  find_transactions_req_free(&find_req);
+  find_transactions_res_free(&find_res);
+  return ret;
+}
+
+// the transaction is the next one of the attachment, siblings from reattachments have other tips.
+static bool batch_accepts(batch_t const *batch, tx_view_t *const tx) {
+  uint64_t index = tx_view_current_index(tx);
+  if (batch->kept == BUNDLE_BATCH_KEEP || index == 0 || tx_view_last_index(tx) != batch->last_index) {
+    return false;
+  }
+  flex_trit_t const *tip = index == batch->last_index ? tx_view_trunk(tx) : tx_view_branch(tx);
+  return memcmp(tip, batch->attach, FLEX_TRIT_SIZE_243) == 0;
+}
+
+// getTrytes of the hash and the next hashes which weren't fetched, up to CONFIG_BUNDLE_VALIDATOR_BATCH_MAX.
+static retcode_t batch_fetch_chunk(iota_client_service_t const *const serv, batch_t *batch, size_t first,
+                                   bundle_val_stats_t *const stats) {
+  retcode_t ret = RC_OOM;
+  get_trytes_req_t *req = get_trytes_req_new();
+  get_trytes_res_t *res = get_trytes_res_new();
+  size_t chunk[CONFIG_BUNDLE_VALIDATOR_BATCH_MAX];
+  size_t count = 0;
+  int64_t start = esp_timer_get_time();
+  tx_view_t tx;
+
+  if (!req || !res) {
+    goto done;
+  }
+  for (size_t i = first; i < first + batch->count && count < CONFIG_BUNDLE_VALIDATOR_BATCH_MAX; i++) {
+    size_t index = i % batch->count;
+    if (!batch->fetched[index]) {
+      if ((ret = hash243_queue_push(&req->hashes, batch->hashes + index * FLEX_TRIT_SIZE_243)) != RC_OK) {
+        goto done;
+      }
+      batch->fetched[index] = true;
+      chunk[count++] = index;
+    }
+  }
+
+  ret = wallet_http_get_trytes(serv, req, res);
+  stats->round_trips++;
+  if (ret != RC_OK) {
+    goto done;
+  }
+  if (hash8019_queue_count(res->trytes) != count) {
+    ret = RC_ERROR;
+    goto done;
+  }
+  for (size_t i = 0; i < count; i++) {
+    flex_trit_t const *trytes = hash8019_queue_at(res->trytes, i);
+    if (flex_trits_are_null(trytes, FLEX_TRIT_SIZE_8019)) {
+      continue;
+    }
+    tx_view_init(&tx, trytes);
+    if (batch_accepts(batch, &tx)) {
+      memcpy(batch->kept_hashes + batch->kept * FLEX_TRIT_SIZE_243, batch->hashes + chunk[i] * FLEX_TRIT_SIZE_243,
+             FLEX_TRIT_SIZE_243);
+      memcpy(batch->kept_trytes + batch->kept * FLEX_TRIT_SIZE_8019, trytes, FLEX_TRIT_SIZE_8019);
+      batch->kept++;
+    }
+  }
+
+done:
+  stats->fetch_us += esp_timer_get_time() - start;
+  get_trytes_req_free(&req);
+  get_trytes_res_free(&res);
+  return ret;
+}
+
+static flex_trit_t const *batch_take(batch_t *batch, flex_trit_t const *hash) {
+  for (size_t i = 0; i < batch->kept; i++) {
+    if (memcmp(batch->kept_hashes + i * FLEX_TRIT_SIZE_243, hash, FLEX_TRIT_SIZE_243) == 0) {
+      batch->taken = i;
+      return batch->kept_trytes + i * FLEX_TRIT_SIZE_8019;
+    }
+  }
+  return NULL;
+}
+
+// Trytes of a hash of the bundle, a chunk starting at the hash is fetched if it wasn't yet. NULL if it's not in the
+// batch, it's walked then. The trytes are valid until the next call.
+static flex_trit_t const *batch_get(iota_client_service_t const *const serv, batch_t **batch, flex_trit_t const *hash,
+                                    bundle_val_stats_t *const stats) {
+  batch_t *b = *batch;
+  flex_trit_t const *trytes = NULL;
+  if (b == NULL) {
+    return NULL;
+  }
+
+  // the walk is past the transaction returned last, the last one moves to its slot
+  if (b->taken < b->kept && --b->kept != b->taken) {
+    memcpy(b->kept_hashes + b->taken * FLEX_TRIT_SIZE_243, b->kept_hashes + b->kept * FLEX_TRIT_SIZE_243,
+           FLEX_TRIT_SIZE_243);
+    memcpy(b->kept_trytes + b->taken * FLEX_TRIT_SIZE_8019, b->kept_trytes + b->kept * FLEX_TRIT_SIZE_8019,
+           FLEX_TRIT_SIZE_8019);
+  }
+  b->taken = BUNDLE_BATCH_KEEP;
+
+  if ((trytes = batch_take(b, hash)) != NULL) {
+    return trytes;
+  }
+  size_t index = 0;
+  while (index < b->count && memcmp(b->hashes + index * FLEX_TRIT_SIZE_243, hash, FLEX_TRIT_SIZE_243) != 0) {
+    index++;
+  }
+  if (index == b->count || b->fetched[index]) {
+    return NULL;
+  }
+  if (batch_fetch_chunk(serv, b, index, stats) != RC_OK) {
+    ESP_LOGW(TAG, "batch failed, walking trunk transactions");
+    batch_free(batch);
+    return NULL;
+  }
+  return batch_take(b, hash);
+}
+
+retcode_t bundle_validator_fetch(iota_client_service_t const *const serv, flex_trit_t const *const tail, bool batched,
+                                 hash8019_array_p const bundle, bundle_status_t *const status,
+                                 bundle_val_stats_t *const stats) {
+  retcode_t ret = RC_OK;
+  tx_view_t tx;
+  flex_trit_t hash[FLEX_TRIT_SIZE_243];
+  batch_t *batch = NULL;
+  int64_t start = esp_timer_get_time();
+
+  memset(stats, 0, sizeof(bundle_val_stats_t));
+  validation_t *val = validation_new();
+  flex_trit_t *trytes = wallet_mem_cold(FLEX_TRIT_SIZE_8019);
+  if (val == NULL || trytes == NULL) {
+    ret = RC_OOM;
+    goto done;
+  }
+
+  memcpy(hash, tail, FLEX_TRIT_SIZE_243);
+  for (size_t i = 0;; i++) {
+    int64_t t;
+    flex_trit_t const *tx_trytes = i > 0 ? batch_get(serv, &batch, hash, stats) : NULL;
+    if (tx_trytes) {
+      stats->batched++;
+    } else {
+      if (batch && stats->walked == 0) {
+        ESP_LOGI(TAG, "index %zu is not in the batch, fetching it alone", i);
+      }
+      t = esp_timer_get_time();
+      ret = fetch_trytes(serv, hash, trytes);
+      stats->fetch_us += esp_timer_get_time() - t;
+      stats->round_trips++;
+      stats->walked += i > 0;
+      if (ret != RC_OK) {
+        goto done;
+      }
+      // the node doesn't have it
+      if (flex_trits_are_null(trytes, FLEX_TRIT_SIZE_8019)) {
+        val->status = BUNDLE_INCOMPLETE;
+        break;
+      }
+      tx_trytes = trytes;
+    }
+
+    t = esp_timer_get_time();
+    tx_view_init(&tx, tx_trytes);
+    bool accepted = validation_add(val, i, &tx);
+    stats->check_us += esp_timer_get_time() - t;
+    stats->txs++;
+    if (!accepted) {
+      break;
+    }
+    hash_array_push(bundle, tx_trytes);
+    stats->inputs += tx_view_value(&tx) < 0;
+    if (tx_view_current_index(&tx) == tx_view_last_index(&tx)) {
+      t = esp_timer_get_time();
+      validation_finish(val);
+      stats->check_us += esp_timer_get_time() - t;
+      break;
+    }
+    // with 3 transactions or less the walk takes no more round trips than the batch
+    if (batched && i == 0 && tx_view_last_index(&tx) >= 3 && batch_open(serv, &tx, hash, &batch, stats) != RC_OK) {
+      ESP_LOGW(TAG, "batch failed, walking trunk transactions");
+    }
+    memcpy(hash, tx_view_trunk(&tx), FLEX_TRIT_SIZE_243);
+  }
+  *status = val->status;
+
+done:
+  if (val) {
+    validation_wait(val);
+    stats->sign_us = val->sign_us;
+    validation_free(val);
+  }
+  free(trytes);
+  batch_free(&batch);
+  stats->total_us = esp_timer_get_time() - start;
+  return ret;
+}
+
+void bundle_validator_to_bundle(flex_trit_t const *const tail, hash8019_array_p const trytes,
+                                bundle_transactions_t *const bundle) {
+  iota_transaction_t tx;
+  tx_view_t view;
+  flex_trit_t hash[FLEX_TRIT_SIZE_243];
+  flex_trit_t *elt = NULL;
+
+  memcpy(hash, tail, FLEX_TRIT_SIZE_243);
+  HASH_ARRAY_FOREACH(trytes, elt) {
+    tx_view_init(&view, elt);
+    tx_view_to_transaction(&view, &tx);
+    transaction_set_hash(&tx, hash);
+    bundle_transactions_add(bundle, &tx);
+    // the hash of the next transaction is the trunk of this one
+    memcpy(hash, tx_view_trunk(&view), FLEX_TRIT_SIZE_243);
+  }
+}
+
+void bundle_val_stats_print(bundle_val_stats_t const *const stats) {
+  printf("%zu txs, %zu inputs, %zu round trips: fetch %" PRId64 "ms, checks %" PRId64 "ms, signatures %" PRId64
+         "ms on %d workers, total %" PRId64 "ms\n",
+         stats->txs, stats->inputs, stats->round_trips, stats->fetch_us / 1000, stats->check_us / 1000,
+         stats->sign_us / 1000, CONFIG_BUNDLE_VALIDATOR_WORKERS, stats->total_us / 1000);
+  if (stats->batched) {
+    // the trunk walk takes a round trip per transaction
+    printf("batched %zu txs, walked %zu txs, %d round trips saved\n", stats->batched, stats->walked,
+           (int)stats->txs - (int)stats->round_trips);
+  }
+}
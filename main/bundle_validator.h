@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cclient/api/core/core_api.h"
+#include "common/model/bundle.h"
+#include "utils/containers/hash/hash_array.h"
+
+/*
+ * Bundle validation while the bundle is fetched
+ *
+ * Each transaction is checked as soon as it's received: index, last index, bundle hash field and
+ * value, and its essence is absorbed into the bundle hash. A bundle is rejected at the first
+ * failed check without fetching the rest. Signatures of inputs are verified on worker tasks
+ * pinned to each core while the next transactions are fetched.
+ *
+ * Batched, the tail is fetched first, then hashes of the bundle are looked up by findTransactions
+ * and fetched by getTrytes in chunks of CONFIG_BUNDLE_VALIDATOR_BATCH_MAX, transactions are ordered
+ * locally by trunk hashes. Only transactions of the attachment of the tail are kept, up to two
+ * chunks, a trunk transaction which isn't among them is fetched alone.
+ *
+ * Transactions are checked through lazy views of their trits and returned serialized, they are
+ * decoded into transaction objects only if the caller needs them.
+ */
+
+typedef struct {
+  size_t txs;
+  size_t round_trips;
+  size_t batched; /*!< transactions from the batch */
+  size_t walked;  /*!< transactions fetched one by one after the tail */
+  size_t inputs;
+  int64_t fetch_us; /*!< waiting for the node */
+  int64_t check_us; /*!< cheap checks and the bundle hash */
+  int64_t sign_us;  /*!< signature checks, summed over workers */
+  int64_t total_us;
+} bundle_val_stats_t;
+
+// Start signature workers
+void bundle_validator_init();
+
+// Fetch the bundle of a tail and validate it on the way, in a batch or by walking trunk transactions.
+// Serialized transactions accepted so far are pushed to the bundle array, from the tail.
+retcode_t bundle_validator_fetch(iota_client_service_t const *const serv, flex_trit_t const *const tail, bool batched,
+                                 hash8019_array_p const bundle, bundle_status_t *const status,
+                                 bundle_val_stats_t *const stats);
+
+// Decode serialized transactions of a bundle from the tail into transaction objects.
+void bundle_validator_to_bundle(flex_trit_t const *const tail, hash8019_array_p const trytes,
+                                bundle_transactions_t *const bundle);
+
+void bundle_val_stats_print(bundle_val_stats_t const *const stats);
@@ -0,0 +1,409 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "cclient/api/extended/extended_api.h"
+#include "confirmation_mgr.h"
+#include "net_sched.h"
+#include "node_events.h"
+#include "tip_pool.h"
+#include "wallet_system.h"
+
+static const char *TAG = "confirm_mgr";
+
+#define CONFIRM_TASK_STACK 12288
+#define CONFIRM_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define US_PER_SEC 1000000LL
+
+typedef struct {
+  bool in_use;
+  pending_state_t state;
+  flex_trit_t bundle_hash[FLEX_TRIT_SIZE_243];
+  flex_trit_t tails[CONFIG_CONFIRM_MAX_TAILS][FLEX_TRIT_SIZE_243]; /*!< the original tail and reattachments */
+  uint8_t tail_count;
+  hash8019_array_p trytes; /*!< signed trytes, last index first */
+  uint8_t attempts;
+  uint32_t interval_s;
+  int64_t created_us;
+  int64_t next_check_us;
+  bool watched;         /*!< in the set of the event stream */
+  bool confirmed_event; /*!< the event stream saw a confirmed transaction of the bundle, check it at once */
+} pending_bundle_t;
+
+static pending_bundle_t pending[CONFIG_CONFIRM_MAX_PENDING];
+static SemaphoreHandle_t pending_lock = NULL;
+
+static char const *state_str(pending_state_t state) {
+  switch (state) {
+    case PENDING_WAITING:
+      return "waiting";
+    case PENDING_PROMOTED:
+      return "promoted";
+    case PENDING_REATTACHED:
+      return "reattached";
+    case PENDING_CONFIRMED:
+      return "confirmed";
+    case PENDING_FAILED:
+      return "failed";
+  }
+  return "unknown";
+}
+
+static void pending_release(pending_bundle_t *p) {
+  if (p->trytes) {
+    hash_array_free(p->trytes);
+  }
+  memset(p, 0, sizeof(pending_bundle_t));
+}
+
+static void schedule_next(pending_bundle_t *p) {
+  p->next_check_us = esp_timer_get_time() + (int64_t)p->interval_s * US_PER_SEC;
+  p->interval_s *= 2;
+  if (p->interval_s > CONFIG_CONFIRM_BACKOFF_MAX) {
+    p->interval_s = CONFIG_CONFIRM_BACKOFF_MAX;
+  }
+}
+
+static retcode_t check_inclusion(iota_client_service_t *serv, pending_bundle_t *p, bool *confirmed) {
+  retcode_t ret = RC_ERROR;
+  hash243_queue_t tails = NULL;
+  get_inclusion_states_res_t *states = get_inclusion_states_res_new();
+  *confirmed = false;
+  if (!states) {
+    return RC_OOM;
+  }
+
+  for (uint8_t i = 0; i < p->tail_count; i++) {
+    if ((ret = hash243_queue_push(&tails, p->tails[i])) != RC_OK) {
+      goto done;
+    }
+  }
+
+  if ((ret = iota_client_get_latest_inclusion(serv, tails, states)) == RC_OK) {
+    for (uint8_t i = 0; i < p->tail_count; i++) {
+      if (get_inclusion_states_res_states_at(states, i)) {
+        *confirmed = true;
+        break;
+      }
+    }
+  }
+
+done:
+  hash243_queue_free(&tails);
+  get_inclusion_states_res_free(&states);
+  return ret;
+}
+
+static retcode_t promote(iota_client_service_t *serv, flex_trit_t const *tail) {
+  retcode_t ret = RC_ERROR;
+  uint32_t depth = 0;
+  uint8_t mwm = 0, security = 0;
+  wallet_client_params(&depth, &mwm, &security);
+
+  // a zero value transaction as the promotion
+  transfer_t spam = {};
+  memset(spam.address, FLEX_TRIT_NULL_VALUE, FLEX_TRIT_SIZE_243);
+  memset(spam.tag, FLEX_TRIT_NULL_VALUE, FLEX_TRIT_SIZE_81);
+  spam.value = 0;
+  transfer_array_t *spam_transfers = transfer_array_new();
+  bundle_transactions_t *out_bundle = NULL;
+  bundle_transactions_new(&out_bundle);
+  if (!spam_transfers || !out_bundle) {
+    ret = RC_OOM;
+    goto done;
+  }
+  transfer_array_add(spam_transfers, &spam);
+
+  ret = iota_client_promote_transaction(serv, tail, security, depth, mwm, spam_transfers, out_bundle);
+
+done:
+  bundle_transactions_free(&out_bundle);
+  transfer_array_free(spam_transfers);
+  return ret;
+}
+
+static retcode_t reattach(iota_client_service_t *serv, pending_bundle_t *p) {
+  retcode_t ret = RC_ERROR;
+  uint32_t depth = 0;
+  uint8_t mwm = 0, security = 0;
+  iota_transaction_t *tx = NULL;
+  wallet_client_params(&depth, &mwm, &security);
+
+  transaction_array_t *out_txs = transaction_array_new();
+  if (!out_txs) {
+    return RC_OOM;
+  }
+
+  // the stored trytes are already signed, only tips and PoW are renewed.
+  if ((ret = tip_pool_send_trytes(serv, p->trytes, depth, mwm, out_txs)) == RC_OK) {
+    TX_OBJS_FOREACH(out_txs, tx) {
+      if (transaction_current_index(tx) == 0) {
+        if (p->tail_count >= CONFIG_CONFIRM_MAX_TAILS) {
+          // forget the oldest reattachment, only once the new one is attached
+          memmove(p->tails[0], p->tails[1], FLEX_TRIT_SIZE_243 * (CONFIG_CONFIRM_MAX_TAILS - 1));
+          p->tail_count--;
+        }
+        memcpy(p->tails[p->tail_count], transaction_hash(tx), FLEX_TRIT_SIZE_243);
+        p->tail_count++;
+        break;
+      }
+    }
+  }
+
+  transaction_array_free(out_txs);
+  return ret;
+}
+
+static void process_pending(iota_client_service_t *serv, pending_bundle_t *p) {
+  bool confirmed = false;
+  bool promotable = false;
+  retcode_t ret = RC_ERROR;
+  // a check ahead of the schedule for an event, it doesn't promote or reattach early
+  bool early = p->next_check_us > esp_timer_get_time();
+
+  // an event can be missed, so promotions, reattachments and giving up always follow a check.
+  if ((ret = check_inclusion(serv, p, &confirmed)) != RC_OK) {
+    ESP_LOGW(TAG, "inclusion check failed: %s", error_2_string(ret));
+    if (!early) {
+      schedule_next(p);
+    }
+    return;
+  }
+
+  if (confirmed) {
+    p->state = PENDING_CONFIRMED;
+    if (p->watched) {
+      node_events_unwatch_bundle(p->bundle_hash);
+    }
+    ESP_LOGI(TAG, "bundle confirmed after %" PRId64 "s", (esp_timer_get_time() - p->created_us) / US_PER_SEC);
+    return;
+  }
+  if (early) {
+    return;
+  }
+
+  if (p->attempts >= CONFIG_CONFIRM_MAX_ATTEMPTS) {
+    p->state = PENDING_FAILED;
+    if (p->watched) {
+      node_events_unwatch_bundle(p->bundle_hash);
+    }
+    ESP_LOGW(TAG, "bundle is not confirmed after %d attempts", p->attempts);
+    return;
+  }
+
+  flex_trit_t const *latest_tail = p->tails[p->tail_count - 1];
+  p->attempts++;
+  if (iota_client_is_promotable(serv, latest_tail, &promotable) == RC_OK && promotable) {
+    if ((ret = promote(serv, latest_tail)) == RC_OK) {
+      p->state = PENDING_PROMOTED;
+    }
+  } else {
+    if ((ret = reattach(serv, p)) == RC_OK) {
+      p->state = PENDING_REATTACHED;
+    }
+  }
+
+  if (ret != RC_OK) {
+    ESP_LOGW(TAG, "%s failed: %s", promotable ? "promotion" : "reattachment", error_2_string(ret));
+  }
+  schedule_next(p);
+}
+
+static bool pending_due(int64_t now) {
+  bool due = false;
+  xSemaphoreTake(pending_lock, portMAX_DELAY);
+  for (int i = 0; i < CONFIG_CONFIRM_MAX_PENDING && !due; i++) {
+    pending_bundle_t *p = &pending[i];
+    due = p->in_use && p->state != PENDING_CONFIRMED && p->state != PENDING_FAILED &&
+          (p->next_check_us <= now || p->confirmed_event);
+  }
+  xSemaphoreGive(pending_lock);
+  return due;
+}
+
+// copies the first due bundle from index start on, returns its index or -1. The slot stays in use and unfinished
+// until it's put back, so nothing releases it or the trytes the copy shares.
+static int pending_take_due(int start, int64_t now, pending_bundle_t *work) {
+  int index = -1;
+  xSemaphoreTake(pending_lock, portMAX_DELAY);
+  for (int i = start; i < CONFIG_CONFIRM_MAX_PENDING; i++) {
+    pending_bundle_t *p = &pending[i];
+    if (p->in_use && p->state != PENDING_CONFIRMED && p->state != PENDING_FAILED &&
+        (p->next_check_us <= now || p->confirmed_event)) {
+      memcpy(work, p, sizeof(pending_bundle_t));
+      p->confirmed_event = false;
+      work->confirmed_event = false;
+      index = i;
+      break;
+    }
+  }
+  xSemaphoreGive(pending_lock);
+  return index;
+}
+
+static void pending_put_back(int index, pending_bundle_t const *work) {
+  xSemaphoreTake(pending_lock, portMAX_DELAY);
+  pending_bundle_t *p = &pending[index];
+  // an event during the check asks for another one
+  bool confirmed_event = p->confirmed_event;
+  memcpy(p, work, sizeof(pending_bundle_t));
+  if (confirmed_event && p->state != PENDING_CONFIRMED && p->state != PENDING_FAILED) {
+    p->confirmed_event = true;
+  }
+  xSemaphoreGive(pending_lock);
+}
+
+static void confirmation_task(void *param) {
+  (void)param;
+  pending_bundle_t work;
+  while (1) {
+    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    if (!pending_due(esp_timer_get_time())) {
+      continue;
+    }
+    // checks are deferred to the next radio wake
+    net_sched_wait_window();
+    int64_t now = esp_timer_get_time();
+
+    // network calls and PoW run on a copy, `pending` and `send` don't wait for them.
+    for (int i = pending_take_due(0, now, &work); i >= 0; i = pending_take_due(i + 1, now, &work)) {
+      iota_client_service_t *serv = wallet_client_acquire();
+      process_pending(serv, &work);
+      wallet_client_release();
+      pending_put_back(i, &work);
+    }
+  }
+}
+
+void confirmation_mgr_start() {
+  pending_lock = xSemaphoreCreateMutex();
+  if (pending_lock == NULL) {
+    ESP_LOGE(TAG, "create mutex failed");
+    return;
+  }
+  if (xTaskCreate(confirmation_task, "confirm_mgr", CONFIRM_TASK_STACK, NULL, CONFIRM_TASK_PRIORITY, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "create task failed");
+  }
+}
+
+bool confirmation_mgr_track(flex_trit_t const *const bundle_hash, flex_trit_t const *const tail,
+                            hash8019_array_p const trytes) {
+  pending_bundle_t *slot = NULL;
+  flex_trit_t *elt = NULL;
+  if (pending_lock == NULL) {
+    return false;
+  }
+
+  // the signed trytes are copied first, a bundle without all of them can't be reattached.
+  hash8019_array_p copy = hash8019_array_new();
+  if (copy) {
+    HASH_ARRAY_FOREACH(trytes, elt) { hash_array_push(copy, elt); }
+  }
+  if (copy == NULL || utarray_len(copy) == 0 || utarray_len(copy) != utarray_len(trytes)) {
+    ESP_LOGW(TAG, "copying the trytes failed, the bundle isn't tracked");
+    if (copy) {
+      hash_array_free(copy);
+    }
+    return false;
+  }
+
+  xSemaphoreTake(pending_lock, portMAX_DELAY);
+  for (int i = 0; i < CONFIG_CONFIRM_MAX_PENDING; i++) {
+    if (!pending[i].in_use) {
+      slot = &pending[i];
+      break;
+    }
+  }
+  // reuse a finished slot if the table is full
+  for (int i = 0; slot == NULL && i < CONFIG_CONFIRM_MAX_PENDING; i++) {
+    if (pending[i].state == PENDING_CONFIRMED || pending[i].state == PENDING_FAILED) {
+      pending_release(&pending[i]);
+      slot = &pending[i];
+    }
+  }
+
+  if (slot) {
+    slot->trytes = copy;
+    copy = NULL;
+    memcpy(slot->bundle_hash, bundle_hash, FLEX_TRIT_SIZE_243);
+    memcpy(slot->tails[0], tail, FLEX_TRIT_SIZE_243);
+    slot->tail_count = 1;
+    slot->state = PENDING_WAITING;
+    slot->interval_s = CONFIG_CONFIRM_CHECK_INTERVAL;
+    slot->created_us = esp_timer_get_time();
+    schedule_next(slot);
+    slot->in_use = true;
+    slot->watched = node_events_watch_bundle(bundle_hash);
+  }
+  xSemaphoreGive(pending_lock);
+
+  if (slot == NULL) {
+    ESP_LOGW(TAG, "no free slot for tracking the bundle");
+    hash_array_free(copy);
+  }
+  return slot != NULL;
+}
+
+void confirmation_mgr_check_bundle(flex_trit_t const *const bundle_hash) {
+  if (pending_lock == NULL) {
+    return;
+  }
+  xSemaphoreTake(pending_lock, portMAX_DELAY);
+  for (int i = 0; i < CONFIG_CONFIRM_MAX_PENDING; i++) {
+    pending_bundle_t *p = &pending[i];
+    if (p->in_use && p->state != PENDING_CONFIRMED && p->state != PENDING_FAILED &&
+        memcmp(p->bundle_hash, bundle_hash, FLEX_TRIT_SIZE_243) == 0) {
+      p->confirmed_event = true;
+    }
+  }
+  xSemaphoreGive(pending_lock);
+}
+
+void confirmation_mgr_dump() {
+  if (pending_lock == NULL) {
+    return;
+  }
+  int64_t now = esp_timer_get_time();
+  size_t count = 0;
+
+  xSemaphoreTake(pending_lock, portMAX_DELAY);
+  for (int i = 0; i < CONFIG_CONFIRM_MAX_PENDING; i++) {
+    pending_bundle_t *p = &pending[i];
+    if (!p->in_use) {
+      continue;
+    }
+    count++;
+    printf("[%d] %s, attempts %d, tails %d, age %" PRId64 "s", i, state_str(p->state), p->attempts, p->tail_count,
+           (now - p->created_us) / US_PER_SEC);
+    if (p->state != PENDING_CONFIRMED && p->state != PENDING_FAILED) {
+      printf(", next check in %" PRId64 "s", p->next_check_us > now ? (p->next_check_us - now) / US_PER_SEC : 0);
+    }
+    printf("\n\tbundle: ");
+    flex_trit_print(p->bundle_hash, NUM_TRITS_HASH);
+    printf("\n\ttail: ");
+    flex_trit_print(p->tails[p->tail_count - 1], NUM_TRITS_HASH);
+    printf("\n");
+  }
+  xSemaphoreGive(pending_lock);
+  printf("pending count = %zu\n", count);
+}
+
+void confirmation_mgr_clear_finished() {
+  if (pending_lock == NULL) {
+    return;
+  }
+  xSemaphoreTake(pending_lock, portMAX_DELAY);
+  for (int i = 0; i < CONFIG_CONFIRM_MAX_PENDING; i++) {
+    if (pending[i].in_use && (pending[i].state == PENDING_CONFIRMED || pending[i].state == PENDING_FAILED)) {
+      pending_release(&pending[i]);
+    }
+  }
+  xSemaphoreGive(pending_lock);
+}
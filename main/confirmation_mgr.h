@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/model/bundle.h"
+#include "utils/containers/hash/hash_array.h"
+
+typedef enum {
+  PENDING_WAITING = 0, /*!< waiting for the next inclusion check */
+  PENDING_PROMOTED,    /*!< the latest tail has been promoted */
+  PENDING_REATTACHED,  /*!< the bundle has been reattached with a new tail */
+  PENDING_CONFIRMED,   /*!< one of the tails is confirmed */
+  PENDING_FAILED,      /*!< gave up after too many attempts */
+} pending_state_t;
+
+// Start the background confirmation task
+void confirmation_mgr_start();
+
+// Track a bundle which was just sent.
+// The signed trytes are kept and reused for reattachment, the caller still owns the trytes array.
+bool confirmation_mgr_track(flex_trit_t const *const bundle_hash, flex_trit_t const *const tail,
+                            hash8019_array_p const trytes);
+
+// Check the inclusion of a tracked bundle at the next round, e.g. on a confirmation event.
+void confirmation_mgr_check_bundle(flex_trit_t const *const bundle_hash);
+
+// Print pending bundles
+void confirmation_mgr_dump();
+
+// Remove confirmed and failed bundles
+void confirmation_mgr_clear_finished();
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbedtls/sha256.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_system.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "crypto_backend.h"
+#include "utils/memset_safe.h"
+
+// 27 * 9, bytes above it would bias the tryte distribution.
+#define TRYTE_REJECT_LIMIT 243
+#define RANDOM_CHUNK 32
+
+static tryte_t const tryte_chars[27] = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N',
+                                        'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', '9'};
+
+void crypto_random_bytes(uint8_t *buf, size_t len) {
+#ifdef ESP_PLATFORM
+  // True random numbers while the RF subsystem is enabled, pseudo-random otherwise.
+  esp_fill_random(buf, len);
+#else
+  int fd = open("/dev/urandom", O_RDONLY);
+  size_t offset = 0;
+  while (fd >= 0 && offset < len) {
+    ssize_t n = read(fd, buf + offset, len - offset);
+    if (n <= 0) {
+      break;
+    }
+    offset += n;
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (offset < len) {
+    fprintf(stderr, "reading /dev/urandom failed\n");
+    abort();
+  }
+#endif
+}
+
+void crypto_random_trytes(tryte_t *trytes, size_t len) {
+  uint8_t chunk[RANDOM_CHUNK];
+  size_t filled = 0;
+
+  while (filled < len) {
+    crypto_random_bytes(chunk, sizeof(chunk));
+    for (size_t i = 0; i < sizeof(chunk) && filled < len; i++) {
+      if (chunk[i] < TRYTE_REJECT_LIMIT) {
+        trytes[filled++] = tryte_chars[chunk[i] % 27];
+      }
+    }
+  }
+  memset_safe(chunk, sizeof(chunk), 0, sizeof(chunk));
+}
+
+int crypto_sha256(void const *data, size_t len, uint8_t digest[CRYPTO_SHA256_LEN]) {
+  return mbedtls_sha256_ret((unsigned char const *)data, len, digest, 0);
+}
+
+void crypto_record_tag(void const *data, size_t len, uint8_t tag[CRYPTO_RECORD_TAG_LEN]) {
+  uint8_t digest[CRYPTO_SHA256_LEN];
+  crypto_sha256(data, len, digest);
+  memcpy(tag, digest, CRYPTO_RECORD_TAG_LEN);
+}
+
+bool crypto_record_verify(void const *data, size_t len, uint8_t const tag[CRYPTO_RECORD_TAG_LEN]) {
+  uint8_t expected[CRYPTO_RECORD_TAG_LEN];
+  crypto_record_tag(data, len, expected);
+  return crypto_memcmp_ct(expected, tag, CRYPTO_RECORD_TAG_LEN) == 0;
+}
+
+int crypto_memcmp_ct(void const *a, void const *b, size_t len) {
+  uint8_t const *pa = (uint8_t const *)a;
+  uint8_t const *pb = (uint8_t const *)b;
+  uint8_t diff = 0;
+  for (size_t i = 0; i < len; i++) {
+    diff |= pa[i] ^ pb[i];
+  }
+  return diff;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/trinary/tryte.h"
+
+#define CRYPTO_SHA256_LEN 32
+#define CRYPTO_RECORD_TAG_LEN 8
+
+// Fill the buffer from the hardware RNG, /dev/urandom on the host build.
+void crypto_random_bytes(uint8_t *buf, size_t len);
+
+// Uniformly distributed random trytes for seeds and nonces.
+void crypto_random_trytes(tryte_t *trytes, size_t len);
+
+// SHA-256 through mbedTLS, it uses the SHA engine on ESP32 if CONFIG_MBEDTLS_HARDWARE_SHA is enabled.
+int crypto_sha256(void const *data, size_t len, uint8_t digest[CRYPTO_SHA256_LEN]);
+
+// Integrity tag of cache and log records, a truncated SHA-256.
+void crypto_record_tag(void const *data, size_t len, uint8_t tag[CRYPTO_RECORD_TAG_LEN]);
+bool crypto_record_verify(void const *data, size_t len, uint8_t const tag[CRYPTO_RECORD_TAG_LEN]);
+
+// Compare in constant time, returns 0 if equal.
+int crypto_memcmp_ct(void const *a, void const *b, size_t len);
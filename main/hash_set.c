@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "wallet_mem.h"
+#else
+#define wallet_mem_cold malloc
+#define wallet_mem_cold_realloc realloc
+#endif
+
+#include "hash_set.h"
+
+// bytes of a hash fed to FNV-1a, 16 to 80 trits with 1 to 5 trits per byte. Hashes are random, so even the 16
+// trits of one trit per byte spread them.
+#define HASH_SET_KEY_BYTES 16
+#define HASH_SET_MIN_SLOTS 64
+#define HASH_SET_MIN_HASHES 32
+
+static inline uint32_t hash_set_hashv(flex_trit_t const *hash) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < HASH_SET_KEY_BYTES; i++) {
+    h ^= (uint8_t)hash[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+#define HASH_FUNCTION(keyptr, keylen, hashv) (hashv) = hash_set_hashv((flex_trit_t const *)(keyptr))
+#include "uthash.h"
+
+struct hash_set_entry_s {
+  flex_trit_t hash[FLEX_TRIT_SIZE_243];
+  UT_hash_handle hh;
+};
+
+void hash_set_init(hash_set_t *const set) {
+#ifdef CONFIG_HASH_SET_OPEN_ADDRESSING
+  hash_set_init_layout(set, HASH_SET_OPEN);
+#else
+  hash_set_init_layout(set, HASH_SET_UTHASH);
+#endif
+}
+
+void hash_set_init_layout(hash_set_t *const set, hash_set_layout_t layout) {
+  memset(set, 0, sizeof(*set));
+  set->layout = layout;
+}
+
+// the slot of a hash, or the empty slot it goes into. The table is never full.
+static uint32_t *open_find(hash_set_t const *const set, flex_trit_t const *const hash) {
+  size_t mask = set->slots_cap - 1;
+  for (size_t i = hash_set_hashv(hash) & mask;; i = (i + 1) & mask) {
+    uint32_t *slot = &set->slots[i];
+    if (*slot == 0 || memcmp(set->hashes + (*slot - 1) * FLEX_TRIT_SIZE_243, hash, FLEX_TRIT_SIZE_243) == 0) {
+      return slot;
+    }
+  }
+}
+
+// at most 3/4 of slots are used
+static retcode_t open_grow_slots(hash_set_t *const set, size_t count) {
+  size_t cap = set->slots_cap ? set->slots_cap : HASH_SET_MIN_SLOTS;
+  while (count * 4 > cap * 3) {
+    cap *= 2;
+  }
+  if (cap == set->slots_cap) {
+    return RC_OK;
+  }
+
+  uint32_t *slots = wallet_mem_cold(cap * sizeof(uint32_t));
+  if (slots == NULL) {
+    return RC_OOM;
+  }
+  memset(slots, 0, cap * sizeof(uint32_t));
+  free(set->slots);
+  set->slots = slots;
+  set->slots_cap = cap;
+  for (size_t i = 0; i < set->count; i++) {
+    *open_find(set, set->hashes + i * FLEX_TRIT_SIZE_243) = i + 1;
+  }
+  return RC_OK;
+}
+
+static retcode_t open_grow_hashes(hash_set_t *const set, size_t count) {
+  if (count <= set->hashes_cap) {
+    return RC_OK;
+  }
+  flex_trit_t *hashes = wallet_mem_cold_realloc(set->hashes, count * FLEX_TRIT_SIZE_243);
+  if (hashes == NULL) {
+    return RC_OOM;
+  }
+  set->hashes = hashes;
+  set->hashes_cap = count;
+  return RC_OK;
+}
+
+retcode_t hash_set_reserve(hash_set_t *const set, size_t count) {
+  retcode_t ret = RC_OK;
+  if (set->layout == HASH_SET_OPEN && (ret = open_grow_hashes(set, count)) == RC_OK) {
+    ret = open_grow_slots(set, count);
+  }
+  return ret;
+}
+
+retcode_t hash_set_add(hash_set_t *const set, flex_trit_t const *const hash, bool *const added) {
+  retcode_t ret = RC_OK;
+  if (added) {
+    *added = false;
+  }
+
+  if (set->layout == HASH_SET_UTHASH) {
+    hash_set_entry_t *entry = NULL;
+    HASH_FIND(hh, set->table, hash, FLEX_TRIT_SIZE_243, entry);
+    if (entry) {
+      return RC_OK;
+    }
+    if ((entry = malloc(sizeof(hash_set_entry_t))) == NULL) {
+      return RC_OOM;
+    }
+    memcpy(entry->hash, hash, FLEX_TRIT_SIZE_243);
+    HASH_ADD(hh, set->table, hash, FLEX_TRIT_SIZE_243, entry);
+  } else {
+    if ((ret = open_grow_slots(set, set->count + 1)) != RC_OK) {
+      return ret;
+    }
+    uint32_t *slot = open_find(set, hash);
+    if (*slot) {
+      return RC_OK;
+    }
+    size_t hashes_cap = set->hashes_cap ? set->hashes_cap + set->hashes_cap / 2 : HASH_SET_MIN_HASHES;
+    if (set->count == set->hashes_cap && (ret = open_grow_hashes(set, hashes_cap)) != RC_OK) {
+      return ret;
+    }
+    memcpy(set->hashes + set->count * FLEX_TRIT_SIZE_243, hash, FLEX_TRIT_SIZE_243);
+    *slot = set->count + 1;
+  }
+
+  set->count++;
+  if (added) {
+    *added = true;
+  }
+  return RC_OK;
+}
+
+bool hash_set_contains(hash_set_t const *const set, flex_trit_t const *const hash) {
+  if (set->layout == HASH_SET_UTHASH) {
+    hash_set_entry_t *entry = NULL;
+    HASH_FIND(hh, set->table, hash, FLEX_TRIT_SIZE_243, entry);
+    return entry != NULL;
+  }
+  return set->count > 0 && *open_find(set, hash) != 0;
+}
+
+size_t hash_set_count(hash_set_t const *const set) { return set->count; }
+
+size_t hash_set_bytes(hash_set_t const *const set) {
+  if (set->layout == HASH_SET_UTHASH) {
+    size_t bytes = set->count * sizeof(hash_set_entry_t);
+    if (set->table) {
+      bytes += sizeof(UT_hash_table) + set->table->hh.tbl->num_buckets * sizeof(UT_hash_bucket);
+    }
+    return bytes;
+  }
+  return set->hashes_cap * FLEX_TRIT_SIZE_243 + set->slots_cap * sizeof(uint32_t);
+}
+
+char const *hash_set_layout_name(hash_set_layout_t layout) {
+  return layout == HASH_SET_OPEN ? "open addressing" : "uthash";
+}
+
+void hash_set_free(hash_set_t *const set) {
+  hash_set_entry_t *entry = NULL, *tmp = NULL;
+  HASH_ITER(hh, set->table, entry, tmp) {
+    HASH_DEL(set->table, entry);
+    free(entry);
+  }
+  free(set->hashes);
+  free(set->slots);
+  hash_set_init_layout(set, set->layout);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/errors.h"
+#include "common/trinary/flex_trit.h"
+
+/*
+ * Set of 243-trit hashes
+ *
+ * Two layouts behind one interface:
+ *  - uthash: an allocation per hash with a uthash handle, chained buckets
+ *  - open addressing: hashes in one array and a table of 32-bit indices probed linearly, no allocation or handle
+ *    per hash. `bench hashset` prints the bytes of both.
+ * Hashes are random, FNV-1a of their first bytes spreads them well enough for both. Without ESP_PLATFORM it builds
+ * on the host, see tools/hash_set_bench.c.
+ */
+
+typedef enum {
+  HASH_SET_UTHASH = 0,
+  HASH_SET_OPEN,
+} hash_set_layout_t;
+
+typedef struct hash_set_entry_s hash_set_entry_t;
+
+typedef struct {
+  hash_set_layout_t layout;
+  size_t count;
+  hash_set_entry_t *table; /*!< uthash */
+  flex_trit_t *hashes;     /*!< open addressing, FLEX_TRIT_SIZE_243 bytes per hash in insertion order */
+  size_t hashes_cap;
+  uint32_t *slots; /*!< open addressing, index + 1 of a hash, 0 is empty */
+  size_t slots_cap; /*!< a power of two */
+} hash_set_t;
+
+// The layout of CONFIG_HASH_SET_OPEN_ADDRESSING
+void hash_set_init(hash_set_t *const set);
+void hash_set_init_layout(hash_set_t *const set, hash_set_layout_t layout);
+
+// Room for count hashes without growing, open addressing only.
+retcode_t hash_set_reserve(hash_set_t *const set, size_t count);
+
+// Add a hash, added is false if it's in the set already. added can be NULL.
+retcode_t hash_set_add(hash_set_t *const set, flex_trit_t const *const hash, bool *const added);
+bool hash_set_contains(hash_set_t const *const set, flex_trit_t const *const hash);
+size_t hash_set_count(hash_set_t const *const set);
+
+// Bytes of the set, including buckets and the allocated capacity
+size_t hash_set_bytes(hash_set_t const *const set);
+char const *hash_set_layout_name(hash_set_layout_t layout);
+
+void hash_set_free(hash_set_t *const set);
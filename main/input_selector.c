@@ -0,0 +1,470 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "argtable3/argtable3.h"
+#include "esp_console.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+#include "common/helpers/sign.h"
+#include "crypto_backend.h"
+#include "input_selector.h"
+#include "wallet_batch.h"
+#include "wallet_http.h"
+#include "wallet_mem.h"
+
+static const char *TAG = "input_selector";
+
+typedef struct {
+  uint8_t seed_tag[CRYPTO_RECORD_TAG_LEN];
+  uint8_t security; /*!< 0 if no addresses are known */
+  uint32_t next_index; /*!< the first address without funds after funded ones */
+  bool next_cached;
+  flex_trit_t next_address[FLEX_TRIT_SIZE_243];
+  size_t count;
+  input_entry_t *entries; /*!< funded addresses sorted by index */
+} input_table_t;
+
+static input_table_t table = {};
+static input_strategy_t strategy =
+#ifdef CONFIG_INPUT_SELECTOR_OLDEST
+    INPUT_STRATEGY_OLDEST;
+#else
+    INPUT_STRATEGY_FEWEST;
+#endif
+static SemaphoreHandle_t table_lock = NULL;
+static uint32_t generation = 0; /*!< changes with the addresses of the table */
+
+void input_selector_init() {
+  table_lock = xSemaphoreCreateMutex();
+  // an entry is about 100 bytes, SPI RAM with the split memory policy.
+  table.entries = wallet_mem_cold(CONFIG_INPUT_SELECTOR_ADDRESSES * sizeof(input_entry_t));
+  if (table_lock == NULL || table.entries == NULL) {
+    ESP_LOGE(TAG, "init failed, inputs are found by get_inputs");
+  }
+}
+
+static bool table_ready() { return table_lock != NULL && table.entries != NULL; }
+
+// must be called with table_lock
+static bool table_matches(flex_trit_t const *seed, uint8_t security) {
+  uint8_t tag[CRYPTO_RECORD_TAG_LEN];
+  crypto_record_tag(seed, FLEX_TRIT_SIZE_243, tag);
+  return table.security == security && crypto_memcmp_ct(tag, table.seed_tag, CRYPTO_RECORD_TAG_LEN) == 0;
+}
+
+// must be called with table_lock, entries stay sorted by index.
+static void table_put(uint32_t index, flex_trit_t const *address, uint64_t balance) {
+  size_t i = 0;
+  while (i < table.count && table.entries[i].index < index) {
+    i++;
+  }
+  if (i < table.count && table.entries[i].index == index) {
+    table.entries[i].balance = balance;
+    return;
+  }
+  if (table.count == CONFIG_INPUT_SELECTOR_ADDRESSES) {
+    ESP_LOGW(TAG, "table is full, address %u is not kept", index);
+    return;
+  }
+  memmove(&table.entries[i + 1], &table.entries[i], (table.count - i) * sizeof(input_entry_t));
+  table.entries[i].index = index;
+  table.entries[i].balance = balance;
+  memcpy(table.entries[i].address, address, FLEX_TRIT_SIZE_243);
+  table.count++;
+  generation++;
+}
+
+// must be called with table_lock
+static void table_remove_if(bool (*pred)(input_entry_t const *, void const *), void const *arg) {
+  size_t kept = 0;
+  for (size_t i = 0; i < table.count; i++) {
+    if (!pred(&table.entries[i], arg)) {
+      table.entries[kept++] = table.entries[i];
+    }
+  }
+  generation += kept != table.count;
+  table.count = kept;
+}
+
+static bool entry_is_empty(input_entry_t const *entry, void const *arg) { return entry->balance == 0; }
+
+static bool entry_has_address(input_entry_t const *entry, void const *arg) {
+  return memcmp(entry->address, arg, FLEX_TRIT_SIZE_243) == 0;
+}
+
+void input_selector_set_account(flex_trit_t const *seed, uint8_t security, account_data_t *account) {
+  if (!table_ready()) {
+    return;
+  }
+  size_t count = hash243_queue_count(account->addresses);
+  xSemaphoreTake(table_lock, portMAX_DELAY);
+  crypto_record_tag(seed, FLEX_TRIT_SIZE_243, table.seed_tag);
+  table.security = security;
+  table.count = 0;
+  // the unused address is the next one to check for deposits
+  table.next_index = count;
+  memcpy(table.next_address, account->latest_address, FLEX_TRIT_SIZE_243);
+  table.next_cached = true;
+  generation++;
+  for (size_t i = 0; i < count; i++) {
+    flex_trit_t const *address = hash243_queue_at(account->addresses, i);
+    uint64_t balance = account_data_get_balance(account, i);
+    if (memcmp(address, account->latest_address, FLEX_TRIT_SIZE_243) == 0) {
+      table.next_index = i;
+    } else if (balance > 0) {
+      table_put(i, address, balance);
+    }
+  }
+  xSemaphoreGive(table_lock);
+}
+
+void input_selector_load(flex_trit_t const *seed, uint8_t security, input_entry_t const *entries, size_t count,
+                         uint32_t next_index, flex_trit_t const *next_address) {
+  if (!table_ready()) {
+    return;
+  }
+  xSemaphoreTake(table_lock, portMAX_DELAY);
+  crypto_record_tag(seed, FLEX_TRIT_SIZE_243, table.seed_tag);
+  table.security = security;
+  table.count = 0;
+  table.next_index = next_index;
+  memcpy(table.next_address, next_address, FLEX_TRIT_SIZE_243);
+  table.next_cached = true;
+  generation++;
+  for (size_t i = 0; i < count; i++) {
+    if (entries[i].balance > 0) {
+      table_put(entries[i].index, entries[i].address, entries[i].balance);
+    }
+  }
+  xSemaphoreGive(table_lock);
+}
+
+// Refresh balances of funded addresses and the next address in one getBalances, funded addresses are
+// copied out of the table as candidates.
+static retcode_t refresh(iota_client_service_t const *const serv, input_entry_t *candidates, size_t *count) {
+  retcode_t ret = RC_OOM;
+  get_balances_req_t *req = get_balances_req_new();
+  get_balances_res_t *res = get_balances_res_new();
+  input_entry_t next = {};
+
+  xSemaphoreTake(table_lock, portMAX_DELAY);
+  *count = table.count;
+  memcpy(candidates, table.entries, table.count * sizeof(input_entry_t));
+  next.index = table.next_index;
+  memcpy(next.address, table.next_address, FLEX_TRIT_SIZE_243);
+  xSemaphoreGive(table_lock);
+
+  if (!req || !res) {
+    goto done;
+  }
+  for (size_t i = 0; i < *count; i++) {
+    if ((ret = get_balances_req_address_add(req, candidates[i].address)) != RC_OK) {
+      goto done;
+    }
+  }
+  if ((ret = get_balances_req_address_add(req, next.address)) != RC_OK) {
+    goto done;
+  }
+  req->threshold = 100;
+  if ((ret = wallet_http_get_balances(serv, req, res)) != RC_OK) {
+    goto done;
+  }
+  if (get_balances_res_balances_num(res) != *count + 1) {
+    ret = RC_ERROR;
+    goto done;
+  }
+  for (size_t i = 0; i < *count; i++) {
+    candidates[i].balance = get_balances_res_balances_at(res, i);
+  }
+  next.balance = get_balances_res_balances_at(res, *count);
+
+  xSemaphoreTake(table_lock, portMAX_DELAY);
+  for (size_t i = 0; i < *count; i++) {
+    table_put(candidates[i].index, candidates[i].address, candidates[i].balance);
+  }
+  table_remove_if(entry_is_empty, NULL);
+  if (next.balance > 0 && next.index == table.next_index) {
+    ESP_LOGI(TAG, "deposit of %" PRIu64 " at address %u", next.balance, next.index);
+    table_put(next.index, next.address, next.balance);
+    table.next_index++;
+    table.next_cached = false;
+    if (*count < CONFIG_INPUT_SELECTOR_ADDRESSES) {
+      candidates[(*count)++] = next;
+    }
+  }
+  xSemaphoreGive(table_lock);
+
+done:
+  get_balances_req_free(&req);
+  get_balances_res_free(&res);
+  return ret;
+}
+
+// Drop candidates the spent index or the node knows as spent.
+static retcode_t drop_spent(iota_client_service_t const *const serv, input_entry_t *candidates, size_t *count) {
+  retcode_t ret = RC_OOM;
+  were_addresses_spent_from_req_t *req = were_addresses_spent_from_req_new();
+  were_addresses_spent_from_res_t *res = were_addresses_spent_from_res_new();
+  if (*count == 0) {
+    ret = RC_OK;
+    goto done;
+  }
+  if (!req || !res) {
+    goto done;
+  }
+  for (size_t i = 0; i < *count; i++) {
+    if ((ret = hash243_queue_push(&req->addresses, candidates[i].address)) != RC_OK) {
+      goto done;
+    }
+  }
+  if ((ret = iota_client_were_addresses_spent_from(serv, req, res)) != RC_OK) {
+    goto done;
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < *count; i++) {
+    if (were_addresses_spent_from_res_states_at(res, i)) {
+      ESP_LOGW(TAG, "address %u is spent, it's not used as an input", candidates[i].index);
+      xSemaphoreTake(table_lock, portMAX_DELAY);
+      table_remove_if(entry_has_address, candidates[i].address);
+      xSemaphoreGive(table_lock);
+    } else {
+      candidates[kept++] = candidates[i];
+    }
+  }
+  *count = kept;
+
+done:
+  were_addresses_spent_from_req_free(&req);
+  were_addresses_spent_from_res_free(&res);
+  return ret;
+}
+
+static int by_balance_desc(void const *a, void const *b) {
+  uint64_t x = ((input_entry_t const *)a)->balance, y = ((input_entry_t const *)b)->balance;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int by_index(void const *a, void const *b) {
+  uint32_t x = ((input_entry_t const *)a)->index, y = ((input_entry_t const *)b)->index;
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Order candidates by the strategy and return how many of the first ones cover the value, 0 if they can't.
+static size_t choose(input_entry_t *candidates, size_t count, uint64_t value) {
+  uint64_t total = 0;
+  if (strategy == INPUT_STRATEGY_FEWEST) {
+    qsort(candidates, count, sizeof(input_entry_t), by_balance_desc);
+    // the smallest address covering the value alone leaves the smallest remainder.
+    for (size_t i = count; i > 0; i--) {
+      if (candidates[i - 1].balance >= value) {
+        candidates[0] = candidates[i - 1];
+        return 1;
+      }
+    }
+  } else {
+    qsort(candidates, count, sizeof(input_entry_t), by_index);
+  }
+  for (size_t i = 0; i < count; i++) {
+    total += candidates[i].balance;
+    if (total >= value) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+retcode_t input_selector_select(iota_client_service_t const *const serv, flex_trit_t const *seed, uint8_t security,
+                                uint64_t value, inputs_t *const inputs) {
+  retcode_t ret = RC_OK;
+  size_t count = 0;
+  input_entry_t *candidates = NULL;
+  if (!table_ready()) {
+    return RC_OK;
+  }
+
+  xSemaphoreTake(table_lock, portMAX_DELAY);
+  bool matches = table_matches(seed, security);
+  bool next_cached = table.next_cached;
+  uint32_t next_index = table.next_index;
+  xSemaphoreGive(table_lock);
+  if (!matches) {
+    ESP_LOGI(TAG, "no funded addresses of the seed, run `account` to keep them");
+    return RC_OK;
+  }
+  if (!next_cached) {
+    flex_trit_t *address = iota_sign_address_gen_flex_trits(seed, next_index, security);
+    if (address == NULL) {
+      return RC_OOM;
+    }
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    if (table.next_index == next_index) {
+      memcpy(table.next_address, address, FLEX_TRIT_SIZE_243);
+      table.next_cached = true;
+      generation++;
+    }
+    xSemaphoreGive(table_lock);
+    free(address);
+  }
+
+  if ((candidates = wallet_mem_cold(CONFIG_INPUT_SELECTOR_ADDRESSES * sizeof(input_entry_t))) == NULL) {
+    return RC_OOM;
+  }
+  if ((ret = refresh(serv, candidates, &count)) != RC_OK || (ret = drop_spent(serv, candidates, &count)) != RC_OK) {
+    goto done;
+  }
+
+  size_t chosen = choose(candidates, count, value);
+  for (size_t i = 0; i < chosen && ret == RC_OK; i++) {
+    input_t input = {.balance = candidates[i].balance, .key_index = candidates[i].index, .security = security};
+    memcpy(input.address, candidates[i].address, FLEX_TRIT_SIZE_243);
+    ret = inputs_append(inputs, &input);
+  }
+
+done:
+  free(candidates);
+  return ret;
+}
+
+void input_selector_mark_bundle(bundle_transactions_t const *const bundle) {
+  iota_transaction_t *tx = NULL;
+  if (!table_ready()) {
+    return;
+  }
+  xSemaphoreTake(table_lock, portMAX_DELAY);
+  BUNDLE_FOREACH(bundle, tx) {
+    if (transaction_value(tx) < 0) {
+      table_remove_if(entry_has_address, transaction_address(tx));
+    }
+  }
+  xSemaphoreGive(table_lock);
+}
+
+uint32_t input_selector_generation() { return generation; }
+
+size_t input_selector_addresses(flex_trit_t *addresses, size_t cap) {
+  size_t count = 0;
+  if (!table_ready()) {
+    return 0;
+  }
+  xSemaphoreTake(table_lock, portMAX_DELAY);
+  for (size_t i = 0; i < table.count && count < cap; i++) {
+    memcpy(addresses + count++ * FLEX_TRIT_SIZE_243, table.entries[i].address, FLEX_TRIT_SIZE_243);
+  }
+  if (table.security && table.next_cached && count < cap) {
+    memcpy(addresses + count++ * FLEX_TRIT_SIZE_243, table.next_address, FLEX_TRIT_SIZE_243);
+  }
+  xSemaphoreGive(table_lock);
+  return count;
+}
+
+retcode_t input_selector_refresh_address(iota_client_service_t const *const serv, flex_trit_t const *address) {
+  retcode_t ret = RC_OOM;
+  get_balances_req_t *req = get_balances_req_new();
+  get_balances_res_t *res = get_balances_res_new();
+  if (!table_ready()) {
+    ret = RC_OK;
+    goto done;
+  }
+  if (!req || !res || (ret = get_balances_req_address_add(req, address)) != RC_OK) {
+    goto done;
+  }
+  req->threshold = 100;
+  if ((ret = wallet_http_get_balances(serv, req, res)) != RC_OK) {
+    goto done;
+  }
+  if (get_balances_res_balances_num(res) != 1) {
+    ret = RC_ERROR;
+    goto done;
+  }
+  uint64_t balance = get_balances_res_balances_at(res, 0);
+
+  xSemaphoreTake(table_lock, portMAX_DELAY);
+  for (size_t i = 0; i < table.count; i++) {
+    if (memcmp(table.entries[i].address, address, FLEX_TRIT_SIZE_243) == 0) {
+      table.entries[i].balance = balance;
+      break;
+    }
+  }
+  table_remove_if(entry_is_empty, NULL);
+  if (balance > 0 && table.next_cached && memcmp(table.next_address, address, FLEX_TRIT_SIZE_243) == 0) {
+    ESP_LOGI(TAG, "deposit of %" PRIu64 " at address %u", balance, table.next_index);
+    table_put(table.next_index, address, balance);
+    table.next_index++;
+    table.next_cached = false;
+  }
+  xSemaphoreGive(table_lock);
+
+done:
+  get_balances_req_free(&req);
+  get_balances_res_free(&res);
+  return ret;
+}
+
+/* 'inputs' command */
+static struct {
+  struct arg_str *strategy;
+  struct arg_lit *clear;
+  struct arg_end *end;
+} inputs_args;
+
+static int fn_inputs(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&inputs_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, inputs_args.end, argv[0]);
+    return -1;
+  }
+  if (!table_ready()) {
+    printf("Input selection is not available\n");
+    return -1;
+  }
+
+  if (inputs_args.strategy->count) {
+    char const *name = inputs_args.strategy->sval[0];
+    if (strcmp(name, "fewest") == 0) {
+      strategy = INPUT_STRATEGY_FEWEST;
+    } else if (strcmp(name, "oldest") == 0) {
+      strategy = INPUT_STRATEGY_OLDEST;
+    } else {
+      printf("Unknown strategy: %s\n", name);
+      return -1;
+    }
+  }
+
+  xSemaphoreTake(table_lock, portMAX_DELAY);
+  if (inputs_args.clear->count) {
+    table.security = 0;
+    table.count = 0;
+    generation++;
+  }
+  uint64_t total = 0;
+  printf("strategy: %s, next address %u\n", strategy == INPUT_STRATEGY_FEWEST ? "fewest" : "oldest",
+         table.next_index);
+  for (size_t i = 0; i < table.count; i++) {
+    printf("[%u] ", table.entries[i].index);
+    flex_trit_print(table.entries[i].address, NUM_TRITS_ADDRESS);
+    printf(" : %" PRIu64 "\n", table.entries[i].balance);
+    total += table.entries[i].balance;
+  }
+  printf("%u funded addresses, total %" PRIu64 "\n", table.count, total);
+  xSemaphoreGive(table_lock);
+  return 0;
+}
+
+void register_input_selector() {
+  inputs_args.strategy = arg_str0("s", "strategy", "<fewest|oldest>", "how inputs are chosen");
+  inputs_args.clear = arg_lit0("c", "clear", "forget funded addresses");
+  inputs_args.end = arg_end(3);
+  const esp_console_cmd_t inputs_cmd = {
+      .command = "inputs",
+      .help = "Show funded addresses used as inputs of `send`, set the selection strategy",
+      .hint = " [-s fewest|oldest] [-c]",
+      .func = &fn_inputs,
+      .argtable = &inputs_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&inputs_cmd, 0));
+}
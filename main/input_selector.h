@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cclient/api/extended/extended_api.h"
+#include "common/model/bundle.h"
+
+/*
+ * Input selection from cached balances
+ *
+ * Funded addresses of the seed are kept by address index, from `account` or from a scan on the
+ * first value transfer. A transfer refreshes their balances and checks the next address for new
+ * deposits in one getBalances, then picks inputs without scanning from index 0 like get_inputs.
+ */
+
+typedef enum {
+  INPUT_STRATEGY_FEWEST = 0, /*!< fewest inputs, fewer signatures and less PoW */
+  INPUT_STRATEGY_OLDEST,     /*!< lowest address indices first */
+} input_strategy_t;
+
+typedef struct {
+  uint32_t index;
+  uint64_t balance;
+  flex_trit_t address[FLEX_TRIT_SIZE_243];
+} input_entry_t;
+
+void input_selector_init();
+
+// Funded addresses of an `account` result
+void input_selector_set_account(flex_trit_t const *seed, uint8_t security, account_data_t *account);
+
+// Funded addresses of the seed known elsewhere, e.g. kept by the account of the seed.
+void input_selector_load(flex_trit_t const *seed, uint8_t security, input_entry_t const *entries, size_t count,
+                         uint32_t next_index, flex_trit_t const *next_address);
+
+// Inputs covering the value, inputs stay empty if the funded addresses known can't cover it.
+retcode_t input_selector_select(iota_client_service_t const *const serv, flex_trit_t const *seed, uint8_t security,
+                                uint64_t value, inputs_t *const inputs);
+
+// Drop inputs of a signed bundle, they are spent.
+void input_selector_mark_bundle(bundle_transactions_t const *const bundle);
+
+// Counter which changes with the funded addresses or the next address
+uint32_t input_selector_generation();
+
+// Copy funded addresses and the next address, addresses holds cap addresses of FLEX_TRIT_SIZE_243.
+size_t input_selector_addresses(flex_trit_t *addresses, size_t cap);
+
+// Refresh the balance of one address of the table, e.g. on a confirmed transaction of it.
+retcode_t input_selector_refresh_address(iota_client_service_t const *const serv, flex_trit_t const *address);
+
+// Register the `inputs` command
+void register_input_selector();
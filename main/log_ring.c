@@ -0,0 +1,450 @@
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "argtable3/argtable3.h"
+#include "esp_console.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "log_ring.h"
+#include "utils/logger_helper.h"
+#include "wallet_batch.h"
+#include "wallet_output.h"
+
+#if defined(CONFIG_CCLIENT_DEBUG) && defined(CONFIG_LOG_RING_ENABLE)
+
+static const char *TAG = "log_ring";
+
+#define LOG_TASK_STACK 3072
+#define LOG_TASK_PRIORITY tskIDLE_PRIORITY
+#define LOG_CORES portNUM_PROCESSORS
+#define LOG_LOGGERS 16
+#define LOG_NAME_LEN 24
+#define LOG_STR_MAX 64 /*!< bytes of a string argument of binary records */
+#define LOG_FRAME_HEADER_LEN 4
+#define LOG_RECORD_HEADER_LEN 6 /*!< level, logger and timestamp of LOG_FRAME_RECORD */
+
+// arguments of int, long and size_t conversions are taken as 32 bits
+_Static_assert(sizeof(long) == 4 && sizeof(size_t) == 4 && sizeof(void *) == 4, "binary records expect 32-bit longs");
+
+typedef struct __attribute__((packed)) {
+  uint16_t len; /*!< of the record with this header */
+  uint8_t binary;
+  char level;
+  uint8_t logger; /*!< index in loggers, UINT8_MAX if unknown */
+  uint32_t ms;
+} log_rec_hdr_t;
+
+typedef struct {
+  uint8_t buf[CONFIG_LOG_RING_SIZE];
+  volatile size_t head; /*!< moved by tasks of the core, with interrupts of the core masked */
+  volatile size_t tail; /*!< moved by the drain task */
+  uint32_t written;
+  uint32_t dropped;
+  uint32_t as_text; /*!< binary records which didn't fit and were formatted instead */
+  size_t high_water;
+} log_ring_t;
+
+typedef struct {
+  logger_id_t id;
+  logger_level_t level;
+  char name[LOG_NAME_LEN];
+} log_logger_t;
+
+static log_ring_t rings[LOG_CORES];
+static uint32_t dropped_reported[LOG_CORES];
+static log_logger_t loggers[LOG_LOGGERS];
+static volatile size_t logger_count = 0;
+static portMUX_TYPE loggers_mux = portMUX_INITIALIZER_UNLOCKED;
+#ifdef CONFIG_LOG_RING_BINARY
+static volatile bool binary = true;
+#else
+static volatile bool binary = false;
+#endif
+static volatile bool names_sent = false;
+static TaskHandle_t drain_task = NULL;
+// only the drain task uses these
+static uint8_t drain_rec[CONFIG_LOG_RING_LINE_MAX];
+static uint8_t drain_frame[LOG_FRAME_HEADER_LEN + LOG_RECORD_HEADER_LEN + CONFIG_LOG_RING_LINE_MAX];
+
+// the real functions of iota_common, see --wrap in CMakeLists.txt
+logger_id_t __real_logger_helper_enable(char const *const logger_name, logger_level_t const level,
+                                        bool const enable_color);
+
+static char level_char(logger_level_t level) {
+  switch (level) {
+    case LOGGER_DEBUG:
+      return 'D';
+    case LOGGER_INFO:
+    case LOGGER_NOTICE:
+      return 'I';
+    case LOGGER_WARNING:
+      return 'W';
+    default:
+      return 'E';
+  }
+}
+
+static bool put_arg(uint8_t *out, size_t cap, size_t *len, void const *data, size_t size) {
+  if (*len + size > cap) {
+    return false;
+  }
+  memcpy(out + *len, data, size);
+  *len += size;
+  return true;
+}
+
+static bool put_int_arg(uint8_t *out, size_t cap, size_t *len, va_list *ap) {
+  uint32_t value = va_arg(*ap, unsigned int);
+  return put_arg(out, cap, len, &value, sizeof(value));
+}
+
+// Arguments of a format in the layout of log_ring.h, false if they don't fit or a conversion is unknown.
+static bool encode_args(uint8_t *out, size_t cap, size_t *len, char const *format, va_list *ap) {
+  for (char const *p = format; *p != '\0'; p++) {
+    if (*p != '%') {
+      continue;
+    }
+    p++;
+    if (*p == '%') {
+      continue;
+    }
+    while (*p != '\0' && strchr("-+ #0", *p)) {
+      p++;
+    }
+    if (*p == '*') {
+      if (!put_int_arg(out, cap, len, ap)) {
+        return false;
+      }
+      p++;
+    }
+    while (isdigit((unsigned char)*p)) {
+      p++;
+    }
+    if (*p == '.') {
+      p++;
+      if (*p == '*') {
+        if (!put_int_arg(out, cap, len, ap)) {
+          return false;
+        }
+        p++;
+      }
+      while (isdigit((unsigned char)*p)) {
+        p++;
+      }
+    }
+    bool wide = false;
+    bool long_double = false;
+    while (*p != '\0' && strchr("hlLqjzt", *p)) {
+      wide |= *p == 'q' || *p == 'j' || (*p == 'l' && p[1] == 'l');
+      long_double |= *p == 'L';
+      p++;
+    }
+
+    switch (*p) {
+      case 'd':
+      case 'i':
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X':
+      case 'c':
+      case 'p':
+        if (wide) {
+          uint64_t value = va_arg(*ap, unsigned long long);
+          if (!put_arg(out, cap, len, &value, sizeof(value))) {
+            return false;
+          }
+        } else if (!put_int_arg(out, cap, len, ap)) {
+          return false;
+        }
+        break;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A': {
+        double value = long_double ? (double)va_arg(*ap, long double) : va_arg(*ap, double);
+        if (!put_arg(out, cap, len, &value, sizeof(value))) {
+          return false;
+        }
+        break;
+      }
+      case 's': {
+        char const *str = va_arg(*ap, char const *);
+        if (str == NULL) {
+          str = "(null)";
+        }
+        uint8_t str_len = strnlen(str, LOG_STR_MAX);
+        if (!put_arg(out, cap, len, &str_len, 1) || !put_arg(out, cap, len, str, str_len)) {
+          return false;
+        }
+        break;
+      }
+      case 'n':
+        (void)va_arg(*ap, void *);
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+static void ring_copy_in(log_ring_t *ring, size_t pos, void const *data, size_t len) {
+  size_t first = len < CONFIG_LOG_RING_SIZE - pos ? len : CONFIG_LOG_RING_SIZE - pos;
+  memcpy(ring->buf + pos, data, first);
+  memcpy(ring->buf, (uint8_t const *)data + first, len - first);
+}
+
+static void ring_copy_out(log_ring_t const *ring, size_t pos, void *data, size_t len) {
+  size_t first = len < CONFIG_LOG_RING_SIZE - pos ? len : CONFIG_LOG_RING_SIZE - pos;
+  memcpy(data, ring->buf + pos, first);
+  memcpy((uint8_t *)data + first, ring->buf, len - first);
+}
+
+// A record into the ring of the current core. Masking interrupts of the core keeps other tasks of the core out and
+// the task on the core, the other core has its own ring.
+static void ring_put(log_rec_hdr_t *hdr, uint8_t const *payload, size_t len, bool as_text) {
+  bool wake = false;
+  hdr->len = sizeof(*hdr) + len;
+
+  UBaseType_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+  log_ring_t *ring = &rings[xPortGetCoreID()];
+  size_t head = ring->head;
+  size_t used = (head + CONFIG_LOG_RING_SIZE - ring->tail) % CONFIG_LOG_RING_SIZE;
+  if (hdr->len >= CONFIG_LOG_RING_SIZE - used) {
+    ring->dropped++;
+  } else {
+    ring_copy_in(ring, head, hdr, sizeof(*hdr));
+    ring_copy_in(ring, (head + sizeof(*hdr)) % CONFIG_LOG_RING_SIZE, payload, len);
+    __sync_synchronize();
+    ring->head = (head + hdr->len) % CONFIG_LOG_RING_SIZE;
+    ring->written++;
+    ring->as_text += as_text;
+    used += hdr->len;
+    if (used > ring->high_water) {
+      ring->high_water = used;
+    }
+    wake = used > CONFIG_LOG_RING_SIZE / 2;
+  }
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+
+  if (wake && drain_task != NULL) {
+    xTaskNotifyGive(drain_task);
+  }
+}
+
+logger_id_t __wrap_logger_helper_enable(char const *const logger_name, logger_level_t const level,
+                                        bool const enable_color) {
+  logger_id_t id = __real_logger_helper_enable(logger_name, level, enable_color);
+  portENTER_CRITICAL(&loggers_mux);
+  size_t i = 0;
+  while (i < logger_count && loggers[i].id != id) {
+    i++;
+  }
+  if (i < LOG_LOGGERS) {
+    loggers[i].id = id;
+    loggers[i].level = level;
+    strncpy(loggers[i].name, logger_name, LOG_NAME_LEN - 1);
+    loggers[i].name[LOG_NAME_LEN - 1] = '\0';
+    if (i == logger_count) {
+      logger_count++;
+    }
+    names_sent = false;
+  }
+  portEXIT_CRITICAL(&loggers_mux);
+  return id;
+}
+
+void __wrap_logger_helper_print(logger_id_t const logger_id, logger_level_t const level, char const *const format,
+                                ...) {
+  size_t count = logger_count;
+  size_t i = 0;
+  while (i < count && loggers[i].id != logger_id) {
+    i++;
+  }
+  if (i < count && level < loggers[i].level) {
+    return;
+  }
+
+  log_rec_hdr_t hdr = {
+      .binary = 0,
+      .level = level_char(level),
+      .logger = i < count ? i : UINT8_MAX,
+      .ms = esp_log_timestamp(),
+  };
+  uint8_t payload[CONFIG_LOG_RING_LINE_MAX];
+  size_t len = 0;
+  bool as_text = false;
+  va_list ap;
+  va_start(ap, format);
+
+  if (binary) {
+    uint32_t address = (uint32_t)format;
+    va_list args;
+    va_copy(args, ap);
+    len = sizeof(address);
+    memcpy(payload, &address, sizeof(address));
+    hdr.binary = encode_args(payload, sizeof(payload), &len, format, &args);
+    as_text = !hdr.binary;
+    va_end(args);
+  }
+  if (!hdr.binary) {
+    int n = vsnprintf((char *)payload, sizeof(payload), format, ap);
+    len = n < 0 ? 0 : (size_t)n < sizeof(payload) ? (size_t)n : sizeof(payload) - 1;
+    while (len > 0 && payload[len - 1] == '\n') {
+      len--;
+    }
+  }
+  va_end(ap);
+
+  ring_put(&hdr, payload, len, as_text);
+}
+
+static void write_frame_header(uint8_t *frame, uint8_t type, size_t payload_len) {
+  frame[0] = LOG_FRAME_SYNC;
+  frame[1] = type;
+  frame[2] = payload_len >> 8;
+  frame[3] = payload_len & 0xFF;
+}
+
+static void write_names() {
+  names_sent = true;
+  size_t count = logger_count;
+  for (size_t i = 0; i < count; i++) {
+    size_t name_len = strlen(loggers[i].name);
+    write_frame_header(drain_frame, LOG_FRAME_LOGGER, 1 + name_len);
+    drain_frame[LOG_FRAME_HEADER_LEN] = i;
+    memcpy(drain_frame + LOG_FRAME_HEADER_LEN + 1, loggers[i].name, name_len);
+    output_write_raw(drain_frame, LOG_FRAME_HEADER_LEN + 1 + name_len);
+  }
+}
+
+static void write_record(log_rec_hdr_t const *hdr, uint8_t const *payload, size_t len) {
+  if (!hdr->binary) {
+    char const *name = hdr->logger < logger_count ? loggers[hdr->logger].name : "cclient";
+    printf("%c (%u) %s: %.*s\n", hdr->level, hdr->ms, name, (int)len, (char const *)payload);
+    return;
+  }
+
+  if (!names_sent) {
+    write_names();
+  }
+  write_frame_header(drain_frame, LOG_FRAME_RECORD, LOG_RECORD_HEADER_LEN + len);
+  uint8_t *p = drain_frame + LOG_FRAME_HEADER_LEN;
+  p[0] = hdr->level;
+  p[1] = hdr->logger;
+  memcpy(p + 2, &hdr->ms, sizeof(hdr->ms));
+  memcpy(p + LOG_RECORD_HEADER_LEN, payload, len);
+  // bytes of a frame can be 0x0A, stdout would add a CR
+  output_write_raw(drain_frame, LOG_FRAME_HEADER_LEN + LOG_RECORD_HEADER_LEN + len);
+}
+
+static void drain_ring(int core) {
+  log_ring_t *ring = &rings[core];
+  size_t head = ring->head;
+  size_t tail = ring->tail;
+  __sync_synchronize();
+
+  while (tail != head) {
+    log_rec_hdr_t hdr;
+    ring_copy_out(ring, tail, &hdr, sizeof(hdr));
+    size_t len = hdr.len - sizeof(hdr);
+    ring_copy_out(ring, (tail + sizeof(hdr)) % CONFIG_LOG_RING_SIZE, drain_rec, len);
+    tail = (tail + hdr.len) % CONFIG_LOG_RING_SIZE;
+    // free the space before the slow write
+    __sync_synchronize();
+    ring->tail = tail;
+    write_record(&hdr, drain_rec, len);
+  }
+
+  uint32_t dropped = ring->dropped;
+  if (dropped != dropped_reported[core]) {
+    ESP_LOGW(TAG, "%u lines dropped on core %d", dropped - dropped_reported[core], core);
+    dropped_reported[core] = dropped;
+  }
+}
+
+static void log_ring_task(void *param) {
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_LOG_RING_DRAIN_MS));
+    for (int core = 0; core < LOG_CORES; core++) {
+      drain_ring(core);
+    }
+    fflush(stdout);
+  }
+}
+
+void log_ring_init() {
+  if (xTaskCreate(log_ring_task, "log_ring", LOG_TASK_STACK, NULL, LOG_TASK_PRIORITY, &drain_task) != pdPASS) {
+    ESP_LOGE(TAG, "create task failed");
+  }
+}
+
+#else
+
+void log_ring_init() {}
+
+#endif
+
+/* 'log_ring' command */
+static struct {
+  struct arg_str *format;
+  struct arg_end *end;
+} log_ring_args;
+
+static int fn_log_ring(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&log_ring_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, log_ring_args.end, argv[0]);
+    return -1;
+  }
+
+#if defined(CONFIG_CCLIENT_DEBUG) && defined(CONFIG_LOG_RING_ENABLE)
+  if (log_ring_args.format->count) {
+    char const *format = log_ring_args.format->sval[0];
+    if (strcmp(format, "text") == 0) {
+      binary = false;
+    } else if (strcmp(format, "bin") == 0) {
+      names_sent = false;
+      binary = true;
+    } else {
+      printf("Unknown format: %s\n", format);
+      return -1;
+    }
+  }
+
+  printf("format: %s, %zu loggers, %d byte rings\n", binary ? "bin" : "text", logger_count, CONFIG_LOG_RING_SIZE);
+  for (int core = 0; core < LOG_CORES; core++) {
+    log_ring_t const *ring = &rings[core];
+    printf("core %d: %u lines, %u dropped, %u binary as text, high water %zu bytes\n", core, ring->written,
+           ring->dropped, ring->as_text, ring->high_water);
+  }
+  return 0;
+#else
+  printf("The log ring is not enabled, see CONFIG_CCLIENT_DEBUG and CONFIG_LOG_RING_ENABLE\n");
+  return -1;
+#endif
+}
+
+void register_log_ring() {
+  log_ring_args.format = arg_str0(NULL, NULL, "<text|bin>", "format of CClient log records");
+  log_ring_args.format->hdr.resetfn = (arg_resetfn *)arg_str_reset;
+  log_ring_args.end = arg_end(2);
+  const esp_console_cmd_t log_ring_cmd = {
+      .command = "log_ring",
+      .help = "Show the CClient log rings, or set the format of CClient logs",
+      .hint = " [text|bin]",
+      .func = &fn_log_ring,
+      .argtable = &log_ring_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&log_ring_cmd, WALLET_CMD_CONCURRENT));
+}
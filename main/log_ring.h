@@ -0,0 +1,28 @@
+#pragma once
+
+/*
+ * Asynchronous CClient logging
+ *
+ * With CONFIG_CCLIENT_DEBUG and CONFIG_LOG_RING_ENABLE, logger_helper_print and logger_helper_enable of iota_common
+ * are wrapped at link time. A log line goes into a ring buffer of the core it runs on, with only interrupts of that
+ * core masked while it's copied, and a task at idle priority writes the rings to the console. A caller never waits
+ * for the UART, a full ring drops the line and counts it.
+ *
+ * Text records are formatted by the caller. Binary records are the address of the format string and its arguments,
+ * the drain task writes them as frames which tools/log_expand.py expands with the ELF of the firmware:
+ *   0xA6, type(u8), payload length(u16 big-endian), payload
+ *   LOG_FRAME_LOGGER: logger index(u8), name
+ *   LOG_FRAME_RECORD: level(char), logger index(u8), timestamp ms(u32), format address(u32), arguments
+ * Arguments are little-endian: 4 bytes for int, long, size_t and pointers, 8 bytes for long long and double, and a
+ * length(u8) and the bytes of a string.
+ */
+
+#define LOG_FRAME_SYNC 0xA6
+#define LOG_FRAME_LOGGER 1
+#define LOG_FRAME_RECORD 2
+
+// Start the drain task, called before logger_helper_init
+void log_ring_init();
+
+// Register the `log_ring` command
+void register_log_ring();
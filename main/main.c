@@ -4,9 +4,10 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // sntp
-#include "lwip/apps/sntp.h"
+#include "esp_sntp.h"
 #include "lwip/err.h"
 
 // console system
@@ -26,6 +27,14 @@
 #include "linenoise/linenoise.h"
 #include "nvs_flash.h"
 #include "sdkconfig.h"
+#include "utils/memset_safe.h"
+#include "net_sched.h"
+#include "spent_index.h"
+#include "wallet_batch.h"
+#include "wallet_boot.h"
+#include "wallet_mem.h"
+#include "wallet_output.h"
+#include "wallet_snapshot.h"
 #include "wallet_system.h"
 
 static const char *TAG = "esp32_main";
@@ -37,15 +46,33 @@ static EventGroupHandle_t wifi_event_group;
    to the AP with an IP? */
 const static int CONNECTED_BIT = BIT0;
 
+// connecting to the AP of the snapshot, a full scan is done if it fails.
+static bool cached_ap = false;
+
 static esp_err_t wifi_event_handler(void *ctx, system_event_t *event) {
   switch (event->event_id) {
     case SYSTEM_EVENT_STA_START:
       esp_wifi_connect();
       break;
-    case SYSTEM_EVENT_STA_GOT_IP:
+    case SYSTEM_EVENT_STA_GOT_IP: {
+      wifi_ap_record_t ap;
+      if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        snapshot_set_ap(ap.bssid, ap.primary);
+      }
       xEventGroupSetBits(wifi_event_group, CONNECTED_BIT);
       break;
+    }
     case SYSTEM_EVENT_STA_DISCONNECTED:
+      if (cached_ap && !(xEventGroupGetBits(wifi_event_group) & CONNECTED_BIT)) {
+        wifi_config_t wifi_config;
+        ESP_LOGW(TAG, "cached AP not found, scanning");
+        cached_ap = false;
+        snapshot_clear_ap();
+        esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+        wifi_config.sta.bssid_set = false;
+        wifi_config.sta.channel = 0;
+        esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+      }
       /* This is a workaround as ESP32 WiFi libs don't currently
              auto-reassociate. */
       esp_wifi_connect();
@@ -69,11 +96,26 @@ static void wifi_conn_init(void) {
           {
               .ssid = CONFIG_WIFI_SSID,
               .password = CONFIG_WIFI_PASSWORD,
+#ifdef CONFIG_NET_SCHED_PS_MAX_MODEM
+              .listen_interval = CONFIG_NET_SCHED_LISTEN_INTERVAL,
+#endif
           },
   };
+  cached_ap = snapshot_get_ap(wifi_config.sta.bssid, &wifi_config.sta.channel);
+  wifi_config.sta.bssid_set = cached_ap;
   ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
   ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
   ESP_ERROR_CHECK(esp_wifi_start());
+  net_sched_init();
+}
+
+static void wifi_wait_connected() {
+  ESP_LOGI(TAG, "Connecting to WiFi network...");
+  /* Wait for the callback to set the CONNECTED_BIT in the event group. */
+  xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, false, true, portMAX_DELAY);
+  ESP_LOGI(TAG, "Connected to AP");
+  ESP_LOGI(TAG, "IOTA Node: %s, port: %d, HTTPS:%s\n", CONFIG_IOTA_NODE_URL, CONFIG_IOTA_NODE_PORT,
+           CONFIG_IOTA_NODE_ENABLE_HTTPS ? "True" : "False");
 }
 
 static void initialize_nvs() {
@@ -129,38 +171,93 @@ static void initialize_console() {
   linenoiseHistorySetMaxLen(50);
 }
 
+static void time_sync_cb(struct timeval *tv) {
+  char strftime_buf[64];
+  struct tm timeinfo = {0};
+  localtime_r(&tv->tv_sec, &timeinfo);
+  strftime(strftime_buf, sizeof(strftime_buf), "%c", &timeinfo);
+  ESP_LOGI(TAG, "The current date/time is: %s", strftime_buf);
+}
+
+// the time is set in the background, nothing waits for it.
 static void update_time() {
-  // init sntp
   ESP_LOGI(TAG, "Initializing SNTP: %s, Timezone: %s", CONFIG_SNTP_SERVER, CONFIG_SNTP_TZ);
+  setenv("TZ", CONFIG_SNTP_TZ, 1);
+  tzset();
   sntp_setoperatingmode(SNTP_OPMODE_POLL);
   sntp_setservername(0, CONFIG_SNTP_SERVER);
-  // sntp_setservername(0, "pool.ntp.org");
+  sntp_set_time_sync_notification_cb(time_sync_cb);
   sntp_init();
+}
 
-  // wait for time to be set
-  time_t now = 0;
-  struct tm timeinfo = {0};
-  int retry = 0;
-  const int retry_count = 10;
-  while (timeinfo.tm_year < (2018 - 1900) && ++retry < retry_count) {
-    ESP_LOGI(TAG, "Waiting for system time to be set... (%d/%d)", retry, retry_count);
-    vTaskDelay(2000 / portTICK_PERIOD_MS);
-    time(&now);
-    localtime_r(&now, &timeinfo);
+// run a command line, the radio is awake for network commands and radio-on time is accounted.
+static esp_err_t run_command(char *line, int *ret) {
+  char name[16] = {};
+  net_sched_cmd_t sched;
+  sscanf(line, "%15s", name);
+  bool network = wallet_batch_cmd_flags(name) & WALLET_CMD_NETWORK;
+  if (network && !boot_wait_network()) {
+    *ret = ESP_ERR_TIMEOUT;
+    return ESP_OK;
   }
 
-  // set timezone
-  char strftime_buf[64];
-  setenv("TZ", CONFIG_SNTP_TZ, 1);
-  tzset();
-  localtime_r(&now, &timeinfo);
-  strftime(strftime_buf, sizeof(strftime_buf), "%c", &timeinfo);
-  ESP_LOGI(TAG, "The current date/time is: %s", strftime_buf);
+  // the radio stays asleep while the command waits for the API server or a batch
+  wallet_batch_cmd_lock(name);
+  net_sched_cmd_begin(&sched);
+  if (network) {
+    wallet_client_acquire();
+  }
+  esp_err_t err = esp_console_run(line, ret);
+  if (network) {
+    wallet_client_release();
+  }
+  net_sched_cmd_end(name, &sched);
+  wallet_batch_cmd_unlock(name);
+  return err;
+}
+
+// a line of a command with WALLET_CMD_SECRET, after a `--format=` prefix
+static bool line_has_secret(char const *line) {
+  char name[16] = {};
+  if (strncmp(line, "--format=", strlen("--format=")) == 0) {
+    line += strcspn(line, " ");
+  }
+  sscanf(line, "%15s", name);
+  return wallet_batch_cmd_flags(name) & WALLET_CMD_SECRET;
+}
+
+// esp_console_run keeps a copy of the last line, a blank line of the same length overwrites it.
+static void wipe_secret_line(char *line, size_t len) {
+  int ret;
+  memset(line, ' ', len);
+  esp_console_run(line, &ret);
+  memset_safe(line, len, 0, len);
 }
 
+// a wake-up of `sleep_cycle` only checks the balance and goes back to sleep.
+static void start_services() {
+  if (!snapshot_cycle_due()) {
+    start_wallet_services();
+  }
+}
+
+// init steps which don't block the console, phases they depend on are done in app_main or by other steps.
+static boot_step_t const boot_steps[] = {
+    {.phase = BOOT_WIFI, .deps = BOOT_BIT(BOOT_NVS), .run = wifi_conn_init},
+    {.phase = BOOT_NETWORK, .deps = BOOT_BIT(BOOT_WIFI), .run = wifi_wait_connected},
+    {.phase = BOOT_TIME, .deps = BOOT_BIT(BOOT_NETWORK), .run = update_time},
+    {.phase = BOOT_SERVICES, .deps = BOOT_BIT(BOOT_CLIENT) | BOOT_BIT(BOOT_NETWORK), .run = start_services},
+};
+
 void app_main() {
+  boot_init();
+  wallet_mem_init();
   initialize_nvs();
+  boot_phase_done(BOOT_NVS);
   ESP_LOGI(TAG, "iota wallet system starting...");
+  // before Wi-Fi starts, it connects to the AP of the snapshot.
+  snapshot_restore();
+  spent_index_init();
 
   // checking default seed
   if (strlen(CONFIG_IOTA_SEED) != HASH_LENGTH_TRYTE) {
@@ -189,16 +286,24 @@ void app_main() {
                                                          : "external");
 #endif
 
+  // Wi-Fi association, SNTP and background services come up while the console is usable.
+  boot_run_async(boot_steps, sizeof(boot_steps) / sizeof(boot_steps[0]));
+
   // init wallet system
   initialize_console();
   esp_console_register_help_command();
   register_wallet_commands();
+  boot_phase_done(BOOT_CONSOLE);
 
-  // init wifi
-  wifi_conn_init();
-
-  // init cclient
-  init_iota_client();
+  // init cclient, offline commands only need the wallet context.
+  if (init_iota_client()) {
+    boot_phase_done(BOOT_CLIENT);
+    if (snapshot_cycle_due()) {
+      snapshot_cycle_run();
+    }
+  } else {
+    ESP_LOGE(TAG, "client init failed, services and network commands are disabled");
+  }
 
   ESP_LOGI(TAG, "esp-idf version: %s, app_version: %s", esp_get_idf_version(), APP_WALLET_VERSION);
 
@@ -214,16 +319,7 @@ void app_main() {
     linenoiseSetDumbMode(1);
     prompt = "IOTA> ";
   }
-
-  ESP_LOGI(TAG, "Connecting to WiFi network...");
-  /* Wait for the callback to set the CONNECTED_BIT in the event group. */
-  xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, false, true, portMAX_DELAY);
-  ESP_LOGI(TAG, "Connected to AP");
-  ESP_LOGI(TAG, "IOTA Node: %s, port: %d, HTTPS:%s\n", CONFIG_IOTA_NODE_URL, CONFIG_IOTA_NODE_PORT,
-           CONFIG_IOTA_NODE_ENABLE_HTTPS ? "True" : "False");
-
-  // get time from sntp
-  update_time();
+  boot_phase_done(BOOT_PROMPT);
 
   while (1) {
     /* Get a line when ENTER is pressed */
@@ -232,12 +328,18 @@ void app_main() {
       continue;
     }
 
-    // add command to history
-    linenoiseHistoryAdd(line);
+    // add command to history, unless it carries a seed or passphrase
+    size_t line_len = strlen(line);
+    bool secret = line_has_secret(line);
+    if (!secret) {
+      linenoiseHistoryAdd(line);
+    }
 
-    /* Try to run the command */
+    /* Try to run the command, `--format=` applies to this command only */
     int ret;
-    esp_err_t err = esp_console_run(line, &ret);
+    output_format_t format = output_format();
+    esp_err_t err = run_command(output_apply_prefix(line), &ret);
+    output_set_format(format);
     if (err == ESP_ERR_NOT_FOUND) {
       printf("Unrecognized command\n");
     } else if (err == ESP_ERR_INVALID_ARG) {
@@ -248,6 +350,9 @@ void app_main() {
       printf("Internal error: %s\n", esp_err_to_name(err));
     }
 
+    if (secret) {
+      wipe_secret_line(line, line_len);
+    }
     /* linenoise allocates line buffer on the heap, so need to free it */
     linenoiseFree(line);
   }
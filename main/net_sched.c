@@ -0,0 +1,287 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#ifdef CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+#include "net_sched.h"
+#include "wallet_binproto.h"
+#include "wallet_http.h"
+
+static const char *TAG = "net_sched";
+
+#define RADIO_AWAKE_BIT BIT0
+#define SLEEP_TASK_STACK 3072
+#define SLEEP_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define CMD_NAME_LEN 16
+
+typedef struct {
+  char name[CMD_NAME_LEN];
+  uint32_t count;
+  int64_t elapsed_us;
+  int64_t radio_on_us;
+} cmd_stats_t;
+
+static SemaphoreHandle_t sched_lock = NULL;
+static EventGroupHandle_t sched_events = NULL;
+static esp_timer_handle_t hold_timer = NULL;
+static esp_timer_handle_t wake_timer = NULL;
+static TaskHandle_t sleep_task = NULL;
+#ifdef CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t pm_lock = NULL;
+#endif
+static int users = 0;
+
+// radio state and statistics, the radio is awake since boot until the scheduler is enabled.
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool awake = true;
+static int64_t awake_since = 0;
+static int64_t radio_on_us = 0;
+static uint32_t wakes = 0;
+static cmd_stats_t cmd_stats[CONFIG_NET_SCHED_MAX_CMDS];
+
+static int64_t radio_on_now() {
+  portENTER_CRITICAL(&stats_mux);
+  int64_t on = awake ? radio_on_us + esp_timer_get_time() - awake_since : radio_on_us;
+  portEXIT_CRITICAL(&stats_mux);
+  return on;
+}
+
+#ifdef CONFIG_NET_SCHED_ENABLE
+static wifi_ps_type_t sleep_mode() {
+#ifdef CONFIG_NET_SCHED_PS_MAX_MODEM
+  return WIFI_PS_MAX_MODEM;
+#else
+  return WIFI_PS_MIN_MODEM;
+#endif
+}
+
+// must be called with sched_lock
+static void radio_wake() {
+  if (awake) {
+    return;
+  }
+#ifdef CONFIG_PM_ENABLE
+  esp_pm_lock_acquire(pm_lock);
+#endif
+  esp_wifi_set_ps(WIFI_PS_NONE);
+  portENTER_CRITICAL(&stats_mux);
+  awake = true;
+  awake_since = esp_timer_get_time();
+  wakes++;
+  portEXIT_CRITICAL(&stats_mux);
+  xEventGroupSetBits(sched_events, RADIO_AWAKE_BIT);
+}
+
+// must be called with sched_lock
+static void radio_sleep() {
+  if (!awake) {
+    return;
+  }
+  xEventGroupClearBits(sched_events, RADIO_AWAKE_BIT);
+  portENTER_CRITICAL(&stats_mux);
+  radio_on_us += esp_timer_get_time() - awake_since;
+  awake = false;
+  portEXIT_CRITICAL(&stats_mux);
+  esp_wifi_set_ps(sleep_mode());
+#ifdef CONFIG_PM_ENABLE
+  esp_pm_lock_release(pm_lock);
+#endif
+}
+
+// closing sessions waits for a request in flight, it doesn't block the esp_timer task.
+static void hold_expired(void *arg) {
+  (void)arg;
+  xTaskNotifyGive(sleep_task);
+}
+
+static void sleep_loop(void *param) {
+  (void)param;
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    bool idle = users == 0;
+    xSemaphoreGive(sched_lock);
+    if (!idle) {
+      continue;
+    }
+
+    // the node closes idle keep-alive sessions anyway, don't wake up for it.
+    wallet_http_close();
+    binproto_close();
+
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    if (users == 0) {
+      radio_sleep();
+    }
+    xSemaphoreGive(sched_lock);
+  }
+}
+
+static void sched_cleanup() {
+  if (hold_timer) {
+    esp_timer_delete(hold_timer);
+    hold_timer = NULL;
+  }
+  if (wake_timer) {
+    esp_timer_delete(wake_timer);
+    wake_timer = NULL;
+  }
+  if (sched_events) {
+    vEventGroupDelete(sched_events);
+    sched_events = NULL;
+  }
+  if (sched_lock) {
+    vSemaphoreDelete(sched_lock);
+    sched_lock = NULL;
+  }
+}
+
+static void wake_periodic(void *arg) {
+  (void)arg;
+  // background tasks waiting for a window run while the radio is held.
+  net_sched_acquire();
+  net_sched_release();
+}
+#endif
+
+void net_sched_init() {
+#ifdef CONFIG_NET_SCHED_ENABLE
+  sched_lock = xSemaphoreCreateMutex();
+  sched_events = xEventGroupCreate();
+  esp_timer_create_args_t hold_args = {.callback = hold_expired, .name = "net_hold"};
+  esp_timer_create_args_t wake_args = {.callback = wake_periodic, .name = "net_wake"};
+  // on failure nothing is left behind, net_sched_wait_window() doesn't wait without the event group.
+  if (sched_lock == NULL || sched_events == NULL || esp_timer_create(&hold_args, &hold_timer) != ESP_OK ||
+      esp_timer_create(&wake_args, &wake_timer) != ESP_OK ||
+      xTaskCreate(sleep_loop, "net_sleep", SLEEP_TASK_STACK, NULL, SLEEP_TASK_PRIORITY, &sleep_task) != pdPASS) {
+    ESP_LOGE(TAG, "init failed, the radio stays awake");
+    sched_cleanup();
+    return;
+  }
+
+#ifdef CONFIG_PM_ENABLE
+  esp_pm_config_esp32_t pm_config = {
+      .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+      .min_freq_mhz = CONFIG_NET_SCHED_MIN_CPU_FREQ_MHZ,
+#ifdef CONFIG_NET_SCHED_LIGHT_SLEEP
+      .light_sleep_enable = true,
+#endif
+  };
+  ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+  // no light sleep and full speed while the radio is awake
+  ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "net_sched", &pm_lock));
+  esp_pm_lock_acquire(pm_lock);
+#endif
+
+  xEventGroupSetBits(sched_events, RADIO_AWAKE_BIT);
+  // sleep after the hold time unless something is running
+  esp_timer_start_once(hold_timer, CONFIG_NET_SCHED_HOLD_MS * 1000LL);
+  esp_timer_start_periodic(wake_timer, CONFIG_NET_SCHED_WAKE_INTERVAL_MS * 1000LL);
+  ESP_LOGI(TAG, "power save %s, hold %dms, wake interval %dms", sleep_mode() == WIFI_PS_MAX_MODEM ? "max" : "min",
+           CONFIG_NET_SCHED_HOLD_MS, CONFIG_NET_SCHED_WAKE_INTERVAL_MS);
+#endif
+}
+
+void net_sched_acquire() {
+#ifdef CONFIG_NET_SCHED_ENABLE
+  if (sched_lock == NULL) {
+    return;
+  }
+  xSemaphoreTake(sched_lock, portMAX_DELAY);
+  esp_timer_stop(hold_timer);
+  users++;
+  radio_wake();
+  xSemaphoreGive(sched_lock);
+#endif
+}
+
+void net_sched_release() {
+#ifdef CONFIG_NET_SCHED_ENABLE
+  if (sched_lock == NULL) {
+    return;
+  }
+  xSemaphoreTake(sched_lock, portMAX_DELAY);
+  if (users > 0 && --users == 0) {
+    esp_timer_start_once(hold_timer, CONFIG_NET_SCHED_HOLD_MS * 1000LL);
+  }
+  xSemaphoreGive(sched_lock);
+#endif
+}
+
+void net_sched_wait_window() {
+  if (sched_events) {
+    xEventGroupWaitBits(sched_events, RADIO_AWAKE_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+  }
+}
+
+void net_sched_cmd_begin(net_sched_cmd_t *cmd) {
+  cmd->start_us = esp_timer_get_time();
+  cmd->radio_on_us = radio_on_now();
+}
+
+void net_sched_cmd_end(char const *name, net_sched_cmd_t const *cmd) {
+  int64_t elapsed = esp_timer_get_time() - cmd->start_us;
+  int64_t radio_on = radio_on_now() - cmd->radio_on_us;
+  cmd_stats_t *entry = NULL;
+
+  if (name == NULL || name[0] == '\0') {
+    return;
+  }
+  portENTER_CRITICAL(&stats_mux);
+  for (int i = 0; i < CONFIG_NET_SCHED_MAX_CMDS; i++) {
+    if (strncmp(cmd_stats[i].name, name, CMD_NAME_LEN - 1) == 0 || cmd_stats[i].name[0] == '\0') {
+      entry = &cmd_stats[i];
+      break;
+    }
+  }
+  if (entry) {
+    if (entry->name[0] == '\0') {
+      strncpy(entry->name, name, CMD_NAME_LEN - 1);
+    }
+    entry->count++;
+    entry->elapsed_us += elapsed;
+    entry->radio_on_us += radio_on;
+  }
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+void net_sched_dump() {
+  int64_t uptime = esp_timer_get_time();
+  int64_t on = radio_on_now();
+  cmd_stats_t stats[CONFIG_NET_SCHED_MAX_CMDS];
+
+  printf("scheduler: %s, radio %s, wakes %u\n", sched_lock ? "enabled" : "disabled", awake ? "awake" : "sleeping",
+         wakes);
+  printf("radio on %" PRId64 "ms of %" PRId64 "ms (%" PRId64 "%%)\n", on / 1000, uptime / 1000,
+         uptime ? on * 100 / uptime : 0);
+
+  portENTER_CRITICAL(&stats_mux);
+  memcpy(stats, cmd_stats, sizeof(stats));
+  portEXIT_CRITICAL(&stats_mux);
+  for (int i = 0; i < CONFIG_NET_SCHED_MAX_CMDS && stats[i].name[0]; i++) {
+    printf("%-16s x%u, %" PRId64 "ms, radio on %" PRId64 "ms/cmd\n", stats[i].name, stats[i].count,
+           stats[i].elapsed_us / 1000, stats[i].radio_on_us / 1000 / stats[i].count);
+  }
+}
+
+void net_sched_stats_reset() {
+  portENTER_CRITICAL(&stats_mux);
+  memset(cmd_stats, 0, sizeof(cmd_stats));
+  radio_on_us = 0;
+  if (awake) {
+    awake_since = esp_timer_get_time();
+  }
+  wakes = 0;
+  portEXIT_CRITICAL(&stats_mux);
+}
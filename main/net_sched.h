@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Network activity scheduler
+ *
+ * The radio stays in power save(modem sleep, and light sleep if power management is enabled)
+ * until a request needs it. Requests acquire the radio, the last release keeps it awake for
+ * CONFIG_NET_SCHED_HOLD_MS so back-to-back requests share the keep-alive session, then the
+ * connections are closed and the radio goes back to sleep.
+ *
+ * Background requests(tip pool, confirmation manager) wait for a wake window, either a
+ * foreground request or the periodic wake every CONFIG_NET_SCHED_WAKE_INTERVAL_MS, so they
+ * are batched into one radio-on period.
+ */
+
+typedef struct {
+  int64_t start_us;
+  int64_t radio_on_us; /*!< radio-on time when the command started */
+} net_sched_cmd_t;
+
+// Apply the power save mode after Wi-Fi started
+void net_sched_init();
+
+// Keep the radio awake for a request, calls can be nested and from any task.
+void net_sched_acquire();
+void net_sched_release();
+
+// Block until the radio is awake for a foreground request or a periodic wake.
+void net_sched_wait_window();
+
+// Account radio-on time to a console command
+void net_sched_cmd_begin(net_sched_cmd_t *cmd);
+void net_sched_cmd_end(char const *name, net_sched_cmd_t const *cmd);
+
+void net_sched_dump();
+void net_sched_stats_reset();
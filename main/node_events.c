@@ -0,0 +1,461 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "argtable3/argtable3.h"
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+
+#include "common/model/transaction.h"
+#include "confirmation_mgr.h"
+#include "input_selector.h"
+#include "node_events.h"
+#include "wallet_batch.h"
+#include "wallet_system.h"
+
+static const char *TAG = "node_events";
+
+#define EVENTS_TASK_STACK 8192
+#define EVENTS_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define EVENTS_MAX_MESSAGE 1024 /*!< a `tx` event is about 600 bytes */
+#define EVENTS_MAX_TOKENS 14
+#define ZMTP_GREETING_LEN 64
+#define ZMTP_FLAG_MORE 0x01
+#define ZMTP_FLAG_LONG 0x02
+#define ZMTP_FLAG_COMMAND 0x04
+#define ZMTP_SUBSCRIBE 0x01
+#define ZMTP_MAX_FRAME (64 * 1024) /*!< anything longer is a broken stream */
+
+// Keys are the first 13 trytes of a hash in base 27, 27^13 < 2^62 leaves two bits.
+#define KEY_TRYTES 13
+#define KEY_USED (1ULL << 63)
+#define KEY_BUNDLE (1ULL << 62)
+// open addressing, at most half full with addresses and bundles
+#define SET_BITS 7
+#define SET_SIZE (1 << SET_BITS)
+#if SET_SIZE < 4 * CONFIG_NODE_EVENTS_WATCH_MAX
+#error "the watch set is too small for CONFIG_NODE_EVENTS_WATCH_MAX"
+#endif
+
+typedef struct {
+  uint32_t connects;
+  uint32_t tx;
+  uint32_t sn;
+  uint32_t lmsi;
+  uint32_t dropped; /*!< messages longer than EVENTS_MAX_MESSAGE */
+  uint32_t address_matches;
+  uint32_t bundle_matches;
+  uint32_t fetches;       /*!< requests triggered by matches */
+  uint32_t polls_skipped; /*!< milestone polls the stream replaced */
+  uint32_t rx_bytes;
+} events_stats_t;
+
+static char const *topics[] = {"tx ", "sn ", "lmsi "};
+
+static SemaphoreHandle_t events_lock = NULL;
+static events_stats_t stats;
+static uint64_t watch_set[SET_SIZE];
+static size_t watch_count = 0;
+static uint64_t bundle_keys[CONFIG_NODE_EVENTS_WATCH_MAX];
+static size_t bundle_count = 0;
+static bool watch_dirty = true;
+static uint32_t watch_generation = 0; /*!< of the input selector when the set was built */
+static int64_t connected_us = 0;      /*!< 0 while the stream is down */
+static uint32_t milestone_index = 0;
+
+static int tryte_value(char c) { return c == '9' ? 0 : (c >= 'A' && c <= 'Z') ? c - 'A' + 1 : -1; }
+
+// 0 if the string isn't a hash
+static uint64_t key_of_trytes(char const *trytes, size_t len) {
+  uint64_t key = 0;
+  if (len != NUM_TRYTES_HASH) {
+    return 0;
+  }
+  for (size_t i = 0; i < len; i++) {
+    int v = tryte_value(trytes[i]);
+    if (v < 0) {
+      return 0;
+    }
+    if (i < KEY_TRYTES) {
+      key = key * 27 + v;
+    }
+  }
+  return key | KEY_USED;
+}
+
+static uint64_t key_of_hash(flex_trit_t const *hash) {
+  tryte_t trytes[NUM_TRYTES_HASH];
+  flex_trits_to_trytes(trytes, NUM_TRYTES_HASH, hash, NUM_TRITS_HASH, NUM_TRITS_HASH);
+  return key_of_trytes((char const *)trytes, NUM_TRYTES_HASH);
+}
+
+static size_t slot_of(uint64_t key) { return (key * 0x9E3779B97F4A7C15ULL) >> (64 - SET_BITS); }
+
+// must be called with events_lock
+static void set_insert(uint64_t key) {
+  if (watch_count >= SET_SIZE / 2) {
+    return;
+  }
+  size_t i = slot_of(key);
+  while (watch_set[i] && watch_set[i] != key) {
+    i = (i + 1) & (SET_SIZE - 1);
+  }
+  if (watch_set[i] == 0) {
+    watch_set[i] = key;
+    watch_count++;
+  }
+}
+
+// must be called with events_lock
+static bool set_contains(uint64_t key) {
+  for (size_t i = slot_of(key); watch_set[i]; i = (i + 1) & (SET_SIZE - 1)) {
+    if (watch_set[i] == key) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Addresses come from the input selector, the set is built again when they or the bundles change.
+static void set_rebuild() {
+  flex_trit_t *addresses = malloc(CONFIG_NODE_EVENTS_WATCH_MAX * FLEX_TRIT_SIZE_243);
+  uint32_t generation = input_selector_generation();
+  size_t count = addresses ? input_selector_addresses(addresses, CONFIG_NODE_EVENTS_WATCH_MAX) : 0;
+
+  xSemaphoreTake(events_lock, portMAX_DELAY);
+  memset(watch_set, 0, sizeof(watch_set));
+  watch_count = 0;
+  for (size_t i = 0; i < bundle_count; i++) {
+    set_insert(bundle_keys[i]);
+  }
+  for (size_t i = 0; i < count; i++) {
+    set_insert(key_of_hash(addresses + i * FLEX_TRIT_SIZE_243));
+  }
+  watch_generation = generation;
+  watch_dirty = false;
+  xSemaphoreGive(events_lock);
+  free(addresses);
+}
+
+static bool watched(char const *hash, bool bundle) {
+  uint64_t key = key_of_trytes(hash, strlen(hash));
+  if (key == 0) {
+    return false;
+  }
+  if (watch_dirty || watch_generation != input_selector_generation()) {
+    set_rebuild();
+  }
+  xSemaphoreTake(events_lock, portMAX_DELAY);
+  bool found = set_contains(bundle ? key | KEY_BUNDLE : key);
+  xSemaphoreGive(events_lock);
+  return found;
+}
+
+bool node_events_watch_bundle(flex_trit_t const *bundle) {
+  if (events_lock == NULL) {
+    return false;
+  }
+  uint64_t key = key_of_hash(bundle) | KEY_BUNDLE;
+  xSemaphoreTake(events_lock, portMAX_DELAY);
+  bool watched = bundle_count < CONFIG_NODE_EVENTS_WATCH_MAX;
+  if (watched) {
+    bundle_keys[bundle_count++] = key;
+    watch_dirty = true;
+  }
+  xSemaphoreGive(events_lock);
+  return watched;
+}
+
+void node_events_unwatch_bundle(flex_trit_t const *bundle) {
+  if (events_lock == NULL) {
+    return;
+  }
+  uint64_t key = key_of_hash(bundle) | KEY_BUNDLE;
+  xSemaphoreTake(events_lock, portMAX_DELAY);
+  for (size_t i = 0; i < bundle_count; i++) {
+    if (bundle_keys[i] == key) {
+      bundle_keys[i] = bundle_keys[--bundle_count];
+      watch_dirty = true;
+      break;
+    }
+  }
+  xSemaphoreGive(events_lock);
+}
+
+bool node_events_milestone(uint32_t *index) {
+  if (events_lock == NULL) {
+    return false;
+  }
+  xSemaphoreTake(events_lock, portMAX_DELAY);
+  bool known = connected_us != 0 && milestone_index != 0;
+  if (known) {
+    *index = milestone_index;
+    stats.polls_skipped++;
+  }
+  xSemaphoreGive(events_lock);
+  return known;
+}
+
+static void count(uint32_t *counter) {
+  xSemaphoreTake(events_lock, portMAX_DELAY);
+  (*counter)++;
+  xSemaphoreGive(events_lock);
+}
+
+static void refresh_address(char const *address) {
+  flex_trit_t hash[FLEX_TRIT_SIZE_243];
+  flex_trits_from_trytes(hash, NUM_TRITS_HASH, (tryte_t const *)address, NUM_TRYTES_HASH, NUM_TRYTES_HASH);
+  count(&stats.fetches);
+  iota_client_service_t *serv = wallet_client_acquire();
+  retcode_t ret = input_selector_refresh_address(serv, hash);
+  wallet_client_release();
+  if (ret != RC_OK) {
+    ESP_LOGW(TAG, "balance refresh failed: %s", error_2_string(ret));
+  }
+}
+
+static void bundle_confirmed(char const *bundle) {
+  flex_trit_t hash[FLEX_TRIT_SIZE_243];
+  flex_trits_from_trytes(hash, NUM_TRITS_HASH, (tryte_t const *)bundle, NUM_TRYTES_HASH, NUM_TRYTES_HASH);
+  count(&stats.fetches);
+  confirmation_mgr_check_bundle(hash);
+}
+
+// tx <hash> <address> <value> <obsolete tag> <timestamp> <index> <last index> <bundle> ...
+// sn <milestone index> <hash> <address> <trunk> <branch> <bundle>
+// lmsi <previous index> <latest index>
+static void handle_event(char *msg) {
+  char *tokens[EVENTS_MAX_TOKENS] = {};
+  size_t n = 0;
+  char *save = NULL;
+  for (char *t = strtok_r(msg, " ", &save); t && n < EVENTS_MAX_TOKENS; t = strtok_r(NULL, " ", &save)) {
+    tokens[n++] = t;
+  }
+
+  if (n >= 9 && strcmp(tokens[0], "tx") == 0) {
+    count(&stats.tx);
+    if (watched(tokens[2], false)) {
+      count(&stats.address_matches);
+      // a balance changes on confirmation, an attached transaction is only reported.
+      if (strtoll(tokens[3], NULL, 10) > 0) {
+        ESP_LOGI(TAG, "incoming %s to a watched address, waiting for confirmation", tokens[3]);
+      }
+    }
+  } else if (n >= 7 && strcmp(tokens[0], "sn") == 0) {
+    count(&stats.sn);
+    if (watched(tokens[6], true)) {
+      count(&stats.bundle_matches);
+      bundle_confirmed(tokens[6]);
+    }
+    if (watched(tokens[3], false)) {
+      count(&stats.address_matches);
+      refresh_address(tokens[3]);
+    }
+  } else if (n >= 3 && strcmp(tokens[0], "lmsi") == 0) {
+    xSemaphoreTake(events_lock, portMAX_DELAY);
+    stats.lmsi++;
+    milestone_index = strtoul(tokens[2], NULL, 10);
+    xSemaphoreGive(events_lock);
+  }
+}
+
+static bool send_all(int sock, uint8_t const *data, size_t len) {
+  while (len > 0) {
+    int n = send(sock, data, len, 0);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+static bool recv_all(int sock, uint8_t *data, size_t len) {
+  while (len > 0) {
+    int n = recv(sock, data, len, 0);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= n;
+    xSemaphoreTake(events_lock, portMAX_DELAY);
+    stats.rx_bytes += n;
+    xSemaphoreGive(events_lock);
+  }
+  return true;
+}
+
+static int events_connect() {
+  struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+  struct addrinfo *res = NULL;
+  char port[8];
+
+  snprintf(port, sizeof(port), "%d", CONFIG_NODE_EVENTS_PORT);
+  if (getaddrinfo(CONFIG_NODE_EVENTS_HOST, port, &hints, &res) != 0 || res == NULL) {
+    ESP_LOGE(TAG, "DNS lookup failed: %s", CONFIG_NODE_EVENTS_HOST);
+    return -1;
+  }
+
+  int sock = socket(res->ai_family, res->ai_socktype, 0);
+  if (sock >= 0) {
+    // a feed without any event for this long is considered dead
+    struct timeval timeout = {.tv_sec = CONFIG_NODE_EVENTS_IDLE_S, .tv_usec = 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(sock, res->ai_addr, res->ai_addrlen) != 0) {
+      ESP_LOGW(TAG, "connect to %s failed: %d", CONFIG_NODE_EVENTS_HOST, errno);
+      close(sock);
+      sock = -1;
+    }
+  }
+  freeaddrinfo(res);
+  return sock;
+}
+
+// ZMTP 3.0 with the NULL mechanism: greetings, READY commands and a subscription message per topic.
+static bool zmtp_handshake(int sock, uint8_t *buf) {
+  uint8_t greeting[ZMTP_GREETING_LEN] = {0xFF, 0, 0, 0, 0, 0, 0, 0, 0, 0x7F, 3, 0, 'N', 'U', 'L', 'L'};
+  static uint8_t const ready[] = {ZMTP_FLAG_COMMAND, 25, 5, 'R', 'E', 'A', 'D', 'Y', 11, 'S', 'o', 'c', 'k', 'e',
+                                  't', '-', 'T', 'y', 'p', 'e', 0, 0, 0, 3, 'S', 'U', 'B'};
+  if (!send_all(sock, greeting, sizeof(greeting)) || !recv_all(sock, buf, ZMTP_GREETING_LEN) || buf[0] != 0xFF ||
+      buf[10] < 3 || !send_all(sock, ready, sizeof(ready))) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(topics) / sizeof(topics[0]); i++) {
+    size_t len = strlen(topics[i]);
+    buf[0] = 0;
+    buf[1] = len + 1;
+    buf[2] = ZMTP_SUBSCRIBE;
+    memcpy(buf + 3, topics[i], len);
+    if (!send_all(sock, buf, len + 3)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Read a frame into buf, a command or a message longer than buf is skipped and *len is 0.
+static bool zmtp_read_frame(int sock, uint8_t *buf, size_t *len) {
+  uint8_t header[9];
+  if (!recv_all(sock, header, 2)) {
+    return false;
+  }
+  uint64_t size = header[1];
+  if (header[0] & ZMTP_FLAG_LONG) {
+    if (!recv_all(sock, header + 2, 7)) {
+      return false;
+    }
+    size = 0;
+    for (int i = 1; i < 9; i++) {
+      size = (size << 8) | header[i];
+    }
+  }
+  if (size > ZMTP_MAX_FRAME) {
+    return false;
+  }
+
+  bool keep = !(header[0] & ZMTP_FLAG_COMMAND) && size < EVENTS_MAX_MESSAGE;
+  if (!keep && !(header[0] & ZMTP_FLAG_COMMAND)) {
+    count(&stats.dropped);
+  }
+  *len = keep ? size : 0;
+  while (size > 0) {
+    size_t chunk = size < EVENTS_MAX_MESSAGE ? size : EVENTS_MAX_MESSAGE;
+    if (!recv_all(sock, buf, chunk)) {
+      return false;
+    }
+    size -= chunk;
+  }
+  buf[*len] = '\0';
+  return true;
+}
+
+static void events_task(void *param) {
+  uint8_t *buf = malloc(EVENTS_MAX_MESSAGE + 1);
+  if (buf == NULL) {
+    ESP_LOGE(TAG, "out of memory");
+    vTaskDelete(NULL);
+    return;
+  }
+
+  while (1) {
+    int sock = events_connect();
+    if (sock >= 0 && zmtp_handshake(sock, buf)) {
+      ESP_LOGI(TAG, "subscribed to %s:%d", CONFIG_NODE_EVENTS_HOST, CONFIG_NODE_EVENTS_PORT);
+      xSemaphoreTake(events_lock, portMAX_DELAY);
+      stats.connects++;
+      connected_us = esp_timer_get_time();
+      xSemaphoreGive(events_lock);
+
+      size_t len = 0;
+      while (zmtp_read_frame(sock, buf, &len)) {
+        if (len > 0) {
+          handle_event((char *)buf);
+        }
+      }
+
+      xSemaphoreTake(events_lock, portMAX_DELAY);
+      connected_us = 0;
+      xSemaphoreGive(events_lock);
+      ESP_LOGW(TAG, "stream closed, polling until it's back");
+    }
+    if (sock >= 0) {
+      close(sock);
+    }
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_NODE_EVENTS_RECONNECT_MS));
+  }
+}
+
+void node_events_start() {
+  events_lock = xSemaphoreCreateMutex();
+  if (events_lock == NULL) {
+    ESP_LOGE(TAG, "create mutex failed");
+    return;
+  }
+  if (xTaskCreate(events_task, "node_events", EVENTS_TASK_STACK, NULL, EVENTS_TASK_PRIORITY, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "create task failed");
+  }
+}
+
+/* 'events' command */
+static int fn_events(int argc, char **argv) {
+  if (events_lock == NULL) {
+    printf("Node events are not enabled\n");
+    return -1;
+  }
+  xSemaphoreTake(events_lock, portMAX_DELAY);
+  events_stats_t s = stats;
+  int64_t up_us = connected_us ? esp_timer_get_time() - connected_us : 0;
+  size_t watching = watch_count;
+  uint32_t milestone = milestone_index;
+  xSemaphoreGive(events_lock);
+
+  printf("stream: %s:%d, %s", CONFIG_NODE_EVENTS_HOST, CONFIG_NODE_EVENTS_PORT, up_us ? "up" : "down");
+  if (up_us) {
+    printf(" for %" PRId64 "s", up_us / 1000000);
+  }
+  printf(", %u connects, latest milestone %u\n", s.connects, milestone);
+  printf("events: tx %u, sn %u, lmsi %u, dropped %u, %u bytes\n", s.tx, s.sn, s.lmsi, s.dropped,
+         s.rx_bytes);
+  printf("watching %zu hashes, matches: address %u, bundle %u\n", watching, s.address_matches, s.bundle_matches);
+  printf("requests: %u on matches, %u polls skipped\n", s.fetches, s.polls_skipped);
+  return 0;
+}
+
+void register_node_events() {
+  const esp_console_cmd_t events_cmd = {
+      .command = "events",
+      .help = "Show the node event stream, watched hashes and polls it replaced",
+      .hint = NULL,
+      .func = &fn_events,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&events_cmd, WALLET_CMD_CONCURRENT));
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/trinary/flex_trit.h"
+
+/*
+ * Node events
+ *
+ * A long-lived subscription to the ZMQ feed of IRI(`tx`, `sn` and `lmsi` topics) replaces polling.
+ * Events are matched on the device against a hash set of watched addresses, funded and next
+ * addresses of the input selector, and bundles tracked by the confirmation manager. Only a match
+ * triggers a request: a confirmed transaction of a watched address refreshes its balance and a
+ * confirmed transaction of a tracked bundle checks its inclusion at once. While the stream is up,
+ * the milestone poll of the tip pool is skipped.
+ */
+
+// Start the subscriber task
+void node_events_start();
+
+// Watch a bundle, e.g. a bundle which was just sent. False without the stream or with
+// CONFIG_NODE_EVENTS_WATCH_MAX bundles watched already.
+bool node_events_watch_bundle(flex_trit_t const *bundle);
+void node_events_unwatch_bundle(flex_trit_t const *bundle);
+
+// The latest milestone index from `lmsi` events, false if the stream is down or none was seen.
+bool node_events_milestone(uint32_t *index);
+
+// Register the `events` command
+void register_node_events();
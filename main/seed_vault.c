@@ -0,0 +1,269 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mbedtls/aes.h"
+#include "mbedtls/md.h"
+#include "mbedtls/pkcs5.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include "common/defs.h"
+#include "crypto_backend.h"
+#include "seed_vault.h"
+#include "wallet_mem.h"
+#include "utils/memset_safe.h"
+
+static const char *TAG = "seed_vault";
+
+#define VAULT_NAMESPACE "seed_vault"
+#define VAULT_KEY "seed"
+#define VAULT_VERSION 1
+#define VAULT_SALT_LEN 16
+#define VAULT_IV_LEN 16
+#define VAULT_AES_KEY_LEN 32
+#define VAULT_MAC_KEY_LEN 32
+#define VAULT_MAC_LEN 32
+
+typedef struct {
+  uint32_t version;
+  uint32_t iterations; /*!< PBKDF2 iterations */
+  uint8_t salt[VAULT_SALT_LEN];
+  uint8_t iv[VAULT_IV_LEN];
+  uint8_t cipher[NUM_TRYTES_HASH]; /*!< AES-256-CTR encrypted seed trytes */
+  uint8_t mac[VAULT_MAC_LEN];      /*!< HMAC-SHA256 over all fields above */
+} vault_record_t;
+
+typedef struct {
+  uint8_t aes[VAULT_AES_KEY_LEN];
+  uint8_t mac[VAULT_MAC_KEY_LEN];
+} vault_keys_t;
+
+static flex_trit_t *session_seed = NULL;
+static esp_timer_handle_t session_timer = NULL;
+static SemaphoreHandle_t vault_lock = NULL;
+// cached NVS lookup: -1 unknown, 0 empty, 1 provisioned.
+static int provisioned = -1;
+
+static void vault_init_once() {
+  if (vault_lock == NULL) {
+    vault_lock = xSemaphoreCreateMutex();
+  }
+}
+
+static int derive_keys(char const *passphrase, uint8_t const *salt, uint32_t iterations, vault_keys_t *keys) {
+  mbedtls_md_context_t md;
+  mbedtls_md_init(&md);
+  int ret = mbedtls_md_setup(&md, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+  if (ret == 0) {
+    ret = mbedtls_pkcs5_pbkdf2_hmac(&md, (unsigned char const *)passphrase, strlen(passphrase), salt, VAULT_SALT_LEN,
+                                    iterations, sizeof(vault_keys_t), (unsigned char *)keys);
+  }
+  mbedtls_md_free(&md);
+  return ret;
+}
+
+static int record_mac(vault_keys_t const *keys, vault_record_t const *rec, uint8_t *mac) {
+  return mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), keys->mac, VAULT_MAC_KEY_LEN,
+                         (unsigned char const *)rec, offsetof(vault_record_t, mac), mac);
+}
+
+// AES-256-CTR, encryption and decryption are the same operation.
+static int record_crypt(vault_keys_t const *keys, uint8_t const *iv, uint8_t const *in, uint8_t *out, size_t len) {
+  mbedtls_aes_context aes;
+  uint8_t nonce_counter[VAULT_IV_LEN];
+  uint8_t stream_block[16];
+  size_t nc_off = 0;
+
+  memcpy(nonce_counter, iv, VAULT_IV_LEN);
+  mbedtls_aes_init(&aes);
+  int ret = mbedtls_aes_setkey_enc(&aes, keys->aes, VAULT_AES_KEY_LEN * 8);
+  if (ret == 0) {
+    ret = mbedtls_aes_crypt_ctr(&aes, len, &nc_off, nonce_counter, stream_block, in, out);
+  }
+  mbedtls_aes_free(&aes);
+  memset_safe(stream_block, sizeof(stream_block), 0, sizeof(stream_block));
+  return ret;
+}
+
+static esp_err_t record_load(vault_record_t *rec) {
+  nvs_handle handle;
+  size_t len = sizeof(vault_record_t);
+  esp_err_t err = nvs_open(VAULT_NAMESPACE, NVS_READONLY, &handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+  err = nvs_get_blob(handle, VAULT_KEY, rec, &len);
+  nvs_close(handle);
+  if (err == ESP_OK && (len != sizeof(vault_record_t) || rec->version != VAULT_VERSION)) {
+    err = ESP_ERR_INVALID_VERSION;
+  }
+  return err;
+}
+
+static esp_err_t record_save(vault_record_t const *rec) {
+  nvs_handle handle;
+  esp_err_t err = nvs_open(VAULT_NAMESPACE, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+  if ((err = nvs_set_blob(handle, VAULT_KEY, rec, sizeof(vault_record_t))) == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  return err;
+}
+
+static void session_wipe() {
+  if (session_seed) {
+    memset_safe(session_seed, FLEX_TRIT_SIZE_243, 0, FLEX_TRIT_SIZE_243);
+    heap_caps_free(session_seed);
+    session_seed = NULL;
+  }
+  if (session_timer) {
+    esp_timer_stop(session_timer);
+  }
+}
+
+static void session_timeout_cb(void *arg) {
+  (void)arg;
+  xSemaphoreTake(vault_lock, portMAX_DELAY);
+  session_wipe();
+  xSemaphoreGive(vault_lock);
+  ESP_LOGI(TAG, "session expired, the vault is locked");
+}
+
+bool seed_vault_is_provisioned() {
+  vault_record_t rec;
+  vault_init_once();
+  xSemaphoreTake(vault_lock, portMAX_DELAY);
+  if (provisioned < 0) {
+    provisioned = record_load(&rec) == ESP_OK;
+  }
+  bool ret = provisioned == 1;
+  xSemaphoreGive(vault_lock);
+  return ret;
+}
+
+esp_err_t seed_vault_store(char const *seed, char const *passphrase, uint32_t iterations) {
+  vault_record_t rec = {};
+  vault_keys_t keys;
+  esp_err_t err = ESP_FAIL;
+
+  rec.version = VAULT_VERSION;
+  rec.iterations = iterations ? iterations : CONFIG_SEED_VAULT_KDF_ITERATIONS;
+  crypto_random_bytes(rec.salt, VAULT_SALT_LEN);
+  crypto_random_bytes(rec.iv, VAULT_IV_LEN);
+
+  if (derive_keys(passphrase, rec.salt, rec.iterations, &keys) != 0 ||
+      record_crypt(&keys, rec.iv, (uint8_t const *)seed, rec.cipher, NUM_TRYTES_HASH) != 0 ||
+      record_mac(&keys, &rec, rec.mac) != 0) {
+    ESP_LOGE(TAG, "encrypting seed failed");
+    goto done;
+  }
+
+  vault_init_once();
+  xSemaphoreTake(vault_lock, portMAX_DELAY);
+  err = record_save(&rec);
+  // a failed write may have left anything in NVS, look it up again next time.
+  provisioned = err == ESP_OK ? 1 : -1;
+  xSemaphoreGive(vault_lock);
+
+done:
+  memset_safe(&keys, sizeof(keys), 0, sizeof(keys));
+  return err;
+}
+
+esp_err_t seed_vault_unlock(char const *passphrase, uint32_t timeout_s) {
+  vault_record_t rec;
+  vault_keys_t keys;
+  uint8_t mac[VAULT_MAC_LEN];
+  tryte_t seed[NUM_TRYTES_HASH];
+  esp_err_t err = ESP_FAIL;
+
+  vault_init_once();
+  if ((err = record_load(&rec)) != ESP_OK) {
+    return err;
+  }
+
+  if (derive_keys(passphrase, rec.salt, rec.iterations, &keys) != 0 || record_mac(&keys, &rec, mac) != 0) {
+    err = ESP_FAIL;
+    goto done;
+  }
+  if (crypto_memcmp_ct(mac, rec.mac, VAULT_MAC_LEN) != 0) {
+    err = ESP_ERR_INVALID_CRC;
+    goto done;
+  }
+  if (record_crypt(&keys, rec.iv, rec.cipher, (uint8_t *)seed, NUM_TRYTES_HASH) != 0) {
+    err = ESP_FAIL;
+    goto done;
+  }
+
+  xSemaphoreTake(vault_lock, portMAX_DELAY);
+  session_wipe();
+  // internal RAM only, the seed never goes to SPI RAM.
+  session_seed = wallet_mem_hot(FLEX_TRIT_SIZE_243);
+  if (session_seed == NULL ||
+      flex_trits_from_trytes(session_seed, NUM_TRITS_HASH, seed, NUM_TRYTES_HASH, NUM_TRYTES_HASH) == 0) {
+    session_wipe();
+    err = ESP_ERR_NO_MEM;
+  } else {
+    if (session_timer == NULL) {
+      esp_timer_create_args_t const timer_args = {.callback = &session_timeout_cb, .name = "vault_session"};
+      esp_timer_create(&timer_args, &session_timer);
+    }
+    uint64_t timeout = timeout_s ? timeout_s : CONFIG_SEED_VAULT_SESSION_TIMEOUT;
+    esp_timer_start_once(session_timer, timeout * 1000000ULL);
+    err = ESP_OK;
+  }
+  xSemaphoreGive(vault_lock);
+
+done:
+  memset_safe(&keys, sizeof(keys), 0, sizeof(keys));
+  memset_safe(seed, sizeof(seed), 0, sizeof(seed));
+  return err;
+}
+
+void seed_vault_lock() {
+  vault_init_once();
+  xSemaphoreTake(vault_lock, portMAX_DELAY);
+  session_wipe();
+  xSemaphoreGive(vault_lock);
+}
+
+bool seed_vault_is_unlocked() {
+  vault_init_once();
+  xSemaphoreTake(vault_lock, portMAX_DELAY);
+  bool unlocked = session_seed != NULL;
+  xSemaphoreGive(vault_lock);
+  return unlocked;
+}
+
+bool seed_vault_get_trits(flex_trit_t *const seed) {
+  bool unlocked = false;
+  vault_init_once();
+  xSemaphoreTake(vault_lock, portMAX_DELAY);
+  if (session_seed) {
+    memcpy(seed, session_seed, FLEX_TRIT_SIZE_243);
+    unlocked = true;
+  }
+  xSemaphoreGive(vault_lock);
+  return unlocked;
+}
+
+int64_t seed_vault_kdf_time_us(uint32_t iterations) {
+  vault_keys_t keys;
+  uint8_t salt[VAULT_SALT_LEN];
+  crypto_random_bytes(salt, VAULT_SALT_LEN);
+
+  int64_t start = esp_timer_get_time();
+  derive_keys("benchmark passphrase", salt, iterations, &keys);
+  int64_t elapsed = esp_timer_get_time() - start;
+
+  memset_safe(&keys, sizeof(keys), 0, sizeof(keys));
+  return elapsed;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/trinary/flex_trit.h"
+#include "esp_err.h"
+
+// Returns true if an encrypted seed is stored in NVS.
+bool seed_vault_is_provisioned();
+
+// Encrypt the seed(81 trytes) with a key derived from the passphrase and store it in NVS.
+// iterations is the cost of the KDF, 0 for the default value.
+esp_err_t seed_vault_store(char const *seed, char const *passphrase, uint32_t iterations);
+
+// Decrypt the seed and keep its trits in internal RAM until the timeout, 0 for the default timeout.
+esp_err_t seed_vault_unlock(char const *passphrase, uint32_t timeout_s);
+
+// Wipe the unlocked seed
+void seed_vault_lock();
+
+bool seed_vault_is_unlocked();
+
+// Copy the unlocked seed, returns false if the vault is locked.
+bool seed_vault_get_trits(flex_trit_t *const seed);
+
+// Time of deriving the key with the given iterations, in microseconds.
+int64_t seed_vault_kdf_time_us(uint32_t iterations);
@@ -0,0 +1,439 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "argtable3/argtable3.h"
+#include "esp32/rom/crc.h"
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include "cclient/api/core/core_api.h"
+#include "common/helpers/sign.h"
+#include "crypto_backend.h"
+#include "spent_index.h"
+#include "wallet_batch.h"
+
+static const char *TAG = "spent_index";
+
+#define SPENT_NAMESPACE "wallet_state"
+#define SPENT_KEY "spent"
+#define SPENT_MAGIC 0x53504e32 /* "SPN2" */
+#define SPENT_BITMAP_BYTES (CONFIG_SPENT_INDEX_MAX_INDEX / 8)
+#define SPENT_BLOOM_BITS (CONFIG_SPENT_INDEX_BLOOM_BYTES * 8)
+#define SPENT_BLOOM_HASHES 4
+#define SPENT_RECENT 32
+// results of the node are saved at most this often, signed addresses right away.
+#define SPENT_SAVE_INTERVAL_US (60 * 1000000LL)
+
+typedef struct {
+  uint8_t seed_tag[CRYPTO_RECORD_TAG_LEN];
+  uint8_t security;                  /*!< 0 if the slot is free */
+  uint32_t used;                     /*!< the least recently used slot is taken by a new seed */
+  uint8_t known[SPENT_BITMAP_BYTES]; /*!< indices with a known state */
+  uint8_t spent[SPENT_BITMAP_BYTES]; /*!< indices signed from */
+} spent_bitmaps_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t used; /*!< counter of bitmap uses */
+  spent_bitmaps_t bitmaps[CONFIG_SPENT_INDEX_SEEDS];
+  uint8_t bloom[CONFIG_SPENT_INDEX_BLOOM_BYTES];
+} spent_index_t;
+
+// addresses generated lately, they map addresses of queries to seeds and indices.
+typedef struct {
+  bool used;
+  uint8_t seed_tag[CRYPTO_RECORD_TAG_LEN];
+  uint8_t security;
+  uint32_t index;
+  flex_trit_t address[FLEX_TRIT_SIZE_243];
+} recent_address_t;
+
+typedef struct {
+  uint32_t spent;    /*!< addresses decided spent locally */
+  uint32_t unspent;  /*!< addresses decided unspent locally */
+  uint32_t queried;  /*!< addresses asked to the node */
+  uint32_t requests; /*!< requests sent to the node */
+  uint32_t avoided;  /*!< requests decided without the node */
+} spent_stats_t;
+
+static spent_index_t spent_index;
+static recent_address_t recent[SPENT_RECENT];
+static size_t recent_next = 0;
+static spent_stats_t spent_stats;
+static SemaphoreHandle_t spent_lock = NULL;
+static bool spent_dirty = false;           /*!< protected by spent_lock */
+static int64_t spent_saved_us = 0;         /*!< protected by spent_lock */
+static SemaphoreHandle_t save_lock = NULL; /*!< taken before spent_lock, serializes NVS writes */
+static spent_index_t save_buf;             /*!< protected by save_lock */
+
+// the real functions of iota_client and iota_common, see --wrap in CMakeLists.txt
+retcode_t __real_iota_client_were_addresses_spent_from(iota_client_service_t const *const service,
+                                                        were_addresses_spent_from_req_t const *const req,
+                                                        were_addresses_spent_from_res_t *res);
+flex_trit_t *__real_iota_sign_address_gen_flex_trits(flex_trit_t const *const seed, uint64_t const index,
+                                                      uint8_t const security);
+
+static bool bit_get(uint8_t const *bits, size_t i) { return bits[i / 8] & (1 << (i % 8)); }
+static void bit_set(uint8_t *bits, size_t i) { bits[i / 8] |= 1 << (i % 8); }
+
+// double hashing, addresses are Kerl hashes so CRCs of them are well spread.
+static uint32_t bloom_bit(flex_trit_t const *address, int k) {
+  uint32_t h1 = crc32_le(0, address, FLEX_TRIT_SIZE_243);
+  uint32_t h2 = crc32_le(h1, address, FLEX_TRIT_SIZE_243) | 1;
+  return (h1 + k * h2) % SPENT_BLOOM_BITS;
+}
+
+static bool bloom_test(flex_trit_t const *address) {
+  for (int k = 0; k < SPENT_BLOOM_HASHES; k++) {
+    if (!bit_get(spent_index.bloom, bloom_bit(address, k))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void bloom_add(flex_trit_t const *address) {
+  for (int k = 0; k < SPENT_BLOOM_HASHES; k++) {
+    bit_set(spent_index.bloom, bloom_bit(address, k));
+  }
+}
+
+static size_t bits_count(uint8_t const *bits, size_t len) {
+  size_t count = 0;
+  for (size_t i = 0; i < len; i++) {
+    count += __builtin_popcount(bits[i]);
+  }
+  return count;
+}
+
+static void index_reset() {
+  memset(&spent_index, 0, sizeof(spent_index));
+  spent_index.magic = SPENT_MAGIC;
+  memset(recent, 0, sizeof(recent));
+}
+
+// must be called with spent_lock, the bitmaps of a seed and security level or NULL.
+static spent_bitmaps_t *bitmaps_find(uint8_t const *seed_tag, uint8_t security) {
+  for (size_t i = 0; i < CONFIG_SPENT_INDEX_SEEDS; i++) {
+    spent_bitmaps_t *bitmaps = &spent_index.bitmaps[i];
+    if (bitmaps->security == security && crypto_memcmp_ct(bitmaps->seed_tag, seed_tag, CRYPTO_RECORD_TAG_LEN) == 0) {
+      bitmaps->used = ++spent_index.used;
+      return bitmaps;
+    }
+  }
+  return NULL;
+}
+
+// must be called with spent_lock, a seed without bitmaps takes the least recently used ones.
+static spent_bitmaps_t *bitmaps_get(uint8_t const *seed_tag, uint8_t security) {
+  spent_bitmaps_t *bitmaps = bitmaps_find(seed_tag, security);
+  if (bitmaps) {
+    return bitmaps;
+  }
+  bitmaps = &spent_index.bitmaps[0];
+  for (size_t i = 1; i < CONFIG_SPENT_INDEX_SEEDS; i++) {
+    if (spent_index.bitmaps[i].used < bitmaps->used) {
+      bitmaps = &spent_index.bitmaps[i];
+    }
+  }
+  if (bitmaps->security) {
+    ESP_LOGI(TAG, "bitmaps of another seed are dropped, its spent addresses stay in the Bloom filter");
+  }
+  memset(bitmaps, 0, sizeof(spent_bitmaps_t));
+  memcpy(bitmaps->seed_tag, seed_tag, CRYPTO_RECORD_TAG_LEN);
+  bitmaps->security = security;
+  bitmaps->used = ++spent_index.used;
+  return bitmaps;
+}
+
+static esp_err_t index_load(spent_index_t *index) {
+  nvs_handle handle;
+  size_t len = sizeof(spent_index_t);
+  esp_err_t err = nvs_open(SPENT_NAMESPACE, NVS_READONLY, &handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+  err = nvs_get_blob(handle, SPENT_KEY, index, &len);
+  nvs_close(handle);
+  if (err == ESP_OK && (len != sizeof(spent_index_t) || index->magic != SPENT_MAGIC)) {
+    err = ESP_ERR_INVALID_VERSION;
+  }
+  return err;
+}
+
+// Write the index to NVS if it changed, results of the node only once in SPENT_SAVE_INTERVAL_US. The NVS write
+// runs on a copy without spent_lock, queries don't wait for the flash.
+static esp_err_t index_save(bool now) {
+  esp_err_t err = ESP_OK;
+  nvs_handle handle;
+  xSemaphoreTake(save_lock, portMAX_DELAY);
+  xSemaphoreTake(spent_lock, portMAX_DELAY);
+  bool due = spent_dirty && (now || esp_timer_get_time() - spent_saved_us >= SPENT_SAVE_INTERVAL_US);
+  if (due) {
+    memcpy(&save_buf, &spent_index, sizeof(spent_index_t));
+    spent_dirty = false;
+    spent_saved_us = esp_timer_get_time();
+  }
+  xSemaphoreGive(spent_lock);
+
+  if (due && (err = nvs_open(SPENT_NAMESPACE, NVS_READWRITE, &handle)) == ESP_OK) {
+    if ((err = nvs_set_blob(handle, SPENT_KEY, &save_buf, sizeof(spent_index_t))) == ESP_OK) {
+      err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+  }
+  xSemaphoreGive(save_lock);
+
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "save failed: %s", esp_err_to_name(err));
+    // tried again with the next change
+    xSemaphoreTake(spent_lock, portMAX_DELAY);
+    spent_dirty = true;
+    xSemaphoreGive(spent_lock);
+  }
+  return err;
+}
+
+void spent_index_init() {
+  spent_lock = xSemaphoreCreateMutex();
+  save_lock = xSemaphoreCreateMutex();
+  if (spent_lock == NULL || save_lock == NULL) {
+    ESP_LOGE(TAG, "create mutex failed, spent states are asked to the node");
+    spent_lock = NULL;
+    return;
+  }
+  if (index_load(&spent_index) != ESP_OK) {
+    index_reset();
+  }
+}
+
+// must be called with spent_lock, returns NULL if the address isn't generated lately.
+static recent_address_t const *recent_find(flex_trit_t const *address) {
+  for (size_t i = 0; i < SPENT_RECENT; i++) {
+    if (recent[i].used && memcmp(recent[i].address, address, FLEX_TRIT_SIZE_243) == 0) {
+      return &recent[i];
+    }
+  }
+  return NULL;
+}
+
+flex_trit_t *__wrap_iota_sign_address_gen_flex_trits(flex_trit_t const *const seed, uint64_t const index,
+                                                      uint8_t const security) {
+  uint8_t tag[CRYPTO_RECORD_TAG_LEN];
+  flex_trit_t *address = __real_iota_sign_address_gen_flex_trits(seed, index, security);
+  if (address == NULL || index >= CONFIG_SPENT_INDEX_MAX_INDEX || spent_lock == NULL) {
+    return address;
+  }
+
+  // other seeds, like random ones of `bench addr`, only pass through here, bitmaps are taken by spent states.
+  crypto_record_tag(seed, FLEX_TRIT_SIZE_243, tag);
+  xSemaphoreTake(spent_lock, portMAX_DELAY);
+  recent[recent_next].used = true;
+  memcpy(recent[recent_next].seed_tag, tag, CRYPTO_RECORD_TAG_LEN);
+  recent[recent_next].security = security;
+  recent[recent_next].index = index;
+  memcpy(recent[recent_next].address, address, FLEX_TRIT_SIZE_243);
+  recent_next = (recent_next + 1) % SPENT_RECENT;
+  xSemaphoreGive(spent_lock);
+  return address;
+}
+
+// must be called with spent_lock, returns 1 if spent, 0 if unspent, -1 if the node has to decide.
+static int spent_decide(flex_trit_t const *address) {
+  recent_address_t const *recent_address = recent_find(address);
+  spent_bitmaps_t const *bitmaps =
+      recent_address ? bitmaps_find(recent_address->seed_tag, recent_address->security) : NULL;
+  if (bitmaps && bit_get(bitmaps->known, recent_address->index)) {
+    if (bit_get(bitmaps->spent, recent_address->index)) {
+      return 1;
+    }
+#ifdef CONFIG_SPENT_INDEX_TRUST_LOCAL
+    return 0;
+#endif
+  }
+#ifdef CONFIG_SPENT_INDEX_TRUST_LOCAL
+  // a false positive would hide a funded address for good, only the only signer takes the risk.
+  if (bloom_test(address)) {
+    return 1;
+  }
+#endif
+  return -1;
+}
+
+// must be called with spent_lock, returns true if the index changed.
+static bool spent_record(flex_trit_t const *address, bool spent) {
+  recent_address_t const *recent_address = recent_find(address);
+  bool changed = false;
+  if (recent_address) {
+    uint32_t index = recent_address->index;
+    spent_bitmaps_t *bitmaps = bitmaps_get(recent_address->seed_tag, recent_address->security);
+    if (!bit_get(bitmaps->known, index) || (spent && !bit_get(bitmaps->spent, index))) {
+      bit_set(bitmaps->known, index);
+      if (spent) {
+        bit_set(bitmaps->spent, index);
+      }
+      changed = true;
+    }
+  }
+  if (spent && !bloom_test(address)) {
+    bloom_add(address);
+    changed = true;
+  }
+  spent_dirty |= changed;
+  return changed;
+}
+
+retcode_t __wrap_iota_client_were_addresses_spent_from(iota_client_service_t const *const service,
+                                                        were_addresses_spent_from_req_t const *const req,
+                                                        were_addresses_spent_from_res_t *res) {
+  retcode_t ret = RC_OK;
+  size_t count = hash243_queue_count(req->addresses);
+  were_addresses_spent_from_req_t *node_req = NULL;
+  were_addresses_spent_from_res_t *node_res = NULL;
+  int8_t *states = NULL;
+
+  if (spent_lock == NULL || spent_index.magic != SPENT_MAGIC || count == 0) {
+    return __real_iota_client_were_addresses_spent_from(service, req, res);
+  }
+  if ((states = malloc(count)) == NULL || (node_req = were_addresses_spent_from_req_new()) == NULL ||
+      (node_res = were_addresses_spent_from_res_new()) == NULL) {
+    ret = RC_OOM;
+    goto done;
+  }
+
+  xSemaphoreTake(spent_lock, portMAX_DELAY);
+  for (size_t i = 0; i < count; i++) {
+    flex_trit_t const *address = hash243_queue_at(req->addresses, i);
+    states[i] = spent_decide(address);
+    if (states[i] == 1) {
+      spent_stats.spent++;
+    } else if (states[i] == 0) {
+      spent_stats.unspent++;
+    } else if ((ret = hash243_queue_push(&node_req->addresses, address)) != RC_OK) {
+      break;
+    }
+  }
+  xSemaphoreGive(spent_lock);
+  if (ret != RC_OK) {
+    goto done;
+  }
+
+  size_t queried = hash243_queue_count(node_req->addresses);
+  if (queried > 0) {
+    if ((ret = __real_iota_client_were_addresses_spent_from(service, node_req, node_res)) != RC_OK) {
+      goto done;
+    }
+    if (were_addresses_spent_from_res_states_count(node_res) != queried) {
+      ret = RC_ERROR;
+      goto done;
+    }
+
+    xSemaphoreTake(spent_lock, portMAX_DELAY);
+    spent_stats.requests++;
+    spent_stats.queried += queried;
+    for (size_t i = 0, j = 0; i < count; i++) {
+      if (states[i] < 0) {
+        states[i] = were_addresses_spent_from_res_states_at(node_res, j++);
+        spent_record(hash243_queue_at(req->addresses, i), states[i]);
+      }
+    }
+    xSemaphoreGive(spent_lock);
+    index_save(false);
+  } else {
+    xSemaphoreTake(spent_lock, portMAX_DELAY);
+    spent_stats.avoided++;
+    xSemaphoreGive(spent_lock);
+  }
+
+  for (size_t i = 0; i < count && ret == RC_OK; i++) {
+    ret = were_addresses_spent_from_res_states_add(res, states[i]);
+  }
+
+done:
+  free(states);
+  were_addresses_spent_from_req_free(&node_req);
+  were_addresses_spent_from_res_free(&node_res);
+  return ret;
+}
+
+void spent_index_mark_bundle(bundle_transactions_t const *const bundle) {
+  iota_transaction_t *tx = NULL;
+  bool changed = false;
+  if (spent_lock == NULL || spent_index.magic != SPENT_MAGIC) {
+    return;
+  }
+
+  xSemaphoreTake(spent_lock, portMAX_DELAY);
+  BUNDLE_FOREACH(bundle, tx) {
+    if (transaction_value(tx) < 0) {
+      changed |= spent_record(transaction_address(tx), true);
+    }
+  }
+  xSemaphoreGive(spent_lock);
+  if (changed) {
+    index_save(true);
+  }
+}
+
+/* 'spent' command */
+static struct {
+  struct arg_lit *clear;
+  struct arg_end *end;
+} spent_args;
+
+static int fn_spent(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&spent_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, spent_args.end, argv[0]);
+    return -1;
+  }
+
+  if (spent_lock == NULL) {
+    printf("The spent index is disabled\n");
+    return -1;
+  }
+  xSemaphoreTake(spent_lock, portMAX_DELAY);
+  if (spent_args.clear->count) {
+    index_reset();
+    memset(&spent_stats, 0, sizeof(spent_stats));
+    spent_dirty = true;
+    xSemaphoreGive(spent_lock);
+    return index_save(true) == ESP_OK ? 0 : -1;
+  }
+  size_t known = 0, spent = 0, seeds = 0;
+  for (size_t i = 0; i < CONFIG_SPENT_INDEX_SEEDS; i++) {
+    spent_bitmaps_t const *bitmaps = &spent_index.bitmaps[i];
+    seeds += bitmaps->security != 0;
+    known += bits_count(bitmaps->known, SPENT_BITMAP_BYTES);
+    spent += bits_count(bitmaps->spent, SPENT_BITMAP_BYTES);
+  }
+  size_t bloom = bits_count(spent_index.bloom, CONFIG_SPENT_INDEX_BLOOM_BYTES);
+  spent_stats_t stats = spent_stats;
+  xSemaphoreGive(spent_lock);
+
+  printf("indices of %u seeds: %u known, %u spent, up to %d\n", seeds, known, spent, CONFIG_SPENT_INDEX_MAX_INDEX);
+  printf("bloom filter: %u of %d bits set, %d hashes\n", bloom, SPENT_BLOOM_BITS, SPENT_BLOOM_HASHES);
+  printf("local: %u spent, %u unspent\n", stats.spent, stats.unspent);
+  printf("node: %u addresses in %u requests, %u requests avoided\n", stats.queried, stats.requests,
+         stats.avoided);
+  return 0;
+}
+
+void register_spent_index() {
+  spent_args.clear = arg_lit0("c", "clear", "clear the index, spent states are asked to the node again");
+  spent_args.end = arg_end(2);
+  const esp_console_cmd_t spent_cmd = {
+      .command = "spent",
+      .help = "Show the local index of spent addresses and queries avoided",
+      .hint = " [-c]",
+      .func = &fn_spent,
+      .argtable = &spent_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&spent_cmd, 0));
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/model/bundle.h"
+#include "common/trinary/flex_trit.h"
+
+/*
+ * Spent-address index
+ *
+ * wereAddressesSpentFrom of iota_client (account, input and remainder address discovery) goes
+ * through the index first, linked with --wrap. The index is kept in NVS:
+ *  - bitmaps by address index of the last CONFIG_SPENT_INDEX_SEEDS seeds and security levels with spent
+ *    states: indices with a known state and indices signed from
+ *  - a Bloom filter of spent addresses of all seeds, from the node or signed by this device
+ * Address indices come from the address generation of the seed, also wrapped. Spent indices of the
+ * bitmaps are decided locally. Unspent indices and hits of the Bloom filter are decided locally only
+ * if this device is the only signer of the seed (CONFIG_SPENT_INDEX_TRUST_LOCAL), a false positive
+ * of the filter would hide a funded address. The node is asked for the other addresses in one request. Signed addresses are saved right away, results of
+ * the node at most once a minute.
+ */
+
+// Load the index from NVS
+void spent_index_init();
+
+// Record inputs of a signed bundle as spent, call it before the bundle leaves the device.
+void spent_index_mark_bundle(bundle_transactions_t const *const bundle);
+
+// Register the `spent` command
+void register_spent_index();
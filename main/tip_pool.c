@@ -0,0 +1,253 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "cclient/api/extended/extended_api.h"
+#include "net_sched.h"
+#include "node_events.h"
+#include "tip_pool.h"
+#include "wallet_system.h"
+
+static const char *TAG = "tip_pool";
+
+#define TIP_POOL_TASK_STACK 6144
+#define TIP_POOL_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+
+typedef struct {
+  flex_trit_t trunk[FLEX_TRIT_SIZE_243];
+  flex_trit_t branch[FLEX_TRIT_SIZE_243];
+  uint32_t milestone_index; /*!< the latest milestone index when the tips were selected */
+  int64_t fetched_us;
+} tip_pair_t;
+
+typedef struct {
+  tip_pair_t pairs[CONFIG_TIP_POOL_SIZE];
+  size_t count;
+  uint32_t milestone_index; /*!< the latest milestone index seen by the pool */
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t expired;
+} tip_pool_t;
+
+static tip_pool_t pool;
+static SemaphoreHandle_t pool_lock = NULL;
+static int attaching = 0; /*!< sends in PoW, from commands or reattachments */
+static portMUX_TYPE attaching_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// drop pairs selected before the latest milestones, must be called with the lock.
+static void pool_age_out(uint32_t milestone_index) {
+  size_t kept = 0;
+  pool.milestone_index = milestone_index;
+  for (size_t i = 0; i < pool.count; i++) {
+    if (milestone_index - pool.pairs[i].milestone_index <= CONFIG_TIP_POOL_MAX_MILESTONE_AGE) {
+      pool.pairs[kept++] = pool.pairs[i];
+    } else {
+      pool.expired++;
+    }
+  }
+  pool.count = kept;
+}
+
+static retcode_t fetch_milestone(iota_client_service_t const *serv, uint32_t *index) {
+  retcode_t ret = RC_ERROR;
+  get_node_info_res_t *node_res = get_node_info_res_new();
+  if (node_res == NULL) {
+    return RC_OOM;
+  }
+  if ((ret = iota_client_get_node_info(serv, node_res)) == RC_OK) {
+    *index = node_res->latest_milestone_index;
+  }
+  get_node_info_res_free(&node_res);
+  return ret;
+}
+
+static retcode_t fetch_tips(iota_client_service_t const *serv, uint32_t depth, tip_pair_t *pair) {
+  retcode_t ret = RC_ERROR;
+  get_transactions_to_approve_req_t *tips_req = get_transactions_to_approve_req_new();
+  get_transactions_to_approve_res_t *tips_res = get_transactions_to_approve_res_new();
+  if (!tips_req || !tips_res) {
+    ret = RC_OOM;
+    goto done;
+  }
+
+  get_transactions_to_approve_req_set_depth(tips_req, depth);
+  if ((ret = iota_client_get_transactions_to_approve(serv, tips_req, tips_res)) == RC_OK) {
+    memcpy(pair->trunk, tips_res->trunk, FLEX_TRIT_SIZE_243);
+    memcpy(pair->branch, tips_res->branch, FLEX_TRIT_SIZE_243);
+    pair->fetched_us = esp_timer_get_time();
+  }
+
+done:
+  get_transactions_to_approve_req_free(&tips_req);
+  get_transactions_to_approve_res_free(&tips_res);
+  return ret;
+}
+
+static void tip_pool_task(void *param) {
+  (void)param;
+  uint32_t depth = 0, milestone_index = 0;
+  uint8_t mwm = 0, security = 0;
+  tip_pair_t pair = {};
+
+  while (1) {
+    // refresh together with other requests when the radio is awake
+    net_sched_wait_window();
+    iota_client_service_t *serv = NULL;
+    retcode_t ret = RC_OK;
+    wallet_client_params(&depth, &mwm, &security);
+    // `lmsi` events of the node event stream replace the poll
+    if (!node_events_milestone(&milestone_index)) {
+      serv = wallet_client_acquire();
+      ret = fetch_milestone(serv, &milestone_index);
+      wallet_client_release();
+    }
+    if (ret != RC_OK) {
+      ESP_LOGW(TAG, "get node info failed: %s", error_2_string(ret));
+      vTaskDelay(CONFIG_TIP_POOL_REFRESH_MS / portTICK_PERIOD_MS);
+      continue;
+    }
+
+    xSemaphoreTake(pool_lock, portMAX_DELAY);
+    pool_age_out(milestone_index);
+    size_t count = pool.count;
+    xSemaphoreGive(pool_lock);
+
+    // fill up the pool, the random walk runs here instead of the send path.
+    while (count < CONFIG_TIP_POOL_SIZE) {
+      serv = wallet_client_acquire();
+      ret = fetch_tips(serv, depth, &pair);
+      wallet_client_release();
+      if (ret != RC_OK) {
+        ESP_LOGW(TAG, "get tips failed: %s", error_2_string(ret));
+        break;
+      }
+      pair.milestone_index = milestone_index;
+
+      xSemaphoreTake(pool_lock, portMAX_DELAY);
+      if (pool.count < CONFIG_TIP_POOL_SIZE) {
+        pool.pairs[pool.count++] = pair;
+      }
+      count = pool.count;
+      xSemaphoreGive(pool_lock);
+    }
+
+    vTaskDelay(CONFIG_TIP_POOL_REFRESH_MS / portTICK_PERIOD_MS);
+  }
+}
+
+void tip_pool_start() {
+  pool_lock = xSemaphoreCreateMutex();
+  if (pool_lock == NULL) {
+    ESP_LOGE(TAG, "create mutex failed");
+    return;
+  }
+  if (xTaskCreate(tip_pool_task, "tip_pool", TIP_POOL_TASK_STACK, NULL, TIP_POOL_TASK_PRIORITY, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "create task failed");
+  }
+}
+
+bool tip_pool_take(flex_trit_t *const trunk, flex_trit_t *const branch) {
+  bool found = false;
+  if (pool_lock == NULL) {
+    return false;
+  }
+
+  xSemaphoreTake(pool_lock, portMAX_DELAY);
+  if (pool.count > 0) {
+    // the latest pair is the freshest one, each pair is used once.
+    tip_pair_t *pair = &pool.pairs[--pool.count];
+    memcpy(trunk, pair->trunk, FLEX_TRIT_SIZE_243);
+    memcpy(branch, pair->branch, FLEX_TRIT_SIZE_243);
+    pool.hits++;
+    found = true;
+  } else {
+    pool.misses++;
+  }
+  xSemaphoreGive(pool_lock);
+  return found;
+}
+
+static retcode_t send_trytes(iota_client_service_t const *const serv, hash8019_array_p const trytes,
+                             uint32_t const depth, uint8_t const mwm, transaction_array_t *const out_txs) {
+  retcode_t ret = RC_ERROR;
+  flex_trit_t trunk[FLEX_TRIT_SIZE_243];
+  flex_trit_t branch[FLEX_TRIT_SIZE_243];
+  flex_trit_t *elt = NULL;
+  iota_transaction_t tx;
+
+  if (!tip_pool_take(trunk, branch)) {
+    return iota_client_send_trytes(serv, trytes, depth, mwm, NULL, false, out_txs);
+  }
+
+  attach_to_tangle_req_t *attach_req = attach_to_tangle_req_new();
+  attach_to_tangle_res_t *attach_res = attach_to_tangle_res_new();
+  if (!attach_req || !attach_res) {
+    ret = RC_OOM;
+    goto done;
+  }
+
+  attach_to_tangle_req_init(attach_req, trunk, branch, mwm);
+  HASH_ARRAY_FOREACH(trytes, elt) {
+    if ((ret = attach_to_tangle_req_trytes_add(attach_req, elt)) != RC_OK) {
+      goto done;
+    }
+  }
+
+  if ((ret = iota_client_attach_to_tangle(serv, attach_req, attach_res)) != RC_OK) {
+    ESP_LOGE(TAG, "attach to tangle failed: %s", error_2_string(ret));
+    goto done;
+  }
+
+  if ((ret = iota_client_store_and_broadcast(serv, (store_transactions_req_t *)attach_res)) != RC_OK) {
+    ESP_LOGE(TAG, "store and broadcast failed: %s", error_2_string(ret));
+    goto done;
+  }
+
+  HASH_ARRAY_FOREACH(attach_res->trytes, elt) {
+    transaction_deserialize_from_trits(&tx, elt, true);
+    transaction_array_push_back(out_txs, &tx);
+  }
+
+done:
+  attach_to_tangle_req_free(&attach_req);
+  attach_to_tangle_res_free(&attach_res);
+  return ret;
+}
+
+retcode_t tip_pool_send_trytes(iota_client_service_t const *const serv, hash8019_array_p const trytes,
+                               uint32_t const depth, uint8_t const mwm, transaction_array_t *const out_txs) {
+  portENTER_CRITICAL(&attaching_mux);
+  attaching++;
+  portEXIT_CRITICAL(&attaching_mux);
+  retcode_t ret = send_trytes(serv, trytes, depth, mwm, out_txs);
+  portENTER_CRITICAL(&attaching_mux);
+  attaching--;
+  portEXIT_CRITICAL(&attaching_mux);
+  return ret;
+}
+
+bool tip_pool_attaching() { return attaching > 0; }
+
+void tip_pool_dump() {
+  if (pool_lock == NULL) {
+    printf("tip pool is not running\n");
+    return;
+  }
+  int64_t now = esp_timer_get_time();
+
+  xSemaphoreTake(pool_lock, portMAX_DELAY);
+  printf("tips %zu/%d, milestone %u, hits %u, misses %u, expired %u\n", pool.count, CONFIG_TIP_POOL_SIZE,
+         pool.milestone_index, pool.hits, pool.misses, pool.expired);
+  for (size_t i = 0; i < pool.count; i++) {
+    printf("[%zu] milestone %u, age %" PRId64 "ms\n", i, pool.pairs[i].milestone_index,
+           (now - pool.pairs[i].fetched_us) / 1000);
+  }
+  xSemaphoreGive(pool_lock);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cclient/api/core/core_api.h"
+#include "common/model/transaction.h"
+#include "utils/containers/hash/hash_array.h"
+
+// Start the background task which keeps fresh tips for attachToTangle
+void tip_pool_start();
+
+// Take a pair of tips from the pool, returns false if the pool is empty.
+bool tip_pool_take(flex_trit_t *const trunk, flex_trit_t *const branch);
+
+// Attach, store and broadcast trytes(last index first).
+// Tips come from the pool when available, otherwise it falls back to iota_client_send_trytes.
+retcode_t tip_pool_send_trytes(iota_client_service_t const *const serv, hash8019_array_p const trytes,
+                               uint32_t const depth, uint8_t const mwm, transaction_array_t *const out_txs);
+
+// True while trytes are in PoW
+bool tip_pool_attaching();
+
+// Print pool status and statistics
+void tip_pool_dump();
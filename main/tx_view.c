@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include "common/trinary/trit_long.h"
+#include "tx_view.h"
+
+// offsets and lengths in trits of the serialized transaction
+#define TX_SIGNATURE_OFFSET 0
+#define TX_ADDRESS_OFFSET 6561
+#define TX_VALUE_OFFSET 6804
+#define TX_VALUE_LEN 81
+#define TX_TIMESTAMP_OFFSET 6966
+#define TX_CURRENT_INDEX_OFFSET 6993
+#define TX_LAST_INDEX_OFFSET 7020
+#define TX_BUNDLE_OFFSET 7047
+#define TX_TRUNK_OFFSET 7290
+#define TX_BRANCH_OFFSET 7533
+#define TX_NUMBER_LEN 27
+#define TX_ESSENCE_LEN 486
+
+#define DECODED(view, field) ((view)->decoded & (1 << (field)))
+
+void tx_view_init(tx_view_t *const view, flex_trit_t const *const trits) {
+  view->trits = trits;
+  view->decoded = 0;
+}
+
+static void decode_hash(tx_view_t *const view, tx_field_t field, size_t offset, flex_trit_t *hash) {
+  if (!DECODED(view, field)) {
+    flex_trits_slice(hash, NUM_TRITS_HASH, view->trits, NUM_TRITS_SERIALIZED_TRANSACTION, offset, NUM_TRITS_HASH);
+    view->decoded |= 1 << field;
+  }
+}
+
+static int64_t decode_number(tx_view_t const *const view, size_t offset, size_t len) {
+  flex_trit_t packed[NUM_FLEX_TRITS_FOR_TRITS(TX_VALUE_LEN)];
+  trit_t trits[TX_VALUE_LEN];
+  flex_trits_slice(packed, len, view->trits, NUM_TRITS_SERIALIZED_TRANSACTION, offset, len);
+  flex_trits_to_trits(trits, len, packed, len, len);
+  return trits_to_long(trits, len);
+}
+
+flex_trit_t const *tx_view_address(tx_view_t *const view) {
+  decode_hash(view, TX_FIELD_ADDRESS, TX_ADDRESS_OFFSET, view->address);
+  return view->address;
+}
+
+flex_trit_t const *tx_view_bundle(tx_view_t *const view) {
+  decode_hash(view, TX_FIELD_BUNDLE, TX_BUNDLE_OFFSET, view->bundle);
+  return view->bundle;
+}
+
+flex_trit_t const *tx_view_trunk(tx_view_t *const view) {
+  decode_hash(view, TX_FIELD_TRUNK, TX_TRUNK_OFFSET, view->trunk);
+  return view->trunk;
+}
+
+flex_trit_t const *tx_view_branch(tx_view_t *const view) {
+  decode_hash(view, TX_FIELD_BRANCH, TX_BRANCH_OFFSET, view->branch);
+  return view->branch;
+}
+
+int64_t tx_view_value(tx_view_t *const view) {
+  if (!DECODED(view, TX_FIELD_VALUE)) {
+    view->value = decode_number(view, TX_VALUE_OFFSET, TX_VALUE_LEN);
+    view->decoded |= 1 << TX_FIELD_VALUE;
+  }
+  return view->value;
+}
+
+uint64_t tx_view_timestamp(tx_view_t *const view) {
+  if (!DECODED(view, TX_FIELD_TIMESTAMP)) {
+    view->timestamp = decode_number(view, TX_TIMESTAMP_OFFSET, TX_NUMBER_LEN);
+    view->decoded |= 1 << TX_FIELD_TIMESTAMP;
+  }
+  return view->timestamp;
+}
+
+uint64_t tx_view_current_index(tx_view_t *const view) {
+  if (!DECODED(view, TX_FIELD_CURRENT_INDEX)) {
+    view->current_index = decode_number(view, TX_CURRENT_INDEX_OFFSET, TX_NUMBER_LEN);
+    view->decoded |= 1 << TX_FIELD_CURRENT_INDEX;
+  }
+  return view->current_index;
+}
+
+uint64_t tx_view_last_index(tx_view_t *const view) {
+  if (!DECODED(view, TX_FIELD_LAST_INDEX)) {
+    view->last_index = decode_number(view, TX_LAST_INDEX_OFFSET, TX_NUMBER_LEN);
+    view->decoded |= 1 << TX_FIELD_LAST_INDEX;
+  }
+  return view->last_index;
+}
+
+void tx_view_signature(tx_view_t const *const view, flex_trit_t *const fragment) {
+  flex_trits_slice(fragment, NUM_TRITS_SIGNATURE, view->trits, NUM_TRITS_SERIALIZED_TRANSACTION, TX_SIGNATURE_OFFSET,
+                   NUM_TRITS_SIGNATURE);
+}
+
+void tx_view_essence(tx_view_t const *const view, flex_trit_t *const essence) {
+  flex_trits_slice(essence, TX_ESSENCE_LEN, view->trits, NUM_TRITS_SERIALIZED_TRANSACTION, TX_ADDRESS_OFFSET,
+                   TX_ESSENCE_LEN);
+}
+
+void tx_view_to_transaction(tx_view_t const *const view, iota_transaction_t *const tx) {
+  transaction_reset(tx);
+  transaction_deserialize_from_trits(tx, view->trits, false);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/model/transaction.h"
+#include "common/trinary/flex_trit.h"
+
+/*
+ * Lazy view of a serialized transaction
+ *
+ * The view keeps a pointer to the 8019 packed trits and decodes a field when it's read, decoded
+ * fields are cached and marked in a bitmask. The signature or message fragment is never cached,
+ * it's copied out on request. transaction_deserialize_from_trits() decodes all fields of a 2.7KB
+ * iota_transaction_t, checks of a bundle only need a few of them.
+ */
+
+typedef enum {
+  TX_FIELD_ADDRESS = 0,
+  TX_FIELD_VALUE,
+  TX_FIELD_TIMESTAMP,
+  TX_FIELD_CURRENT_INDEX,
+  TX_FIELD_LAST_INDEX,
+  TX_FIELD_BUNDLE,
+  TX_FIELD_TRUNK,
+  TX_FIELD_BRANCH,
+} tx_field_t;
+
+typedef struct {
+  flex_trit_t const *trits; /*!< serialized transaction, owned by the caller */
+  uint16_t decoded;         /*!< bits of tx_field_t */
+  int64_t value;
+  uint64_t timestamp;
+  uint64_t current_index;
+  uint64_t last_index;
+  flex_trit_t address[FLEX_TRIT_SIZE_243];
+  flex_trit_t bundle[FLEX_TRIT_SIZE_243];
+  flex_trit_t trunk[FLEX_TRIT_SIZE_243];
+  flex_trit_t branch[FLEX_TRIT_SIZE_243];
+} tx_view_t;
+
+// The trits must outlive the view.
+void tx_view_init(tx_view_t *const view, flex_trit_t const *const trits);
+
+flex_trit_t const *tx_view_address(tx_view_t *const view);
+int64_t tx_view_value(tx_view_t *const view);
+uint64_t tx_view_timestamp(tx_view_t *const view);
+uint64_t tx_view_current_index(tx_view_t *const view);
+uint64_t tx_view_last_index(tx_view_t *const view);
+flex_trit_t const *tx_view_bundle(tx_view_t *const view);
+flex_trit_t const *tx_view_trunk(tx_view_t *const view);
+flex_trit_t const *tx_view_branch(tx_view_t *const view);
+
+static inline bool tx_view_is_tail(tx_view_t *const view) { return tx_view_current_index(view) == 0; }
+
+// Copy the signature or message fragment, FLEX_TRIT_SIZE_6561 bytes.
+void tx_view_signature(tx_view_t const *const view, flex_trit_t *const fragment);
+
+// Copy trits of the essence, address to last index, for the bundle hash.
+void tx_view_essence(tx_view_t const *const view, flex_trit_t *const essence);
+
+// Decode all fields into a transaction object.
+void tx_view_to_transaction(tx_view_t const *const view, iota_transaction_t *const tx);
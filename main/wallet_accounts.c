@@ -0,0 +1,821 @@
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/reent.h>
+
+#include "argtable3/argtable3.h"
+#include "esp_console.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include "common/crypto/kerl/kerl.h"
+#include "common/helpers/sign.h"
+#include "utils/input_validators.h"
+#include "utils/memset_safe.h"
+
+#include "crypto_backend.h"
+#include "input_selector.h"
+#include "wallet_accounts.h"
+#include "wallet_batch.h"
+#include "wallet_http.h"
+#include "wallet_mem.h"
+#include "wallet_output.h"
+
+static const char *TAG = "wallet_accounts";
+
+#define ACCOUNTS_NAMESPACE "wallet_state"
+#define ACCOUNTS_KEY "accounts"
+#define ACCOUNTS_MAGIC 0x41434331 /* "ACC1" */
+#define ACCOUNTS_NAME_LEN 16
+#define ACCOUNTS_MAIN "main"
+#define ACCOUNTS_SLOTS (CONFIG_WALLET_ACCOUNTS_MAX * (CONFIG_WALLET_ACCOUNTS_ADDRESSES + 1))
+
+typedef struct {
+  char name[ACCOUNTS_NAME_LEN];
+  uint8_t security;     /*!< 0 for "main", it follows the security of the command */
+  uint8_t imported;     /*!< the seed is not derived from the wallet seed */
+  uint8_t known;        /*!< next_index and funded are valid */
+  uint8_t funded_count; /*!< funded addresses */
+  uint8_t seed_tag[CRYPTO_RECORD_TAG_LEN]; /*!< fingerprint of an imported seed */
+  uint32_t next_index;                     /*!< the unused address */
+  uint32_t funded[CONFIG_WALLET_ACCOUNTS_ADDRESSES];
+} account_rec_t;
+
+typedef struct {
+  uint32_t magic;
+  uint8_t master_tag[CRYPTO_RECORD_TAG_LEN]; /*!< fingerprint of the wallet seed of derived accounts */
+  uint8_t master_known;
+  uint8_t count;
+  uint8_t active;
+  account_rec_t recs[CONFIG_WALLET_ACCOUNTS_MAX];
+} account_table_t;
+
+// addresses of an account generated in this boot
+typedef struct {
+  bool seed_set; /*!< an imported seed is in RAM */
+  flex_trit_t seed[FLEX_TRIT_SIZE_243];
+  bool cached;      /*!< entries match funded indices of the record */
+  bool next_cached; /*!< next_address matches next_index of the record */
+  flex_trit_t next_address[FLEX_TRIT_SIZE_243];
+  input_entry_t *entries; /*!< funded addresses with their balance */
+} account_cache_t;
+
+// an address of the combined getBalances
+typedef struct {
+  uint8_t account;
+  int8_t entry; /*!< -1 for the next address */
+} refresh_slot_t;
+
+static account_table_t table;
+static account_cache_t caches[CONFIG_WALLET_ACCOUNTS_MAX];
+static uint32_t generation = 0; /*!< changes when accounts are added or removed */
+static bool selector_loaded = false;
+static SemaphoreHandle_t accounts_lock = NULL;
+
+static void table_reset() {
+  memset(&table, 0, sizeof(table));
+  table.magic = ACCOUNTS_MAGIC;
+  table.count = 1;
+  strcpy(table.recs[0].name, ACCOUNTS_MAIN);
+}
+
+static esp_err_t table_load() {
+  nvs_handle handle;
+  size_t len = sizeof(account_table_t);
+  esp_err_t err = nvs_open(ACCOUNTS_NAMESPACE, NVS_READONLY, &handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+  err = nvs_get_blob(handle, ACCOUNTS_KEY, &table, &len);
+  nvs_close(handle);
+  if (err == ESP_OK && (len != sizeof(account_table_t) || table.magic != ACCOUNTS_MAGIC || table.count == 0 ||
+                        table.count > CONFIG_WALLET_ACCOUNTS_MAX || table.active >= table.count)) {
+    err = ESP_ERR_INVALID_VERSION;
+  }
+  return err;
+}
+
+// must be called with accounts_lock
+static esp_err_t table_save() {
+  nvs_handle handle;
+  esp_err_t err = nvs_open(ACCOUNTS_NAMESPACE, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+  if ((err = nvs_set_blob(handle, ACCOUNTS_KEY, &table, sizeof(account_table_t))) == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "save failed: %s", esp_err_to_name(err));
+  }
+  return err;
+}
+
+void wallet_accounts_init() {
+  accounts_lock = xSemaphoreCreateMutex();
+  // an entry is about 60 bytes, SPI RAM with the split memory policy.
+  input_entry_t *entries =
+      wallet_mem_cold(CONFIG_WALLET_ACCOUNTS_MAX * CONFIG_WALLET_ACCOUNTS_ADDRESSES * sizeof(input_entry_t));
+  if (accounts_lock == NULL || entries == NULL) {
+    ESP_LOGE(TAG, "init failed, only the wallet seed is used");
+    if (accounts_lock) {
+      vSemaphoreDelete(accounts_lock);
+      accounts_lock = NULL;
+    }
+    return;
+  }
+  for (size_t i = 0; i < CONFIG_WALLET_ACCOUNTS_MAX; i++) {
+    caches[i].entries = entries + i * CONFIG_WALLET_ACCOUNTS_ADDRESSES;
+  }
+  if (table_load() != ESP_OK) {
+    table_reset();
+  }
+  ESP_LOGI(TAG, "%u accounts, active: %s", table.count, table.recs[table.active].name);
+}
+
+// must be called with accounts_lock
+static int table_find(char const *name) {
+  for (int i = 0; i < table.count; i++) {
+    if (strcmp(table.recs[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// must be called with accounts_lock, states of derived accounts are dropped if the wallet seed changed.
+static void check_master(flex_trit_t const *master) {
+  uint8_t tag[CRYPTO_RECORD_TAG_LEN];
+  crypto_record_tag(master, FLEX_TRIT_SIZE_243, tag);
+  if (table.master_known && crypto_memcmp_ct(tag, table.master_tag, CRYPTO_RECORD_TAG_LEN) == 0) {
+    return;
+  }
+  if (table.master_known) {
+    ESP_LOGI(TAG, "new wallet seed, states of derived accounts are dropped");
+  }
+  for (size_t i = 0; i < table.count; i++) {
+    if (!table.recs[i].imported) {
+      table.recs[i].known = 0;
+      table.recs[i].funded_count = 0;
+      caches[i].cached = false;
+      caches[i].next_cached = false;
+    }
+  }
+  memcpy(table.master_tag, tag, CRYPTO_RECORD_TAG_LEN);
+  table.master_known = 1;
+  selector_loaded = false;
+  table_save();
+}
+
+// Kerl(wallet seed, name in trytes), the name is encoded like ASCII messages, padded with 9.
+static void derive_seed(flex_trit_t const *master, char const *name, flex_trit_t *seed) {
+  static char const alphabet[] = "9ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  Kerl kerl;
+  trit_t trits[NUM_TRITS_HASH];
+  tryte_t name_trytes[NUM_TRYTES_HASH];
+  flex_trit_t name_trits[FLEX_TRIT_SIZE_243];
+
+  memset(name_trytes, '9', sizeof(name_trytes));
+  for (size_t i = 0; name[i] && i < ACCOUNTS_NAME_LEN; i++) {
+    name_trytes[2 * i] = alphabet[(uint8_t)name[i] % 27];
+    name_trytes[2 * i + 1] = alphabet[(uint8_t)name[i] / 27];
+  }
+  flex_trits_from_trytes(name_trits, NUM_TRITS_HASH, name_trytes, NUM_TRYTES_HASH, NUM_TRYTES_HASH);
+
+  kerl_init(&kerl);
+  flex_trits_to_trits(trits, NUM_TRITS_HASH, master, NUM_TRITS_HASH, NUM_TRITS_HASH);
+  kerl_absorb(&kerl, trits, NUM_TRITS_HASH);
+  flex_trits_to_trits(trits, NUM_TRITS_HASH, name_trits, NUM_TRITS_HASH, NUM_TRITS_HASH);
+  kerl_absorb(&kerl, trits, NUM_TRITS_HASH);
+  kerl_squeeze(&kerl, trits, NUM_TRITS_HASH);
+  flex_trits_from_trits(seed, NUM_TRITS_HASH, trits, NUM_TRITS_HASH, NUM_TRITS_HASH);
+  memset_safe(trits, sizeof(trits), 0, sizeof(trits));
+  memset_safe(&kerl, sizeof(kerl), 0, sizeof(kerl));
+}
+
+// must be called with accounts_lock
+static bool account_seed(size_t i, flex_trit_t const *master, flex_trit_t *seed) {
+  if (i == 0) {
+    memcpy(seed, master, FLEX_TRIT_SIZE_243);
+  } else if (table.recs[i].imported) {
+    if (!caches[i].seed_set) {
+      return false;
+    }
+    memcpy(seed, caches[i].seed, FLEX_TRIT_SIZE_243);
+  } else {
+    derive_seed(master, table.recs[i].name, seed);
+  }
+  return true;
+}
+
+bool wallet_accounts_seed(flex_trit_t *seed, uint8_t *security) {
+  flex_trit_t master[FLEX_TRIT_SIZE_243];
+  bool ret = true;
+  if (accounts_lock == NULL) {
+    return true;
+  }
+
+  xSemaphoreTake(accounts_lock, portMAX_DELAY);
+  check_master(seed);
+  size_t active = table.active;
+  account_rec_t const *rec = &table.recs[active];
+  memcpy(master, seed, FLEX_TRIT_SIZE_243);
+  if (!account_seed(active, master, seed)) {
+    printf("The seed of account %s isn't in RAM, `account_add %s -s` again\n", rec->name, rec->name);
+    ret = false;
+  } else {
+    if (rec->security) {
+      *security = rec->security;
+    }
+    // funded addresses of the account for `send`, the selector keeps one seed.
+    if (!selector_loaded && caches[active].cached && caches[active].next_cached) {
+      input_selector_load(seed, *security, caches[active].entries, rec->funded_count, rec->next_index,
+                          caches[active].next_address);
+      selector_loaded = true;
+    }
+  }
+  xSemaphoreGive(accounts_lock);
+  memset_safe(master, sizeof(master), 0, sizeof(master));
+  return ret;
+}
+
+// must be called with accounts_lock
+static void account_update(size_t i, account_data_t *account) {
+  account_rec_t *rec = &table.recs[i];
+  account_cache_t *cache = &caches[i];
+  size_t count = hash243_queue_count(account->addresses);
+
+  rec->funded_count = 0;
+  rec->next_index = count;
+  for (size_t j = 0; j < count; j++) {
+    flex_trit_t const *address = hash243_queue_at(account->addresses, j);
+    uint64_t balance = account_data_get_balance(account, j);
+    if (memcmp(address, account->latest_address, FLEX_TRIT_SIZE_243) == 0) {
+      rec->next_index = j;
+    } else if (balance > 0) {
+      if (rec->funded_count == CONFIG_WALLET_ACCOUNTS_ADDRESSES) {
+        ESP_LOGW(TAG, "%s: address %u is not kept, too many funded addresses", rec->name, j);
+        continue;
+      }
+      input_entry_t *entry = &cache->entries[rec->funded_count];
+      entry->index = j;
+      entry->balance = balance;
+      memcpy(entry->address, address, FLEX_TRIT_SIZE_243);
+      rec->funded[rec->funded_count++] = j;
+    }
+  }
+  memcpy(cache->next_address, account->latest_address, FLEX_TRIT_SIZE_243);
+  rec->known = 1;
+  cache->cached = true;
+  cache->next_cached = true;
+  table_save();
+}
+
+void wallet_accounts_set_account(account_data_t *account) {
+  if (accounts_lock == NULL) {
+    return;
+  }
+  xSemaphoreTake(accounts_lock, portMAX_DELAY);
+  account_update(table.active, account);
+  // `account` loads the selector with the same result
+  selector_loaded = true;
+  xSemaphoreGive(accounts_lock);
+}
+
+// Generate funded and next addresses of an account with a known state, they are not kept across restarts.
+static retcode_t cache_addresses(char const *name, flex_trit_t const *seed, uint8_t security) {
+  account_rec_t rec;
+  bool cached = false, next_cached = false;
+  flex_trit_t next_address[FLEX_TRIT_SIZE_243];
+  flex_trit_t *address = NULL;
+  input_entry_t *entries = wallet_mem_cold(CONFIG_WALLET_ACCOUNTS_ADDRESSES * sizeof(input_entry_t));
+  if (entries == NULL) {
+    return RC_OOM;
+  }
+
+  xSemaphoreTake(accounts_lock, portMAX_DELAY);
+  int i = table_find(name);
+  if (i >= 0) {
+    rec = table.recs[i];
+    cached = caches[i].cached;
+    next_cached = caches[i].next_cached;
+  }
+  xSemaphoreGive(accounts_lock);
+  if (i < 0) {
+    free(entries);
+    return RC_OK;
+  }
+
+  for (size_t j = 0; j < rec.funded_count && !cached; j++) {
+    if ((address = iota_sign_address_gen_flex_trits(seed, rec.funded[j], security)) == NULL) {
+      goto oom;
+    }
+    entries[j].index = rec.funded[j];
+    entries[j].balance = 0;
+    memcpy(entries[j].address, address, FLEX_TRIT_SIZE_243);
+    free(address);
+  }
+  if (!next_cached) {
+    if ((address = iota_sign_address_gen_flex_trits(seed, rec.next_index, security)) == NULL) {
+      goto oom;
+    }
+    memcpy(next_address, address, FLEX_TRIT_SIZE_243);
+    free(address);
+  }
+
+  // the state may change while addresses are generated, e.g. by `account`.
+  xSemaphoreTake(accounts_lock, portMAX_DELAY);
+  if ((i = table_find(name)) >= 0 && table.recs[i].known) {
+    if (!cached && !caches[i].cached && table.recs[i].funded_count == rec.funded_count &&
+        memcmp(table.recs[i].funded, rec.funded, rec.funded_count * sizeof(uint32_t)) == 0) {
+      memcpy(caches[i].entries, entries, rec.funded_count * sizeof(input_entry_t));
+      caches[i].cached = true;
+    }
+    if (!next_cached && !caches[i].next_cached && table.recs[i].next_index == rec.next_index) {
+      memcpy(caches[i].next_address, next_address, FLEX_TRIT_SIZE_243);
+      caches[i].next_cached = true;
+    }
+  }
+  xSemaphoreGive(accounts_lock);
+  free(entries);
+  return RC_OK;
+
+oom:
+  free(entries);
+  return RC_OOM;
+}
+
+// Scan accounts without a known state and generate addresses of the others.
+static retcode_t prepare_all(iota_client_service_t const *const serv, flex_trit_t const *master, uint8_t security) {
+  retcode_t ret = RC_OK;
+  flex_trit_t seed[FLEX_TRIT_SIZE_243];
+  char name[ACCOUNTS_NAME_LEN];
+
+  for (size_t i = 0; i < CONFIG_WALLET_ACCOUNTS_MAX && ret == RC_OK; i++) {
+    xSemaphoreTake(accounts_lock, portMAX_DELAY);
+    if (i >= table.count) {
+      xSemaphoreGive(accounts_lock);
+      break;
+    }
+    account_rec_t const *rec = &table.recs[i];
+    bool has_seed = account_seed(i, master, seed);
+    bool known = rec->known;
+    bool cached = caches[i].cached && caches[i].next_cached;
+    uint8_t account_security = rec->security ? rec->security : security;
+    strcpy(name, rec->name);
+    xSemaphoreGive(accounts_lock);
+
+    if (!has_seed) {
+      printf("%s: the seed isn't in RAM, skipped\n", name);
+    } else if (!known) {
+      ESP_LOGI(TAG, "%s: no known state, scanning addresses", name);
+      account_data_t account = {};
+      account_data_init(&account);
+      if ((ret = iota_client_get_account_data(serv, seed, account_security, &account)) == RC_OK) {
+        xSemaphoreTake(accounts_lock, portMAX_DELAY);
+        int j = table_find(name);
+        if (j >= 0) {
+          account_update(j, &account);
+          if (j == table.active) {
+            selector_loaded = false;
+          }
+        }
+        xSemaphoreGive(accounts_lock);
+      }
+      account_data_clear(&account);
+    } else if (!cached) {
+      ret = cache_addresses(name, seed, account_security);
+    }
+  }
+  memset_safe(seed, sizeof(seed), 0, sizeof(seed));
+  return ret;
+}
+
+// must be called with accounts_lock, applies balances of the combined getBalances.
+static void apply_balances(refresh_slot_t const *slots, size_t count, get_balances_res_t *res) {
+  bool changed = false;
+  for (size_t s = 0; s < count; s++) {
+    account_rec_t *rec = &table.recs[slots[s].account];
+    account_cache_t *cache = &caches[slots[s].account];
+    uint64_t balance = get_balances_res_balances_at(res, s);
+    if (slots[s].entry >= 0) {
+      cache->entries[slots[s].entry].balance = balance;
+    } else if (balance > 0) {
+      // a deposit on the unused address, it's funded now and the next one is unused.
+      ESP_LOGI(TAG, "%s: deposit of %" PRIu64 " at address %u", rec->name, balance, rec->next_index);
+      if (rec->funded_count < CONFIG_WALLET_ACCOUNTS_ADDRESSES) {
+        input_entry_t *entry = &cache->entries[rec->funded_count++];
+        entry->index = rec->next_index;
+        entry->balance = balance;
+        memcpy(entry->address, cache->next_address, FLEX_TRIT_SIZE_243);
+      }
+      rec->next_index++;
+      cache->next_cached = false;
+      changed = true;
+    }
+  }
+
+  // spent or emptied addresses are dropped
+  for (size_t i = 0; i < table.count; i++) {
+    account_rec_t *rec = &table.recs[i];
+    size_t kept = 0;
+    for (size_t j = 0; j < rec->funded_count && caches[i].cached; j++) {
+      if (caches[i].entries[j].balance > 0) {
+        caches[i].entries[kept++] = caches[i].entries[j];
+      }
+    }
+    if (caches[i].cached && kept != rec->funded_count) {
+      rec->funded_count = kept;
+      changed = true;
+    }
+    for (size_t j = 0; j < rec->funded_count && caches[i].cached; j++) {
+      rec->funded[j] = caches[i].entries[j].index;
+    }
+  }
+  if (changed) {
+    table_save();
+  }
+  selector_loaded = false;
+}
+
+// All cached addresses of all accounts in one getBalances
+static retcode_t refresh_balances(iota_client_service_t const *const serv, size_t *addresses) {
+  retcode_t ret = RC_OOM;
+  get_balances_req_t *req = get_balances_req_new();
+  get_balances_res_t *res = get_balances_res_new();
+  refresh_slot_t *slots = wallet_mem_cold(ACCOUNTS_SLOTS * sizeof(refresh_slot_t));
+  size_t count = 0;
+  if (!req || !res || !slots) {
+    goto done;
+  }
+
+  ret = RC_OK;
+  xSemaphoreTake(accounts_lock, portMAX_DELAY);
+  uint32_t gen = generation;
+  for (size_t i = 0; i < table.count && ret == RC_OK; i++) {
+    if (!table.recs[i].known || !caches[i].cached || !caches[i].next_cached) {
+      continue;
+    }
+    for (size_t j = 0; j < table.recs[i].funded_count && ret == RC_OK; j++) {
+      slots[count++] = (refresh_slot_t){.account = i, .entry = j};
+      ret = get_balances_req_address_add(req, caches[i].entries[j].address);
+    }
+    if (ret == RC_OK) {
+      slots[count++] = (refresh_slot_t){.account = i, .entry = -1};
+      ret = get_balances_req_address_add(req, caches[i].next_address);
+    }
+  }
+  xSemaphoreGive(accounts_lock);
+  *addresses = count;
+  if (ret != RC_OK || count == 0) {
+    goto done;
+  }
+
+  req->threshold = 100;
+  if ((ret = wallet_http_get_balances(serv, req, res)) != RC_OK) {
+    goto done;
+  }
+  if (get_balances_res_balances_num(res) != count) {
+    ret = RC_ERROR;
+    goto done;
+  }
+
+  xSemaphoreTake(accounts_lock, portMAX_DELAY);
+  if (gen == generation) {
+    apply_balances(slots, count, res);
+  } else {
+    ESP_LOGW(TAG, "accounts changed during the refresh, balances are dropped");
+    ret = RC_ERROR;
+  }
+  xSemaphoreGive(accounts_lock);
+
+done:
+  free(slots);
+  get_balances_req_free(&req);
+  get_balances_res_free(&res);
+  return ret;
+}
+
+static void print_accounts() {
+  uint64_t total = 0;
+  xSemaphoreTake(accounts_lock, portMAX_DELAY);
+  for (size_t i = 0; i < table.count; i++) {
+    account_rec_t const *rec = &table.recs[i];
+    uint64_t balance = 0;
+    for (size_t j = 0; j < rec->funded_count && caches[i].cached; j++) {
+      balance += caches[i].entries[j].balance;
+    }
+    total += balance;
+    if (output_format() != OUTPUT_TEXT) {
+      output_rec_t out;
+      output_rec_begin(&out, OUTPUT_REC_SUBACCOUNT);
+      output_rec_str(&out, "name", rec->name);
+      output_rec_uint(&out, "security", rec->security);
+      output_rec_uint(&out, "nextIndex", rec->next_index);
+      output_rec_uint(&out, "fundedCount", rec->funded_count);
+      output_rec_uint(&out, "balance", balance);
+      output_rec_end(&out);
+      continue;
+    }
+    printf("%c %-15s security %c, ", i == table.active ? '*' : ' ', rec->name,
+           rec->security ? '0' + rec->security : '-');
+    if (!rec->known) {
+      printf("not scanned\n");
+    } else if (!caches[i].cached) {
+      printf("next address %u, %u funded addresses\n", rec->next_index, rec->funded_count);
+    } else {
+      printf("next address %u, %u funded addresses, balance %" PRIu64 "\n", rec->next_index, rec->funded_count,
+             balance);
+    }
+  }
+  if (output_format() == OUTPUT_TEXT) {
+    printf("total balance: %" PRIu64 "\n", total);
+  }
+  xSemaphoreGive(accounts_lock);
+}
+
+retcode_t wallet_accounts_refresh_all(iota_client_service_t const *const serv, flex_trit_t const *master,
+                                      uint8_t security) {
+  retcode_t ret = RC_OK;
+  size_t addresses = 0;
+  if (accounts_lock == NULL) {
+    printf("Accounts are not available\n");
+    return RC_ERROR;
+  }
+
+  xSemaphoreTake(accounts_lock, portMAX_DELAY);
+  check_master(master);
+  xSemaphoreGive(accounts_lock);
+
+  if ((ret = prepare_all(serv, master, security)) != RC_OK || (ret = refresh_balances(serv, &addresses)) != RC_OK) {
+    return ret;
+  }
+  print_accounts();
+  if (output_format() == OUTPUT_TEXT) {
+    printf("%u addresses in one getBalances\n", addresses);
+  }
+  return RC_OK;
+}
+
+static bool valid_name(char const *name) {
+  size_t len = strlen(name);
+  if (len == 0 || len >= ACCOUNTS_NAME_LEN) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (!isalnum((unsigned char)name[i]) && name[i] != '_' && name[i] != '-') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// string data is not reset in argtable3
+static void arg_str_reset(struct arg_str *parent) {
+  for (int i = 0; i < parent->count; i++) {
+    parent->sval[i] = "";
+  }
+  parent->count = 0;
+}
+
+/* 'accounts' command */
+static int fn_accounts(int argc, char **argv) {
+  if (accounts_lock == NULL) {
+    printf("Accounts are not available\n");
+    return -1;
+  }
+  print_accounts();
+  return 0;
+}
+
+/* 'account_add' command */
+static struct {
+  struct arg_str *name;
+  struct arg_int *security;
+  struct arg_lit *seed;
+  struct arg_end *end;
+} account_add_args;
+
+// An imported seed is typed at a prompt, it doesn't end up in the console history or a batch script.
+static bool prompt_seed(char *trytes, size_t size) {
+  // the console UART isn't stdin and stdout of batch jobs and API requests
+  if (stdin != _GLOBAL_REENT->_stdin || stdout != _GLOBAL_REENT->_stdout) {
+    printf("Seeds are imported at the console\n");
+    return false;
+  }
+  printf("Seed: ");
+  fflush(stdout);
+  bool read = fgets(trytes, size, stdin) != NULL;
+  printf("\n");
+  trytes[strcspn(trytes, "\r\n")] = '\0';
+  return read;
+}
+
+static int fn_account_add(int argc, char **argv) {
+  int ret = 0;
+  flex_trit_t seed[FLEX_TRIT_SIZE_243];
+  char trytes[NUM_TRYTES_HASH + 16];
+  uint8_t tag[CRYPTO_RECORD_TAG_LEN];
+
+  int nerrors = arg_parse(argc, argv, (void **)&account_add_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, account_add_args.end, argv[0]);
+    return -1;
+  }
+  if (accounts_lock == NULL) {
+    printf("Accounts are not available\n");
+    return -1;
+  }
+
+  char const *name = account_add_args.name->sval[0];
+  int security = account_add_args.security->count ? account_add_args.security->ival[0] : 2;
+  bool imported = account_add_args.seed->count > 0;
+  if (!valid_name(name) || strcmp(name, ACCOUNTS_MAIN) == 0) {
+    printf("Invalid name, up to %d of [A-Za-z0-9_-]\n", ACCOUNTS_NAME_LEN - 1);
+    return -1;
+  }
+  if (security < 1 || security > 3) {
+    printf("Invalid security level %d\n", security);
+    return -1;
+  }
+  if (imported) {
+    if (!prompt_seed(trytes, sizeof(trytes))) {
+      return -1;
+    }
+    for (size_t i = 0; trytes[i]; i++) {
+      trytes[i] = toupper((unsigned char)trytes[i]);
+    }
+    bool valid = is_seed((tryte_t *)trytes) && flex_trits_from_trytes(seed, NUM_TRITS_HASH, (tryte_t const *)trytes,
+                                                                      NUM_TRYTES_HASH, NUM_TRYTES_HASH) != 0;
+    size_t len = strlen(trytes);
+    memset_safe(trytes, sizeof(trytes), 0, sizeof(trytes));
+    if (!valid) {
+      printf("Invalid SEED hash(%d), expect %d\n", len, NUM_TRYTES_HASH);
+      return -1;
+    }
+    crypto_record_tag(seed, FLEX_TRIT_SIZE_243, tag);
+  }
+
+  xSemaphoreTake(accounts_lock, portMAX_DELAY);
+  int i = table_find(name);
+  if (i >= 0) {
+    // the seed of an imported account is entered again after a restart
+    account_rec_t *rec = &table.recs[i];
+    if (imported && rec->imported && crypto_memcmp_ct(tag, rec->seed_tag, CRYPTO_RECORD_TAG_LEN) == 0) {
+      memcpy(caches[i].seed, seed, FLEX_TRIT_SIZE_243);
+      caches[i].seed_set = true;
+      printf("The seed of %s is in RAM\n", name);
+    } else {
+      printf("Account %s exists\n", name);
+      ret = -1;
+    }
+  } else if (table.count == CONFIG_WALLET_ACCOUNTS_MAX) {
+    printf("No room for more than %d accounts\n", CONFIG_WALLET_ACCOUNTS_MAX);
+    ret = -1;
+  } else {
+    i = table.count++;
+    account_rec_t *rec = &table.recs[i];
+    memset(rec, 0, sizeof(account_rec_t));
+    strcpy(rec->name, name);
+    rec->security = security;
+    rec->imported = imported;
+    caches[i].seed_set = imported;
+    caches[i].cached = false;
+    caches[i].next_cached = false;
+    if (imported) {
+      memcpy(rec->seed_tag, tag, CRYPTO_RECORD_TAG_LEN);
+      memcpy(caches[i].seed, seed, FLEX_TRIT_SIZE_243);
+    }
+    generation++;
+    table_save();
+    printf("Added %s, security %d, %s seed\n", name, security, imported ? "imported" : "derived");
+  }
+  xSemaphoreGive(accounts_lock);
+  memset_safe(seed, sizeof(seed), 0, sizeof(seed));
+  return ret;
+}
+
+/* 'account_use' and 'account_remove' commands */
+static struct {
+  struct arg_str *name;
+  struct arg_end *end;
+} account_name_args;
+
+static int fn_account_use(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&account_name_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, account_name_args.end, argv[0]);
+    return -1;
+  }
+  if (accounts_lock == NULL) {
+    printf("Accounts are not available\n");
+    return -1;
+  }
+
+  xSemaphoreTake(accounts_lock, portMAX_DELAY);
+  int i = table_find(account_name_args.name->sval[0]);
+  if (i >= 0 && i != table.active) {
+    table.active = i;
+    selector_loaded = false;
+    table_save();
+  }
+  xSemaphoreGive(accounts_lock);
+  if (i < 0) {
+    printf("No account %s\n", account_name_args.name->sval[0]);
+    return -1;
+  }
+  return 0;
+}
+
+static int fn_account_remove(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&account_name_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, account_name_args.end, argv[0]);
+    return -1;
+  }
+  if (accounts_lock == NULL) {
+    printf("Accounts are not available\n");
+    return -1;
+  }
+
+  xSemaphoreTake(accounts_lock, portMAX_DELAY);
+  int i = table_find(account_name_args.name->sval[0]);
+  if (i > 0) {
+    // slots of entries move with their account
+    input_entry_t *entries = caches[i].entries;
+    memset_safe(caches[i].seed, sizeof(caches[i].seed), 0, sizeof(caches[i].seed));
+    memmove(&table.recs[i], &table.recs[i + 1], (table.count - i - 1) * sizeof(account_rec_t));
+    memmove(&caches[i], &caches[i + 1], (table.count - i - 1) * sizeof(account_cache_t));
+    table.count--;
+    memset(&caches[table.count], 0, sizeof(account_cache_t));
+    caches[table.count].entries = entries;
+    if (table.active == i) {
+      table.active = 0;
+      selector_loaded = false;
+    } else if (table.active > i) {
+      table.active--;
+    }
+    generation++;
+    table_save();
+  }
+  xSemaphoreGive(accounts_lock);
+  if (i == 0) {
+    printf("The main account can't be removed\n");
+    return -1;
+  } else if (i < 0) {
+    printf("No account %s\n", account_name_args.name->sval[0]);
+    return -1;
+  }
+  return 0;
+}
+
+void register_wallet_accounts() {
+  const esp_console_cmd_t accounts_cmd = {
+      .command = "accounts",
+      .help = "List accounts, * marks the active one",
+      .hint = NULL,
+      .func = &fn_accounts,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&accounts_cmd, WALLET_CMD_CONCURRENT));
+
+  account_add_args.name = arg_str1(NULL, NULL, "<name>", "account name");
+  account_add_args.security = arg_int0("l", "security", "<1|2|3>", "security level, 2 by default");
+  account_add_args.seed = arg_lit0("s", "seed", "import a seed instead of deriving one, it's asked for");
+  account_add_args.name->hdr.resetfn = (arg_resetfn *)arg_str_reset;
+  account_add_args.end = arg_end(4);
+  const esp_console_cmd_t account_add_cmd = {
+      .command = "account_add",
+      .help = "Add an account, its seed is derived from the wallet seed unless -s imports one",
+      .hint = " <name> [-l security] [-s]",
+      .func = &fn_account_add,
+      .argtable = &account_add_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&account_add_cmd, 0));
+
+  account_name_args.name = arg_str1(NULL, NULL, "<name>", "account name");
+  account_name_args.name->hdr.resetfn = (arg_resetfn *)arg_str_reset;
+  account_name_args.end = arg_end(2);
+  const esp_console_cmd_t account_use_cmd = {
+      .command = "account_use",
+      .help = "Switch the account of `account`, `send`, `get_addresses` and `seed`",
+      .hint = " <name>",
+      .func = &fn_account_use,
+      .argtable = &account_name_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&account_use_cmd, 0));
+
+  const esp_console_cmd_t account_remove_cmd = {
+      .command = "account_remove",
+      .help = "Remove an account, funds stay on its addresses",
+      .hint = " <name>",
+      .func = &fn_account_remove,
+      .argtable = &account_name_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&account_remove_cmd, 0));
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cclient/api/extended/extended_api.h"
+#include "common/trinary/flex_trit.h"
+
+/*
+ * Named accounts
+ *
+ * An account has its own seed, security level and address index state. "main" is the wallet seed,
+ * seeds of other accounts are derived from the wallet seed and the account name with Kerl, so
+ * nothing secret is stored, or imported with `account_add -s` at a prompt and kept in RAM until a restart.
+ * `account`, `send`, `get_addresses` and `seed` work on the active account.
+ *
+ * Accounts share the client session and the spent-address index. Funded address indices and the
+ * next address index of each account are kept in NVS, `account --all` refreshes balances of all
+ * accounts in one getBalances and scans only accounts without a known state.
+ */
+
+// Load accounts from NVS
+void wallet_accounts_init();
+
+// Turn the wallet seed into the seed of the active account, security is set if the account has its own.
+// Returns false if the seed of an imported account isn't in RAM.
+bool wallet_accounts_seed(flex_trit_t *seed, uint8_t *security);
+
+// Keep the address state of an `account` result of the active account.
+void wallet_accounts_set_account(account_data_t *account);
+
+// Refresh balances of all accounts, master is the wallet seed and security is the level of "main".
+retcode_t wallet_accounts_refresh_all(iota_client_service_t const *const serv, flex_trit_t const *master,
+                                      uint8_t security);
+
+// Register `accounts`, `account_add`, `account_use` and `account_remove` commands
+void register_wallet_accounts();
@@ -0,0 +1,623 @@
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "argtable3/argtable3.h"
+#include "cJSON.h"
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+
+#include "tip_pool.h"
+#include "wallet_api.h"
+#include "wallet_batch.h"
+#include "wallet_output.h"
+
+static const char *TAG = "wallet_api";
+
+#define API_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define API_LISTEN_STACK 3072
+#define API_MAX_REQUEST 2048
+#define API_MAX_LINE 1024
+#define API_HASH_TRYTES 81
+#define API_ADDRESS_TRYTES 90 /*!< with the checksum */
+#define API_TAG_TRYTES 27
+#define API_MAX_VALUE 2779530283277761.0 /*!< the IOTA supply */
+
+typedef struct {
+  uint32_t requests;
+  uint32_t coalesced;  /*!< requests which shared a command in flight */
+  uint32_t queue_full; /*!< connections rejected by a full queue */
+  uint32_t busy;       /*!< 503 for PoW or a command lock which wasn't free */
+  uint32_t bad;        /*!< 4xx */
+  uint32_t failed;     /*!< commands returned an error */
+  int64_t busy_us;     /*!< time of commands, the sum over workers */
+} api_stats_t;
+
+// a command in flight, identical requests wait for its result.
+typedef struct api_flight {
+  char *line;
+  char *result;
+  int ret;
+  int refs;                /*!< the owner and waiters */
+  int waiters;
+  SemaphoreHandle_t done;  /*!< given once per waiter */
+  struct api_flight *next;
+} api_flight_t;
+
+typedef struct {
+  char method[8];
+  char target[API_MAX_LINE]; /*!< the path, and the query after its '?' */
+  char *query;               /*!< into target, NULL without a query */
+  char *body;                /*!< into the request buffer */
+  size_t body_len;
+  char *token;               /*!< of "Authorization: Bearer", NULL without one */
+} api_request_t;
+
+static QueueHandle_t conn_queue = NULL;
+static SemaphoreHandle_t api_lock = NULL;
+static api_flight_t *flights = NULL;
+static api_stats_t stats;
+static int workers = 0;
+
+static char const *status_text(int status) {
+  switch (status) {
+    case 200:
+      return "OK";
+    case 400:
+      return "Bad Request";
+    case 401:
+      return "Unauthorized";
+    case 403:
+      return "Forbidden";
+    case 404:
+      return "Not Found";
+    case 405:
+      return "Method Not Allowed";
+    case 413:
+      return "Payload Too Large";
+    case 503:
+      return "Service Unavailable";
+    default:
+      return "Internal Server Error";
+  }
+}
+
+static void send_all(int sock, char const *data, size_t len) {
+  while (len > 0) {
+    int n = send(sock, data, len, 0);
+    if (n <= 0) {
+      return;
+    }
+    data += n;
+    len -= n;
+  }
+}
+
+static void respond(int sock, int status, char const *body) {
+  char header[160];
+  size_t len = body ? strlen(body) : 0;
+  int n = snprintf(header, sizeof(header),
+                   "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\n"
+                   "%sConnection: close\r\n\r\n",
+                   status, status_text(status), (unsigned)len,
+                   status == 503 ? "Retry-After: 1\r\n" : status == 401 ? "WWW-Authenticate: Bearer\r\n" : "");
+  send_all(sock, header, n);
+  if (len) {
+    send_all(sock, body, len);
+  }
+}
+
+static void respond_error(int sock, int status, char const *error) {
+  char body[96];
+  snprintf(body, sizeof(body), "{\"err\":\"%s\"}\n", error);
+  xSemaphoreTake(api_lock, portMAX_DELAY);
+  if (status == 503) {
+    stats.busy++;
+  } else {
+    stats.bad++;
+  }
+  xSemaphoreGive(api_lock);
+  respond(sock, status, body);
+}
+
+// Read the header and the body, returns 0 or an HTTP status.
+static int read_request(int sock, char *buf, api_request_t *req) {
+  size_t len = 0;
+  char *end = NULL;
+  while ((end = strstr(buf, "\r\n\r\n")) == NULL) {
+    if (len == API_MAX_REQUEST - 1) {
+      return 413;
+    }
+    int n = recv(sock, buf + len, API_MAX_REQUEST - 1 - len, 0);
+    if (n <= 0) {
+      return 400;
+    }
+    len += n;
+    buf[len] = '\0';
+  }
+  *end = '\0';
+  req->body = end + 4;
+  size_t header_len = req->body - buf;
+
+  if (sscanf(buf, "%7s %1023s", req->method, req->target) != 2) {
+    return 400;
+  }
+  if ((req->query = strchr(req->target, '?')) != NULL) {
+    *req->query++ = '\0';
+  }
+
+  char *length = strcasestr(buf, "\r\nContent-Length:");
+  req->body_len = 0;
+  if (length) {
+    char *digits = length + 17, *end = NULL;
+    digits += strspn(digits, " \t");
+    errno = 0;
+    unsigned long body_len = strtoul(digits, &end, 10);
+    end += strspn(end, " \t");
+    if (!isdigit((unsigned char)*digits) || errno == ERANGE || (*end != '\0' && *end != '\r')) {
+      return 400;
+    }
+    req->body_len = body_len;
+  }
+  // header_len is below API_MAX_REQUEST, the difference can't wrap
+  if (req->body_len >= API_MAX_REQUEST - header_len) {
+    return 413;
+  }
+  req->token = NULL;
+  char *auth = strcasestr(buf, "\r\nAuthorization: Bearer ");
+  if (auth) {
+    req->token = auth + 24;
+    req->token[strcspn(req->token, "\r")] = '\0';
+  }
+  while (len < header_len + req->body_len) {
+    int n = recv(sock, buf + len, header_len + req->body_len - len, 0);
+    if (n <= 0) {
+      return 400;
+    }
+    len += n;
+  }
+  req->body[req->body_len] = '\0';
+  return 0;
+}
+
+// The token of state-changing routes, compared in constant time. Without CONFIG_WALLET_API_TOKEN they're refused.
+static int check_token(api_request_t const *req) {
+  char const *expected = CONFIG_WALLET_API_TOKEN;
+  size_t len = strlen(expected);
+  if (len == 0) {
+    return 403;
+  }
+  if (req->token == NULL || strlen(req->token) != len) {
+    return 401;
+  }
+  uint8_t diff = 0;
+  for (size_t i = 0; i < len; i++) {
+    diff |= req->token[i] ^ expected[i];
+  }
+  return diff ? 401 : 0;
+}
+
+// Copy a query parameter, returns false if it's missing or too long.
+static bool query_param(char const *query, char const *name, char *value, size_t cap) {
+  size_t name_len = strlen(name);
+  while (query && *query) {
+    size_t len = strcspn(query, "&");
+    if (len > name_len && strncmp(query, name, name_len) == 0 && query[name_len] == '=') {
+      len -= name_len + 1;
+      if (len >= cap) {
+        return false;
+      }
+      memcpy(value, query + name_len + 1, len);
+      value[len] = '\0';
+      return true;
+    }
+    query += len;
+    query += *query == '&';
+  }
+  return false;
+}
+
+static bool is_trytes(char const *str, size_t min, size_t max) {
+  size_t len = strlen(str);
+  if (len < min || len > max) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (str[i] != '9' && (str[i] < 'A' || str[i] > 'Z')) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool is_number(char const *str) {
+  if (*str == '\0' || strlen(str) > 19) {
+    return false;
+  }
+  for (; *str; str++) {
+    if (!isdigit((unsigned char)*str)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Command lines of requests, they return 0 or an HTTP status. Parameters are checked, a line can't
+// take more arguments than its command expects.
+static int line_balance(api_request_t const *req, char *line) {
+  char addresses[API_MAX_LINE / 2];
+  if (!query_param(req->query, "address", addresses, sizeof(addresses))) {
+    return 400;
+  }
+  strcpy(line, "balance");
+  for (char *address = strtok(addresses, ","); address; address = strtok(NULL, ",")) {
+    if (!is_trytes(address, API_HASH_TRYTES, API_HASH_TRYTES)) {
+      return 400;
+    }
+    strcat(line, " ");
+    strcat(line, address);
+  }
+  return 0;
+}
+
+static int line_addresses(api_request_t const *req, char *line) {
+  char start[24], end[24];
+  if (!query_param(req->query, "start", start, sizeof(start)) || !query_param(req->query, "end", end, sizeof(end)) ||
+      !is_number(start) || !is_number(end)) {
+    return 400;
+  }
+  sprintf(line, "get_addresses %s %s", start, end);
+  return 0;
+}
+
+static int line_transactions(api_request_t const *req, char *line) {
+  char address[API_ADDRESS_TRYTES + 1];
+  if (!query_param(req->query, "address", address, sizeof(address)) ||
+      !is_trytes(address, API_HASH_TRYTES, API_HASH_TRYTES)) {
+    return 400;
+  }
+  sprintf(line, "transactions %s", address);
+  return 0;
+}
+
+static int line_bundle(api_request_t const *req, char *line) {
+  char tail[API_HASH_TRYTES + 1];
+  if (!query_param(req->query, "tail", tail, sizeof(tail)) || !is_trytes(tail, API_HASH_TRYTES, API_HASH_TRYTES)) {
+    return 400;
+  }
+  sprintf(line, "get_bundle %s", tail);
+  return 0;
+}
+
+// the message is quoted for esp_console_split_argv
+static int line_send(api_request_t const *req, char *line) {
+  int status = 400;
+  cJSON *json = cJSON_Parse(req->body);
+  cJSON *address = cJSON_GetObjectItem(json, "address");
+  cJSON *value = cJSON_GetObjectItem(json, "value");
+  cJSON *tag = cJSON_GetObjectItem(json, "tag");
+  cJSON *message = cJSON_GetObjectItem(json, "message");
+  if (!cJSON_IsString(address) || !is_trytes(address->valuestring, API_ADDRESS_TRYTES, API_ADDRESS_TRYTES) ||
+      (value && (!cJSON_IsNumber(value) || !(value->valuedouble >= 0 && value->valuedouble <= API_MAX_VALUE) ||
+                 value->valuedouble != (double)(uint64_t)value->valuedouble)) ||
+      (tag && (!cJSON_IsString(tag) || !is_trytes(tag->valuestring, 0, API_TAG_TRYTES))) ||
+      (message && !cJSON_IsString(message))) {
+    goto done;
+  }
+
+  int len = snprintf(line, API_MAX_LINE, "send %s -v %" PRIu64, address->valuestring,
+                     value ? (uint64_t)value->valuedouble : 0);
+  if (tag && *tag->valuestring) {
+    len += snprintf(line + len, API_MAX_LINE - len, " -t %s", tag->valuestring);
+  }
+  if (message) {
+    len += snprintf(line + len, API_MAX_LINE - len, " -m \"");
+    for (char const *c = message->valuestring; *c && len < API_MAX_LINE - 4; c++) {
+      if (*c == '"' || *c == '\\') {
+        line[len++] = '\\';
+      }
+      line[len++] = isprint((unsigned char)*c) ? *c : ' ';
+    }
+    if (len >= API_MAX_LINE - 4) {
+      status = 413;
+      goto done;
+    }
+    line[len++] = '"';
+    line[len] = '\0';
+  }
+  status = 0;
+
+done:
+  cJSON_Delete(json);
+  return status;
+}
+
+static int line_fixed(char const *command, char *line) {
+  strcpy(line, command);
+  return 0;
+}
+
+static int line_node_info(api_request_t const *req, char *line) { return line_fixed("node_info", line); }
+static int line_account(api_request_t const *req, char *line) { return line_fixed("account", line); }
+static int line_accounts(api_request_t const *req, char *line) { return line_fixed("account -a", line); }
+
+typedef struct {
+  char const *method;
+  char const *path;
+  int (*line)(api_request_t const *req, char *line);
+  bool auth; /*!< changes the wallet state, needs the token */
+} api_route_t;
+
+static api_route_t const routes[] = {
+    {"GET", "/v1/node_info", line_node_info, false},
+    {"GET", "/v1/balance", line_balance, false},
+    {"GET", "/v1/account", line_account, false},
+    {"GET", "/v1/accounts", line_accounts, false},
+    {"GET", "/v1/addresses", line_addresses, false},
+    {"GET", "/v1/transactions", line_transactions, false},
+    {"GET", "/v1/bundle", line_bundle, false},
+    {"POST", "/v1/send", line_send, true},
+};
+
+// Run the line, or wait for the same line in flight. The result is freed by the caller.
+static char *run_coalesced(char const *line, bool concurrent, uint32_t wait_ms, int *ret) {
+  api_flight_t *flight = NULL;
+  char *result = NULL;
+
+  xSemaphoreTake(api_lock, portMAX_DELAY);
+  for (flight = flights; concurrent && flight; flight = flight->next) {
+    if (strcmp(flight->line, line) == 0) {
+      flight->refs++;
+      flight->waiters++;
+      stats.coalesced++;
+      break;
+    }
+  }
+  xSemaphoreGive(api_lock);
+
+  if (flight) {
+    xSemaphoreTake(flight->done, portMAX_DELAY);
+  } else {
+    // only concurrent commands are shared, the others change the wallet state.
+    flight = calloc(1, sizeof(api_flight_t));
+    if (flight == NULL || (flight->line = strdup(line)) == NULL ||
+        (flight->done = xSemaphoreCreateCounting(CONFIG_WALLET_API_WORKERS, 0)) == NULL) {
+      if (flight) {
+        free(flight->line);
+        free(flight);
+      }
+      return NULL;
+    }
+    flight->refs = 1;
+    if (concurrent) {
+      xSemaphoreTake(api_lock, portMAX_DELAY);
+      flight->next = flights;
+      flights = flight;
+      xSemaphoreGive(api_lock);
+    }
+
+    int64_t start = esp_timer_get_time();
+    flight->result = wallet_batch_run_line(line, wait_ms, &flight->ret);
+
+    xSemaphoreTake(api_lock, portMAX_DELAY);
+    stats.busy_us += esp_timer_get_time() - start;
+    for (api_flight_t **p = &flights; *p; p = &(*p)->next) {
+      if (*p == flight) {
+        *p = flight->next;
+        break;
+      }
+    }
+    for (int i = 0; i < flight->waiters; i++) {
+      xSemaphoreGive(flight->done);
+    }
+    xSemaphoreGive(api_lock);
+  }
+
+  xSemaphoreTake(api_lock, portMAX_DELAY);
+  *ret = flight->ret;
+  result = flight->result ? strdup(flight->result) : NULL;
+  bool last = --flight->refs == 0;
+  xSemaphoreGive(api_lock);
+  if (last) {
+    vSemaphoreDelete(flight->done);
+    free(flight->result);
+    free(flight->line);
+    free(flight);
+  }
+  return result;
+}
+
+static void print_stats(FILE *f) {
+  xSemaphoreTake(api_lock, portMAX_DELAY);
+  fprintf(f,
+          "{\"requests\":%u,\"coalesced\":%u,\"queue_full\":%u,\"busy\":%u,\"bad\":%u,\"failed\":%u,"
+          "\"busy_us\":%" PRId64 ",\"workers\":%d}\n",
+          stats.requests, stats.coalesced, stats.queue_full, stats.busy, stats.bad, stats.failed, stats.busy_us,
+          workers);
+  xSemaphoreGive(api_lock);
+}
+
+static void handle(int sock, char *buf, char *line) {
+  api_request_t req = {};
+  int status = read_request(sock, buf, &req);
+  if (status) {
+    respond_error(sock, status, "bad request");
+    return;
+  }
+
+  xSemaphoreTake(api_lock, portMAX_DELAY);
+  stats.requests++;
+  xSemaphoreGive(api_lock);
+
+  if (strcmp(req.target, "/v1/stats") == 0) {
+    char *body = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&body, &len);
+    if (f) {
+      print_stats(f);
+      fclose(f);
+    }
+    respond(sock, body ? 200 : 500, body);
+    free(body);
+    return;
+  }
+
+  api_route_t const *route = NULL;
+  bool path_found = false;
+  for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+    if (strcmp(routes[i].path, req.target) == 0) {
+      path_found = true;
+      if (strcmp(routes[i].method, req.method) == 0) {
+        route = &routes[i];
+      }
+    }
+  }
+  if (route == NULL) {
+    respond_error(sock, path_found ? 405 : 404, path_found ? "method not allowed" : "not found");
+    return;
+  }
+  if (route->auth && (status = check_token(&req)) != 0) {
+    respond_error(sock, status, status == 401 ? "unauthorized" : "no token configured");
+    return;
+  }
+  if ((status = route->line(&req, line)) != 0) {
+    respond_error(sock, status, "invalid parameters");
+    return;
+  }
+
+  // signing and PoW take seconds, a send waits for nothing and a client retries later.
+  char name[16] = {};
+  sscanf(line, "%15s", name);
+  bool concurrent = wallet_batch_cmd_flags(name) & WALLET_CMD_CONCURRENT;
+  if (!concurrent && tip_pool_attaching()) {
+    respond_error(sock, 503, "attaching");
+    return;
+  }
+
+  int ret = 0;
+  char *result = run_coalesced(line, concurrent, concurrent ? CONFIG_WALLET_API_WAIT_MS : 0, &ret);
+  if (result == NULL) {
+    respond_error(sock, 503, "out of memory");
+    return;
+  }
+  if (ret == ESP_ERR_INVALID_STATE) {
+    respond_error(sock, 503, "busy");
+  } else {
+    if (ret != 0) {
+      xSemaphoreTake(api_lock, portMAX_DELAY);
+      stats.failed++;
+      xSemaphoreGive(api_lock);
+    }
+    respond(sock, ret == 0 ? 200 : 500, result);
+  }
+  free(result);
+}
+
+static void api_worker(void *param) {
+  int sock = -1;
+  char *buf = malloc(API_MAX_REQUEST);
+  char *line = malloc(API_MAX_LINE);
+  if (buf == NULL || line == NULL || !output_set_task_format(OUTPUT_JSON)) {
+    ESP_LOGE(TAG, "worker init failed");
+    free(buf);
+    free(line);
+    vTaskDelete(NULL);
+    return;
+  }
+
+  while (xQueueReceive(conn_queue, &sock, portMAX_DELAY) == pdTRUE) {
+    struct timeval timeout = {.tv_sec = CONFIG_WALLET_API_RECV_TIMEOUT_MS / 1000,
+                              .tv_usec = (CONFIG_WALLET_API_RECV_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    buf[0] = '\0';
+    handle(sock, buf, line);
+    close(sock);
+  }
+}
+
+static void api_listen(void *param) {
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET, .sin_port = htons(CONFIG_WALLET_API_PORT), .sin_addr.s_addr = htonl(INADDR_ANY)};
+  int opt = 1;
+  int server = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (server < 0) {
+    ESP_LOGE(TAG, "socket failed: %d", errno);
+    vTaskDelete(NULL);
+    return;
+  }
+  setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, CONFIG_WALLET_API_QUEUE) != 0) {
+    ESP_LOGE(TAG, "listen on port %d failed: %d", CONFIG_WALLET_API_PORT, errno);
+    close(server);
+    vTaskDelete(NULL);
+    return;
+  }
+  ESP_LOGI(TAG, "listening on port %d, %d workers", CONFIG_WALLET_API_PORT, workers);
+
+  while (1) {
+    int sock = accept(server, NULL, NULL);
+    if (sock < 0) {
+      continue;
+    }
+    // back-pressure, connections beyond the queue are turned away at once.
+    if (xQueueSend(conn_queue, &sock, 0) != pdTRUE) {
+      xSemaphoreTake(api_lock, portMAX_DELAY);
+      stats.queue_full++;
+      xSemaphoreGive(api_lock);
+      respond(sock, 503, "{\"err\":\"queue full\"}\n");
+      close(sock);
+    }
+  }
+}
+
+void wallet_api_start() {
+  api_lock = xSemaphoreCreateMutex();
+  conn_queue = xQueueCreate(CONFIG_WALLET_API_QUEUE, sizeof(int));
+  if (api_lock == NULL || conn_queue == NULL) {
+    ESP_LOGE(TAG, "create queue failed");
+    return;
+  }
+  for (int i = 0; i < CONFIG_WALLET_API_WORKERS; i++) {
+    if (xTaskCreate(api_worker, "api_worker", CONFIG_WALLET_API_TASK_STACK, NULL, API_TASK_PRIORITY, NULL) !=
+        pdPASS) {
+      ESP_LOGW(TAG, "create worker failed, %d workers", workers);
+      break;
+    }
+    workers++;
+  }
+  if (workers == 0 ||
+      xTaskCreate(api_listen, "api_listen", API_LISTEN_STACK, NULL, API_TASK_PRIORITY, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "start failed");
+  }
+}
+
+/* 'api' command */
+static int fn_api(int argc, char **argv) {
+  if (api_lock == NULL) {
+    printf("The API server is not running\n");
+    return -1;
+  }
+  printf("port %d, queue %d, ", CONFIG_WALLET_API_PORT, CONFIG_WALLET_API_QUEUE);
+  print_stats(stdout);
+  return 0;
+}
+
+void register_wallet_api() {
+  const esp_console_cmd_t api_cmd = {
+      .command = "api",
+      .help = "Show counters of the HTTP API server",
+      .hint = NULL,
+      .func = &fn_api,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&api_cmd, WALLET_CMD_CONCURRENT));
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * HTTP API for LAN clients
+ *
+ * Requests map to console commands and return their batch result as a JSON line:
+ * {"id":0,"cmd":"balance","ret":0,"us":52310,"out":"{\"t\":\"balance\",...}\n"}
+ *
+ *   GET  /v1/node_info
+ *   GET  /v1/balance?address=A,B,...
+ *   GET  /v1/account               the active account
+ *   GET  /v1/accounts              balances of all accounts
+ *   GET  /v1/addresses?start=0&end=4
+ *   GET  /v1/transactions?address=A
+ *   GET  /v1/bundle?tail=T
+ *   POST /v1/send                  {"address":"...","value":10,"tag":"...","message":"..."}
+ *   GET  /v1/stats                 counters of the server
+ *
+ * A send needs "Authorization: Bearer <CONFIG_WALLET_API_TOKEN>", it's refused with 403 while the token is empty.
+ * Connections are handed to a pool of workers, commands take the command lock like the console.
+ * Identical requests of concurrent commands in flight share one execution. A full queue, a send
+ * during PoW or a command lock which isn't free in time returns 503 with Retry-After.
+ */
+
+// Start the listener and workers, call it when the network is up.
+void wallet_api_start();
+
+// Register the `api` command
+void register_wallet_api();
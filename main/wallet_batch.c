@@ -0,0 +1,540 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "argtable3/argtable3.h"
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#ifdef CONFIG_WALLET_BATCH_SPIFFS
+#include "esp_spiffs.h"
+#endif
+
+#include "net_sched.h"
+#include "wallet_batch.h"
+#include "wallet_boot.h"
+#include "wallet_output.h"
+#include "wallet_system.h"
+
+static const char *TAG = "wallet_batch";
+
+#define BATCH_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define BATCH_END_OF_SCRIPT "."
+#define BATCH_LOCK_WAKEUPS 64 /*!< more than tasks which take the command lock */
+
+typedef struct {
+  char const *name;
+  esp_console_cmd_func_t func;
+  uint32_t flags;
+  bool running; /*!< an instance is on a worker, argtables are not reentrant */
+  bool locked;  /*!< an instance holds the command lock */
+} batch_cmd_t;
+
+typedef struct batch_job_s {
+  struct batch_job_s *next; /*!< of the script */
+  uint32_t id;              /*!< line number in the script */
+  output_format_t format;   /*!< of the console when the job was dispatched */
+  batch_cmd_t *cmd;
+  char *line; /*!< argv points into the line */
+  char **argv;
+  int argc;
+  int ret;
+  int64_t elapsed_us;
+  char *out; /*!< captured stdout and stderr */
+  size_t out_len;
+} batch_job_t;
+
+typedef struct {
+  QueueHandle_t jobs;
+  QueueHandle_t done;
+  int in_flight;
+  uint32_t count;
+  uint32_t failed;
+} batch_ctx_t;
+
+static batch_cmd_t *cmd_table = NULL;
+static size_t cmd_count = 0;
+
+// the command lock, shared by concurrent commands
+static SemaphoreHandle_t lock_mutex = NULL;
+static int lock_readers = 0;
+static bool lock_writer = false;
+static int lock_writers_waiting = 0; /*!< concurrent commands wait for them */
+static SemaphoreHandle_t lock_changed = NULL; /*!< given once per sleeper when the lock gets free */
+static int lock_sleepers = 0;
+
+static batch_cmd_t *cmd_find(char const *name) {
+  for (size_t i = 0; i < cmd_count; i++) {
+    if (strcmp(cmd_table[i].name, name) == 0) {
+      return &cmd_table[i];
+    }
+  }
+  return NULL;
+}
+
+esp_err_t wallet_batch_cmd_register(esp_console_cmd_t const *cmd, uint32_t flags) {
+  if (lock_mutex == NULL && (lock_mutex = xSemaphoreCreateMutex()) == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  if (lock_changed == NULL && (lock_changed = xSemaphoreCreateCounting(BATCH_LOCK_WAKEUPS, 0)) == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  batch_cmd_t *table = realloc(cmd_table, (cmd_count + 1) * sizeof(batch_cmd_t));
+  if (table == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  cmd_table = table;
+  cmd_table[cmd_count] = (batch_cmd_t){.name = cmd->command, .func = cmd->func, .flags = flags};
+  cmd_count++;
+  return esp_console_cmd_register(cmd);
+}
+
+uint32_t wallet_batch_cmd_flags(char const *name) {
+  batch_cmd_t *cmd = cmd_find(name);
+  return cmd ? cmd->flags : 0;
+}
+
+// Wake the sleepers of cmd_lock to check the lock again, called with lock_mutex. A sleeper which timed out
+// leaves its wakeup behind, the next one wakes up once for nothing.
+static void lock_wake() {
+  for (int i = 0; i < lock_sleepers; i++) {
+    xSemaphoreGive(lock_changed);
+  }
+}
+
+// A waiting exclusive command keeps new concurrent commands out, so it isn't starved.
+static bool cmd_lock(batch_cmd_t *cmd, uint32_t wait_ms) {
+  bool exclusive = !(cmd->flags & WALLET_CMD_CONCURRENT);
+  bool waiting = false, ok = false;
+  int64_t deadline = esp_timer_get_time() + (int64_t)wait_ms * 1000;
+
+  xSemaphoreTake(lock_mutex, portMAX_DELAY);
+  for (;;) {
+    ok = !cmd->locked && !lock_writer && (exclusive ? lock_readers == 0 : lock_writers_waiting == 0);
+    if (ok) {
+      cmd->locked = true;
+      if (exclusive) {
+        lock_writer = true;
+      } else {
+        lock_readers++;
+      }
+      break;
+    }
+
+    TickType_t ticks = portMAX_DELAY;
+    if (wait_ms != UINT32_MAX) {
+      int64_t left_ms = (deadline - esp_timer_get_time()) / 1000;
+      if (left_ms <= 0) {
+        break;
+      }
+      ticks = pdMS_TO_TICKS(left_ms) + 1;
+    }
+    if (exclusive && !waiting) {
+      lock_writers_waiting++;
+      waiting = true;
+    }
+    lock_sleepers++;
+    xSemaphoreGive(lock_mutex);
+    xSemaphoreTake(lock_changed, ticks);
+    xSemaphoreTake(lock_mutex, portMAX_DELAY);
+    lock_sleepers--;
+  }
+
+  if (waiting) {
+    lock_writers_waiting--;
+    // concurrent commands held back by a writer which gave up
+    if (!ok) {
+      lock_wake();
+    }
+  }
+  xSemaphoreGive(lock_mutex);
+  return ok;
+}
+
+static void cmd_unlock(batch_cmd_t *cmd) {
+  xSemaphoreTake(lock_mutex, portMAX_DELAY);
+  cmd->locked = false;
+  if (cmd->flags & WALLET_CMD_CONCURRENT) {
+    lock_readers--;
+  } else {
+    lock_writer = false;
+  }
+  lock_wake();
+  xSemaphoreGive(lock_mutex);
+}
+
+void wallet_batch_cmd_lock(char const *name) {
+  batch_cmd_t *cmd = cmd_find(name);
+  if (cmd) {
+    cmd_lock(cmd, UINT32_MAX);
+  }
+}
+
+void wallet_batch_cmd_unlock(char const *name) {
+  batch_cmd_t *cmd = cmd_find(name);
+  if (cmd) {
+    cmd_unlock(cmd);
+  }
+}
+
+static void print_json_string(FILE *f, char const *str, size_t len) {
+  fputc('"', f);
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = str[i];
+    switch (c) {
+      case '"':
+      case '\\':
+        fputc('\\', f);
+        fputc(c, f);
+        break;
+      case '\n':
+        fputs("\\n", f);
+        break;
+      case '\r':
+        fputs("\\r", f);
+        break;
+      case '\t':
+        fputs("\\t", f);
+        break;
+      default:
+        if (c < 0x20) {
+          fprintf(f, "\\u%04x", c);
+        } else {
+          fputc(c, f);
+        }
+    }
+  }
+  fputc('"', f);
+}
+
+static void print_result(FILE *f, batch_job_t const *job, char const *error) {
+  fprintf(f, "{\"id\":%u,\"cmd\":", job->id);
+  print_json_string(f, job->argv[0], strlen(job->argv[0]));
+  fprintf(f, ",\"ret\":%d,\"us\":%" PRId64, job->ret, job->elapsed_us);
+  if (error) {
+    fprintf(f, ",\"err\":\"%s\"", error);
+  }
+  fprintf(f, ",\"out\":");
+  print_json_string(f, job->out ? job->out : "", job->out_len);
+  fprintf(f, "}\n");
+  fflush(f);
+}
+
+static void job_free(batch_job_t *job) {
+  if (job) {
+    free(job->out);
+    free(job->argv);
+    free(job->line);
+    free(job);
+  }
+}
+
+static batch_job_t *job_new(uint32_t id, char const *line) {
+  batch_job_t *job = calloc(1, sizeof(batch_job_t));
+  if (job == NULL) {
+    return NULL;
+  }
+  job->id = id;
+  job->line = strdup(line);
+  job->argv = calloc(CONFIG_WALLET_BATCH_MAX_ARGS, sizeof(char *));
+  if (job->line == NULL || job->argv == NULL) {
+    job_free(job);
+    return NULL;
+  }
+  job->argc = esp_console_split_argv(job->line, job->argv, CONFIG_WALLET_BATCH_MAX_ARGS);
+  return job;
+}
+
+// stdout and stderr are per task in newlib, the output of the command goes to the job.
+// Returns false if the command lock isn't free within wait_ms.
+static bool job_run(batch_job_t *job, uint32_t wait_ms) {
+  if (!cmd_lock(job->cmd, wait_ms)) {
+    return false;
+  }
+  FILE *out = open_memstream(&job->out, &job->out_len);
+  FILE *saved_out = stdout;
+  FILE *saved_err = stderr;
+  if (out) {
+    stdout = out;
+    stderr = out;
+  }
+
+  bool network = job->cmd->flags & WALLET_CMD_NETWORK;
+  net_sched_cmd_t sched;
+  net_sched_cmd_begin(&sched);
+  if (network && !boot_wait_network()) {
+    job->ret = ESP_ERR_TIMEOUT;
+  } else if (network) {
+    wallet_client_acquire();
+    job->ret = job->cmd->func(job->argc, job->argv);
+    wallet_client_release();
+  } else {
+    job->ret = job->cmd->func(job->argc, job->argv);
+  }
+  net_sched_cmd_end(job->argv[0], &sched);
+  job->elapsed_us = esp_timer_get_time() - sched.start_us;
+
+  if (out) {
+    stdout = saved_out;
+    stderr = saved_err;
+    fclose(out);
+  }
+  cmd_unlock(job->cmd);
+  return true;
+}
+
+static void batch_worker(void *param) {
+  batch_ctx_t *ctx = (batch_ctx_t *)param;
+  batch_job_t *job = NULL;
+  while (xQueueReceive(ctx->jobs, &job, portMAX_DELAY) == pdTRUE && job != NULL) {
+    // the format is per task, a `format` of the console doesn't change it under a running job
+    output_set_task_format(job->format);
+    job_run(job, UINT32_MAX);
+    xQueueSend(ctx->done, &job, portMAX_DELAY);
+  }
+  output_clear_task_format();
+  // NULL tells the batch the worker is gone
+  job = NULL;
+  xQueueSend(ctx->done, &job, portMAX_DELAY);
+  vTaskDelete(NULL);
+}
+
+static void wait_one(batch_ctx_t *ctx) {
+  batch_job_t *job = NULL;
+  xQueueReceive(ctx->done, &job, portMAX_DELAY);
+  job->cmd->running = false;
+  ctx->in_flight--;
+  ctx->failed += job->ret != 0;
+  print_result(stdout, job, NULL);
+  job_free(job);
+}
+
+static void dispatch(batch_ctx_t *ctx, batch_job_t *job, int workers) {
+  if (job->argc == 0) {
+    job_free(job);
+    return;
+  }
+  ctx->count++;
+
+  if ((job->cmd = cmd_find(job->argv[0])) == NULL) {
+    job->ret = -1;
+    ctx->failed++;
+    print_result(stdout, job, "unknown command");
+    job_free(job);
+    return;
+  }
+
+  if ((job->cmd->flags & WALLET_CMD_CONCURRENT) && workers > 0) {
+    while (ctx->in_flight >= workers || job->cmd->running) {
+      wait_one(ctx);
+    }
+    job->cmd->running = true;
+    job->format = output_format();
+    ctx->in_flight++;
+    xQueueSend(ctx->jobs, &job, portMAX_DELAY);
+    return;
+  }
+
+  // serialized, nothing else runs while the command changes the wallet state.
+  while (ctx->in_flight > 0) {
+    wait_one(ctx);
+  }
+  job_run(job, UINT32_MAX);
+  ctx->failed += job->ret != 0;
+  print_result(stdout, job, NULL);
+  job_free(job);
+}
+
+char *wallet_batch_run_line(char const *line, uint32_t wait_ms, int *ret) {
+  char *result = NULL;
+  size_t result_len = 0;
+  batch_job_t *job = job_new(0, line);
+  FILE *f = open_memstream(&result, &result_len);
+  if (job == NULL || f == NULL) {
+    if (f) {
+      fclose(f);
+    }
+    free(result);
+    job_free(job);
+    return NULL;
+  }
+
+  if (job->argc == 0 || (job->cmd = cmd_find(job->argv[0])) == NULL) {
+    job->ret = ESP_ERR_NOT_FOUND;
+    job->argv[0] = job->argc ? job->argv[0] : "";
+    print_result(f, job, "unknown command");
+  } else if (!job_run(job, wait_ms)) {
+    job->ret = ESP_ERR_INVALID_STATE;
+    print_result(f, job, "busy");
+  } else {
+    print_result(f, job, NULL);
+  }
+  *ret = job->ret;
+  fclose(f);
+  job_free(job);
+  return result;
+}
+
+static int start_workers(batch_ctx_t *ctx) {
+  int workers = 0;
+  ctx->jobs = xQueueCreate(CONFIG_WALLET_BATCH_WORKERS, sizeof(batch_job_t *));
+  ctx->done = xQueueCreate(CONFIG_WALLET_BATCH_WORKERS + 1, sizeof(batch_job_t *));
+  if (ctx->jobs == NULL || ctx->done == NULL) {
+    ESP_LOGW(TAG, "create queues failed, commands run one at a time");
+    return 0;
+  }
+  for (int i = 0; i < CONFIG_WALLET_BATCH_WORKERS; i++) {
+    if (xTaskCreate(batch_worker, "batch_worker", CONFIG_WALLET_BATCH_TASK_STACK, ctx, BATCH_TASK_PRIORITY, NULL) !=
+        pdPASS) {
+      ESP_LOGW(TAG, "create worker failed, %d workers", workers);
+      break;
+    }
+    workers++;
+  }
+  return workers;
+}
+
+static void stop_workers(batch_ctx_t *ctx, int workers) {
+  batch_job_t *job = NULL;
+  for (int i = 0; i < workers; i++) {
+    xQueueSend(ctx->jobs, &job, portMAX_DELAY);
+  }
+  while (workers > 0) {
+    xQueueReceive(ctx->done, &job, portMAX_DELAY);
+    if (job == NULL) {
+      workers--;
+    }
+  }
+  if (ctx->jobs) {
+    vQueueDelete(ctx->jobs);
+  }
+  if (ctx->done) {
+    vQueueDelete(ctx->done);
+  }
+}
+
+static void run_script(FILE *script) {
+  batch_ctx_t ctx = {};
+  batch_job_t *jobs = NULL, **jobs_tail = &jobs;
+  char *line = NULL;
+  size_t line_cap = 0;
+  ssize_t len = 0;
+  uint32_t line_no = 0;
+  int64_t start = esp_timer_get_time();
+  int workers = start_workers(&ctx);
+
+  // heap figures let a host script tell the peak use of a script, min_free is the low-water mark since boot
+  printf("{\"batch\":\"start\",\"workers\":%d,\"free\":%u,\"min_free\":%u}\n", workers, esp_get_free_heap_size(),
+         esp_get_minimum_free_heap_size());
+  // the whole script is read before commands run, the UART RX buffer would overflow while they block the console.
+  while ((len = getline(&line, &line_cap, script)) >= 0) {
+    line_no++;
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+      line[--len] = '\0';
+    }
+    if (strcmp(line, BATCH_END_OF_SCRIPT) == 0) {
+      break;
+    }
+    if (len == 0 || line[0] == '#') {
+      continue;
+    }
+    if (len > CONFIG_WALLET_BATCH_MAX_LINE) {
+      printf("{\"id\":%u,\"ret\":-1,\"err\":\"line too long\"}\n", line_no);
+      ctx.failed++;
+      continue;
+    }
+
+    batch_job_t *job = job_new(line_no, line);
+    if (job == NULL) {
+      printf("{\"id\":%u,\"ret\":-1,\"err\":\"out of memory\"}\n", line_no);
+      ctx.failed++;
+      continue;
+    }
+    *jobs_tail = job;
+    jobs_tail = &job->next;
+  }
+  free(line);
+
+  while (jobs) {
+    batch_job_t *job = jobs;
+    jobs = job->next;
+    dispatch(&ctx, job, workers);
+  }
+  while (ctx.in_flight > 0) {
+    wait_one(&ctx);
+  }
+  stop_workers(&ctx, workers);
+  printf("{\"batch\":\"end\",\"count\":%u,\"failed\":%u,\"us\":%" PRId64 ",\"free\":%u,\"min_free\":%u}\n",
+         ctx.count, ctx.failed, esp_timer_get_time() - start, esp_get_free_heap_size(),
+         esp_get_minimum_free_heap_size());
+}
+
+#ifdef CONFIG_WALLET_BATCH_SPIFFS
+static bool mount_spiffs() {
+  static bool mounted = false;
+  if (!mounted) {
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = "/spiffs", .partition_label = NULL, .max_files = 2, .format_if_mount_failed = false};
+    esp_err_t err = esp_vfs_spiffs_register(&conf);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "mount SPIFFS failed: %s", esp_err_to_name(err));
+      return false;
+    }
+    mounted = true;
+  }
+  return true;
+}
+#endif
+
+/* 'batch' command */
+static struct {
+  struct arg_str *file;
+  struct arg_end *end;
+} batch_args;
+
+static int fn_batch(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&batch_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, batch_args.end, argv[0]);
+    return -1;
+  }
+
+  if (batch_args.file->count == 0) {
+    run_script(stdin);
+    return 0;
+  }
+
+#ifdef CONFIG_WALLET_BATCH_SPIFFS
+  if (!mount_spiffs()) {
+    return -1;
+  }
+#endif
+  FILE *script = fopen(batch_args.file->sval[0], "r");
+  if (script == NULL) {
+    printf("open %s failed\n", batch_args.file->sval[0]);
+    return -1;
+  }
+  run_script(script);
+  fclose(script);
+  return 0;
+}
+
+void register_batch() {
+  batch_args.file = arg_str0("f", "file", "<path>", "script file, e.g. /spiffs/script.txt");
+  batch_args.end = arg_end(2);
+  const esp_console_cmd_t batch_cmd = {
+      .command = "batch",
+      .help = "Run a script of commands and print results as JSON lines, a line of '.' ends the script",
+      .hint = " [-f <path>]",
+      .func = &fn_batch,
+      .argtable = &batch_args,
+  };
+  ESP_ERROR_CHECK(esp_console_cmd_register(&batch_cmd));
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_console.h"
+
+/*
+ * Batch mode runs a script of commands and prints a JSON line for each of them:
+ * {"id":1,"cmd":"balance","ret":0,"us":52310,"out":"..."}
+ *
+ * Concurrent commands run on worker tasks with their output captured, other commands wait for
+ * in-flight commands and run one at a time. A script comes from the console and ends with a
+ * line of ".", or from a file with `batch -f <path>`.
+ */
+
+#define WALLET_CMD_CONCURRENT (1 << 0) /*!< doesn't change the wallet state, runs on batch workers */
+#define WALLET_CMD_NETWORK (1 << 1)    /*!< talks to the node, the radio is kept awake while it runs */
+#define WALLET_CMD_SECRET (1 << 2)     /*!< arguments carry a seed or passphrase, kept out of the console history */
+
+// Register a console command with WALLET_CMD_* flags and record it for batch mode
+esp_err_t wallet_batch_cmd_register(esp_console_cmd_t const *cmd, uint32_t flags);
+// Flags of a registered command, 0 if it's unknown
+uint32_t wallet_batch_cmd_flags(char const *name);
+
+// The command lock, concurrent commands share it and other commands hold it alone. An instance of a
+// command runs at a time since argtables are not reentrant. Commands of the console, batch scripts and
+// the API server take it, unknown commands don't.
+void wallet_batch_cmd_lock(char const *name);
+void wallet_batch_cmd_unlock(char const *name);
+
+// Run a command line like a batch job, returns its JSON line or NULL if it's out of memory, the caller
+// frees it. ret is the return value of the command, ESP_ERR_NOT_FOUND for unknown commands and
+// ESP_ERR_INVALID_STATE if the command lock isn't free within wait_ms, UINT32_MAX waits forever.
+char *wallet_batch_run_line(char const *line, uint32_t wait_ms, int *ret);
+
+// Register the `batch` command
+void register_batch();
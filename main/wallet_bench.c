@@ -0,0 +1,383 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "argtable3/argtable3.h"
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "soc/soc_memory_layout.h"
+#include "xtensa/hal.h"
+
+#include "common/crypto/curl-p/curl_p.h"
+#include "common/crypto/kerl/kerl.h"
+#include "common/defs.h"
+#include "common/helpers/sign.h"
+#include "crypto_backend.h"
+#include "hash_set.h"
+#include "seed_vault.h"
+#include "tx_view.h"
+#include "wallet_batch.h"
+#include "wallet_bench.h"
+#include "wallet_binproto.h"
+#include "wallet_http.h"
+#include "wallet_system.h"
+
+static const char *TAG = "wallet_bench";
+
+#define BENCH_SHA_BLOCK 1024
+
+static struct {
+  struct arg_str *target;
+  struct arg_int *count;
+  struct arg_end *end;
+} bench_args;
+
+static void bench_rng(int count) {
+  tryte_t seed[NUM_TRYTES_HASH];
+  tryte_t const legacy_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ9";
+
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < count; i++) {
+    crypto_random_trytes(seed, NUM_TRYTES_HASH);
+  }
+  int64_t hw_us = esp_timer_get_time() - start;
+
+  // the previous `gen_hash` implementation
+  start = esp_timer_get_time();
+  for (int i = 0; i < count; i++) {
+    srand(esp_timer_get_time());
+    for (int j = 0; j < NUM_TRYTES_HASH; j++) {
+      seed[j] = legacy_chars[rand() % 27];
+    }
+  }
+  int64_t sw_us = esp_timer_get_time() - start;
+
+  printf("seeds: %d\n", count);
+  printf("hardware RNG: %" PRId64 " us/seed\n", hw_us / count);
+  printf("rand(): %" PRId64 " us/seed\n", sw_us / count);
+}
+
+static void bench_sha(int count) {
+  uint8_t digest[CRYPTO_SHA256_LEN];
+  uint8_t *block = malloc(BENCH_SHA_BLOCK);
+  if (block == NULL) {
+    ESP_LOGE(TAG, "Error: OOM");
+    return;
+  }
+  crypto_random_bytes(block, BENCH_SHA_BLOCK);
+
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < count; i++) {
+    crypto_sha256(block, BENCH_SHA_BLOCK, digest);
+  }
+  int64_t elapsed_us = esp_timer_get_time() - start;
+  free(block);
+
+#ifdef CONFIG_MBEDTLS_HARDWARE_SHA
+  printf("SHA-256 (hardware): ");
+#else
+  printf("SHA-256 (software): ");
+#endif
+  printf("%d x %d bytes in %" PRId64 " us, %" PRId64 " KB/s\n", count, BENCH_SHA_BLOCK, elapsed_us,
+         elapsed_us ? ((int64_t)count * BENCH_SHA_BLOCK * 1000000 / 1024) / elapsed_us : 0);
+}
+
+typedef struct {
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;
+} bench_cycles_t;
+
+static void cycles_add(bench_cycles_t *c, uint32_t start) {
+  uint32_t cycles = xthal_get_ccount() - start;
+  c->min = c->min && c->min < cycles ? c->min : cycles;
+  c->max = c->max > cycles ? c->max : cycles;
+  c->total += cycles;
+}
+
+static void cycles_print(char const *name, bench_cycles_t const *c, int count, void const *fn) {
+  printf("%s: %d runs, %" PRIu64 " cycles/run(min %u, max %u), %s\n", name, count, c->total / count, c->min, c->max,
+         esp_ptr_in_iram(fn) ? "IRAM" : "flash");
+}
+
+// one Curl-P-81 transform per 243 trits absorbed
+static void bench_curl(int count) {
+  trit_t trits[NUM_TRITS_HASH];
+  bench_cycles_t cycles = {};
+  Curl curl;
+  curl.type = CURL_P_81;
+  init_curl(&curl);
+  memset(trits, 1, sizeof(trits));
+
+  for (int i = 0; i < count; i++) {
+    uint32_t start = xthal_get_ccount();
+    curl_absorb(&curl, trits, NUM_TRITS_HASH);
+    cycles_add(&cycles, start);
+  }
+  cycles_print("curl transform", &cycles, count, curl_absorb);
+}
+
+// one Keccak-f[1600] permutation and the trit-byte conversions per 243 trits hashed
+static void bench_kerl(int count) {
+  trit_t trits[NUM_TRITS_HASH];
+  bench_cycles_t cycles = {};
+  Kerl kerl;
+  kerl_init(&kerl);
+  memset(trits, 1, sizeof(trits));
+  trits[NUM_TRITS_HASH - 1] = 0;
+
+  for (int i = 0; i < count; i++) {
+    uint32_t start = xthal_get_ccount();
+    kerl_absorb(&kerl, trits, NUM_TRITS_HASH);
+    kerl_squeeze(&kerl, trits, NUM_TRITS_HASH);
+    cycles_add(&cycles, start);
+    kerl_reset(&kerl);
+  }
+  cycles_print("kerl hash", &cycles, count, kerl_absorb);
+}
+
+static void bench_addr(int count) {
+  flex_trit_t seed[FLEX_TRIT_SIZE_243];
+  tryte_t seed_trytes[NUM_TRYTES_HASH];
+  bench_cycles_t cycles = {};
+  crypto_random_trytes(seed_trytes, NUM_TRYTES_HASH);
+  flex_trits_from_trytes(seed, NUM_TRITS_HASH, seed_trytes, NUM_TRYTES_HASH, NUM_TRYTES_HASH);
+
+  for (int i = 0; i < count; i++) {
+    uint32_t start = xthal_get_ccount();
+    flex_trit_t *addr = iota_sign_address_gen_flex_trits(seed, i, 2);
+    cycles_add(&cycles, start);
+    if (addr == NULL) {
+      ESP_LOGE(TAG, "Error: OOM");
+      return;
+    }
+    free(addr);
+  }
+  cycles_print("address security 2", &cycles, count, kerl_absorb);
+}
+
+// fields read by bundle checks, from a full transaction object and from a lazy view
+static void bench_txview(int count) {
+  bench_cycles_t full_cycles = {}, view_cycles = {};
+  volatile uint64_t sink = 0;
+  tryte_t *trytes = malloc(NUM_TRYTES_SERIALIZED_TRANSACTION);
+  flex_trit_t *trits = malloc(FLEX_TRIT_SIZE_8019);
+  iota_transaction_t *tx = malloc(sizeof(iota_transaction_t));
+  tx_view_t *view = malloc(sizeof(tx_view_t));
+  if (trytes == NULL || trits == NULL || tx == NULL || view == NULL) {
+    ESP_LOGE(TAG, "Error: OOM");
+    goto done;
+  }
+  crypto_random_trytes(trytes, NUM_TRYTES_SERIALIZED_TRANSACTION);
+  // value, timestamp and indices in range
+  memset(trytes + NUM_TRYTES_SIGNATURE + NUM_TRYTES_ADDRESS, '9', NUM_TRYTES_VALUE + NUM_TRYTES_OBSOLETE_TAG +
+         NUM_TRYTES_TIMESTAMP + NUM_TRYTES_CURRENT_INDEX + NUM_TRYTES_LAST_INDEX);
+  flex_trits_from_trytes(trits, NUM_TRITS_SERIALIZED_TRANSACTION, trytes, NUM_TRYTES_SERIALIZED_TRANSACTION,
+                         NUM_TRYTES_SERIALIZED_TRANSACTION);
+
+  for (int i = 0; i < count; i++) {
+    uint32_t start = xthal_get_ccount();
+    transaction_reset(tx);
+    transaction_deserialize_from_trits(tx, trits, false);
+    sink += transaction_value(tx) + transaction_current_index(tx) + transaction_last_index(tx) +
+            transaction_address(tx)[0] + transaction_bundle(tx)[0] + transaction_trunk(tx)[0];
+    cycles_add(&full_cycles, start);
+
+    start = xthal_get_ccount();
+    tx_view_init(view, trits);
+    sink += tx_view_value(view) + tx_view_current_index(view) + tx_view_last_index(view) + tx_view_address(view)[0] +
+            tx_view_bundle(view)[0] + tx_view_trunk(view)[0];
+    cycles_add(&view_cycles, start);
+  }
+  cycles_print("transaction object", &full_cycles, count, transaction_deserialize_from_trits);
+  cycles_print("transaction view", &view_cycles, count, tx_view_value);
+  printf("object %u bytes, view %u bytes\n", sizeof(iota_transaction_t), sizeof(tx_view_t));
+
+done:
+  free(trytes);
+  free(trits);
+  free(tx);
+  free(view);
+}
+
+static void bench_kdf(int count) {
+  uint32_t const iterations[] = {1000, 2000, 5000, 10000, 20000};
+  for (size_t i = 0; i < sizeof(iterations) / sizeof(iterations[0]); i++) {
+    int64_t total_us = 0;
+    for (int j = 0; j < count; j++) {
+      total_us += seed_vault_kdf_time_us(iterations[i]);
+    }
+    printf("PBKDF2-SHA256 %5u iterations: %" PRId64 " ms/unlock\n", iterations[i], total_us / count / 1000);
+  }
+}
+
+// findTransactions by the null address, the mock node or the gateway decides the response size.
+static int64_t bench_find_transactions(int count, size_t *hashes) {
+  flex_trit_t address[FLEX_TRIT_SIZE_243];
+  memset(address, FLEX_TRIT_NULL_VALUE, sizeof(address));
+  int64_t elapsed = 0;
+  *hashes = 0;
+
+  for (int i = 0; i < count; i++) {
+    find_transactions_req_t *req = find_transactions_req_new();
+    find_transactions_res_t *res = find_transactions_res_new();
+    if (req && res && hash243_queue_push(&req->addresses, address) == RC_OK) {
+      iota_client_service_t *serv = wallet_client_acquire();
+      int64_t start = esp_timer_get_time();
+      if (wallet_http_find_transactions(serv, req, res) == RC_OK) {
+        elapsed += esp_timer_get_time() - start;
+        *hashes += hash243_queue_count(res->hashes);
+      }
+      wallet_client_release();
+    }
+    find_transactions_req_free(&req);
+    find_transactions_res_free(&res);
+  }
+  return elapsed;
+}
+
+static void bench_proto(int count) {
+  wallet_http_stats_t http_stats;
+  binproto_stats_t bin_stats;
+  size_t hashes = 0;
+  bool bin_enabled = binproto_is_enabled();
+
+  binproto_enable(false);
+  wallet_http_stats_reset();
+  int64_t json_us = bench_find_transactions(count, &hashes);
+  wallet_http_stats(&http_stats);
+  printf("json: %d requests, %zu hashes, %" PRId64 " ms, %" PRIu64 " bytes received\n", count, hashes,
+         json_us / 1000, http_stats.wire_bytes);
+
+  binproto_enable(true);
+  binproto_stats_reset();
+  int64_t bin_us = bench_find_transactions(count, &hashes);
+  binproto_stats(&bin_stats);
+  printf("bin: %d requests, %zu hashes, %" PRId64 " ms, %" PRIu64 " bytes received, %" PRIu64 " bytes sent\n", count,
+         hashes, bin_us / 1000, bin_stats.rx_bytes, bin_stats.tx_bytes);
+
+  binproto_enable(bin_enabled);
+}
+
+// random hashes from an index, the same as tools/hash_set_bench.c
+static void bench_hash(uint32_t index, flex_trit_t *hash) {
+  uint32_t x = index * 2654435761u + 1;
+  for (size_t i = 0; i < FLEX_TRIT_SIZE_243; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    hash[i] = (flex_trit_t)(x % 27) - 13;
+  }
+}
+
+static void bench_hashset_layout(hash_set_layout_t layout, uint32_t count) {
+  flex_trit_t hash[FLEX_TRIT_SIZE_243];
+  hash_set_t set;
+  size_t found = 0;
+  volatile flex_trit_t sink = 0;
+  size_t free_before = esp_get_free_heap_size();
+  hash_set_init_layout(&set, layout);
+
+  // generating hashes is timed alone and taken off the other passes
+  int64_t start = esp_timer_get_time();
+  for (uint32_t i = 0; i < count; i++) {
+    bench_hash(i, hash);
+    sink += hash[0];
+  }
+  int64_t gen_us = esp_timer_get_time() - start;
+
+  start = esp_timer_get_time();
+  for (uint32_t i = 0; i < count; i++) {
+    bench_hash(i, hash);
+    if (hash_set_add(&set, hash, NULL) != RC_OK) {
+      printf("%s: out of memory after %zu hashes\n", hash_set_layout_name(layout), hash_set_count(&set));
+      hash_set_free(&set);
+      return;
+    }
+  }
+  int64_t insert_us = esp_timer_get_time() - start - gen_us;
+  size_t heap_used = free_before - esp_get_free_heap_size();
+
+  start = esp_timer_get_time();
+  for (uint32_t i = 0; i < count; i++) {
+    bench_hash(i, hash);
+    found += hash_set_contains(&set, hash);
+  }
+  int64_t hit_us = esp_timer_get_time() - start - gen_us;
+
+  start = esp_timer_get_time();
+  for (uint32_t i = count; i < 2 * count; i++) {
+    bench_hash(i, hash);
+    found += hash_set_contains(&set, hash);
+  }
+  int64_t miss_us = esp_timer_get_time() - start - gen_us;
+
+  printf("%-16s %u hashes: insert %" PRId64 " ns, hit %" PRId64 " ns, miss %" PRId64 " ns, %zu bytes, %zu of heap "
+         "(%zu of %u found)\n",
+         hash_set_layout_name(layout), count, insert_us * 1000 / count, hit_us * 1000 / count,
+         miss_us * 1000 / count, hash_set_bytes(&set), heap_used, found, count);
+  hash_set_free(&set);
+}
+
+static void bench_hashset(int count) {
+  bench_hashset_layout(HASH_SET_UTHASH, count);
+  bench_hashset_layout(HASH_SET_OPEN, count);
+}
+
+static int fn_bench(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&bench_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, bench_args.end, argv[0]);
+    return -1;
+  }
+
+  char const *target = bench_args.target->sval[0];
+  int count = bench_args.count->count ? bench_args.count->ival[0] : 100;
+  if (count <= 0) {
+    printf("Invalid count %d\n", count);
+    return -1;
+  }
+
+  if (strcmp(target, "rng") == 0) {
+    bench_rng(count);
+  } else if (strcmp(target, "sha") == 0) {
+    bench_sha(count);
+  } else if (strcmp(target, "proto") == 0) {
+    bench_proto(bench_args.count->count ? count : 10);
+  } else if (strcmp(target, "curl") == 0) {
+    bench_curl(count);
+  } else if (strcmp(target, "kerl") == 0) {
+    bench_kerl(count);
+  } else if (strcmp(target, "addr") == 0) {
+    bench_addr(bench_args.count->count ? count : 5);
+  } else if (strcmp(target, "txview") == 0) {
+    bench_txview(count);
+  } else if (strcmp(target, "hashset") == 0) {
+    // about 65 KB for uthash with 3 trits per byte, it fits in internal RAM
+    bench_hashset(bench_args.count->count ? count : 500);
+  } else if (strcmp(target, "kdf") == 0) {
+    bench_kdf(bench_args.count->count ? count : 1);
+  } else {
+    printf("Unknown target: %s\n", target);
+    return -1;
+  }
+  return 0;
+}
+
+void register_bench() {
+  bench_args.target = arg_str1(NULL, NULL, "<target>", "rng|sha|kdf|proto|curl|kerl|addr|txview|hashset");
+  bench_args.count = arg_int0("n", "count", "<count>", "number of iterations, default 100");
+  bench_args.end = arg_end(4);
+  const esp_console_cmd_t bench_cmd = {
+      .command = "bench",
+      .help = "Run a microbenchmark",
+      .hint = " <rng|sha|kdf|proto|curl|kerl|addr|txview|hashset> [-n count]",
+      .func = &fn_bench,
+      .argtable = &bench_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&bench_cmd, WALLET_CMD_NETWORK));
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// Register the `bench` command for on-device microbenchmarks
+void register_bench();
@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+
+#include "common/model/transaction.h"
+#include "common/trinary/flex_trit.h"
+#include "common/trinary/trit_byte.h"
+#include "net_sched.h"
+#include "wallet_binproto.h"
+#include "wallet_mem.h"
+
+static const char *TAG = "binproto";
+
+#define BINPROTO_HEADER_LEN 10
+#define BINPROTO_MAX_PAYLOAD (256 * 1024)
+#define TRITS_PER_BYTE 5
+#define PACKED_LEN(trits) (((trits) + TRITS_PER_BYTE - 1) / TRITS_PER_BYTE)
+#define PACKED_HASH_LEN PACKED_LEN(NUM_TRITS_HASH)
+#define PACKED_TX_LEN PACKED_LEN(NUM_TRITS_SERIALIZED_TRANSACTION)
+
+static int gw_sock = -1;
+#ifdef CONFIG_WALLET_BINPROTO_DEFAULT
+static bool binproto_enabled = true;
+#else
+static bool binproto_enabled = false;
+#endif
+static binproto_stats_t gw_stats;
+static SemaphoreHandle_t gw_lock = NULL;
+static trit_t trits_buf[NUM_TRITS_SERIALIZED_TRANSACTION]; /*!< protected by gw_lock */
+
+static void put_u16(uint8_t *p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v & 0xFF;
+}
+
+static uint16_t get_u16(uint8_t const *p) { return (p[0] << 8) | p[1]; }
+
+static void put_u32(uint8_t *p, uint32_t v) {
+  put_u16(p, v >> 16);
+  put_u16(p + 2, v & 0xFFFF);
+}
+
+static uint32_t get_u32(uint8_t const *p) { return ((uint32_t)get_u16(p) << 16) | get_u16(p + 2); }
+
+static uint64_t get_u64(uint8_t const *p) { return ((uint64_t)get_u32(p) << 32) | get_u32(p + 4); }
+
+static void gw_close() {
+  if (gw_sock >= 0) {
+    close(gw_sock);
+    gw_sock = -1;
+  }
+}
+
+static int gw_connect() {
+  struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+  struct addrinfo *res = NULL;
+  char port[8];
+
+  snprintf(port, sizeof(port), "%d", CONFIG_WALLET_BINPROTO_GATEWAY_PORT);
+  if (getaddrinfo(CONFIG_WALLET_BINPROTO_GATEWAY_HOST, port, &hints, &res) != 0 || res == NULL) {
+    ESP_LOGE(TAG, "DNS lookup failed: %s", CONFIG_WALLET_BINPROTO_GATEWAY_HOST);
+    return -1;
+  }
+
+  int sock = socket(res->ai_family, res->ai_socktype, 0);
+  if (sock >= 0) {
+    struct timeval timeout = {.tv_sec = CONFIG_WALLET_HTTP_TIMEOUT_MS / 1000, .tv_usec = 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(sock, res->ai_addr, res->ai_addrlen) != 0) {
+      ESP_LOGE(TAG, "connect to gateway failed: %d", errno);
+      close(sock);
+      sock = -1;
+    }
+  }
+  freeaddrinfo(res);
+  return sock;
+}
+
+static bool send_all(uint8_t const *data, size_t len) {
+  while (len > 0) {
+    int n = send(gw_sock, data, len, 0);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= n;
+    gw_stats.tx_bytes += n;
+  }
+  return true;
+}
+
+static bool recv_all(uint8_t *data, size_t len) {
+  while (len > 0) {
+    int n = recv(gw_sock, data, len, 0);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= n;
+    gw_stats.rx_bytes += n;
+  }
+  return true;
+}
+
+// send a request frame and receive the response payload, must be called with gw_lock.
+static retcode_t gw_call(binproto_cmd_t cmd, uint8_t const *payload, size_t len, uint8_t **res_payload,
+                         size_t *res_len) {
+  uint8_t header[BINPROTO_HEADER_LEN] = {'I', 'B', BINPROTO_VERSION, cmd, 0, 0};
+  int64_t start = esp_timer_get_time();
+  *res_payload = NULL;
+
+  if (gw_sock < 0 && (gw_sock = gw_connect()) < 0) {
+    return RC_ERROR;
+  }
+
+  put_u32(header + 6, len);
+  if (!send_all(header, sizeof(header)) || !send_all(payload, len) || !recv_all(header, sizeof(header))) {
+    ESP_LOGE(TAG, "gateway I/O failed");
+    goto io_err;
+  }
+  if (header[0] != 'I' || header[1] != 'B' || header[2] != BINPROTO_VERSION || header[3] != cmd) {
+    ESP_LOGE(TAG, "invalid response frame");
+    goto io_err;
+  }
+
+  *res_len = get_u32(header + 6);
+  if (*res_len > BINPROTO_MAX_PAYLOAD) {
+    ESP_LOGE(TAG, "response too large: %zu", *res_len);
+    goto io_err;
+  }
+  if ((*res_payload = wallet_mem_cold(*res_len + 1)) == NULL) {
+    goto io_err;
+  }
+  if (!recv_all(*res_payload, *res_len)) {
+    goto io_err;
+  }
+
+  gw_stats.requests++;
+  gw_stats.total_us += esp_timer_get_time() - start;
+  if (header[4] != 0) {
+    (*res_payload)[*res_len] = '\0';
+    ESP_LOGE(TAG, "gateway error %d: %s", header[4], (char *)*res_payload);
+    free(*res_payload);
+    *res_payload = NULL;
+    return RC_ERROR;
+  }
+  return RC_OK;
+
+io_err:
+  // the stream is out of sync, reconnect for the next request.
+  free(*res_payload);
+  *res_payload = NULL;
+  gw_close();
+  return RC_ERROR;
+}
+
+static void pack_hash(flex_trit_t const *hash, uint8_t *out) {
+  flex_trits_to_trits(trits_buf, NUM_TRITS_HASH, hash, NUM_TRITS_HASH, NUM_TRITS_HASH);
+  trits_to_bytes(trits_buf, out, NUM_TRITS_HASH);
+}
+
+static void unpack_trits(uint8_t const *in, size_t num_trits, flex_trit_t *out) {
+  bytes_to_trits(in, PACKED_LEN(num_trits), trits_buf, num_trits);
+  flex_trits_from_trits(out, num_trits, trits_buf, num_trits, num_trits);
+}
+
+// u16 count followed by packed hashes, the extra bytes are left for the caller.
+static uint8_t *pack_hash_list(hash243_queue_t hashes, size_t extra, size_t *len) {
+  hash243_queue_entry_t *iter = NULL;
+  size_t count = hash243_queue_count(hashes);
+  *len = 2 + count * PACKED_HASH_LEN + extra;
+  uint8_t *payload = wallet_mem_cold(*len);
+  if (payload == NULL) {
+    return NULL;
+  }
+
+  put_u16(payload, count);
+  uint8_t *p = payload + 2;
+  CDL_FOREACH(hashes, iter) {
+    pack_hash(iter->hash, p);
+    p += PACKED_HASH_LEN;
+  }
+  return payload;
+}
+
+void binproto_init() {
+  gw_lock = xSemaphoreCreateMutex();
+  if (gw_lock == NULL) {
+    ESP_LOGE(TAG, "create mutex failed");
+  }
+}
+
+static retcode_t gw_lock_take() {
+  if (gw_lock == NULL) {
+    return RC_ERROR;
+  }
+  xSemaphoreTake(gw_lock, portMAX_DELAY);
+  net_sched_acquire();
+  return RC_OK;
+}
+
+static void gw_lock_give() {
+  net_sched_release();
+  xSemaphoreGive(gw_lock);
+}
+
+void binproto_enable(bool enable) { binproto_enabled = enable; }
+
+bool binproto_is_enabled() { return binproto_enabled; }
+
+retcode_t binproto_find_transactions(find_transactions_req_t const *const req, find_transactions_res_t *const res) {
+  retcode_t ret = RC_ERROR;
+  uint8_t *payload = NULL, *res_payload = NULL;
+  size_t len = 0, res_len = 0;
+  flex_trit_t hash[FLEX_TRIT_SIZE_243];
+
+  if ((ret = gw_lock_take()) != RC_OK) {
+    return ret;
+  }
+
+  if ((payload = pack_hash_list(req->addresses, 0, &len)) == NULL) {
+    ret = RC_OOM;
+    goto done;
+  }
+  if ((ret = gw_call(BINPROTO_CMD_FIND_TRANSACTIONS, payload, len, &res_payload, &res_len)) != RC_OK) {
+    goto done;
+  }
+
+  uint16_t count = res_len >= 2 ? get_u16(res_payload) : 0;
+  if (res_len != 2 + (size_t)count * PACKED_HASH_LEN) {
+    ret = RC_ERROR;
+    goto done;
+  }
+  for (uint16_t i = 0; i < count && ret == RC_OK; i++) {
+    unpack_trits(res_payload + 2 + i * PACKED_HASH_LEN, NUM_TRITS_HASH, hash);
+    ret = hash243_queue_push(&res->hashes, hash);
+  }
+
+done:
+  gw_lock_give();
+  free(payload);
+  free(res_payload);
+  return ret;
+}
+
+retcode_t binproto_get_trytes(get_trytes_req_t const *const req, get_trytes_res_t *const res) {
+  retcode_t ret = RC_ERROR;
+  uint8_t *payload = NULL, *res_payload = NULL;
+  size_t len = 0, res_len = 0;
+  flex_trit_t *tx = NULL;
+
+  if ((ret = gw_lock_take()) != RC_OK) {
+    return ret;
+  }
+
+  if ((payload = pack_hash_list(req->hashes, 0, &len)) == NULL || (tx = wallet_mem_cold(FLEX_TRIT_SIZE_8019)) == NULL) {
+    ret = RC_OOM;
+    goto done;
+  }
+  if ((ret = gw_call(BINPROTO_CMD_GET_TRYTES, payload, len, &res_payload, &res_len)) != RC_OK) {
+    goto done;
+  }
+
+  uint16_t count = res_len >= 2 ? get_u16(res_payload) : 0;
+  if (res_len != 2 + (size_t)count * PACKED_TX_LEN) {
+    ret = RC_ERROR;
+    goto done;
+  }
+  for (uint16_t i = 0; i < count && ret == RC_OK; i++) {
+    unpack_trits(res_payload + 2 + i * PACKED_TX_LEN, NUM_TRITS_SERIALIZED_TRANSACTION, tx);
+    ret = hash8019_queue_push(&res->trytes, tx);
+  }
+
+done:
+  gw_lock_give();
+  free(tx);
+  free(payload);
+  free(res_payload);
+  return ret;
+}
+
+retcode_t binproto_get_balances(get_balances_req_t const *const req, get_balances_res_t *const res) {
+  retcode_t ret = RC_ERROR;
+  uint8_t *payload = NULL, *res_payload = NULL;
+  size_t len = 0, res_len = 0;
+
+  if ((ret = gw_lock_take()) != RC_OK) {
+    return ret;
+  }
+
+  if ((payload = pack_hash_list(req->addresses, 1, &len)) == NULL) {
+    ret = RC_OOM;
+    goto done;
+  }
+  payload[len - 1] = req->threshold;
+  if ((ret = gw_call(BINPROTO_CMD_GET_BALANCES, payload, len, &res_payload, &res_len)) != RC_OK) {
+    goto done;
+  }
+
+  // u16 count, count * u64 balances, u32 milestone index
+  uint16_t count = res_len >= 2 ? get_u16(res_payload) : 0;
+  if (res_len != 2 + (size_t)count * 8 + 4) {
+    ret = RC_ERROR;
+    goto done;
+  }
+  for (uint16_t i = 0; i < count; i++) {
+    uint64_t balance = get_u64(res_payload + 2 + i * 8);
+    utarray_push_back(res->balances, &balance);
+  }
+  res->milestone_index = get_u32(res_payload + 2 + count * 8);
+
+done:
+  gw_lock_give();
+  free(payload);
+  free(res_payload);
+  return ret;
+}
+
+void binproto_close() {
+  if (gw_lock == NULL) {
+    return;
+  }
+  xSemaphoreTake(gw_lock, portMAX_DELAY);
+  gw_close();
+  xSemaphoreGive(gw_lock);
+}
+
+void binproto_stats(binproto_stats_t *const stats) { *stats = gw_stats; }
+
+void binproto_stats_reset() { memset(&gw_stats, 0, sizeof(gw_stats)); }
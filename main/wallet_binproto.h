@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cclient/api/core/core_api.h"
+
+/*
+ * A compact binary protocol between the wallet and a gateway(tools/binproto_gateway.py),
+ * the gateway translates frames to IRI JSON requests.
+ *
+ * Frame: magic "IB", version, command, status, reserved, payload length(u32 big-endian), payload.
+ * Hashes and transactions are packed 5 trits per byte by trits_to_bytes().
+ */
+
+#define BINPROTO_VERSION 1
+
+typedef enum {
+  BINPROTO_CMD_GET_TRYTES = 0x01,        /*!< u16 count, count * 49 bytes hashes */
+  BINPROTO_CMD_FIND_TRANSACTIONS = 0x02, /*!< u16 count, count * 49 bytes addresses */
+  BINPROTO_CMD_GET_BALANCES = 0x03,      /*!< u16 count, count * 49 bytes addresses, u8 threshold */
+} binproto_cmd_t;
+
+typedef struct {
+  uint32_t requests;
+  uint64_t tx_bytes;
+  uint64_t rx_bytes;
+  int64_t total_us;
+} binproto_stats_t;
+
+// Create the gateway lock, before any task sends a query
+void binproto_init();
+
+// Use the binary protocol for node queries, otherwise JSON over HTTP.
+void binproto_enable(bool enable);
+bool binproto_is_enabled();
+
+retcode_t binproto_find_transactions(find_transactions_req_t const *const req, find_transactions_res_t *const res);
+retcode_t binproto_get_trytes(get_trytes_req_t const *const req, get_trytes_res_t *const res);
+retcode_t binproto_get_balances(get_balances_req_t const *const req, get_balances_res_t *const res);
+
+// Close the gateway connection
+void binproto_close();
+
+void binproto_stats(binproto_stats_t *const stats);
+void binproto_stats_reset();
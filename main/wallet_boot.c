@@ -0,0 +1,99 @@
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "wallet_batch.h"
+#include "wallet_boot.h"
+
+static const char *TAG = "boot";
+
+#define BOOT_TASK_STACK 4096
+#define BOOT_TASK_PRIORITY (tskIDLE_PRIORITY + 2)
+#define BOOT_NETWORK_PHASES (BOOT_BIT(BOOT_CLIENT) | BOOT_BIT(BOOT_NETWORK))
+
+static EventGroupHandle_t boot_events = NULL;
+static int64_t phase_us[BOOT_PHASE_MAX];
+
+static char const *phase_names[BOOT_PHASE_MAX] = {
+    [BOOT_NVS] = "nvs",           [BOOT_CONSOLE] = "console", [BOOT_CLIENT] = "client",
+    [BOOT_WIFI] = "wifi",         [BOOT_NETWORK] = "network", [BOOT_TIME] = "sntp",
+    [BOOT_SERVICES] = "services", [BOOT_PROMPT] = "prompt",
+};
+
+void boot_init() { boot_events = xEventGroupCreate(); }
+
+void boot_phase_done(boot_phase_t phase) {
+  phase_us[phase] = esp_timer_get_time();
+  ESP_LOGI(TAG, "%s ready at %" PRId64 "ms", phase_names[phase], phase_us[phase] / 1000);
+  xEventGroupSetBits(boot_events, BOOT_BIT(phase));
+}
+
+static void boot_step_task(void *param) {
+  boot_step_t const *step = (boot_step_t const *)param;
+  if (step->deps) {
+    xEventGroupWaitBits(boot_events, step->deps, pdFALSE, pdTRUE, portMAX_DELAY);
+  }
+  step->run();
+  boot_phase_done(step->phase);
+  vTaskDelete(NULL);
+}
+
+void boot_run_async(boot_step_t const *steps, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (xTaskCreate(boot_step_task, phase_names[steps[i].phase], BOOT_TASK_STACK, (void *)&steps[i],
+                    BOOT_TASK_PRIORITY, NULL) != pdPASS) {
+      // run it here, later steps still wait for it.
+      ESP_LOGW(TAG, "create task for %s failed", phase_names[steps[i].phase]);
+      xEventGroupWaitBits(boot_events, steps[i].deps, pdFALSE, pdTRUE, portMAX_DELAY);
+      steps[i].run();
+      boot_phase_done(steps[i].phase);
+    }
+  }
+}
+
+bool boot_wait(uint32_t phases, uint32_t timeout_ms) {
+  EventBits_t bits = xEventGroupWaitBits(boot_events, phases, pdFALSE, pdTRUE, timeout_ms / portTICK_PERIOD_MS);
+  return (bits & phases) == phases;
+}
+
+bool boot_wait_network() {
+  if ((xEventGroupGetBits(boot_events) & BOOT_NETWORK_PHASES) == BOOT_NETWORK_PHASES) {
+    return true;
+  }
+  printf("Waiting for the network...\n");
+  if (!boot_wait(BOOT_NETWORK_PHASES, CONFIG_BOOT_NETWORK_WAIT_MS)) {
+    printf("Network is not ready\n");
+    return false;
+  }
+  return true;
+}
+
+/* 'boot' command */
+static int fn_boot(int argc, char **argv) {
+  EventBits_t bits = xEventGroupGetBits(boot_events);
+  for (int i = 0; i < BOOT_PHASE_MAX; i++) {
+    if (bits & BOOT_BIT(i)) {
+      printf("%-10s %" PRId64 "ms\n", phase_names[i], phase_us[i] / 1000);
+    } else {
+      printf("%-10s pending\n", phase_names[i]);
+    }
+  }
+  return 0;
+}
+
+void register_boot() {
+  const esp_console_cmd_t boot_cmd = {
+      .command = "boot",
+      .help = "Show timestamps of boot phases",
+      .hint = NULL,
+      .func = &fn_boot,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&boot_cmd, WALLET_CMD_CONCURRENT));
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Boot phases and a small dependency graph of init steps.
+ * Steps run on their own tasks once the phases they depend on are done, the console is
+ * usable before the network is up and network commands wait for it.
+ */
+
+typedef enum {
+  BOOT_NVS = 0,
+  BOOT_CONSOLE,
+  BOOT_CLIENT,   /*!< wallet context and client service, no network */
+  BOOT_WIFI,     /*!< Wi-Fi started */
+  BOOT_NETWORK,  /*!< connected to the AP with an IP */
+  BOOT_TIME,     /*!< SNTP started, the time is set in the background */
+  BOOT_SERVICES, /*!< background tasks, tip pool and confirmation manager */
+  BOOT_PROMPT,
+  BOOT_PHASE_MAX,
+} boot_phase_t;
+
+#define BOOT_BIT(phase) (1 << (phase))
+
+typedef struct {
+  boot_phase_t phase;
+  uint32_t deps; /*!< BOOT_BIT of phases to wait for */
+  void (*run)(); /*!< the phase is done when it returns */
+} boot_step_t;
+
+void boot_init();
+void boot_phase_done(boot_phase_t phase);
+// Run steps on their own tasks, steps must be static.
+void boot_run_async(boot_step_t const *steps, size_t count);
+bool boot_wait(uint32_t phases, uint32_t timeout_ms);
+// Wait up to CONFIG_BOOT_NETWORK_WAIT_MS for network commands
+bool boot_wait_network();
+
+// Register the `boot` command for boot phase timestamps
+void register_boot();
@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp32/rom/miniz.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+#include "net_sched.h"
+#include "wallet_binproto.h"
+#include "wallet_http.h"
+#include "wallet_mem.h"
+
+static const char *TAG = "wallet_http";
+
+#define HTTP_BODY_INIT_SIZE 1024
+#define GZIP_HEADER_LEN 10
+#define GZIP_FLAG_FHCRC 0x02
+#define GZIP_FLAG_FEXTRA 0x04
+#define GZIP_FLAG_FNAME 0x08
+#define GZIP_FLAG_FCOMMENT 0x10
+#define GZIP_OPTIONAL_FIELDS (GZIP_FLAG_FHCRC | GZIP_FLAG_FEXTRA | GZIP_FLAG_FNAME | GZIP_FLAG_FCOMMENT)
+
+typedef enum {
+  ENCODING_IDENTITY = 0,
+  ENCODING_GZIP,
+  ENCODING_DEFLATE,
+} content_encoding_t;
+
+typedef struct {
+  tinfl_decompressor inflator;
+  uint8_t *window; /*!< wrapping output buffer, the LZ77 window */
+  size_t window_ofs;
+  uint8_t gzip_header[GZIP_HEADER_LEN];
+  size_t header_len; /*!< bytes of the fixed gzip header received */
+  uint8_t flags;     /*!< optional gzip header fields to be skipped */
+  uint8_t xlen_bytes;
+  uint8_t crc_bytes;
+  uint16_t skip;
+  bool header_done;
+  bool done;
+} inflate_ctx_t;
+
+typedef struct {
+  content_encoding_t encoding;
+  inflate_ctx_t *inflate;
+  char *body;
+  size_t body_len;
+  size_t body_cap;
+  bool failed;
+} http_response_t;
+
+static esp_http_client_handle_t http_client = NULL;
+static char http_host[64];
+static uint16_t http_port;
+static wallet_http_stats_t http_stats;
+static SemaphoreHandle_t http_lock = NULL;
+
+static bool body_append(http_response_t *res, uint8_t const *data, size_t len) {
+  if (res->body_len + len + 1 > res->body_cap) {
+    size_t cap = res->body_cap ? res->body_cap : HTTP_BODY_INIT_SIZE;
+    while (cap < res->body_len + len + 1) {
+      cap *= 2;
+    }
+    char *body = wallet_mem_cold_realloc(res->body, cap);
+    if (body == NULL) {
+      return false;
+    }
+    res->body = body;
+    res->body_cap = cap;
+  }
+  memcpy(res->body + res->body_len, data, len);
+  res->body_len += len;
+  res->body[res->body_len] = '\0';
+  return true;
+}
+
+// skip the gzip member header(RFC 1952), returns the number of consumed bytes or -1 if it's still in the header.
+static int gzip_header_skip(inflate_ctx_t *ctx, uint8_t const *data, size_t len) {
+  size_t i = 0;
+  while (i < len && !ctx->header_done) {
+    uint8_t c = data[i++];
+    if (ctx->header_len < GZIP_HEADER_LEN) {
+      ctx->gzip_header[ctx->header_len++] = c;
+      if (ctx->header_len == GZIP_HEADER_LEN) {
+        ctx->flags = ctx->gzip_header[3] & GZIP_OPTIONAL_FIELDS;
+        ctx->header_done = ctx->flags == 0;
+      }
+      continue;
+    }
+
+    if (ctx->flags & GZIP_FLAG_FEXTRA) {
+      // 2 bytes length, then the extra field
+      if (ctx->xlen_bytes < 2) {
+        ctx->skip |= c << (8 * ctx->xlen_bytes++);
+        if (ctx->xlen_bytes == 2 && ctx->skip == 0) {
+          ctx->flags &= ~GZIP_FLAG_FEXTRA;
+        }
+      } else if (--ctx->skip == 0) {
+        ctx->flags &= ~GZIP_FLAG_FEXTRA;
+      }
+    } else if (ctx->flags & GZIP_FLAG_FNAME) {
+      if (c == '\0') ctx->flags &= ~GZIP_FLAG_FNAME;
+    } else if (ctx->flags & GZIP_FLAG_FCOMMENT) {
+      if (c == '\0') ctx->flags &= ~GZIP_FLAG_FCOMMENT;
+    } else if (ctx->flags & GZIP_FLAG_FHCRC) {
+      if (++ctx->crc_bytes == 2) ctx->flags &= ~GZIP_FLAG_FHCRC;
+    }
+    ctx->header_done = ctx->flags == 0;
+  }
+  return ctx->header_done ? (int)i : -1;
+}
+
+static bool inflate_feed(http_response_t *res, uint8_t const *data, size_t len) {
+  inflate_ctx_t *ctx = res->inflate;
+  size_t const mask = CONFIG_WALLET_HTTP_INFLATE_WINDOW - 1;
+  mz_uint32 flags = TINFL_FLAG_HAS_MORE_INPUT;
+
+  if (res->encoding == ENCODING_GZIP) {
+    int skipped = gzip_header_skip(ctx, data, len);
+    if (skipped < 0) {
+      return true;
+    }
+    data += skipped;
+    len -= skipped;
+  } else {
+    flags |= TINFL_FLAG_PARSE_ZLIB_HEADER;
+  }
+
+  // output pending in the inflator is drained even when the input is used up
+  while (!ctx->done) {
+    size_t in_bytes = len;
+    size_t out_bytes = CONFIG_WALLET_HTTP_INFLATE_WINDOW - ctx->window_ofs;
+    tinfl_status status = tinfl_decompress(&ctx->inflator, data, &in_bytes, ctx->window,
+                                           ctx->window + ctx->window_ofs, &out_bytes, flags);
+    data += in_bytes;
+    len -= in_bytes;
+    if (out_bytes && !body_append(res, ctx->window + ctx->window_ofs, out_bytes)) {
+      return false;
+    }
+    ctx->window_ofs = (ctx->window_ofs + out_bytes) & mask;
+
+    if (status == TINFL_STATUS_DONE) {
+      // the gzip trailer(CRC32 and size) is ignored, a stream without its end fails the request.
+      ctx->done = true;
+    } else if (status < TINFL_STATUS_DONE) {
+      ESP_LOGE(TAG, "inflate failed: %d", status);
+      return false;
+    } else if (status != TINFL_STATUS_HAS_MORE_OUTPUT && len == 0) {
+      break;
+    }
+  }
+  return true;
+}
+
+static esp_err_t http_event_handler(esp_http_client_event_t *evt) {
+  http_response_t *res = (http_response_t *)evt->user_data;
+  switch (evt->event_id) {
+    case HTTP_EVENT_ON_CONNECTED:
+      http_stats.connections++;
+      break;
+    case HTTP_EVENT_ON_HEADER:
+      if (strcasecmp(evt->header_key, "Content-Encoding") == 0) {
+        if (strcasecmp(evt->header_value, "gzip") == 0) {
+          res->encoding = ENCODING_GZIP;
+        } else if (strcasecmp(evt->header_value, "deflate") == 0) {
+          res->encoding = ENCODING_DEFLATE;
+        }
+      }
+      break;
+    case HTTP_EVENT_ON_DATA:
+      if (res->failed) {
+        break;
+      }
+      http_stats.wire_bytes += evt->data_len;
+      if (res->encoding == ENCODING_IDENTITY) {
+        res->failed = !body_append(res, evt->data, evt->data_len);
+      } else {
+        if (res->inflate == NULL) {
+          res->inflate = calloc(1, sizeof(inflate_ctx_t));
+          if (res->inflate) {
+            res->inflate->window = wallet_mem_cold(CONFIG_WALLET_HTTP_INFLATE_WINDOW);
+            tinfl_init(&res->inflate->inflator);
+          }
+          if (res->inflate == NULL || res->inflate->window == NULL) {
+            res->failed = true;
+            break;
+          }
+          http_stats.compressed++;
+        }
+        res->failed = !inflate_feed(res, evt->data, evt->data_len);
+      }
+      break;
+    default:
+      break;
+  }
+  return ESP_OK;
+}
+
+static void http_client_close() {
+  if (http_client) {
+    esp_http_client_cleanup(http_client);
+    http_client = NULL;
+  }
+}
+
+static esp_err_t http_client_open(iota_client_service_t const *const serv) {
+  if (http_client && strcmp(http_host, serv->http.host) == 0 && http_port == serv->http.port) {
+    return ESP_OK;
+  }
+  http_client_close();
+
+  esp_http_client_config_t config = {
+      .host = serv->http.host,
+      .port = serv->http.port,
+      .path = "/",
+      .cert_pem = serv->http.ca_pem,
+      .transport_type = serv->http.ca_pem ? HTTP_TRANSPORT_OVER_SSL : HTTP_TRANSPORT_OVER_TCP,
+      .method = HTTP_METHOD_POST,
+      .timeout_ms = CONFIG_WALLET_HTTP_TIMEOUT_MS,
+      .event_handler = http_event_handler,
+      .buffer_size = CONFIG_WALLET_HTTP_RX_BUFFER,
+  };
+  if ((http_client = esp_http_client_init(&config)) == NULL) {
+    return ESP_FAIL;
+  }
+  esp_http_client_set_header(http_client, "Content-Type", "application/json");
+  esp_http_client_set_header(http_client, "Accept", "application/json");
+  esp_http_client_set_header(http_client, "X-IOTA-API-Version", "1");
+#ifdef CONFIG_WALLET_HTTP_COMPRESSION
+  esp_http_client_set_header(http_client, "Accept-Encoding", "gzip, deflate");
+#endif
+  strncpy(http_host, serv->http.host, sizeof(http_host) - 1);
+  http_port = serv->http.port;
+  return ESP_OK;
+}
+
+void wallet_http_init() {
+  http_lock = xSemaphoreCreateMutex();
+  if (http_lock == NULL) {
+    ESP_LOGE(TAG, "create mutex failed");
+  }
+}
+
+retcode_t wallet_http_query(iota_client_service_t const *const serv, char_buffer_t const *const req,
+                            char_buffer_t *const res) {
+  retcode_t ret = RC_ERROR;
+  http_response_t response = {};
+
+  if (http_lock == NULL) {
+    ESP_LOGE(TAG, "not initialized");
+    return RC_ERROR;
+  }
+
+  net_sched_acquire();
+  xSemaphoreTake(http_lock, portMAX_DELAY);
+  int64_t start = esp_timer_get_time();
+  if (http_client_open(serv) != ESP_OK) {
+    ESP_LOGE(TAG, "http client init failed");
+    goto done;
+  }
+
+  esp_http_client_set_user_data(http_client, &response);
+  esp_http_client_set_post_field(http_client, req->data, req->length);
+  esp_err_t err = esp_http_client_perform(http_client);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "request failed: %s", esp_err_to_name(err));
+    // drop the connection, the next request reconnects.
+    http_client_close();
+    goto done;
+  }
+  if (response.failed || response.body == NULL) {
+    ESP_LOGE(TAG, "receiving response failed");
+    ret = response.failed ? RC_OOM : RC_ERROR;
+    goto done;
+  }
+  if (response.inflate && !response.inflate->done) {
+    ESP_LOGE(TAG, "compressed body is truncated");
+    goto done;
+  }
+  if (esp_http_client_get_status_code(http_client) != 200) {
+    ESP_LOGW(TAG, "HTTP status %d: %s", esp_http_client_get_status_code(http_client), response.body);
+    goto done;
+  }
+
+  if (char_buffer_set(res, response.body) == RC_OK) {
+    ret = RC_OK;
+  }
+  http_stats.requests++;
+  http_stats.body_bytes += response.body_len;
+  http_stats.total_us += esp_timer_get_time() - start;
+
+done:
+  xSemaphoreGive(http_lock);
+  net_sched_release();
+  if (response.inflate) {
+    free(response.inflate->window);
+    free(response.inflate);
+  }
+  free(response.body);
+  return ret;
+}
+
+retcode_t wallet_http_find_transactions(iota_client_service_t const *const serv, find_transactions_req_t const *const req,
+                                        find_transactions_res_t *const res) {
+  retcode_t ret = RC_ERROR;
+  char_buffer_t *req_buff = char_buffer_new();
+  char_buffer_t *res_buff = char_buffer_new();
+  if (!req_buff || !res_buff) {
+    ret = RC_OOM;
+    goto done;
+  }
+
+  // the binary protocol only queries by addresses
+  if (binproto_is_enabled() && req->bundles == NULL && req->tags == NULL && req->approvees == NULL) {
+    ret = binproto_find_transactions(req, res);
+    goto done;
+  }
+
+  if ((ret = serv->serializer.vtable.find_transactions_serialize_request(req, req_buff)) != RC_OK) {
+    goto done;
+  }
+  if ((ret = wallet_http_query(serv, req_buff, res_buff)) != RC_OK) {
+    goto done;
+  }
+  ret = serv->serializer.vtable.find_transactions_deserialize_response(res_buff->data, res);
+
+done:
+  char_buffer_free(req_buff);
+  char_buffer_free(res_buff);
+  return ret;
+}
+
+retcode_t wallet_http_get_trytes(iota_client_service_t const *const serv, get_trytes_req_t const *const req,
+                                 get_trytes_res_t *const res) {
+  retcode_t ret = RC_ERROR;
+  char_buffer_t *req_buff = char_buffer_new();
+  char_buffer_t *res_buff = char_buffer_new();
+  if (!req_buff || !res_buff) {
+    ret = RC_OOM;
+    goto done;
+  }
+
+  if (binproto_is_enabled()) {
+    ret = binproto_get_trytes(req, res);
+    goto done;
+  }
+
+  if ((ret = serv->serializer.vtable.get_trytes_serialize_request(req, req_buff)) != RC_OK) {
+    goto done;
+  }
+  if ((ret = wallet_http_query(serv, req_buff, res_buff)) != RC_OK) {
+    goto done;
+  }
+  ret = serv->serializer.vtable.get_trytes_deserialize_response(res_buff->data, res);
+
+done:
+  char_buffer_free(req_buff);
+  char_buffer_free(res_buff);
+  return ret;
+}
+
+retcode_t wallet_http_get_balances(iota_client_service_t const *const serv, get_balances_req_t const *const req,
+                                   get_balances_res_t *const res) {
+  retcode_t ret = RC_ERROR;
+  char_buffer_t *req_buff = char_buffer_new();
+  char_buffer_t *res_buff = char_buffer_new();
+  if (!req_buff || !res_buff) {
+    ret = RC_OOM;
+    goto done;
+  }
+
+  if (binproto_is_enabled() && req->tips == NULL) {
+    ret = binproto_get_balances(req, res);
+    goto done;
+  }
+
+  if ((ret = serv->serializer.vtable.get_balances_serialize_request(req, req_buff)) != RC_OK) {
+    goto done;
+  }
+  if ((ret = wallet_http_query(serv, req_buff, res_buff)) != RC_OK) {
+    goto done;
+  }
+  ret = serv->serializer.vtable.get_balances_deserialize_response(res_buff->data, res);
+
+done:
+  char_buffer_free(req_buff);
+  char_buffer_free(res_buff);
+  return ret;
+}
+
+void wallet_http_close() {
+  if (http_lock == NULL) {
+    return;
+  }
+  xSemaphoreTake(http_lock, portMAX_DELAY);
+  http_client_close();
+  xSemaphoreGive(http_lock);
+}
+
+void wallet_http_stats(wallet_http_stats_t *const stats) { *stats = http_stats; }
+
+void wallet_http_stats_reset() { memset(&http_stats, 0, sizeof(http_stats)); }
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "cclient/api/core/core_api.h"
+#include "utils/char_buffer.h"
+
+typedef struct {
+  uint32_t requests;    /*!< number of requests */
+  uint32_t compressed;  /*!< number of compressed responses */
+  uint64_t wire_bytes;  /*!< response body bytes on the wire */
+  uint64_t body_bytes;  /*!< response body bytes after inflating */
+  int64_t total_us;     /*!< time to complete all requests */
+  uint32_t connections; /*!< number of new connections */
+} wallet_http_stats_t;
+
+// Create the connection lock, before any task sends a request
+void wallet_http_init();
+
+// Send a JSON request to the node of the service over a keep-alive connection.
+// Responses with gzip or deflate content encoding are inflated while receiving.
+retcode_t wallet_http_query(iota_client_service_t const *const serv, char_buffer_t const *const req,
+                            char_buffer_t *const res);
+
+// Core APIs with large responses, they go through wallet_http_query instead of the cclient http client,
+// or through the binary protocol if it's enabled.
+retcode_t wallet_http_find_transactions(iota_client_service_t const *const serv, find_transactions_req_t const *const req,
+                                        find_transactions_res_t *const res);
+retcode_t wallet_http_get_trytes(iota_client_service_t const *const serv, get_trytes_req_t const *const req,
+                                 get_trytes_res_t *const res);
+retcode_t wallet_http_get_balances(iota_client_service_t const *const serv, get_balances_req_t const *const req,
+                                   get_balances_res_t *const res);
+
+// Close the keep-alive connection
+void wallet_http_close();
+
+void wallet_http_stats(wallet_http_stats_t *const stats);
+void wallet_http_stats_reset();
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "argtable3/argtable3.h"
+#include "cJSON.h"
+#include "esp_console.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "soc/soc_memory_layout.h"
+
+#include "wallet_batch.h"
+#include "wallet_mem.h"
+
+static const char *TAG = "wallet_mem";
+
+#define MEM_CAPS_COLD (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#define MEM_CAPS_HOT (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+
+static mem_policy_t mem_policy = MEM_POLICY_DEFAULT;
+
+static bool cold_in_spiram() { return mem_policy == MEM_POLICY_SPLIT && heap_caps_get_total_size(MEM_CAPS_COLD) > 0; }
+
+void *wallet_mem_cold(size_t size) {
+  void *ptr = cold_in_spiram() ? heap_caps_malloc(size, MEM_CAPS_COLD) : NULL;
+  // internal RAM if SPI RAM is full
+  if (ptr == NULL) {
+    ptr = malloc(size);
+  }
+  return ptr;
+}
+
+void *wallet_mem_cold_realloc(void *ptr, size_t size) {
+  if (cold_in_spiram() && (ptr == NULL || esp_ptr_external_ram(ptr))) {
+    void *new_ptr = heap_caps_realloc(ptr, size, MEM_CAPS_COLD);
+    if (new_ptr) {
+      return new_ptr;
+    }
+  }
+  return realloc(ptr, size);
+}
+
+void *wallet_mem_hot(size_t size) { return heap_caps_malloc(size, MEM_CAPS_HOT); }
+
+static void *json_malloc(size_t size) { return wallet_mem_cold(size); }
+
+void wallet_mem_set_policy(mem_policy_t policy) { mem_policy = policy; }
+
+mem_policy_t wallet_mem_policy() { return mem_policy; }
+
+void wallet_mem_init() {
+  // set once before any task parses JSON, the hook follows the policy instead of being swapped at runtime.
+  // cJSON_InitHooks() falls back to free with a NULL free hook.
+  cJSON_Hooks hooks = {
+      .malloc_fn = json_malloc,
+      .free_fn = NULL,
+  };
+  cJSON_InitHooks(&hooks);
+#ifdef CONFIG_WALLET_MEM_POLICY_SPLIT
+  wallet_mem_set_policy(MEM_POLICY_SPLIT);
+#else
+  wallet_mem_set_policy(MEM_POLICY_DEFAULT);
+#endif
+  if (mem_policy == MEM_POLICY_SPLIT && heap_caps_get_total_size(MEM_CAPS_COLD) == 0) {
+    ESP_LOGW(TAG, "no SPI RAM, cold data stays in internal RAM");
+  }
+}
+
+void wallet_mem_dump() {
+  printf("policy: %s\n", mem_policy == MEM_POLICY_SPLIT ? "split" : "default");
+  printf("internal: free %u, min free %u, largest block %u\n", heap_caps_get_free_size(MEM_CAPS_HOT),
+         heap_caps_get_minimum_free_size(MEM_CAPS_HOT), heap_caps_get_largest_free_block(MEM_CAPS_HOT));
+  if (heap_caps_get_total_size(MEM_CAPS_COLD) > 0) {
+    printf("spiram: free %u, min free %u, largest block %u\n", heap_caps_get_free_size(MEM_CAPS_COLD),
+           heap_caps_get_minimum_free_size(MEM_CAPS_COLD), heap_caps_get_largest_free_block(MEM_CAPS_COLD));
+  } else {
+    printf("spiram: none\n");
+  }
+}
+
+/* 'mem' command */
+static struct {
+  struct arg_str *policy;
+  struct arg_end *end;
+} mem_args;
+
+static int fn_mem(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&mem_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, mem_args.end, argv[0]);
+    return -1;
+  }
+
+  if (mem_args.policy->count) {
+    char const *policy = mem_args.policy->sval[0];
+    if (strcmp(policy, "default") == 0) {
+      wallet_mem_set_policy(MEM_POLICY_DEFAULT);
+    } else if (strcmp(policy, "split") == 0) {
+      wallet_mem_set_policy(MEM_POLICY_SPLIT);
+    } else {
+      printf("Unknown policy: %s\n", policy);
+      return -1;
+    }
+  }
+  wallet_mem_dump();
+  return 0;
+}
+
+void register_mem() {
+  mem_args.policy = arg_str0("p", "policy", "<default|split>", "placement of cold data");
+  mem_args.end = arg_end(2);
+  const esp_console_cmd_t mem_cmd = {
+      .command = "mem",
+      .help = "Show internal and SPI RAM usage, set the placement policy",
+      .hint = " [-p default|split]",
+      .func = &fn_mem,
+      .argtable = &mem_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&mem_cmd, 0));
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Memory placement
+ *
+ * Internal DRAM is shared with Wi-Fi and lwIP, with SPI RAM large transient buffers(serialized
+ * transactions, HTTP bodies, JSON trees) are moved out of it:
+ *  - cold: bulk data used once, SPI RAM with the split policy, internal RAM otherwise
+ *  - hot: crypto state and buffers of tight loops, always internal RAM
+ * cJSON trees of iota_client are cold through cJSON hooks. Other allocations of iota_common and
+ * iota_client keep the placement of malloc(), key fragments of address generation and signing
+ * are as large as the bulk data, a size threshold can't tell them apart.
+ */
+
+typedef enum {
+  MEM_POLICY_DEFAULT = 0, /*!< placement of ESP-IDF */
+  MEM_POLICY_SPLIT,       /*!< cold data in SPI RAM, hot data in internal RAM */
+} mem_policy_t;
+
+// Apply CONFIG_WALLET_MEM_POLICY, call it before the client is initialized.
+void wallet_mem_init();
+// Placement of later allocations, blocks placed before are left where they are.
+void wallet_mem_set_policy(mem_policy_t policy);
+mem_policy_t wallet_mem_policy();
+
+void *wallet_mem_cold(size_t size);
+void *wallet_mem_cold_realloc(void *ptr, size_t size);
+void *wallet_mem_hot(size_t size);
+
+// Free bytes of internal and SPI RAM, the minimum is since boot.
+void wallet_mem_dump();
+
+// Register the `mem` command
+void register_mem();
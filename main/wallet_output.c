@@ -0,0 +1,323 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/reent.h>
+
+#include "driver/uart.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "common/defs.h"
+#include "common/trinary/trit_byte.h"
+#include "common/trinary/tryte.h"
+#include "wallet_output.h"
+
+#define OUTPUT_REC_INIT_SIZE 128
+#define OUTPUT_BIN_HEADER_LEN 4
+#define TRITS_PER_BYTE 5
+#define PACKED_LEN(trits) (((trits) + TRITS_PER_BYTE - 1) / TRITS_PER_BYTE)
+
+static output_format_t output_fmt = OUTPUT_TEXT; /*!< of the console */
+
+// formats of tasks which don't write to the console, e.g. API and batch workers.
+typedef struct {
+  TaskHandle_t task;
+  output_format_t format;
+} task_format_t;
+
+static task_format_t task_formats[OUTPUT_TASK_FORMATS];
+static portMUX_TYPE task_formats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static char const *rec_names[] = {
+    [OUTPUT_REC_HASHES] = "hashes",           [OUTPUT_REC_BALANCE] = "balance",
+    [OUTPUT_REC_ADDRESS] = "address",         [OUTPUT_REC_ACCOUNT] = "account",
+    [OUTPUT_REC_TRANSACTION] = "transaction", [OUTPUT_REC_NODE_INFO] = "node_info",
+    [OUTPUT_REC_CLIENT_CONF] = "client_conf", [OUTPUT_REC_VALUE] = "value",
+    [OUTPUT_REC_SUBACCOUNT] = "subaccount",
+};
+
+static char const *format_names[] = {
+    [OUTPUT_TEXT] = "text",
+    [OUTPUT_JSON] = "json",
+    [OUTPUT_BIN] = "bin",
+};
+
+void output_set_format(output_format_t format) { output_fmt = format; }
+
+bool output_set_task_format(output_format_t format) {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  bool set = false;
+  portENTER_CRITICAL(&task_formats_mux);
+  for (size_t i = 0; i < OUTPUT_TASK_FORMATS && !set; i++) {
+    if (task_formats[i].task == self || task_formats[i].task == NULL) {
+      task_formats[i].task = self;
+      task_formats[i].format = format;
+      set = true;
+    }
+  }
+  portEXIT_CRITICAL(&task_formats_mux);
+  return set;
+}
+
+void output_clear_task_format() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  portENTER_CRITICAL(&task_formats_mux);
+  for (size_t i = 0; i < OUTPUT_TASK_FORMATS; i++) {
+    if (task_formats[i].task == self) {
+      task_formats[i].task = NULL;
+    }
+  }
+  portEXIT_CRITICAL(&task_formats_mux);
+}
+
+output_format_t output_format() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  output_format_t format = output_fmt;
+  portENTER_CRITICAL(&task_formats_mux);
+  for (size_t i = 0; i < OUTPUT_TASK_FORMATS; i++) {
+    if (task_formats[i].task == self) {
+      format = task_formats[i].format;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&task_formats_mux);
+  return format;
+}
+
+void output_write_raw(void const *buf, size_t len) {
+  // stdout of a task is the console unless it's redirected, like the capture of a batch job.
+  if (stdout == _GLOBAL_REENT->_stdout) {
+    fflush(stdout);
+    uart_write_bytes(CONFIG_CONSOLE_UART_NUM, buf, len);
+  } else {
+    fwrite(buf, 1, len, stdout);
+  }
+}
+
+char const *output_format_name(output_format_t format) { return format_names[format]; }
+
+bool output_format_from_name(char const *name, output_format_t *format) {
+  for (size_t i = 0; i < sizeof(format_names) / sizeof(format_names[0]); i++) {
+    if (strcmp(name, format_names[i]) == 0) {
+      *format = (output_format_t)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+char *output_apply_prefix(char *line) {
+  static char const prefix[] = "--format=";
+  output_format_t format;
+
+  if (strncmp(line, prefix, sizeof(prefix) - 1) != 0) {
+    return line;
+  }
+  char *name = line + sizeof(prefix) - 1;
+  char *rest = name + strcspn(name, " ");
+  if (*rest != '\0') {
+    *rest++ = '\0';
+  }
+  if (output_format_from_name(name, &format)) {
+    output_set_format(format);
+  } else {
+    printf("Unknown format: %s\n", name);
+  }
+  return rest + strspn(rest, " ");
+}
+
+static bool rec_reserve(output_rec_t *rec, size_t size) {
+  if (rec->oom) {
+    return false;
+  }
+  if (rec->len + size > rec->cap) {
+    size_t cap = rec->cap * 2 > rec->len + size ? rec->cap * 2 : rec->len + size;
+    uint8_t *buf = realloc(rec->buf, cap);
+    if (buf == NULL) {
+      rec->oom = true;
+      return false;
+    }
+    rec->buf = buf;
+    rec->cap = cap;
+  }
+  return true;
+}
+
+static void rec_put(output_rec_t *rec, void const *data, size_t len) {
+  if (rec_reserve(rec, len)) {
+    memcpy(rec->buf + rec->len, data, len);
+    rec->len += len;
+  }
+}
+
+static void rec_putc(output_rec_t *rec, char c) { rec_put(rec, &c, 1); }
+
+static void rec_puts(output_rec_t *rec, char const *str) { rec_put(rec, str, strlen(str)); }
+
+static void rec_varint(output_rec_t *rec, uint64_t value) {
+  do {
+    uint8_t b = value & 0x7F;
+    value >>= 7;
+    rec_putc(rec, value ? (b | 0x80) : b);
+  } while (value);
+}
+
+static void json_key(output_rec_t *rec, char const *key) {
+  if (!rec->first) {
+    rec_putc(rec, ',');
+  }
+  rec->first = false;
+  if (key) {
+    rec_putc(rec, '"');
+    rec_puts(rec, key);
+    rec_puts(rec, "\":");
+  }
+}
+
+static void json_trytes(output_rec_t *rec, flex_trit_t const *trits, size_t num_trits) {
+  size_t num_trytes = num_trits / 3;
+  rec_putc(rec, '"');
+  if (rec_reserve(rec, num_trytes)) {
+    flex_trits_to_trytes((tryte_t *)rec->buf + rec->len, num_trytes, trits, num_trits, num_trits);
+    rec->len += num_trytes;
+  }
+  rec_putc(rec, '"');
+}
+
+static void bin_trits(output_rec_t *rec, flex_trit_t const *trits, size_t num_trits) {
+  trit_t *buf = malloc(num_trits);
+  if (buf == NULL) {
+    rec->oom = true;
+    return;
+  }
+  flex_trits_to_trits(buf, num_trits, trits, num_trits, num_trits);
+  if (rec_reserve(rec, PACKED_LEN(num_trits))) {
+    trits_to_bytes(buf, rec->buf + rec->len, num_trits);
+    rec->len += PACKED_LEN(num_trits);
+  }
+  free(buf);
+}
+
+void output_rec_begin(output_rec_t *rec, output_rec_type_t type) {
+  memset(rec, 0, sizeof(output_rec_t));
+  rec->format = output_format();
+  if ((rec->buf = malloc(OUTPUT_REC_INIT_SIZE)) == NULL) {
+    rec->oom = true;
+    return;
+  }
+  rec->cap = OUTPUT_REC_INIT_SIZE;
+
+  if (rec->format == OUTPUT_BIN) {
+    uint8_t header[OUTPUT_BIN_HEADER_LEN] = {OUTPUT_BIN_SYNC, type, 0, 0};
+    rec_put(rec, header, sizeof(header));
+  } else {
+    rec_puts(rec, "{\"t\":\"");
+    rec_puts(rec, rec_names[type]);
+    rec_putc(rec, '"');
+  }
+}
+
+void output_rec_hash(output_rec_t *rec, char const *key, flex_trit_t const *hash) {
+  if (rec->format == OUTPUT_BIN) {
+    rec_putc(rec, OUTPUT_FIELD_HASH);
+    bin_trits(rec, hash, NUM_TRITS_HASH);
+  } else {
+    json_key(rec, rec->in_array ? NULL : key);
+    json_trytes(rec, hash, NUM_TRITS_HASH);
+  }
+}
+
+void output_rec_trits(output_rec_t *rec, char const *key, flex_trit_t const *trits, size_t num_trits) {
+  if (rec->format == OUTPUT_BIN) {
+    uint8_t len[2] = {num_trits >> 8, num_trits & 0xFF};
+    rec_putc(rec, OUTPUT_FIELD_TRITS);
+    rec_put(rec, len, sizeof(len));
+    bin_trits(rec, trits, num_trits);
+  } else {
+    json_key(rec, key);
+    json_trytes(rec, trits, num_trits);
+  }
+}
+
+void output_rec_uint(output_rec_t *rec, char const *key, uint64_t value) {
+  if (rec->format == OUTPUT_BIN) {
+    rec_putc(rec, OUTPUT_FIELD_UINT);
+    rec_varint(rec, value);
+  } else {
+    char num[24];
+    json_key(rec, key);
+    snprintf(num, sizeof(num), "%" PRIu64, value);
+    rec_puts(rec, num);
+  }
+}
+
+void output_rec_str(output_rec_t *rec, char const *key, char const *str) {
+  size_t len = strlen(str);
+  if (rec->format == OUTPUT_BIN) {
+    rec_putc(rec, OUTPUT_FIELD_STR);
+    rec_varint(rec, len);
+    rec_put(rec, str, len);
+    return;
+  }
+
+  json_key(rec, key);
+  rec_putc(rec, '"');
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = str[i];
+    if (c == '"' || c == '\\') {
+      rec_putc(rec, '\\');
+      rec_putc(rec, c);
+    } else if (c < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+      rec_puts(rec, esc);
+    } else {
+      rec_putc(rec, c);
+    }
+  }
+  rec_putc(rec, '"');
+}
+
+void output_rec_array_begin(output_rec_t *rec, char const *key) {
+  if (rec->format != OUTPUT_BIN) {
+    json_key(rec, key);
+    rec_putc(rec, '[');
+    rec->first = true;
+  }
+  rec->in_array = true;
+}
+
+void output_rec_array_end(output_rec_t *rec) {
+  if (rec->format != OUTPUT_BIN) {
+    rec_putc(rec, ']');
+    rec->first = false;
+  }
+  rec->in_array = false;
+}
+
+void output_rec_end(output_rec_t *rec) {
+  if (rec->format == OUTPUT_BIN) {
+    size_t payload_len = rec->len - OUTPUT_BIN_HEADER_LEN;
+    if (!rec->oom && payload_len > UINT16_MAX) {
+      rec->oom = true;
+    }
+    if (!rec->oom) {
+      rec->buf[2] = payload_len >> 8;
+      rec->buf[3] = payload_len & 0xFF;
+    }
+  } else {
+    rec_puts(rec, "}\n");
+  }
+
+  if (rec->oom) {
+    printf("Error: output record dropped, OOM\n");
+  } else if (rec->format == OUTPUT_BIN) {
+    output_write_raw(rec->buf, rec->len);
+  } else {
+    fwrite(rec->buf, 1, rec->len, stdout);
+  }
+  free(rec->buf);
+  rec->buf = NULL;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/trinary/flex_trit.h"
+
+/*
+ * Output records of commands in JSON lines or binary frames, a record is written with a single fwrite.
+ *
+ * JSON: {"t":"balance","address":"ABC...","balance":100}
+ * Binary: 0xA5, type(u8), payload length(u16 big-endian), fields.
+ *   A field starts with its kind, hashes and trits are packed 5 trits per byte:
+ *   OUTPUT_FIELD_HASH: 49 bytes
+ *   OUTPUT_FIELD_TRITS: number of trits(u16 big-endian), packed trits
+ *   OUTPUT_FIELD_UINT: LEB128 varint
+ *   OUTPUT_FIELD_STR: length(varint), bytes
+ * Field names are not sent in binary, the order of fields is fixed per record type.
+ * tools/output_decode.py converts binary frames to JSON lines.
+ */
+
+#define OUTPUT_BIN_SYNC 0xA5
+// hashes per OUTPUT_REC_HASHES record, keeps binary payloads within u16
+#define OUTPUT_HASHES_PER_REC 256
+// tasks with their own format
+#define OUTPUT_TASK_FORMATS 8
+
+typedef enum {
+  OUTPUT_TEXT = 0,
+  OUTPUT_JSON,
+  OUTPUT_BIN,
+} output_format_t;
+
+typedef enum {
+  OUTPUT_REC_HASHES = 1,  /*!< hash... */
+  OUTPUT_REC_BALANCE,     /*!< address, balance */
+  OUTPUT_REC_ADDRESS,     /*!< index, address, balance(account only) */
+  OUTPUT_REC_ACCOUNT,     /*!< balance, unused address, address count */
+  OUTPUT_REC_TRANSACTION, /*!< serialized transaction trits */
+  OUTPUT_REC_NODE_INFO,   /*!< app name, app version, latest milestone and index, solid milestone and index, tips */
+  OUTPUT_REC_CLIENT_CONF, /*!< mwm, depth, security */
+  OUTPUT_REC_VALUE,       /*!< name, value string, e.g. free heap or a random hash */
+  OUTPUT_REC_SUBACCOUNT,  /*!< name, security, next index, funded address count, balance */
+} output_rec_type_t;
+
+typedef enum {
+  OUTPUT_FIELD_HASH = 1,
+  OUTPUT_FIELD_TRITS,
+  OUTPUT_FIELD_UINT,
+  OUTPUT_FIELD_STR,
+} output_field_t;
+
+typedef struct {
+  output_format_t format;
+  uint8_t *buf;
+  size_t len;
+  size_t cap;
+  bool first;    /*!< no comma before the next JSON field */
+  bool in_array; /*!< JSON array of hashes */
+  bool oom;
+} output_rec_t;
+
+// The output format of commands, text is the human readable output.
+void output_set_format(output_format_t format);
+output_format_t output_format();
+// A format of the calling task, it overrides the console format for commands the task runs.
+// Returns false if OUTPUT_TASK_FORMATS tasks have one.
+bool output_set_task_format(output_format_t format);
+void output_clear_task_format();
+char const *output_format_name(output_format_t format);
+// Write bytes to the console without the CRLF conversion of stdout, e.g. binary frames.
+// A redirected stdout gets them as they are.
+void output_write_raw(void const *buf, size_t len);
+bool output_format_from_name(char const *name, output_format_t *format);
+
+// Strip a leading `--format=json|bin|text` of a command line and apply it,
+// returns the rest of the line, the caller restores the format after the command.
+char *output_apply_prefix(char *line);
+
+void output_rec_begin(output_rec_t *rec, output_rec_type_t type);
+void output_rec_hash(output_rec_t *rec, char const *key, flex_trit_t const *hash);
+void output_rec_trits(output_rec_t *rec, char const *key, flex_trit_t const *trits, size_t num_trits);
+void output_rec_uint(output_rec_t *rec, char const *key, uint64_t value);
+void output_rec_str(output_rec_t *rec, char const *key, char const *str);
+// Hashes between begin and end are a JSON array, each hash is a field in binary.
+void output_rec_array_begin(output_rec_t *rec, char const *key);
+void output_rec_array_end(output_rec_t *rec);
+// Write the record and release the buffer
+void output_rec_end(output_rec_t *rec);
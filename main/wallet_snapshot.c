@@ -0,0 +1,406 @@
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "argtable3/argtable3.h"
+#include "esp32/rom/crc.h"
+#include "esp_attr.h"
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include "crypto_backend.h"
+#include "wallet_batch.h"
+#include "wallet_binproto.h"
+#include "wallet_boot.h"
+#include "wallet_http.h"
+#include "wallet_snapshot.h"
+#include "wallet_system.h"
+
+static const char *TAG = "snapshot";
+
+#define SNAPSHOT_NAMESPACE "wallet_state"
+#define SNAPSHOT_KEY "snapshot"
+#define SNAPSHOT_MAGIC 0x534e5031 /* "SNP1" */
+#define SNAPSHOT_BSSID_LEN 6
+
+typedef struct {
+  uint32_t magic;
+  uint8_t seed_tag[CRYPTO_RECORD_TAG_LEN]; /*!< fingerprint of the seed trits */
+  uint8_t security;                        /*!< security level of cached addresses */
+  uint8_t address_count;
+  uint8_t ap_channel; /*!< 0 if no AP is cached */
+  uint8_t ap_bssid[SNAPSHOT_BSSID_LEN];
+  uint32_t first_index; /*!< address index of addresses[0] */
+  uint32_t unused_index;
+  uint32_t milestone_index;
+  uint32_t cycle_interval_s; /*!< 0 if `sleep_cycle` is off */
+  uint32_t cycles;
+  uint64_t balance; /*!< balance of cached addresses */
+  flex_trit_t milestone[FLEX_TRIT_SIZE_243];
+  flex_trit_t addresses[CONFIG_SNAPSHOT_ADDRESSES][FLEX_TRIT_SIZE_243];
+  uint32_t crc; /*!< CRC32 of fields above */
+} snapshot_t;
+
+// RTC slow memory is kept in deep sleep and software resets, it's garbage after a power cycle.
+static RTC_NOINIT_ATTR snapshot_t rtc_snapshot;
+static RTC_NOINIT_ATTR uint32_t nvs_crc;
+
+static SemaphoreHandle_t snapshot_lock = NULL;
+static char const *restored_from = "none";
+
+static uint32_t snapshot_crc(snapshot_t const *snap) {
+  return crc32_le(0, (uint8_t const *)snap, offsetof(snapshot_t, crc));
+}
+
+static bool snapshot_is_valid(snapshot_t const *snap) {
+  return snap->magic == SNAPSHOT_MAGIC && snap->address_count <= CONFIG_SNAPSHOT_ADDRESSES &&
+         snap->crc == snapshot_crc(snap);
+}
+
+// must be called with snapshot_lock
+static void snapshot_seal() { rtc_snapshot.crc = snapshot_crc(&rtc_snapshot); }
+
+static void snapshot_reset() {
+  memset(&rtc_snapshot, 0, sizeof(rtc_snapshot));
+  rtc_snapshot.magic = SNAPSHOT_MAGIC;
+  snapshot_seal();
+}
+
+static esp_err_t snapshot_load(snapshot_t *snap) {
+  nvs_handle handle;
+  size_t len = sizeof(snapshot_t);
+  esp_err_t err = nvs_open(SNAPSHOT_NAMESPACE, NVS_READONLY, &handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+  err = nvs_get_blob(handle, SNAPSHOT_KEY, snap, &len);
+  nvs_close(handle);
+  if (err == ESP_OK && (len != sizeof(snapshot_t) || !snapshot_is_valid(snap))) {
+    err = ESP_ERR_INVALID_VERSION;
+  }
+  return err;
+}
+
+static esp_err_t snapshot_save(snapshot_t const *snap) {
+  nvs_handle handle;
+  esp_err_t err = nvs_open(SNAPSHOT_NAMESPACE, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+  if ((err = nvs_set_blob(handle, SNAPSHOT_KEY, snap, sizeof(snapshot_t))) == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  return err;
+}
+
+static bool seed_tag_matches(flex_trit_t const *seed) {
+  uint8_t tag[CRYPTO_RECORD_TAG_LEN];
+  crypto_record_tag(seed, FLEX_TRIT_SIZE_243, tag);
+  return crypto_memcmp_ct(tag, rtc_snapshot.seed_tag, CRYPTO_RECORD_TAG_LEN) == 0;
+}
+
+void snapshot_restore() {
+  snapshot_lock = xSemaphoreCreateMutex();
+  if (snapshot_is_valid(&rtc_snapshot)) {
+    restored_from = "rtc";
+  } else if (snapshot_load(&rtc_snapshot) == ESP_OK) {
+    restored_from = "nvs";
+    nvs_crc = rtc_snapshot.crc;
+  } else {
+    snapshot_reset();
+    nvs_crc = 0;
+  }
+
+  // the cycle goes on only on its own timer wake-ups, a reset brings the prompt back.
+  if (rtc_snapshot.cycle_interval_s && esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER) {
+    rtc_snapshot.cycle_interval_s = 0;
+    snapshot_seal();
+  }
+  ESP_LOGI(TAG, "restored from %s, %u addresses, unused index %u", restored_from, rtc_snapshot.address_count,
+           rtc_snapshot.unused_index);
+}
+
+void snapshot_set_account(flex_trit_t const *seed, uint8_t security, account_data_t *account) {
+  size_t count = hash243_queue_count(account->addresses);
+  size_t unused = count;
+  for (size_t i = 0; i < count; i++) {
+    if (memcmp(hash243_queue_at(account->addresses, i), account->latest_address, FLEX_TRIT_SIZE_243) == 0) {
+      unused = i;
+      break;
+    }
+  }
+  // the latest addresses up to the unused one
+  size_t first = unused + 1 > CONFIG_SNAPSHOT_ADDRESSES ? unused + 1 - CONFIG_SNAPSHOT_ADDRESSES : 0;
+
+  xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+  crypto_record_tag(seed, FLEX_TRIT_SIZE_243, rtc_snapshot.seed_tag);
+  rtc_snapshot.security = security;
+  rtc_snapshot.first_index = first;
+  rtc_snapshot.unused_index = unused;
+  rtc_snapshot.address_count = unused + 1 - first;
+  rtc_snapshot.balance = 0;
+  for (size_t i = first; i <= unused; i++) {
+    if (i < count) {
+      memcpy(rtc_snapshot.addresses[i - first], hash243_queue_at(account->addresses, i), FLEX_TRIT_SIZE_243);
+      rtc_snapshot.balance += account_data_get_balance(account, i);
+    } else {
+      memcpy(rtc_snapshot.addresses[i - first], account->latest_address, FLEX_TRIT_SIZE_243);
+    }
+  }
+  snapshot_seal();
+  xSemaphoreGive(snapshot_lock);
+  snapshot_commit();
+}
+
+bool snapshot_get_address(flex_trit_t const *seed, uint8_t security, uint64_t index, flex_trit_t *addr) {
+  bool found = false;
+  xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+  if (rtc_snapshot.security == security && index >= rtc_snapshot.first_index &&
+      index < (uint64_t)rtc_snapshot.first_index + rtc_snapshot.address_count && seed_tag_matches(seed)) {
+    memcpy(addr, rtc_snapshot.addresses[index - rtc_snapshot.first_index], FLEX_TRIT_SIZE_243);
+    found = true;
+  }
+  xSemaphoreGive(snapshot_lock);
+  return found;
+}
+
+void snapshot_set_milestone(flex_trit_t const *hash, uint32_t index) {
+  xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+  if (index >= rtc_snapshot.milestone_index) {
+    memcpy(rtc_snapshot.milestone, hash, FLEX_TRIT_SIZE_243);
+    rtc_snapshot.milestone_index = index;
+    snapshot_seal();
+  }
+  xSemaphoreGive(snapshot_lock);
+}
+
+bool snapshot_get_ap(uint8_t *bssid, uint8_t *channel) {
+  xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+  bool cached = rtc_snapshot.ap_channel != 0;
+  if (cached) {
+    memcpy(bssid, rtc_snapshot.ap_bssid, SNAPSHOT_BSSID_LEN);
+    *channel = rtc_snapshot.ap_channel;
+  }
+  xSemaphoreGive(snapshot_lock);
+  return cached;
+}
+
+void snapshot_set_ap(uint8_t const *bssid, uint8_t channel) {
+  xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+  memcpy(rtc_snapshot.ap_bssid, bssid, SNAPSHOT_BSSID_LEN);
+  rtc_snapshot.ap_channel = channel;
+  snapshot_seal();
+  xSemaphoreGive(snapshot_lock);
+}
+
+void snapshot_clear_ap() { snapshot_set_ap((uint8_t[SNAPSHOT_BSSID_LEN]){}, 0); }
+
+esp_err_t snapshot_commit() {
+  snapshot_t snap;
+  xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+  memcpy(&snap, &rtc_snapshot, sizeof(snap));
+  xSemaphoreGive(snapshot_lock);
+  if (snap.crc == nvs_crc) {
+    return ESP_OK;
+  }
+  esp_err_t err = snapshot_save(&snap);
+  if (err == ESP_OK) {
+    nvs_crc = snap.crc;
+  } else {
+    ESP_LOGW(TAG, "saving to NVS failed: %s", esp_err_to_name(err));
+  }
+  return err;
+}
+
+bool snapshot_cycle_due() {
+  return rtc_snapshot.cycle_interval_s && rtc_snapshot.address_count &&
+         esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+}
+
+// RTC memory is kept in deep sleep, the NVS copy isn't written on every cycle.
+static void snapshot_deep_sleep(uint32_t interval_s) {
+  wallet_http_close();
+  binproto_close();
+  esp_wifi_stop();
+  ESP_LOGI(TAG, "sleeping for %us", interval_s);
+  esp_sleep_enable_timer_wakeup(interval_s * 1000000ULL);
+  esp_deep_sleep_start();
+}
+
+static retcode_t cycle_check_balance() {
+  retcode_t ret = RC_OOM;
+  get_balances_req_t *req = get_balances_req_new();
+  get_balances_res_t *res = get_balances_res_new();
+  if (!req || !res) {
+    goto done;
+  }
+  for (size_t i = 0; i < rtc_snapshot.address_count; i++) {
+    if ((ret = get_balances_req_address_add(req, rtc_snapshot.addresses[i])) != RC_OK) {
+      goto done;
+    }
+  }
+  req->threshold = 100;
+
+  iota_client_service_t *client = wallet_client_acquire();
+  ret = wallet_http_get_balances(client, req, res);
+  wallet_client_release();
+  if (ret != RC_OK) {
+    goto done;
+  }
+
+  uint64_t balance = 0;
+  for (size_t i = 0; i < get_balances_res_balances_num(res); i++) {
+    balance += get_balances_res_balances_at(res, i);
+  }
+  if (balance != rtc_snapshot.balance) {
+    ESP_LOGW(TAG, "balance changed: %" PRIu64 " -> %" PRIu64, rtc_snapshot.balance, balance);
+  }
+  xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+  rtc_snapshot.balance = balance;
+  snapshot_seal();
+  xSemaphoreGive(snapshot_lock);
+  if (res->references) {
+    snapshot_set_milestone(res->references->hash, res->milestone_index);
+  }
+
+done:
+  get_balances_req_free(&req);
+  get_balances_res_free(&res);
+  return ret;
+}
+
+void snapshot_cycle_run() {
+  uint32_t interval = rtc_snapshot.cycle_interval_s;
+  retcode_t ret = RC_ERROR;
+  if (boot_wait_network()) {
+    ret = cycle_check_balance();
+  }
+
+  xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+  rtc_snapshot.cycles++;
+  snapshot_seal();
+  xSemaphoreGive(snapshot_lock);
+  ESP_LOGI(TAG, "cycle %u: %s, balance %" PRIu64 ", milestone %u, done at %" PRId64 "ms", rtc_snapshot.cycles,
+           ret == RC_OK ? "ok" : error_2_string(ret), rtc_snapshot.balance, rtc_snapshot.milestone_index,
+           esp_timer_get_time() / 1000);
+  snapshot_deep_sleep(interval);
+}
+
+/* 'snapshot' command */
+static struct {
+  struct arg_lit *clear;
+  struct arg_end *end;
+} snapshot_args;
+
+static int fn_snapshot(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&snapshot_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, snapshot_args.end, argv[0]);
+    return -1;
+  }
+
+  snapshot_t snap;
+  xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+  if (snapshot_args.clear->count) {
+    snapshot_reset();
+  }
+  memcpy(&snap, &rtc_snapshot, sizeof(snap));
+  xSemaphoreGive(snapshot_lock);
+  if (snapshot_args.clear->count) {
+    return snapshot_commit();
+  }
+
+  printf("restored from %s, %u bytes\n", restored_from, sizeof(snapshot_t));
+  printf("seed tag: ");
+  for (int i = 0; i < CRYPTO_RECORD_TAG_LEN; i++) {
+    printf("%02x", snap.seed_tag[i]);
+  }
+  printf("\naddresses: %u from index %u, unused index %u, security %u\n", snap.address_count, snap.first_index,
+         snap.unused_index, snap.security);
+  for (int i = 0; i < snap.address_count; i++) {
+    printf("[%u] ", snap.first_index + i);
+    flex_trit_print(snap.addresses[i], NUM_TRITS_ADDRESS);
+    printf("\n");
+  }
+  printf("balance: %" PRIu64 "\n", snap.balance);
+  printf("milestone %u: ", snap.milestone_index);
+  flex_trit_print(snap.milestone, NUM_TRITS_HASH);
+  printf("\n");
+  if (snap.ap_channel) {
+    printf("ap: %02x:%02x:%02x:%02x:%02x:%02x, channel %u\n", snap.ap_bssid[0], snap.ap_bssid[1], snap.ap_bssid[2],
+           snap.ap_bssid[3], snap.ap_bssid[4], snap.ap_bssid[5], snap.ap_channel);
+  }
+  printf("sleep cycle: %us, %u cycles\n", snap.cycle_interval_s, snap.cycles);
+  return 0;
+}
+
+/* 'sleep_cycle' command */
+static struct {
+  struct arg_int *interval;
+  struct arg_end *end;
+} sleep_cycle_args;
+
+static int fn_sleep_cycle(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&sleep_cycle_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, sleep_cycle_args.end, argv[0]);
+    return -1;
+  }
+
+  int interval = sleep_cycle_args.interval->ival[0];
+  if (interval <= 0) {
+    printf("Invalid interval\n");
+    return -1;
+  }
+  xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+  bool cached = rtc_snapshot.address_count > 0;
+  if (cached) {
+    rtc_snapshot.cycle_interval_s = interval;
+    rtc_snapshot.cycles = 0;
+    snapshot_seal();
+  }
+  xSemaphoreGive(snapshot_lock);
+  if (!cached) {
+    printf("No cached addresses, run `account` first\n");
+    return -1;
+  }
+
+  printf("Checking the balance every %ds, reset the board to stop\n", interval);
+  fflush(stdout);
+  snapshot_commit();
+  snapshot_deep_sleep(interval);
+  return 0;
+}
+
+void register_snapshot() {
+  snapshot_args.clear = arg_lit0("c", "clear", "clear the snapshot");
+  snapshot_args.end = arg_end(2);
+  const esp_console_cmd_t snapshot_cmd = {
+      .command = "snapshot",
+      .help = "Show the wallet state kept in RTC memory and NVS",
+      .hint = " [-c]",
+      .func = &fn_snapshot,
+      .argtable = &snapshot_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&snapshot_cmd, 0));
+
+  sleep_cycle_args.interval = arg_int1(NULL, NULL, "<seconds>", "wake-up interval");
+  sleep_cycle_args.end = arg_end(2);
+  const esp_console_cmd_t sleep_cycle_cmd = {
+      .command = "sleep_cycle",
+      .help = "Deep sleep and check the balance of cached addresses periodically",
+      .hint = " <seconds>",
+      .func = &fn_sleep_cycle,
+      .argtable = &sleep_cycle_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&sleep_cycle_cmd, 0));
+}
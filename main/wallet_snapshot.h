@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cclient/api/extended/extended_api.h"
+#include "common/trinary/flex_trit.h"
+#include "esp_err.h"
+
+/*
+ * Snapshot of hot wallet state in RTC memory, it survives deep sleep and `restart`, a copy in
+ * NVS survives power cycles. It's restored before Wi-Fi starts and holds:
+ *  - a fingerprint of the seed, cached addresses are dropped if the seed changes
+ *  - the next unused address index and the latest addresses with their balance
+ *  - the last milestone seen
+ *  - the AP of the last connection, Wi-Fi connects without a scan
+ *
+ * `sleep_cycle` wakes from deep sleep periodically, checks the balance of cached addresses and
+ * goes back to sleep without generating addresses or showing the prompt.
+ */
+
+// Restore from RTC memory, or from NVS after a power cycle. Call it before Wi-Fi starts.
+void snapshot_restore();
+
+// Cache the latest addresses of an `account` result, they end with the unused address.
+void snapshot_set_account(flex_trit_t const *seed, uint8_t security, account_data_t *account);
+// Copy a cached address of the seed, returns false if it's not cached.
+bool snapshot_get_address(flex_trit_t const *seed, uint8_t security, uint64_t index, flex_trit_t *addr);
+void snapshot_set_milestone(flex_trit_t const *hash, uint32_t index);
+
+// AP of the last connection, channel and BSSID for a fast reconnect.
+bool snapshot_get_ap(uint8_t *bssid, uint8_t *channel);
+void snapshot_set_ap(uint8_t const *bssid, uint8_t channel);
+void snapshot_clear_ap();
+
+// Write the NVS copy if the snapshot changed since the last write.
+esp_err_t snapshot_commit();
+
+// True if this boot is a wake-up of `sleep_cycle`
+bool snapshot_cycle_due();
+// Check balances of cached addresses, update the snapshot and go back to deep sleep.
+void snapshot_cycle_run();
+
+// Register `snapshot` and `sleep_cycle` commands
+void register_snapshot();
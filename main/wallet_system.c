@@ -13,6 +13,7 @@
 #include "esp_spi_flash.h"
 #include "esp_system.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "sdkconfig.h"
 #include "soc/rtc_cntl_reg.h"
@@ -23,6 +24,31 @@
 #include "cclient/api/extended/extended_api.h"
 #include "common/helpers/sign.h"
 #include "utils/input_validators.h"
+#include "utils/memset_safe.h"
+
+#include "bundle_validator.h"
+#include "confirmation_mgr.h"
+#include "crypto_backend.h"
+#include "esp_timer.h"
+#include "hash_set.h"
+#include "input_selector.h"
+#include "log_ring.h"
+#include "net_sched.h"
+#include "node_events.h"
+#include "seed_vault.h"
+#include "spent_index.h"
+#include "tip_pool.h"
+#include "tx_view.h"
+#include "wallet_accounts.h"
+#include "wallet_api.h"
+#include "wallet_batch.h"
+#include "wallet_bench.h"
+#include "wallet_boot.h"
+#include "wallet_binproto.h"
+#include "wallet_http.h"
+#include "wallet_mem.h"
+#include "wallet_output.h"
+#include "wallet_snapshot.h"
 
 static const char *TAG = "wallet_system";
 
@@ -35,6 +61,10 @@ typedef struct {
 } iota_ctx_t;
 
 static iota_ctx_t iota_ctx;
+// the client is shared by its users and replaced when it has none
+static SemaphoreHandle_t client_lock = NULL; /*!< protects client_users */
+static SemaphoreHandle_t client_idle = NULL; /*!< given while the client has no users */
+static int client_users = 0;
 
 static char const *amazon_ca1_pem =
     "-----BEGIN CERTIFICATE-----\r\n"
@@ -73,6 +103,36 @@ static void arg_str_reset(struct arg_str *parent) {
   parent->count = 0;
 }
 
+// the wallet seed, from the vault if it's provisioned.
+static bool wallet_master_seed(flex_trit_t *seed) {
+  if (seed_vault_is_provisioned()) {
+    if (!seed_vault_get_trits(seed)) {
+      printf("The seed vault is locked, `unlock` it first\n");
+      return false;
+    }
+    return true;
+  }
+
+  if (flex_trits_from_trytes(seed, NUM_TRITS_HASH, (tryte_t const *)iota_ctx.seed, NUM_TRYTES_HASH, NUM_TRYTES_HASH) ==
+      0) {
+    ESP_LOGE(TAG, "seed flex_trits convertion failed");
+    return false;
+  }
+  return true;
+}
+
+// the seed of commands, the seed of the active account. security is set if the account has its own level.
+static bool wallet_seed(flex_trit_t *seed, uint8_t *security) {
+  if (!wallet_master_seed(seed)) {
+    return false;
+  }
+  if (!wallet_accounts_seed(seed, security)) {
+    memset_safe(seed, FLEX_TRIT_SIZE_243, 0, FLEX_TRIT_SIZE_243);
+    return false;
+  }
+  return true;
+}
+
 /* 'version' command */
 static int fn_get_version(int argc, char **argv) {
   esp_chip_info_t info;
@@ -98,12 +158,14 @@ static void register_version() {
       .hint = NULL,
       .func = &fn_get_version,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&cmd, WALLET_CMD_CONCURRENT));
 }
 
 /* 'restart' command */
 static int fn_restart(int argc, char **argv) {
   ESP_LOGI(TAG, "Restarting");
+  wallet_http_close();
+  binproto_close();
   destory_iota_client();
   esp_restart();
 }
@@ -115,11 +177,19 @@ static void register_restart() {
       .hint = NULL,
       .func = &fn_restart,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&cmd, 0));
 }
 
 /* 'free' command */
 static int fn_free_mem(int argc, char **argv) {
+  if (output_format() != OUTPUT_TEXT) {
+    output_rec_t rec;
+    output_rec_begin(&rec, OUTPUT_REC_VALUE);
+    output_rec_str(&rec, "name", "free");
+    output_rec_uint(&rec, "value", esp_get_free_heap_size());
+    output_rec_end(&rec);
+    return 0;
+  }
   printf("%d\n", esp_get_free_heap_size());
   return 0;
 }
@@ -131,7 +201,7 @@ static void register_free() {
       .hint = NULL,
       .func = &fn_free_mem,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&cmd, WALLET_CMD_CONCURRENT));
 }
 
 /* 'heap' command */
@@ -150,7 +220,7 @@ static void register_heap() {
       .hint = NULL,
       .func = &fn_heap_size,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&heap_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&heap_cmd, WALLET_CMD_CONCURRENT));
 }
 
 /* 'stack' command */
@@ -167,7 +237,7 @@ static void register_stack_info() {
       .hint = NULL,
       .func = &fn_stack_info,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&stack_info_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&stack_info_cmd, WALLET_CMD_CONCURRENT));
 }
 
 /* 'node_info' command */
@@ -180,6 +250,20 @@ static int fn_node_info(int argc, char **argv) {
   }
 
   if ((ret = iota_client_get_node_info(iota_ctx.client, node_res)) == RC_OK) {
+    snapshot_set_milestone(node_res->latest_milestone, node_res->latest_milestone_index);
+  }
+  if (ret == RC_OK && output_format() != OUTPUT_TEXT) {
+    output_rec_t rec;
+    output_rec_begin(&rec, OUTPUT_REC_NODE_INFO);
+    output_rec_str(&rec, "appName", get_node_info_res_app_name(node_res));
+    output_rec_str(&rec, "appVersion", get_node_info_res_app_version(node_res));
+    output_rec_hash(&rec, "latestMilestone", node_res->latest_milestone);
+    output_rec_uint(&rec, "latestMilestoneIndex", node_res->latest_milestone_index);
+    output_rec_hash(&rec, "latestSolidSubtangleMilestone", node_res->latest_solid_subtangle_milestone);
+    output_rec_uint(&rec, "latestSolidSubtangleMilestoneIndex", node_res->latest_solid_subtangle_milestone_index);
+    output_rec_uint(&rec, "tips", node_res->tips);
+    output_rec_end(&rec);
+  } else if (ret == RC_OK) {
     printf("=== Node: %s:%d ===\n", iota_ctx.client->http.host, iota_ctx.client->http.port);
     printf("appName %s \n", get_node_info_res_app_name(node_res));
     printf("appVersion %s \n", get_node_info_res_app_version(node_res));
@@ -215,7 +299,7 @@ static void register_node_info() {
       .hint = NULL,
       .func = &fn_node_info,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&node_info_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&node_info_cmd, WALLET_CMD_CONCURRENT | WALLET_CMD_NETWORK));
 }
 
 /* 'node_info_set' command */
@@ -250,8 +334,10 @@ static int fn_node_info_set(int argc, char **argv) {
   }
 
   if (iota_client_get_node_info(service, node_res) == RC_OK) {
+    xSemaphoreTake(client_idle, portMAX_DELAY);
     iota_client_core_destroy(&iota_ctx.client);
     iota_ctx.client = service;
+    xSemaphoreGive(client_idle);
   } else {
     iota_client_core_destroy(&service);
   }
@@ -275,23 +361,30 @@ static void register_node_info_set() {
       .argtable = &node_info_set_args,
   };
 
-  ESP_ERROR_CHECK(esp_console_cmd_register(&node_info_set_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&node_info_set_cmd, 0));
 }
 
 /* 'seed' command */
 static int fn_get_seed(int argc, char **argv) {
-  printf("%s\n", iota_ctx.seed);
+  flex_trit_t seed[FLEX_TRIT_SIZE_243];
+  uint8_t security = iota_ctx.security;
+  if (!wallet_seed(seed, &security)) {
+    return -1;
+  }
+  flex_trit_print(seed, NUM_TRITS_HASH);
+  printf("\n");
+  memset_safe(seed, sizeof(seed), 0, sizeof(seed));
   return 0;
 }
 
 static void register_get_seed() {
   const esp_console_cmd_t get_seed_cmd = {
       .command = "seed",
-      .help = "Get the seed of this wallet",
+      .help = "Get the seed of the active account",
       .hint = NULL,
       .func = &fn_get_seed,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&get_seed_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&get_seed_cmd, WALLET_CMD_CONCURRENT));
 }
 
 /* 'seed_set' command */
@@ -307,6 +400,11 @@ static int fn_seed_set(int argc, char **argv) {
     return -1;
   }
 
+  if (seed_vault_is_provisioned()) {
+    printf("The seed is stored in the vault, use `vault_store` to replace it\n");
+    return -1;
+  }
+
   char *seed = (char *)seed_set_args.seed->sval[0];
   to_uppercase(seed, strlen(seed));
   if (!is_seed((tryte_t *)seed)) {
@@ -330,7 +428,126 @@ static void register_seed_set() {
       .func = &fn_seed_set,
       .argtable = &seed_set_args,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&seed_set_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&seed_set_cmd, WALLET_CMD_SECRET));
+}
+
+/* 'vault_store' command */
+static struct {
+  struct arg_str *passphrase;
+  struct arg_int *iterations;
+  struct arg_end *end;
+} vault_store_args;
+
+static int fn_vault_store(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&vault_store_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, vault_store_args.end, argv[0]);
+    return -1;
+  }
+
+  char seed[NUM_TRYTES_HASH + 1] = {};
+  flex_trit_t seed_trits[FLEX_TRIT_SIZE_243];
+  if (seed_vault_is_provisioned()) {
+    // re-encrypt the unlocked seed with a new passphrase or KDF cost
+    if (!wallet_master_seed(seed_trits)) {
+      return -1;
+    }
+    flex_trits_to_trytes((tryte_t *)seed, NUM_TRYTES_HASH, seed_trits, NUM_TRITS_HASH, NUM_TRITS_HASH);
+    memset_safe(seed_trits, sizeof(seed_trits), 0, sizeof(seed_trits));
+  } else {
+    memcpy(seed, iota_ctx.seed, NUM_TRYTES_HASH);
+  }
+
+  uint32_t iterations = vault_store_args.iterations->count ? vault_store_args.iterations->ival[0] : 0;
+  esp_err_t err = seed_vault_store(seed, vault_store_args.passphrase->sval[0], iterations);
+  memset_safe(seed, sizeof(seed), 0, sizeof(seed));
+  if (err != ESP_OK) {
+    printf("Storing seed failed: %s\n", esp_err_to_name(err));
+    return -1;
+  }
+
+  // the plaintext seed is not needed anymore
+  memset_safe(iota_ctx.seed, sizeof(iota_ctx.seed), 0, sizeof(iota_ctx.seed));
+  seed_vault_lock();
+  printf("The seed is stored in the vault, `unlock` it for using\n");
+  return 0;
+}
+
+static void register_vault_store() {
+  vault_store_args.passphrase = arg_str1(NULL, NULL, "<passphrase>", "passphrase of the vault");
+  vault_store_args.iterations = arg_int0("i", "iterations", "<iterations>", "KDF iterations");
+  vault_store_args.passphrase->hdr.resetfn = (arg_resetfn *)arg_str_reset;
+  vault_store_args.end = arg_end(3);
+  const esp_console_cmd_t vault_store_cmd = {
+      .command = "vault_store",
+      .help = "Encrypt the seed and store it in NVS",
+      .hint = " <passphrase> [-i iterations]",
+      .func = &fn_vault_store,
+      .argtable = &vault_store_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&vault_store_cmd, WALLET_CMD_SECRET));
+}
+
+/* 'unlock' command */
+static struct {
+  struct arg_str *passphrase;
+  struct arg_int *timeout;
+  struct arg_end *end;
+} unlock_args;
+
+static int fn_unlock(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&unlock_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, unlock_args.end, argv[0]);
+    return -1;
+  }
+
+  uint32_t timeout = unlock_args.timeout->count ? unlock_args.timeout->ival[0] : 0;
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = seed_vault_unlock(unlock_args.passphrase->sval[0], timeout);
+  if (err == ESP_ERR_INVALID_CRC) {
+    printf("Wrong passphrase\n");
+    return -1;
+  } else if (err != ESP_OK) {
+    printf("Unlock failed: %s\n", esp_err_to_name(err));
+    return -1;
+  }
+  printf("Unlocked in %" PRId64 "ms\n", (esp_timer_get_time() - start) / 1000);
+  return 0;
+}
+
+static void register_unlock() {
+  unlock_args.passphrase = arg_str1(NULL, NULL, "<passphrase>", "passphrase of the vault");
+  unlock_args.timeout = arg_int0("t", "timeout", "<seconds>", "session timeout");
+  unlock_args.passphrase->hdr.resetfn = (arg_resetfn *)arg_str_reset;
+  unlock_args.end = arg_end(3);
+  const esp_console_cmd_t unlock_cmd = {
+      .command = "unlock",
+      .help = "Unlock the seed vault for a session",
+      .hint = " <passphrase> [-t seconds]",
+      .func = &fn_unlock,
+      .argtable = &unlock_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&unlock_cmd, WALLET_CMD_SECRET));
+}
+
+/* 'lock' command */
+static int fn_lock(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  seed_vault_lock();
+  return 0;
+}
+
+static void register_lock() {
+  const esp_console_cmd_t lock_cmd = {
+      .command = "lock",
+      .help = "Lock the seed vault",
+      .hint = NULL,
+      .func = &fn_lock,
+      .argtable = NULL,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&lock_cmd, 0));
 }
 
 /* 'balance' command */
@@ -376,7 +593,17 @@ static int fn_get_balance(int argc, char **argv) {
 
   balance_req->threshold = 100;
 
-  if ((ret_code = iota_client_get_balances(iota_ctx.client, balance_req, balance_res)) == RC_OK) {
+  if ((ret_code = wallet_http_get_balances(iota_ctx.client, balance_req, balance_res)) == RC_OK &&
+      output_format() != OUTPUT_TEXT) {
+    size_t balance_cnt = get_balances_res_balances_num(balance_res);
+    for (size_t i = 0; i < balance_cnt; i++) {
+      output_rec_t rec;
+      output_rec_begin(&rec, OUTPUT_REC_BALANCE);
+      output_rec_hash(&rec, "address", get_balances_req_address_get(balance_req, i));
+      output_rec_uint(&rec, "balance", get_balances_res_balances_at(balance_res, i));
+      output_rec_end(&rec);
+    }
+  } else if (ret_code == RC_OK) {
     hash243_queue_entry_t *q_iter = NULL;
     size_t balance_cnt = get_balances_res_balances_num(balance_res);
     for (size_t i = 0; i < balance_cnt; i++) {
@@ -400,9 +627,10 @@ done:
 
 static void register_get_balance() {
   // get_balance_args.address = arg_str1(NULL, NULL, "<ADDRESS>", "An Address hash");
-  get_balance_args.address = arg_strn(NULL, NULL, "<address...>", 1, 10, "Address hashes");
+  get_balance_args.address =
+      arg_strn(NULL, NULL, "<address...>", 1, CONFIG_WALLET_BATCH_MAX_ARGS - 1, "Address hashes");
   get_balance_args.address->hdr.resetfn = (arg_resetfn *)arg_str_reset;
-  get_balance_args.end = arg_end(12);
+  get_balance_args.end = arg_end(CONFIG_WALLET_BATCH_MAX_ARGS + 2);
   const esp_console_cmd_t get_balance_cmd = {
       .command = "balance",
       .help = "Get the balance from an addresses",
@@ -410,17 +638,41 @@ static void register_get_balance() {
       .func = &fn_get_balance,
       .argtable = &get_balance_args,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&get_balance_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&get_balance_cmd, WALLET_CMD_CONCURRENT | WALLET_CMD_NETWORK));
 }
 
 /* 'account' command */
+static struct {
+  struct arg_lit *all;
+  struct arg_end *end;
+} account_data_args;
+
 static int fn_account_data(int argc, char **argv) {
   retcode_t ret = RC_OK;
   flex_trit_t seed[FLEX_TRIT_SIZE_243];
+  uint8_t security = 2;
 
-  if (flex_trits_from_trytes(seed, NUM_TRITS_ADDRESS, (const tryte_t *)iota_ctx.seed, NUM_TRYTES_ADDRESS,
-                             NUM_TRYTES_ADDRESS) == 0) {
-    ESP_LOGE(TAG, "converting flex_trit failed");
+  int nerrors = arg_parse(argc, argv, (void **)&account_data_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, account_data_args.end, argv[0]);
+    return 1;
+  }
+
+  if (account_data_args.all->count) {
+    // balances of all accounts in one getBalances
+    if (!wallet_master_seed(seed)) {
+      return 1;
+    }
+    ret = wallet_accounts_refresh_all(iota_ctx.client, seed, security);
+    memset_safe(seed, sizeof(seed), 0, sizeof(seed));
+    if (ret != RC_OK) {
+      ESP_LOGE(TAG, "Error: %s\n", error_2_string(ret));
+      return 2;
+    }
+    return 0;
+  }
+
+  if (!wallet_seed(seed, &security)) {
     return 1;
   }
 
@@ -428,7 +680,28 @@ static int fn_account_data(int argc, char **argv) {
   account_data_t account = {};
   account_data_init(&account);
 
-  if ((ret = iota_client_get_account_data(iota_ctx.client, seed, 2, &account)) == RC_OK) {
+  if ((ret = iota_client_get_account_data(iota_ctx.client, seed, security, &account)) == RC_OK) {
+    snapshot_set_account(seed, security, &account);
+    input_selector_set_account(seed, security, &account);
+    wallet_accounts_set_account(&account);
+  }
+  if (ret == RC_OK && output_format() != OUTPUT_TEXT) {
+    output_rec_t rec;
+    size_t addr_count = hash243_queue_count(account.addresses);
+    for (size_t i = 0; i < addr_count; i++) {
+      output_rec_begin(&rec, OUTPUT_REC_ADDRESS);
+      output_rec_uint(&rec, "index", i);
+      output_rec_hash(&rec, "address", hash243_queue_at(account.addresses, i));
+      output_rec_uint(&rec, "balance", account_data_get_balance(&account, i));
+      output_rec_end(&rec);
+    }
+    output_rec_begin(&rec, OUTPUT_REC_ACCOUNT);
+    output_rec_uint(&rec, "balance", account.balance);
+    output_rec_hash(&rec, "unusedAddress", account.latest_address);
+    output_rec_uint(&rec, "addressCount", addr_count);
+    output_rec_end(&rec);
+    account_data_clear(&account);
+  } else if (ret == RC_OK) {
 #if 0  // dump transaction hashes
     size_t tx_count = hash243_queue_count(account.transactions);
     for (size_t i = 0; i < tx_count; i++) {
@@ -459,19 +732,23 @@ static int fn_account_data(int argc, char **argv) {
     account_data_clear(&account);
   } else {
     ESP_LOGE(TAG, "Error: %s\n", error_2_string(ret));
-    return 2;
+    ret = 2;
   }
-  return 0;
+  memset_safe(seed, sizeof(seed), 0, sizeof(seed));
+  return ret;
 }
 
 static void register_account_data() {
+  account_data_args.all = arg_lit0("a", "all", "balances of all accounts in one request");
+  account_data_args.end = arg_end(2);
   const esp_console_cmd_t account_data_cmd = {
       .command = "account",
-      .help = "Get account data",
-      .hint = NULL,
+      .help = "Get account data of the active account, or balances of all accounts",
+      .hint = " [-a]",
       .func = &fn_account_data,
+      .argtable = &account_data_args,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&account_data_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&account_data_cmd, WALLET_CMD_CONCURRENT | WALLET_CMD_NETWORK));
 }
 
 void convertToUpperCase(char *sPtr, int nchar) {
@@ -488,6 +765,7 @@ static struct {
   struct arg_str *tag;
   struct arg_str *remainder;
   struct arg_str *message;
+  struct arg_lit *scan;
   struct arg_end *end;
 } send_args;
 
@@ -521,29 +799,42 @@ static int fn_send(int argc, char **argv) {
   padded_tag[NUM_TRYTES_TAG] = '\0';
 
   printf("sending %lld to %s\n", value, receiver);
-  printf("security %d, depth %d, MWM %d, tag [%s]\n", iota_ctx.security, iota_ctx.depth, iota_ctx.mwm,
-         strlen(tag) ? padded_tag : "empty");
   printf("remainder [%s]\n", strlen(remainder) ? remainder : "empty");
   printf("message [%s]\n", strlen(msg) ? msg : "empty");
 
   bundle_transactions_t *bundle = NULL;
   bundle_transactions_new(&bundle);
   transfer_array_t *transfers = transfer_array_new();
+  hash8019_array_p trytes = hash8019_array_new();
+  flex_trit_t seed[NUM_FLEX_TRITS_ADDRESS];
+  uint8_t security = iota_ctx.security;
+  transaction_array_t *out_txs = transaction_array_new();
+  iota_transaction_t *tx = NULL;
+  flex_trit_t serialized_tx[FLEX_TRIT_SIZE_8019];
+  inputs_t inputs = {};
+  inputs_init(&inputs);
 
   /* transfer setup */
   transfer_t tf = {};
+  if (!bundle || !transfers || !trytes || !out_txs) {
+    ESP_LOGE(TAG, "Error: OOM");
+    ret_code = RC_OOM;
+    goto done;
+  }
+
   // seed
-  flex_trit_t seed[NUM_FLEX_TRITS_ADDRESS];
-  if (flex_trits_from_trytes(seed, NUM_TRITS_ADDRESS, (tryte_t const *)iota_ctx.seed, NUM_TRYTES_ADDRESS,
-                             NUM_TRYTES_ADDRESS) == 0) {
-    ESP_LOGE(TAG, "seed flex_trits convertion failed");
+  if (!wallet_seed(seed, &security)) {
+    ret_code = RC_ERROR;
     goto done;
   }
+  printf("security %d, depth %d, MWM %d, tag [%s]\n", security, iota_ctx.depth, iota_ctx.mwm,
+         strlen(tag) ? padded_tag : "empty");
 
   // receiver
   if (flex_trits_from_trytes(tf.address, NUM_TRITS_ADDRESS, (tryte_t const *)receiver, NUM_TRYTES_ADDRESS,
                              NUM_TRYTES_ADDRESS) == 0) {
     ESP_LOGE(TAG, "address flex_trits convertion failed");
+    ret_code = RC_ERROR;
     goto done;
   }
 
@@ -551,6 +842,7 @@ static int fn_send(int argc, char **argv) {
   printf("tag: %s\n", padded_tag);
   if (flex_trits_from_trytes(tf.tag, NUM_TRITS_TAG, (tryte_t const *)padded_tag, NUM_TRYTES_TAG, NUM_TRYTES_TAG) == 0) {
     ESP_LOGE(TAG, "tag flex_trits convertion failed");
+    ret_code = RC_ERROR;
     goto done;
   }
 
@@ -562,8 +854,33 @@ static int fn_send(int argc, char **argv) {
 
   transfer_array_add(transfers, &tf);
 
-  ret_code = iota_client_send_transfer(iota_ctx.client, seed, iota_ctx.security, iota_ctx.depth, iota_ctx.mwm, false,
-                                       transfers, NULL, NULL, NULL, bundle);
+  // inputs from cached balances, get_inputs of the client library scans addresses from index 0.
+  int64_t prepare_start = esp_timer_get_time();
+  if (value > 0 && !send_args.scan->count &&
+      (ret_code = input_selector_select(iota_ctx.client, seed, security, value, &inputs)) != RC_OK) {
+    ESP_LOGW(TAG, "input selection failed: %s", error_2_string(ret_code));
+  }
+  size_t selected = inputs_len(&inputs);
+
+  // same steps as iota_client_send_transfer, but keeping the signed trytes for reattachment.
+  ret_code = iota_client_prepare_transfers(iota_ctx.client, seed, security, transfers, NULL,
+                                           selected ? &inputs : NULL, false, 0, bundle);
+  if (value > 0) {
+    printf("prepare latency: %" PRId64 "ms, inputs from %s\n", (esp_timer_get_time() - prepare_start) / 1000,
+           selected ? "the selector" : "get_inputs");
+  }
+  if (ret_code == RC_OK) {
+    spent_index_mark_bundle(bundle);
+    input_selector_mark_bundle(bundle);
+    // attachToTangle expects the last index first
+    BUNDLE_FOREACH(bundle, tx) {
+      transaction_serialize_on_flex_trits(tx, serialized_tx);
+      utarray_insert(trytes, serialized_tx, 0);
+    }
+    int64_t attach_start = esp_timer_get_time();
+    ret_code = tip_pool_send_trytes(iota_ctx.client, trytes, iota_ctx.depth, iota_ctx.mwm, out_txs);
+    printf("attach latency: %" PRId64 "ms\n", (esp_timer_get_time() - attach_start) / 1000);
+  }
 
   printf("send transaction: %s\n", error_2_string(ret_code));
   if (ret_code == RC_OK) {
@@ -571,14 +888,30 @@ static int fn_send(int argc, char **argv) {
     printf("bundle hash: ");
     flex_trit_print(bundle_hash, NUM_TRITS_HASH);
     printf("\n");
+
+    TX_OBJS_FOREACH(out_txs, tx) {
+      if (transaction_current_index(tx) == 0) {
+        printf("tail hash: ");
+        flex_trit_print(transaction_hash(tx), NUM_TRITS_HASH);
+        printf("\n");
+#ifdef CONFIG_CONFIRM_MGR_ENABLE
+        confirmation_mgr_track(bundle_hash, transaction_hash(tx), trytes);
+#endif
+        break;
+      }
+    }
   }
 
 done:
+  memset_safe(seed, sizeof(seed), 0, sizeof(seed));
   bundle_transactions_free(&bundle);
   transfer_message_free(&tf);
   transfer_array_free(transfers);
+  hash_array_free(trytes);
+  transaction_array_free(out_txs);
+  inputs_clear(&inputs);
 
-  return 0;
+  return ret_code;
 }
 
 static void register_send() {
@@ -587,6 +920,7 @@ static void register_send() {
   send_args.remainder = arg_str0("r", "remainder", "<REMAINDER>", "A remainder address");
   send_args.message = arg_str0("m", "message", "<MESSAGE>", "a message for this transaction");
   send_args.tag = arg_str0("t", "tag", "<TAG>", "A tag for this transaction");
+  send_args.scan = arg_lit0("f", "full-scan", "find inputs by get_inputs from address index 0");
   send_args.end = arg_end(12);
   // reset callbacks
   send_args.receiver->hdr.resetfn = (arg_resetfn *)arg_str_reset;
@@ -602,87 +936,233 @@ static void register_send() {
       .func = &fn_send,
       .argtable = &send_args,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&send_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&send_cmd, WALLET_CMD_NETWORK));
 }
 
 /* 'transactions' command */
+#define TRANSACTIONS_TRYTES_BATCH CONFIG_BUNDLE_VALIDATOR_BATCH_MAX
+
 static struct {
   struct arg_str *address;
+  struct arg_str *bundle;
+  struct arg_str *tag;
+  struct arg_lit *details;
   struct arg_end *end;
 } get_transactions_args;
 
+static retcode_t push_hashes(hash243_queue_t *queue, struct arg_str const *arg) {
+  flex_trit_t hash[FLEX_TRIT_SIZE_243];
+  for (int i = 0; i < arg->count; i++) {
+    if (strlen(arg->sval[i]) != HASH_LENGTH_TRYTE ||
+        flex_trits_from_trytes(hash, NUM_TRITS_HASH, (tryte_t const *)arg->sval[i], NUM_TRYTES_HASH,
+                               NUM_TRYTES_HASH) == 0) {
+      ESP_LOGE(TAG, "Invalid hash: %s", arg->sval[i]);
+      return RC_ERROR;
+    }
+    if (hash243_queue_push(queue, hash) != RC_OK) {
+      return RC_OOM;
+    }
+  }
+  return RC_OK;
+}
+
+static retcode_t push_tags(hash81_queue_t *queue, struct arg_str const *arg) {
+  flex_trit_t tag[FLEX_TRIT_SIZE_81];
+  char padded_tag[NUM_TRYTES_TAG];
+  for (int i = 0; i < arg->count; i++) {
+    size_t tag_size = strlen(arg->sval[i]);
+    if (tag_size > NUM_TRYTES_TAG) {
+      ESP_LOGE(TAG, "Invalid tag: %s", arg->sval[i]);
+      return RC_ERROR;
+    }
+    memset(padded_tag, '9', NUM_TRYTES_TAG);
+    memcpy(padded_tag, arg->sval[i], tag_size);
+    convertToUpperCase(padded_tag, tag_size);
+    if (flex_trits_from_trytes(tag, NUM_TRITS_TAG, (tryte_t const *)padded_tag, NUM_TRYTES_TAG, NUM_TRYTES_TAG) == 0) {
+      ESP_LOGE(TAG, "Invalid tag: %s", arg->sval[i]);
+      return RC_ERROR;
+    }
+    if (hash81_queue_push(queue, tag) != RC_OK) {
+      return RC_OOM;
+    }
+  }
+  return RC_OK;
+}
+
+// Hashes of a request not in the set yet go to the union in the order of the response.
+static retcode_t find_union(find_transactions_req_t const *req, hash_set_t *seen, hash243_queue_t *hashes,
+                            size_t *found) {
+  retcode_t ret = RC_OOM;
+  find_transactions_res_t *res = find_transactions_res_new();
+  if (res && (ret = wallet_http_find_transactions(iota_ctx.client, req, res)) == RC_OK) {
+    hash243_queue_entry_t *q_iter = NULL;
+    CDL_FOREACH(res->hashes, q_iter) {
+      bool added = false;
+      (*found)++;
+      if ((ret = hash_set_add(seen, q_iter->hash, &added)) != RC_OK ||
+          (added && (ret = hash243_queue_push(hashes, q_iter->hash)) != RC_OK)) {
+        break;
+      }
+    }
+  }
+  find_transactions_res_free(&res);
+  return ret;
+}
+
+// getTrytes of each hash once, in batches
+static retcode_t output_details(hash243_queue_t hashes) {
+  retcode_t ret = RC_OK;
+  hash243_queue_entry_t *q_iter = hashes;
+  size_t count = hash243_queue_count(hashes);
+  size_t index = 0;
+  tx_view_t view;
+
+  while (ret == RC_OK && index < count) {
+    get_trytes_req_t *req = get_trytes_req_new();
+    get_trytes_res_t *res = get_trytes_res_new();
+    if (req == NULL || res == NULL) {
+      ret = RC_OOM;
+    }
+    size_t batch = 0;
+    for (; ret == RC_OK && batch < TRANSACTIONS_TRYTES_BATCH && index + batch < count; batch++) {
+      ret = hash243_queue_push(&req->hashes, q_iter->hash);
+      q_iter = q_iter->next;
+    }
+    if (ret == RC_OK && (ret = wallet_http_get_trytes(iota_ctx.client, req, res)) == RC_OK) {
+      for (size_t i = 0; i < hash8019_queue_count(res->trytes) && i < batch; i++) {
+        flex_trit_t const *trytes = hash8019_queue_at(res->trytes, i);
+        if (output_format() != OUTPUT_TEXT) {
+          output_rec_t rec;
+          output_rec_begin(&rec, OUTPUT_REC_TRANSACTION);
+          output_rec_trits(&rec, "trytes", trytes, NUM_TRITS_SERIALIZED_TRANSACTION);
+          output_rec_end(&rec);
+          continue;
+        }
+        tx_view_init(&view, trytes);
+        printf("[%ld] ", (long int)(index + i));
+        flex_trit_print(hash243_queue_at(req->hashes, i), NUM_TRITS_HASH);
+        printf(" value %" PRId64 " index %" PRIu64 "/%" PRIu64 "\n", tx_view_value(&view),
+               tx_view_current_index(&view), tx_view_last_index(&view));
+      }
+    }
+    index += batch;
+    get_trytes_req_free(&req);
+    get_trytes_res_free(&res);
+  }
+  return ret;
+}
+
 static int fn_get_transactions(int argc, char **argv) {
   retcode_t ret_code = RC_OK;
-  flex_trit_t tmp_hash[FLEX_TRIT_SIZE_243];
+  hash_set_t seen;
+  hash243_queue_t hashes = NULL;
+  size_t found = 0;
+  find_transactions_req_t *reqs[3] = {};
 
   int nerrors = arg_parse(argc, argv, (void **)&get_transactions_args);
   if (nerrors != 0) {
     arg_print_errors(stderr, get_transactions_args.end, argv[0]);
     return 1;
   }
-
-  char const *address_ptr = get_transactions_args.address->sval[0];
-
-  if (strlen(address_ptr) != HASH_LENGTH_TRYTE) {
-    ESP_LOGE(TAG, "Invalid hash length!");
-    return 2;
+  int criteria = get_transactions_args.address->count + get_transactions_args.bundle->count +
+                 get_transactions_args.tag->count;
+  if (criteria == 0) {
+    printf("An address, a bundle or a tag is needed\n");
+    return 1;
   }
 
-  find_transactions_req_t *transactions_req = find_transactions_req_new();
-  find_transactions_res_t *transactions_res = find_transactions_res_new();
-
-  if (!transactions_req || !transactions_res) {
-    ESP_LOGE(TAG, "Error: OOM");
-    goto done;
+  // the node intersects addresses, bundles and tags of one request, the union takes a request for each
+  for (size_t i = 0; i < 3; i++) {
+    if ((reqs[i] = find_transactions_req_new()) == NULL) {
+      ret_code = RC_OOM;
+      goto done;
+    }
   }
-
-  if (flex_trits_from_trytes(tmp_hash, NUM_TRITS_HASH, (const tryte_t *)address_ptr, NUM_TRYTES_HASH,
-                             NUM_TRYTES_HASH) == 0) {
-    ESP_LOGE(TAG, "Error: converting flex_trit failed");
+  if ((ret_code = push_hashes(&reqs[0]->addresses, get_transactions_args.address)) != RC_OK ||
+      (ret_code = push_hashes(&reqs[1]->bundles, get_transactions_args.bundle)) != RC_OK ||
+      (ret_code = push_tags(&reqs[2]->tags, get_transactions_args.tag)) != RC_OK) {
     goto done;
   }
 
-  if ((hash243_queue_push(&transactions_req->addresses, tmp_hash)) != RC_OK) {
-    ESP_LOGE(TAG, "Error: add a hash to queue failed.\n");
-    goto done;
+  hash_set_init(&seen);
+  if (get_transactions_args.address->count) {
+    ret_code = find_union(reqs[0], &seen, &hashes, &found);
+  }
+  if (ret_code == RC_OK && get_transactions_args.bundle->count) {
+    ret_code = find_union(reqs[1], &seen, &hashes, &found);
   }
+  if (ret_code == RC_OK && get_transactions_args.tag->count) {
+    ret_code = find_union(reqs[2], &seen, &hashes, &found);
+  }
+  hash_set_free(&seen);
 
-  if (iota_client_find_transactions(iota_ctx.client, transactions_req, transactions_res) == RC_OK) {
-    size_t count = hash243_queue_count(transactions_res->hashes);
-    hash243_queue_t curr = transactions_res->hashes;
+  if (ret_code == RC_OK && get_transactions_args.details->count) {
+    ret_code = output_details(hashes);
+    if (ret_code == RC_OK && output_format() == OUTPUT_TEXT) {
+      printf("tx count = %ld, %ld duplicates\n", (long int)hash243_queue_count(hashes),
+             (long int)(found - hash243_queue_count(hashes)));
+    }
+  } else if (ret_code == RC_OK && output_format() != OUTPUT_TEXT) {
+    output_rec_t rec;
+    hash243_queue_entry_t *q_iter = NULL;
+    size_t in_rec = 0;
+    CDL_FOREACH(hashes, q_iter) {
+      if (in_rec == 0) {
+        output_rec_begin(&rec, OUTPUT_REC_HASHES);
+        output_rec_array_begin(&rec, "hashes");
+      }
+      output_rec_hash(&rec, NULL, q_iter->hash);
+      if (++in_rec == OUTPUT_HASHES_PER_REC || q_iter->next == hashes) {
+        output_rec_array_end(&rec);
+        output_rec_end(&rec);
+        in_rec = 0;
+      }
+    }
+  } else if (ret_code == RC_OK) {
+    size_t count = hash243_queue_count(hashes);
+    hash243_queue_t curr = hashes;
     for (size_t i = 0; i < count; i++) {
       printf("[%ld] ", (long int)i);
       flex_trit_print(curr->hash, NUM_TRITS_HASH);
       printf("\n");
       curr = curr->next;
     }
-    printf("tx count = %ld\n", (long int)count);
+    printf("tx count = %ld, %ld duplicates\n", (long int)count, (long int)(found - count));
   }
 
 done:
-  find_transactions_req_free(&transactions_req);
-  find_transactions_res_free(&transactions_res);
+  if (ret_code != RC_OK) {
+    ESP_LOGE(TAG, "%s", error_2_string(ret_code));
+  }
+  for (size_t i = 0; i < 3; i++) {
+    find_transactions_req_free(&reqs[i]);
+  }
+  hash243_queue_free(&hashes);
   return ret_code;
 }
 
 static void register_get_transactions() {
-  get_transactions_args.address = arg_str1(NULL, NULL, "<ADDRESS>", "An Address hash");
+  get_transactions_args.address =
+      arg_strn(NULL, NULL, "<address...>", 0, CONFIG_WALLET_BATCH_MAX_ARGS - 1, "Address hashes");
   get_transactions_args.address->hdr.resetfn = (arg_resetfn *)arg_str_reset;
-  get_transactions_args.end = arg_end(1);
+  get_transactions_args.bundle =
+      arg_strn("b", "bundle", "<bundle>", 0, CONFIG_WALLET_BATCH_MAX_ARGS - 1, "Bundle hashes");
+  get_transactions_args.bundle->hdr.resetfn = (arg_resetfn *)arg_str_reset;
+  get_transactions_args.tag = arg_strn("t", "tag", "<tag>", 0, CONFIG_WALLET_BATCH_MAX_ARGS - 1, "Tags");
+  get_transactions_args.tag->hdr.resetfn = (arg_resetfn *)arg_str_reset;
+  get_transactions_args.details = arg_lit0("d", "details", "fetch each transaction once with getTrytes");
+  get_transactions_args.end = arg_end(CONFIG_WALLET_BATCH_MAX_ARGS + 2);
   const esp_console_cmd_t get_transactions_cmd = {
       .command = "transactions",
-      .help = "Get the transaction associate to an address (after last milestone)",
-      .hint = NULL,
+      .help = "Get transactions of addresses, bundles and tags(after last milestone), duplicates are dropped",
+      .hint = " [address...] [-b <bundle>] [-t <tag>] [-d]",
       .func = &fn_get_transactions,
       .argtable = &get_transactions_args,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&get_transactions_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&get_transactions_cmd, WALLET_CMD_CONCURRENT | WALLET_CMD_NETWORK));
 }
 
 /* 'gen_hash' command */
-tryte_t const tryte_chars[27] = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N',
-                                 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', '9'};
-
 static struct {
   struct arg_int *len;
   struct arg_end *end;
@@ -696,19 +1176,28 @@ static int fn_gen_hash(int argc, char **argv) {
   }
 
   int len = gen_hash_args.len->ival[0];
+  if (len <= 0 || len > NUM_TRYTES_SERIALIZED_TRANSACTION) {
+    printf("Invalid length %d, 1 to %d\n", len, NUM_TRYTES_SERIALIZED_TRANSACTION);
+    return -1;
+  }
   char *hash = (char *)malloc(sizeof(char) * (len + 1));
   if (hash == NULL) {
     ESP_LOGE(TAG, "Out of Memory\n");
     return -1;
   }
 
-  srand(time(0));
-  for (int i = 0; i < len; i++) {
-    memset(hash + i, tryte_chars[rand() % 27], 1);
-  }
+  crypto_random_trytes((tryte_t *)hash, len);
   hash[len] = '\0';
 
-  printf("Hash: %s\n", hash);
+  if (output_format() != OUTPUT_TEXT) {
+    output_rec_t rec;
+    output_rec_begin(&rec, OUTPUT_REC_VALUE);
+    output_rec_str(&rec, "name", "hash");
+    output_rec_str(&rec, "value", hash);
+    output_rec_end(&rec);
+  } else {
+    printf("Hash: %s\n", hash);
+  }
   free(hash);
   return 0;
 }
@@ -723,7 +1212,7 @@ static void register_gen_hash() {
       .func = &fn_gen_hash,
       .argtable = &gen_hash_args,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&gen_hash_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&gen_hash_cmd, WALLET_CMD_CONCURRENT));
 }
 
 /* 'get_addresses' command */
@@ -757,15 +1246,45 @@ static int fn_get_addresses(int argc, char **argv) {
     return -1;
   }
 
-  printf("Security level: %d\n", iota_ctx.security);
+  flex_trit_t seed[FLEX_TRIT_SIZE_243];
+  uint8_t security = iota_ctx.security;
+  if (!wallet_seed(seed, &security)) {
+    return -1;
+  }
+
+  bool text = output_format() == OUTPUT_TEXT;
+  if (text) {
+    printf("Security level: %d\n", security);
+  }
   // printf("get address %"PRId64" , %"PRId64"\n", start_index, end_index);
   while (start_index <= end_index) {
-    char *addr = iota_sign_address_gen_trytes(iota_ctx.seed, start_index, iota_ctx.security);
-    printf("[%" PRIu64 "] %s\n", start_index, addr);
-    free(addr);
+    // addresses of the last `account` are cached in the snapshot
+    flex_trit_t cached[FLEX_TRIT_SIZE_243];
+    flex_trit_t *addr = NULL;
+    if (snapshot_get_address(seed, security, start_index, cached)) {
+      addr = cached;
+    } else if ((addr = iota_sign_address_gen_flex_trits(seed, start_index, security)) == NULL) {
+      ESP_LOGE(TAG, "Error: OOM");
+      break;
+    }
+    if (text) {
+      printf("[%" PRIu64 "] ", start_index);
+      flex_trit_print(addr, NUM_TRITS_ADDRESS);
+      printf("\n");
+    } else {
+      output_rec_t rec;
+      output_rec_begin(&rec, OUTPUT_REC_ADDRESS);
+      output_rec_uint(&rec, "index", start_index);
+      output_rec_hash(&rec, "address", addr);
+      output_rec_end(&rec);
+    }
+    if (addr != cached) {
+      free(addr);
+    }
     start_index++;
   }
 
+  memset_safe(seed, sizeof(seed), 0, sizeof(seed));
   return 0;
 }
 
@@ -782,39 +1301,83 @@ static void register_get_addresses() {
       .func = &fn_get_addresses,
       .argtable = &get_addresses_args,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&get_addresses_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&get_addresses_cmd, WALLET_CMD_CONCURRENT));
 }
 
 /* 'get_bundle' command */
 static struct {
   struct arg_str *tail;
+  struct arg_lit *legacy;
+  struct arg_lit *walk;
+  struct arg_lit *timing;
   struct arg_end *end;
 } get_bundle_args;
 
-static int fn_get_bundle(int argc, char **argv) {
+static retcode_t serialize_bundle(bundle_transactions_t *bundle, hash8019_array_p trytes) {
+  iota_transaction_t *tx = NULL;
+  flex_trit_t *serialized_tx = wallet_mem_cold(FLEX_TRIT_SIZE_8019);
+  if (serialized_tx == NULL) {
+    return RC_OOM;
+  }
+  BUNDLE_FOREACH(bundle, tx) {
+    transaction_serialize_on_flex_trits(tx, serialized_tx);
+    hash_array_push(trytes, serialized_tx);
+  }
+  free(serialized_tx);
+  return RC_OK;
+}
+
+// a record of serialized trits for each transaction
+static void output_bundle(hash8019_array_p trytes) {
+  flex_trit_t *elt = NULL;
+  HASH_ARRAY_FOREACH(trytes, elt) {
+    output_rec_t rec;
+    output_rec_begin(&rec, OUTPUT_REC_TRANSACTION);
+    output_rec_trits(&rec, "trytes", elt, NUM_TRITS_SERIALIZED_TRANSACTION);
+    output_rec_end(&rec);
+  }
+}
+
+static retcode_t get_bundle_of_tail(tryte_t const *tail_ptr) {
   retcode_t ret_code = RC_OK;
   flex_trit_t tmp_tail[FLEX_TRIT_SIZE_243];
   bundle_status_t bundle_status = BUNDLE_NOT_INITIALIZED;
   bundle_transactions_t *bundle = NULL;
-
-  int nerrors = arg_parse(argc, argv, (void **)&get_bundle_args);
-  if (nerrors != 0) {
-    arg_print_errors(stderr, get_bundle_args.end, argv[0]);
-    return -1;
-  }
-
-  tryte_t const *tail_ptr = (tryte_t *)get_bundle_args.tail->sval[0];
-  if (!is_address(tail_ptr)) {
-    ESP_LOGE(TAG, "Invalid address\n");
-    return -1;
-  }
+  hash8019_array_p trytes = NULL;
 
   bundle_transactions_new(&bundle);
-  if (flex_trits_from_trytes(tmp_tail, NUM_TRITS_HASH, tail_ptr, NUM_TRYTES_HASH, NUM_TRYTES_HASH) == 0) {
+  trytes = hash8019_array_new();
+  if (bundle == NULL || trytes == NULL) {
+    ESP_LOGE(TAG, "Error: OOM");
+    ret_code = RC_OOM;
+  } else if (flex_trits_from_trytes(tmp_tail, NUM_TRITS_HASH, tail_ptr, NUM_TRYTES_HASH, NUM_TRYTES_HASH) == 0) {
     ESP_LOGE(TAG, "converting flex_trit failed.\n");
+    ret_code = RC_ERROR;
   } else {
-    if ((ret_code = iota_client_get_bundle(iota_ctx.client, tmp_tail, bundle, &bundle_status)) == RC_OK) {
-      if (bundle_status == BUNDLE_VALID) {
+    bundle_val_stats_t stats = {};
+    int64_t start = esp_timer_get_time();
+    if (get_bundle_args.legacy->count) {
+      ret_code = iota_client_get_bundle(iota_ctx.client, tmp_tail, bundle, &bundle_status);
+      stats.total_us = esp_timer_get_time() - start;
+      stats.txs = bundle_transactions_size(bundle);
+    } else {
+      // transactions stay serialized, they are decoded only for the text output.
+      ret_code = bundle_validator_fetch(iota_ctx.client, tmp_tail, !get_bundle_args.walk->count, trytes, &bundle_status,
+                                        &stats);
+    }
+    if (get_bundle_args.timing->count) {
+      bundle_val_stats_print(&stats);
+    }
+    if (ret_code == RC_OK) {
+      if (bundle_status == BUNDLE_VALID && output_format() != OUTPUT_TEXT) {
+        if (get_bundle_args.legacy->count) {
+          ret_code = serialize_bundle(bundle, trytes);
+        }
+        output_bundle(trytes);
+      } else if (bundle_status == BUNDLE_VALID) {
+        if (!get_bundle_args.legacy->count) {
+          bundle_validator_to_bundle(tmp_tail, trytes, bundle);
+        }
         printf("=== bundle status: %d ===\n", bundle_status);
         bundle_dump(bundle);
       } else {
@@ -826,27 +1389,281 @@ static int fn_get_bundle(int argc, char **argv) {
   }
 
   bundle_transactions_free(&bundle);
+  if (trytes) {
+    hash_array_free(trytes);
+  }
+  return ret_code;
+}
+
+// tails are fetched one after another, the result is the first error.
+static int fn_get_bundle(int argc, char **argv) {
+  retcode_t ret_code = RC_OK;
+
+  int nerrors = arg_parse(argc, argv, (void **)&get_bundle_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, get_bundle_args.end, argv[0]);
+    return -1;
+  }
+
+  for (int i = 0; i < get_bundle_args.tail->count; i++) {
+    if (!is_address((tryte_t *)get_bundle_args.tail->sval[i])) {
+      ESP_LOGE(TAG, "Invalid address\n");
+      return -1;
+    }
+  }
+  for (int i = 0; i < get_bundle_args.tail->count; i++) {
+    retcode_t ret = get_bundle_of_tail((tryte_t *)get_bundle_args.tail->sval[i]);
+    if (ret_code == RC_OK) {
+      ret_code = ret;
+    }
+  }
   return ret_code;
 }
 
 static void register_get_bundle() {
-  get_bundle_args.tail = arg_strn(NULL, NULL, "<tail>", 1, 10, "A tail hash");
+  get_bundle_args.tail = arg_strn(NULL, NULL, "<tail>", 1, CONFIG_WALLET_BATCH_MAX_ARGS - 1, "Tail hashes");
   get_bundle_args.tail->hdr.resetfn = (arg_resetfn *)arg_str_reset;
-  get_bundle_args.end = arg_end(4);
+  get_bundle_args.legacy = arg_lit0("l", "legacy", "fetch and validate with iota_client_get_bundle");
+  get_bundle_args.walk = arg_lit0("w", "walk", "fetch one transaction at a time by trunk hashes");
+  get_bundle_args.timing = arg_lit0("t", "timing", "show round trips and validation time");
+  get_bundle_args.end = arg_end(CONFIG_WALLET_BATCH_MAX_ARGS + 2);
   const esp_console_cmd_t get_bundle_cmd = {
       .command = "get_bundle",
-      .help = "Gets associated transactions from a tail hash",
-      .hint = " <tail>",
+      .help = "Gets associated transactions from tail hashes",
+      .hint = " <tail>... [-l|-w] [-t]",
       .func = &fn_get_bundle,
       .argtable = &get_bundle_args,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&get_bundle_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&get_bundle_cmd, WALLET_CMD_CONCURRENT | WALLET_CMD_NETWORK));
+}
+
+/* 'net_stats' command */
+static struct {
+  struct arg_lit *reset;
+  struct arg_end *end;
+} net_stats_args;
+
+static int fn_net_stats(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&net_stats_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, net_stats_args.end, argv[0]);
+    return -1;
+  }
+
+  wallet_http_stats_t stats;
+  wallet_http_stats(&stats);
+  printf("requests %u, compressed %u, connections %u\n", stats.requests, stats.compressed, stats.connections);
+  printf("wire bytes %" PRIu64 ", body bytes %" PRIu64 "\n", stats.wire_bytes, stats.body_bytes);
+  printf("total time %" PRId64 "ms\n", stats.total_us / 1000);
+
+  binproto_stats_t bin_stats;
+  binproto_stats(&bin_stats);
+  if (bin_stats.requests) {
+    printf("binary requests %u, sent %" PRIu64 ", received %" PRIu64 " bytes, total time %" PRId64 "ms\n",
+           bin_stats.requests, bin_stats.tx_bytes, bin_stats.rx_bytes, bin_stats.total_us / 1000);
+  }
+  if (net_stats_args.reset->count) {
+    wallet_http_stats_reset();
+    binproto_stats_reset();
+  }
+  return 0;
+}
+
+static void register_net_stats() {
+  net_stats_args.reset = arg_lit0("r", "reset", "reset statistics");
+  net_stats_args.end = arg_end(2);
+  const esp_console_cmd_t net_stats_cmd = {
+      .command = "net_stats",
+      .help = "Show bytes on the wire and time of node requests",
+      .hint = " [-r]",
+      .func = &fn_net_stats,
+      .argtable = &net_stats_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&net_stats_cmd, 0));
+}
+
+/* 'power' command */
+static struct {
+  struct arg_lit *reset;
+  struct arg_end *end;
+} power_args;
+
+static int fn_power(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&power_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, power_args.end, argv[0]);
+    return -1;
+  }
+
+  net_sched_dump();
+  if (power_args.reset->count) {
+    net_sched_stats_reset();
+  }
+  return 0;
+}
+
+static void register_power() {
+  power_args.reset = arg_lit0("r", "reset", "reset statistics");
+  power_args.end = arg_end(2);
+  const esp_console_cmd_t power_cmd = {
+      .command = "power",
+      .help = "Show the radio state and radio-on time per command",
+      .hint = " [-r]",
+      .func = &fn_power,
+      .argtable = &power_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&power_cmd, 0));
+}
+
+/* 'proto' command */
+static struct {
+  struct arg_str *mode;
+  struct arg_end *end;
+} proto_args;
+
+static int fn_proto(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&proto_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, proto_args.end, argv[0]);
+    return -1;
+  }
+
+  if (proto_args.mode->count) {
+    char const *mode = proto_args.mode->sval[0];
+    if (strcmp(mode, "bin") == 0) {
+      binproto_enable(true);
+    } else if (strcmp(mode, "json") == 0) {
+      binproto_enable(false);
+      binproto_close();
+    } else {
+      printf("Unknown mode: %s\n", mode);
+      return -1;
+    }
+  }
+  printf("protocol: %s\n", binproto_is_enabled() ? "bin" : "json");
+  return 0;
+}
+
+static void register_proto() {
+  proto_args.mode = arg_str0(NULL, NULL, "<json|bin>", "JSON to the node or binary to the gateway");
+  proto_args.mode->hdr.resetfn = (arg_resetfn *)arg_str_reset;
+  proto_args.end = arg_end(2);
+  const esp_console_cmd_t proto_cmd = {
+      .command = "proto",
+      .help = "Show or set the protocol of node queries",
+      .hint = " [json|bin]",
+      .func = &fn_proto,
+      .argtable = &proto_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&proto_cmd, 0));
+}
+
+/* 'tips' command */
+static int fn_tips(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  tip_pool_dump();
+  return 0;
+}
+
+static void register_tips() {
+  const esp_console_cmd_t tips_cmd = {
+      .command = "tips",
+      .help = "Show prefetched tips for attachToTangle",
+      .hint = NULL,
+      .func = &fn_tips,
+      .argtable = NULL,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&tips_cmd, WALLET_CMD_CONCURRENT));
+}
+
+#ifdef CONFIG_CONFIRM_MGR_ENABLE
+/* 'pending' command */
+static struct {
+  struct arg_lit *clear;
+  struct arg_end *end;
+} pending_args;
+
+static int fn_pending(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&pending_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, pending_args.end, argv[0]);
+    return -1;
+  }
+
+  if (pending_args.clear->count) {
+    confirmation_mgr_clear_finished();
+  }
+  confirmation_mgr_dump();
+  return 0;
+}
+
+static void register_pending() {
+  pending_args.clear = arg_lit0("c", "clear", "remove confirmed and failed bundles");
+  pending_args.end = arg_end(2);
+  const esp_console_cmd_t pending_cmd = {
+      .command = "pending",
+      .help = "Show bundles waiting for confirmation",
+      .hint = " [-c]",
+      .func = &fn_pending,
+      .argtable = &pending_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&pending_cmd, WALLET_CMD_CONCURRENT));
+}
+#endif
+
+/* 'format' command */
+static struct {
+  struct arg_str *format;
+  struct arg_end *end;
+} format_args;
+
+static int fn_format(int argc, char **argv) {
+  output_format_t format;
+  int nerrors = arg_parse(argc, argv, (void **)&format_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, format_args.end, argv[0]);
+    return -1;
+  }
+
+  if (format_args.format->count) {
+    if (!output_format_from_name(format_args.format->sval[0], &format)) {
+      printf("Unknown format: %s\n", format_args.format->sval[0]);
+      return -1;
+    }
+    output_set_format(format);
+  }
+  printf("format: %s\n", output_format_name(output_format()));
+  return 0;
+}
+
+static void register_format() {
+  format_args.format = arg_str0(NULL, NULL, "<text|json|bin>", "output format of commands");
+  format_args.format->hdr.resetfn = (arg_resetfn *)arg_str_reset;
+  format_args.end = arg_end(2);
+  const esp_console_cmd_t format_cmd = {
+      .command = "format",
+      .help = "Show or set the output format, `--format=<text|json|bin>` before a command applies to the command only",
+      .hint = " [text|json|bin]",
+      .func = &fn_format,
+      .argtable = &format_args,
+  };
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&format_cmd, 0));
 }
 
 /* 'client_conf' command */
 static int fn_client_conf(int argc, char **argv) {
   (void)argc;
   (void)argv;
+  if (output_format() != OUTPUT_TEXT) {
+    output_rec_t rec;
+    output_rec_begin(&rec, OUTPUT_REC_CLIENT_CONF);
+    output_rec_uint(&rec, "mwm", iota_ctx.mwm);
+    output_rec_uint(&rec, "depth", iota_ctx.depth);
+    output_rec_uint(&rec, "security", iota_ctx.security);
+    output_rec_end(&rec);
+    return 0;
+  }
   printf("MWM %d, Depth %d, Security %d\n", iota_ctx.mwm, iota_ctx.depth, iota_ctx.security);
   return 0;
 }
@@ -859,7 +1676,7 @@ static void register_client_conf() {
       .func = &fn_client_conf,
       .argtable = NULL,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&client_conf_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&client_conf_cmd, WALLET_CMD_CONCURRENT));
 }
 
 /* 'client_conf_set' command */
@@ -905,7 +1722,7 @@ static void register_client_conf_set() {
       .func = &fn_client_conf_set,
       .argtable = &client_conf_set_args,
   };
-  ESP_ERROR_CHECK(esp_console_cmd_register(&client_conf_set_cmd));
+  ESP_ERROR_CHECK(wallet_batch_cmd_register(&client_conf_set_cmd, 0));
 }
 
 //============= Public functions====================
@@ -917,12 +1734,20 @@ void register_wallet_commands() {
   register_stack_info();
   register_version();
   register_restart();
+  register_bench();
+  register_batch();
+  register_boot();
+  register_mem();
+  register_format();
 
   // cclient APIs
   register_node_info();
   register_node_info_set();
   register_get_seed();
   register_seed_set();
+  register_vault_store();
+  register_unlock();
+  register_lock();
   register_get_balance();
   register_account_data();
   register_send();
@@ -932,14 +1757,33 @@ void register_wallet_commands() {
   register_get_bundle();
   register_client_conf();
   register_client_conf_set();
+  register_tips();
+  register_net_stats();
+  register_proto();
+  register_power();
+  register_snapshot();
+  register_spent_index();
+  register_input_selector();
+  register_wallet_accounts();
+  register_wallet_api();
+  register_node_events();
+  register_log_ring();
+#ifdef CONFIG_CONFIRM_MGR_ENABLE
+  register_pending();
+#endif
 }
 
-void init_iota_client() {
+bool init_iota_client() {
   iota_ctx.depth = CONFIG_IOTA_NODE_DEPTH;
   iota_ctx.mwm = CONFIG_IOTA_NODE_MWM;
   iota_ctx.security = 2;
-  memcpy(iota_ctx.seed, CONFIG_IOTA_SEED, NUM_TRYTES_HASH);
-  iota_ctx.seed[NUM_TRYTES_HASH] = '\0';
+  if (seed_vault_is_provisioned()) {
+    memset(iota_ctx.seed, 0, sizeof(iota_ctx.seed));
+    ESP_LOGI(TAG, "the seed vault is locked");
+  } else {
+    memcpy(iota_ctx.seed, CONFIG_IOTA_SEED, NUM_TRYTES_HASH);
+    iota_ctx.seed[NUM_TRYTES_HASH] = '\0';
+  }
 
 #ifdef CONFIG_IOTA_NODE_ENABLE_HTTPS
   iota_ctx.client = iota_client_core_init(CONFIG_IOTA_NODE_URL, CONFIG_IOTA_NODE_PORT, amazon_ca1_pem);
@@ -948,12 +1792,71 @@ void init_iota_client() {
 #endif
 
 #ifdef CONFIG_CCLIENT_DEBUG
+  log_ring_init();
   logger_helper_init(LOGGER_DEBUG);
   logger_init_client_core(LOGGER_DEBUG);
   logger_init_client_extended(LOGGER_DEBUG);
   logger_init_json_serializer(LOGGER_DEBUG);
 #endif
   ESP_LOGI(TAG, "IOTA_COMMON_VERSION: %s IOTA_CLIENT_VERSION: %s\n", IOTA_COMMON_VERSION, CCLIENT_VERSION);
+
+  wallet_http_init();
+  binproto_init();
+  bundle_validator_init();
+  input_selector_init();
+  wallet_accounts_init();
+  client_lock = xSemaphoreCreateMutex();
+  client_idle = xSemaphoreCreateBinary();
+  if (client_lock == NULL || client_idle == NULL) {
+    ESP_LOGE(TAG, "create client lock failed");
+    return false;
+  }
+  xSemaphoreGive(client_idle);
+  if (iota_ctx.client == NULL) {
+    ESP_LOGE(TAG, "client init failed");
+    return false;
+  }
+  return true;
+}
+
+void start_wallet_services() {
+#ifdef CONFIG_TIP_POOL_ENABLE
+  tip_pool_start();
+#endif
+#ifdef CONFIG_CONFIRM_MGR_ENABLE
+  confirmation_mgr_start();
+#endif
+#ifdef CONFIG_WALLET_API_ENABLE
+  wallet_api_start();
+#endif
+#ifdef CONFIG_NODE_EVENTS_ENABLE
+  node_events_start();
+#endif
+}
+
+void destory_iota_client() { iota_client_core_destroy(&iota_ctx.client); }
+
+iota_client_service_t *wallet_client_acquire() {
+  xSemaphoreTake(client_lock, portMAX_DELAY);
+  if (client_users++ == 0) {
+    xSemaphoreTake(client_idle, portMAX_DELAY);
+  }
+  xSemaphoreGive(client_lock);
+  net_sched_acquire();
+  return iota_ctx.client;
+}
+
+void wallet_client_release() {
+  net_sched_release();
+  xSemaphoreTake(client_lock, portMAX_DELAY);
+  if (--client_users == 0) {
+    xSemaphoreGive(client_idle);
+  }
+  xSemaphoreGive(client_lock);
 }
 
-void destory_iota_client() { iota_client_core_destroy(&iota_ctx.client); }
\ No newline at end of file
+void wallet_client_params(uint32_t *depth, uint8_t *mwm, uint8_t *security) {
+  *depth = iota_ctx.depth;
+  *mwm = iota_ctx.mwm;
+  *security = iota_ctx.security;
+}
\ No newline at end of file
@@ -14,5 +14,14 @@
 
 // Register system commands
 void register_wallet_commands();
-void init_iota_client();
+// Returns false if the shared client can't be used, services and network commands must not start then.
+bool init_iota_client();
+// Background tasks which talk to the node
+void start_wallet_services();
 void destory_iota_client();
+
+// Shared client for background tasks and network commands, the client is not replaced while it's acquired.
+// Users run concurrently and can acquire it again.
+iota_client_service_t *wallet_client_acquire();
+void wallet_client_release();
+void wallet_client_params(uint32_t *depth, uint8_t *mwm, uint8_t *security);
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""Load test of the wallet HTTP API, reports requests/s, latency percentiles and status codes.
+
+Usage:
+    python3 tools/api_load_test.py --host 192.168.1.50 -c 8 -d 30 --address ADDRESS1
+
+Clients run a mix of read requests in a loop, `--send` adds a zero-value send to the mix to
+check 503 back-pressure during PoW, it needs `--token`. Only the Python standard library is needed.
+"""
+from __future__ import print_function
+
+import argparse
+import collections
+import json
+import random
+import threading
+import time
+
+try:
+    import http.client as httplib
+except ImportError:
+    import httplib
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+class Results(object):
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latency = collections.defaultdict(list)
+        self.status = collections.Counter()
+
+    def add(self, name, status, seconds):
+        with self.lock:
+            self.latency[name].append(seconds)
+            self.status[status] += 1
+
+
+def requests_mix(args):
+    mix = [("node_info", "GET", "/v1/node_info", None)]
+    if args.address:
+        mix.append(("balance", "GET", "/v1/balance?address=" + args.address, None))
+        mix.append(("transactions", "GET", "/v1/transactions?address=" + args.address, None))
+    if args.account:
+        mix.append(("account", "GET", "/v1/account", None))
+    if args.send:
+        body = json.dumps({"address": args.send, "value": 0, "message": "load test"})
+        mix.append(("send", "POST", "/v1/send", body))
+    return mix
+
+
+def client(args, mix, results, deadline):
+    while time.time() < deadline:
+        name, method, path, body = random.choice(mix)
+        start = time.time()
+        try:
+            conn = httplib.HTTPConnection(args.host, args.port, timeout=args.timeout)
+            headers = {"Content-Type": "application/json"} if body else {}
+            if body and args.token:
+                headers["Authorization"] = "Bearer " + args.token
+            conn.request(method, path, body, headers)
+            response = conn.getresponse()
+            response.read()
+            status = response.status
+            conn.close()
+        except Exception:
+            status = "error"
+        results.add(name, status, time.time() - start)
+        if status == 503:
+            # Retry-After is a second, clients back off a little instead
+            time.sleep(args.backoff)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="load test of the wallet HTTP API")
+    parser.add_argument("--host", required=True)
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("-c", "--clients", type=int, default=4)
+    parser.add_argument("-d", "--duration", type=float, default=30, help="seconds")
+    parser.add_argument("--address", help="address of balance and transactions requests")
+    parser.add_argument("--account", action="store_true", help="add account requests, they scan the seed")
+    parser.add_argument("--send", metavar="ADDRESS", help="add zero-value sends to the address")
+    parser.add_argument("--token", help="CONFIG_WALLET_API_TOKEN of sends")
+    parser.add_argument("--timeout", type=float, default=120)
+    parser.add_argument("--backoff", type=float, default=0.2, help="seconds to wait after a 503")
+    args = parser.parse_args()
+
+    mix = requests_mix(args)
+    results = Results()
+    start = time.time()
+    deadline = start + args.duration
+    threads = [threading.Thread(target=client, args=(args, mix, results, deadline)) for _ in range(args.clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.time() - start
+
+    total = sum(len(v) for v in results.latency.values())
+    print("%d requests in %.1fs, %.2f requests/s, %d clients" % (total, elapsed, total / elapsed, args.clients))
+    print("%-14s %8s %10s %10s %10s" % ("request", "count", "p50 ms", "p90 ms", "p99 ms"))
+    for name in sorted(results.latency):
+        values = results.latency[name]
+        print("%-14s %8d %10.1f %10.1f %10.1f" % (name, len(values), percentile(values, 50) * 1000,
+                                                  percentile(values, 90) * 1000, percentile(values, 99) * 1000))
+    print("status: " + ", ".join("%s=%d" % (k, v) for k, v in sorted(results.status.items(), key=str)))
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
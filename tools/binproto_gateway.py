@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""A gateway between the wallet binary protocol and an IOTA node.
+
+Frames from the wallet(see main/wallet_binproto.h) are translated to IRI JSON requests,
+hashes and transactions are packed 5 trits per byte on the wire.
+
+Usage:
+    python3 tools/binproto_gateway.py --upstream http://127.0.0.1:14265 --port 14270
+
+Then switch the wallet with `proto bin`.
+"""
+from __future__ import print_function
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+try:
+    from socketserver import StreamRequestHandler, ThreadingMixIn, TCPServer
+    from urllib.request import Request, urlopen
+except ImportError:  # python 2.x
+    from SocketServer import StreamRequestHandler, ThreadingMixIn, TCPServer
+    from urllib2 import Request, urlopen
+
+VERSION = 1
+HEADER = struct.Struct(">2sBBBBI")
+CMD_GET_TRYTES = 0x01
+CMD_FIND_TRANSACTIONS = 0x02
+CMD_GET_BALANCES = 0x03
+
+TRYTE_CHARS = "9ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+HASH_TRITS = 243
+TX_TRITS = 8019
+
+
+def packed_len(num_trits):
+    return (num_trits + 4) // 5
+
+
+HASH_BYTES = packed_len(HASH_TRITS)
+TX_BYTES = packed_len(TX_TRITS)
+
+# tryte value(-13..13) to 3 trits, the least significant trit first
+TRYTE_TRITS = {}
+for _c in TRYTE_CHARS:
+    _v = TRYTE_CHARS.index(_c)
+    _v = _v - 27 if _v > 13 else _v
+    _trits = []
+    for _ in range(3):
+        _t = ((_v + 1) % 3) - 1
+        _trits.append(_t)
+        _v = (_v - _t) // 3
+    TRYTE_TRITS[_c] = _trits
+
+
+def trytes_to_trits(trytes):
+    trits = []
+    for c in trytes:
+        trits.extend(TRYTE_TRITS[c])
+    return trits
+
+
+def trits_to_trytes(trits):
+    out = []
+    for i in range(0, len(trits), 3):
+        v = trits[i] + 3 * trits[i + 1] + 9 * trits[i + 2]
+        out.append(TRYTE_CHARS[v % 27])
+    return "".join(out)
+
+
+def pack(trytes):
+    trits = trytes_to_trits(trytes)
+    out = bytearray()
+    for i in range(0, len(trits), 5):
+        v = 0
+        for t in reversed(trits[i:i + 5]):
+            v = v * 3 + t
+        out.append(v & 0xFF)
+    return bytes(out)
+
+
+def unpack(data, num_trits):
+    trits = []
+    for b in bytearray(data):
+        v = b - 256 if b > 127 else b
+        for _ in range(5):
+            t = ((v + 1) % 3) - 1
+            trits.append(t)
+            v = (v - t) // 3
+    return trits_to_trytes(trits[:num_trits])
+
+
+def unpack_hashes(payload, offset=0):
+    count = struct.unpack_from(">H", payload, offset)[0]
+    offset += 2
+    if len(payload) < offset + count * HASH_BYTES:
+        raise ValueError("truncated hash list")
+    hashes = [unpack(payload[offset + i * HASH_BYTES:offset + (i + 1) * HASH_BYTES], HASH_TRITS)
+              for i in range(count)]
+    return hashes, offset + count * HASH_BYTES
+
+
+class Gateway(object):
+    def __init__(self, upstream):
+        self.upstream = upstream
+
+    def query(self, req):
+        body = json.dumps(req).encode("utf-8")
+        headers = {"Content-Type": "application/json", "X-IOTA-API-Version": "1"}
+        res = urlopen(Request(self.upstream, body, headers)).read()
+        return json.loads(res.decode("utf-8")), len(res)
+
+    def handle(self, cmd, payload):
+        if cmd == CMD_FIND_TRANSACTIONS:
+            addresses, _ = unpack_hashes(payload)
+            res, size = self.query({"command": "findTransactions", "addresses": addresses})
+            hashes = res.get("hashes", [])
+            out = struct.pack(">H", len(hashes)) + b"".join(pack(h) for h in hashes)
+        elif cmd == CMD_GET_TRYTES:
+            hashes, _ = unpack_hashes(payload)
+            res, size = self.query({"command": "getTrytes", "hashes": hashes})
+            trytes = res.get("trytes", [])
+            out = struct.pack(">H", len(trytes)) + b"".join(pack(t) for t in trytes)
+        elif cmd == CMD_GET_BALANCES:
+            addresses, offset = unpack_hashes(payload)
+            threshold = bytearray(payload)[offset] if len(payload) > offset else 100
+            res, size = self.query({"command": "getBalances", "addresses": addresses, "threshold": threshold})
+            balances = res.get("balances", [])
+            out = struct.pack(">H", len(balances)) + b"".join(struct.pack(">Q", int(b)) for b in balances)
+            out += struct.pack(">I", int(res.get("milestoneIndex", 0)))
+        else:
+            raise ValueError("unknown command %d" % cmd)
+        return out, size
+
+
+def make_handler(gateway):
+    class Handler(StreamRequestHandler):
+        def handle(self):
+            while True:
+                header = self.rfile.read(HEADER.size)
+                if len(header) < HEADER.size:
+                    return
+                magic, version, cmd, _, _, length = HEADER.unpack(header)
+                if magic != b"IB" or version != VERSION:
+                    sys.stderr.write("invalid frame from %s\n" % self.client_address[0])
+                    return
+                payload = self.rfile.read(length)
+                start = time.time()
+                try:
+                    out, json_size = gateway.handle(cmd, payload)
+                    status = 0
+                except Exception as e:  # report the error to the wallet and keep the connection
+                    out, json_size = str(e).encode("utf-8"), 0
+                    status = 1
+                self.wfile.write(HEADER.pack(b"IB", VERSION, cmd, status, 0, len(out)) + out)
+                self.wfile.flush()
+                sys.stderr.write("%.3f cmd %d: %d bytes in, %d bytes out, JSON %d bytes, %.1f ms\n" %
+                                 (time.time(), cmd, len(payload), len(out), json_size,
+                                  (time.time() - start) * 1000))
+
+    return Handler
+
+
+class ThreadedTCPServer(ThreadingMixIn, TCPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description="binary protocol gateway")
+    parser.add_argument("--upstream", required=True, help="URL of the IOTA node")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=14270)
+    args = parser.parse_args()
+
+    server = ThreadedTCPServer((args.host, args.port), make_handler(Gateway(args.upstream)))
+    print("gateway listening on %s:%d -> %s" % (args.host, args.port, args.upstream))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""A compressing proxy in front of an IOTA node.
+
+Responses are compressed with gzip or deflate when the wallet sends Accept-Encoding,
+and the bytes before and after compression are logged for each request.
+
+Usage:
+    python3 tools/compress_proxy.py --upstream https://nodes.iota.cafe:443 --port 14266 --wbits 13
+"""
+from __future__ import print_function
+
+import argparse
+import json
+import ssl
+import sys
+import time
+import zlib
+
+try:
+    from http.server import BaseHTTPRequestHandler, HTTPServer
+    from socketserver import ThreadingMixIn
+    from urllib.request import Request, urlopen
+    from urllib.error import HTTPError
+except ImportError:  # python 2.x
+    from BaseHTTPServer import BaseHTTPRequestHandler, HTTPServer
+    from SocketServer import ThreadingMixIn
+    from urllib2 import Request, urlopen, HTTPError
+
+
+def compress(body, encoding, wbits, level):
+    if encoding == "gzip":
+        # wbits + 16 writes the gzip header and trailer
+        c = zlib.compressobj(level, zlib.DEFLATED, wbits + 16)
+    else:
+        c = zlib.compressobj(level, zlib.DEFLATED, wbits)
+    return c.compress(body) + c.flush()
+
+
+def make_handler(args, totals):
+    class Handler(BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def do_POST(self):
+            length = int(self.headers.get("Content-Length", 0))
+            req_body = self.rfile.read(length)
+            start = time.time()
+            upstream = Request(args.upstream, data=req_body, headers={
+                "Content-Type": "application/json",
+                "X-IOTA-API-Version": "1",
+            })
+            context = ssl.create_default_context() if args.upstream.startswith("https") else None
+            try:
+                res = urlopen(upstream, timeout=args.timeout, context=context) if context else \
+                    urlopen(upstream, timeout=args.timeout)
+                status, body = res.getcode(), res.read()
+            except HTTPError as e:
+                status, body = e.code, e.read()
+            upstream_ms = (time.time() - start) * 1000
+
+            accepted = [e.strip() for e in self.headers.get("Accept-Encoding", "").split(",")]
+            encoding = None
+            for candidate in ("gzip", "deflate"):
+                if candidate in accepted and len(body) >= args.min_size:
+                    encoding = candidate
+                    break
+            wire = compress(body, encoding, args.wbits, args.level) if encoding else body
+
+            self.send_response(status)
+            self.send_header("Content-Type", "application/json")
+            if encoding:
+                self.send_header("Content-Encoding", encoding)
+            self.send_header("Content-Length", str(len(wire)))
+            self.end_headers()
+            self.wfile.write(wire)
+
+            try:
+                command = json.loads(req_body.decode("utf-8")).get("command", "?")
+            except ValueError:
+                command = "?"
+            totals["body"] += len(body)
+            totals["wire"] += len(wire)
+            print("%-26s %-8s body %8d wire %8d (%5.1f%%) upstream %6.0fms, total body %d wire %d" % (
+                command, encoding or "identity", len(body), len(wire), 100.0 * len(wire) / max(len(body), 1),
+                upstream_ms, totals["body"], totals["wire"]))
+            sys.stdout.flush()
+
+        def log_message(self, fmt, *args):
+            pass
+
+    return Handler
+
+
+class ThreadedHTTPServer(ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description="compressing proxy for IOTA nodes")
+    parser.add_argument("--upstream", required=True, help="node URL, e.g. http://127.0.0.1:14265")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=14266)
+    parser.add_argument("--wbits", type=int, default=15, choices=range(9, 16),
+                        help="deflate window bits, must not exceed the window of the wallet (13 for 8KB)")
+    parser.add_argument("--level", type=int, default=6)
+    parser.add_argument("--min-size", type=int, default=256, help="do not compress smaller responses")
+    parser.add_argument("--timeout", type=int, default=30)
+    args = parser.parse_args()
+
+    server = ThreadedHTTPServer((args.host, args.port), make_handler(args, {"body": 0, "wire": 0}))
+    print("compressing proxy on %s:%d -> %s, wbits %d" % (args.host, args.port, args.upstream, args.wbits))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
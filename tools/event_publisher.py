@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+"""A stand-in for the ZMQ event feed of IRI, for testing node events without a node.
+
+Usage:
+    python3 tools/event_publisher.py --port 5556 --watch ADDRESS --bundle BUNDLE
+
+Speaks ZMTP 3.0 as a PUB socket with the standard library only, pyzmq subscribers work too.
+Publishes `lmsi` every --milestone-interval seconds with `sn` events of the milestone, and
+random `tx` events at --tx-rate per second. A --watch address receives a transaction every
+--deposit-every seconds which is confirmed at the next milestone, a --bundle is confirmed
+--confirm-after seconds after the start.
+
+At exit, the events sent to the wallet are compared with the requests polling would send in
+the same time for the same watched addresses and bundles.
+"""
+from __future__ import print_function
+
+import argparse
+import random
+import socket
+import struct
+import threading
+import time
+
+TRYTE_CHARS = "9ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+
+GREETING = b"\xff" + b"\x00" * 8 + b"\x7f" + b"\x03\x00" + b"NULL" + b"\x00" * 16 + b"\x00" + b"\x00" * 31
+FLAG_LONG = 0x02
+FLAG_COMMAND = 0x04
+
+
+def random_hash():
+    return "".join(random.choice(TRYTE_CHARS) for _ in range(81))
+
+
+def frame(body, flags=0):
+    if len(body) > 255:
+        return struct.pack(">BQ", flags | FLAG_LONG, len(body)) + body
+    return struct.pack(">BB", flags, len(body)) + body
+
+
+def ready_command(socket_type):
+    name = b"Socket-Type"
+    body = b"\x05READY" + struct.pack(">B", len(name)) + name + struct.pack(">I", len(socket_type)) + socket_type
+    return frame(body, FLAG_COMMAND)
+
+
+def recv_exact(sock, n):
+    data = b""
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise EOFError()
+        data += chunk
+    return data
+
+
+def read_frame(sock):
+    flags, size = struct.unpack(">BB", recv_exact(sock, 2))
+    if flags & FLAG_LONG:
+        size = struct.unpack(">Q", struct.pack(">B", size) + recv_exact(sock, 7))[0]
+    return flags, recv_exact(sock, size)
+
+
+class Subscriber(object):
+    def __init__(self, sock, addr):
+        self.sock = sock
+        self.addr = addr
+        self.topics = set()
+        self.lock = threading.Lock()
+        self.sent = 0
+
+    def matches(self, message):
+        with self.lock:
+            return any(message.startswith(t) for t in self.topics)
+
+
+class Publisher(object):
+    def __init__(self):
+        self.subscribers = []
+        self.lock = threading.Lock()
+        self.counts = {"tx": 0, "sn": 0, "lmsi": 0}
+        self.delivered = 0
+        self.bytes = 0
+
+    def serve(self, server):
+        while True:
+            sock, addr = server.accept()
+            thread = threading.Thread(target=self.handshake, args=(sock, addr))
+            thread.daemon = True
+            thread.start()
+
+    def handshake(self, sock, addr):
+        sub = Subscriber(sock, addr)
+        try:
+            sock.sendall(GREETING)
+            greeting = recv_exact(sock, 64)
+            if greeting[0:1] != b"\xff" or bytearray(greeting)[10] < 3:
+                raise EOFError()
+            sock.sendall(ready_command(b"PUB"))
+            with self.lock:
+                self.subscribers.append(sub)
+            print("subscriber %s:%d" % addr)
+            while True:
+                flags, body = read_frame(sock)
+                if flags & FLAG_COMMAND:
+                    # SUBSCRIBE and CANCEL commands of ZMTP 3.1
+                    if body.startswith(b"\x09SUBSCRIBE"):
+                        with sub.lock:
+                            sub.topics.add(body[10:])
+                    elif body.startswith(b"\x06CANCEL"):
+                        with sub.lock:
+                            sub.topics.discard(body[7:])
+                elif body[:1] == b"\x01":
+                    with sub.lock:
+                        sub.topics.add(body[1:])
+                elif body[:1] == b"\x00":
+                    with sub.lock:
+                        sub.topics.discard(body[1:])
+        except (EOFError, socket.error):
+            pass
+        with self.lock:
+            if sub in self.subscribers:
+                self.subscribers.remove(sub)
+        sock.close()
+        print("subscriber %s:%d left after %d events" % (addr[0], addr[1], sub.sent))
+
+    def publish(self, message):
+        data = message.encode("ascii")
+        with self.lock:
+            self.counts[message.split(" ", 1)[0]] += 1
+            subscribers = list(self.subscribers)
+        for sub in subscribers:
+            if not sub.matches(data):
+                continue
+            try:
+                sub.sock.sendall(frame(data))
+                sub.sent += 1
+                with self.lock:
+                    self.delivered += 1
+                    self.bytes += len(data)
+            except socket.error:
+                pass
+
+
+def tx_event(address, value, bundle):
+    # tx <hash> <address> <value> <obsolete tag> <timestamp> <index> <last index> <bundle> <trunk> <branch>
+    # <arrival time> <tag>
+    now = int(time.time())
+    return "tx %s %s %d %s %d 0 0 %s %s %s %d %s" % (random_hash(), address, value, "9" * 27, now, bundle,
+                                                     random_hash(), random_hash(), now * 1000, "9" * 27)
+
+
+def sn_event(index, address, bundle):
+    # sn <milestone index> <hash> <address> <trunk> <branch> <bundle>
+    return "sn %d %s %s %s %s %s" % (index, random_hash(), address, random_hash(), random_hash(), bundle)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="stand-in for the ZMQ event feed of IRI")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=5556)
+    parser.add_argument("--tx-rate", type=float, default=5, help="random tx events per second")
+    parser.add_argument("--milestone-interval", type=float, default=60, help="seconds")
+    parser.add_argument("--watch", action="append", default=[], help="address which receives deposits")
+    parser.add_argument("--deposit-every", type=float, default=120, help="seconds between deposits")
+    parser.add_argument("--bundle", action="append", default=[], help="bundle which gets confirmed")
+    parser.add_argument("--confirm-after", type=float, default=180, help="seconds until bundles are confirmed")
+    parser.add_argument("--duration", type=float, default=0, help="seconds, 0 runs until Ctrl-C")
+    parser.add_argument("--poll-interval", type=float, default=30,
+                        help="interval of the polling compared with, seconds")
+    args = parser.parse_args()
+
+    pub = Publisher()
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind((args.host, args.port))
+    server.listen(4)
+    thread = threading.Thread(target=pub.serve, args=(server,))
+    thread.daemon = True
+    thread.start()
+    print("publishing on %s:%d" % (args.host, args.port))
+
+    start = time.time()
+    milestone = 1000000
+    next_milestone = start + args.milestone_interval
+    next_deposit = start + args.deposit_every
+    unconfirmed = []  # (address, bundle) attached and waiting for a milestone
+    bundles = list(args.bundle)
+    try:
+        while not args.duration or time.time() - start < args.duration:
+            time.sleep(random.expovariate(args.tx_rate) if args.tx_rate > 0 else 1)
+            now = time.time()
+            if args.tx_rate > 0:
+                pub.publish(tx_event(random_hash(), random.choice([0, 0, 0, 1, 100]), random_hash()))
+            if args.watch and now >= next_deposit:
+                next_deposit += args.deposit_every
+                deposit = (random.choice(args.watch), random_hash())
+                pub.publish(tx_event(deposit[0], random.randint(1, 1000), deposit[1]))
+                unconfirmed.append(deposit)
+            if bundles and now - start >= args.confirm_after:
+                unconfirmed.extend((random_hash(), b) for b in bundles)
+                bundles = []
+            if now >= next_milestone:
+                next_milestone += args.milestone_interval
+                milestone += 1
+                for address, bundle in unconfirmed + [(random_hash(), random_hash())]:
+                    pub.publish(sn_event(milestone, address, bundle))
+                unconfirmed = []
+                pub.publish("lmsi %d %d" % (milestone - 1, milestone))
+    except KeyboardInterrupt:
+        pass
+
+    elapsed = time.time() - start
+    polls = int(elapsed / args.poll_interval)
+    print("%.0fs, published tx %d, sn %d, lmsi %d" % (elapsed, pub.counts["tx"], pub.counts["sn"],
+                                                     pub.counts["lmsi"]))
+    print("delivered %d events, %d bytes, all filtered on the device" % (pub.delivered, pub.bytes))
+    # a poll every interval: getNodeInfo for the tip pool, getInclusionStates per bundle, getBalances
+    # for the watched addresses
+    polling = polls * (1 + len(args.bundle) + (1 if args.watch else 0))
+    print("polling every %.0fs would send %d requests in the same time, compare with `events` and "
+          "`net_stats` on the wallet" % (args.poll_interval, polling))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+"""Expand binary CClient log records of the log ring to text lines.
+
+Usage:
+    python3 tools/log_expand.py build/iota_wallet.elf < capture.bin
+    python3 tools/log_expand.py build/iota_wallet.elf --port /dev/ttyUSB0
+
+With `log_ring bin` or CONFIG_LOG_RING_BINARY the wallet writes the address of the format string
+and the arguments of a log line, see main/log_ring.h. Format strings are read from the ELF the
+firmware was built from, a different build expands to garbage. Text between frames, such as the
+prompt and other logs, is passed through.
+"""
+from __future__ import print_function
+
+import argparse
+import re
+import struct
+import sys
+
+SYNC = 0xA6
+FRAME_LOGGER = 1
+FRAME_RECORD = 2
+SHT_NOBITS = 8
+
+SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?([hlLqjzt]*)([diouxXcpfFeEgGaAsn%])")
+
+
+class Elf(object):
+    """Sections of a 32-bit little-endian ELF, enough to read strings at addresses."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or bytearray(self.data)[4] != 1:
+            raise ValueError("%s is not a 32-bit ELF" % path)
+        shoff = struct.unpack_from("<I", self.data, 0x20)[0]
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            _, sh_type, _, addr, offset, size = struct.unpack_from("<IIIIII", self.data, shoff + i * shentsize)
+            if addr and sh_type != SHT_NOBITS:
+                self.sections.append((addr, offset, size))
+
+    def string(self, address):
+        for addr, offset, size in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                end = self.data.index(b"\x00", start, offset + size)
+                return self.data[start:end].decode("utf-8", "replace")
+        return None
+
+
+def take(args, offset, fmt):
+    value = struct.unpack_from(fmt, args, offset)[0]
+    return value, offset + struct.calcsize(fmt)
+
+
+def expand(fmt, args):
+    """printf of a format with arguments in the layout of main/log_ring.h"""
+    out = []
+    offset = 0
+    last = 0
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[last:m.start()])
+        last = m.end()
+        flags, width, precision, length, conv = m.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+        if width == "*":
+            width, offset = take(args, offset, "<i")
+            width = str(width)
+        if precision == "*":
+            precision, offset = take(args, offset, "<i")
+            precision = str(precision)
+        wide = "ll" in length or "q" in length or "j" in length
+        spec = "%" + flags + (width or "")
+        if precision is not None:
+            spec += "." + (precision or "0")
+
+        if conv in "di":
+            value, offset = take(args, offset, "<q" if wide else "<i")
+            out.append((spec + "d") % value)
+        elif conv in "ouxX":
+            value, offset = take(args, offset, "<Q" if wide else "<I")
+            out.append((spec + ("d" if conv == "u" else conv)) % value)
+        elif conv == "c":
+            value, offset = take(args, offset, "<I")
+            out.append(chr(value & 0xFF))
+        elif conv == "p":
+            value, offset = take(args, offset, "<Q" if wide else "<I")
+            out.append("0x%x" % value)
+        elif conv in "fFeEgG":
+            value, offset = take(args, offset, "<d")
+            out.append((spec + conv) % value)
+        elif conv in "aA":
+            value, offset = take(args, offset, "<d")
+            out.append(value.hex())
+        elif conv == "s":
+            size = bytearray(args)[offset]
+            value = args[offset + 1:offset + 1 + size].decode("utf-8", "replace")
+            offset += 1 + size
+            out.append((spec + "s") % value)
+    out.append(fmt[last:])
+    return "".join(out)
+
+
+class Expander(object):
+    def __init__(self, elf, out):
+        self.elf = elf
+        self.out = out
+        self.names = {}
+
+    def frame(self, frame_type, payload):
+        if frame_type == FRAME_LOGGER:
+            self.names[bytearray(payload)[0]] = payload[1:].decode("utf-8", "replace")
+            return
+        level, logger, ms, address = struct.unpack_from("<cBII", payload, 0)
+        fmt = self.elf.string(address)
+        name = self.names.get(logger, "cclient")
+        if fmt is None:
+            line = "format at 0x%08x not in the ELF" % address
+        else:
+            try:
+                line = expand(fmt, payload[10:])
+            except (struct.error, IndexError, ValueError, TypeError) as e:
+                line = "%r: %s" % (fmt, e)
+        self.out.write("%s (%d) %s: %s\n" % (level.decode("ascii"), ms, name, line.rstrip("\n")))
+        self.out.flush()
+
+    def feed(self, buf):
+        """Expand complete frames of buf and pass text through, returns the rest"""
+        while buf:
+            sync = buf.find(bytearray([SYNC]))
+            if sync < 0:
+                self.text(buf)
+                return bytearray()
+            self.text(buf[:sync])
+            buf = buf[sync:]
+            if len(buf) < 4:
+                return buf
+            if buf[1] not in (FRAME_LOGGER, FRAME_RECORD):
+                self.text(buf[:1])
+                buf = buf[1:]
+                continue
+            size = struct.unpack_from(">H", buf, 2)[0]
+            if len(buf) < 4 + size:
+                return buf
+            self.frame(buf[1], bytes(buf[4:4 + size]))
+            buf = buf[4 + size:]
+        return buf
+
+    def text(self, data):
+        if data:
+            self.out.write(bytes(data).decode("utf-8", "replace"))
+            self.out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="expand binary CClient logs of the wallet")
+    parser.add_argument("elf", help="ELF of the running firmware")
+    parser.add_argument("--port", help="read from a serial port instead of stdin")
+    parser.add_argument("--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    expander = Expander(Elf(args.elf), sys.stdout)
+    if args.port:
+        import serial
+        stream = serial.Serial(args.port, args.baud, timeout=0.1)
+    else:
+        stream = getattr(sys.stdin, "buffer", sys.stdin)
+
+    read = getattr(stream, "read1", stream.read)
+    buf = bytearray()
+    try:
+        while True:
+            chunk = read(4096)
+            if not chunk:
+                if args.port:
+                    continue
+                break
+            buf = expander.feed(buf + bytearray(chunk))
+    except KeyboardInterrupt:
+        pass
+    expander.text(buf)
+
+
+if __name__ == "__main__":
+    main()
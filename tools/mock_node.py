@@ -0,0 +1,337 @@
+#!/usr/bin/env python3
+"""A mock IRI node for measuring the wallet on a local network.
+
+Usage:
+    python3 tools/mock_node.py --port 14265 --latency getTransactionsToApprove=1500
+
+Then point the wallet to it with `node_info_set <host> 14265 0`.
+
+With --bundle-file, getTrytes serves the transactions of a real bundle by their hashes and
+findTransactions finds them by the bundle hash, the file is a JSON list of transaction trytes, one
+transaction per line, or the output of `get_bundle --format=json`. --find-missing leaves the last
+transactions out of findTransactions like a bundle being reattached.
+
+With --used-addresses, the first addresses queried by findTransactions are used, later ones are
+unused, like a wallet which has used that many addresses. The last --funded of them have a
+balance, `send` has to go through all of them to find inputs with get_inputs.
+
+Flaky and slow nodes: --errors getBalances=0.2 fails that share of requests with --error-kind
+(`500`, `drop` closes the connection, `invalid` returns broken JSON), --bandwidth limits responses
+to kilobytes per second. tools/wallet_soak.py runs the node in-process and changes these per
+scenario.
+"""
+from __future__ import print_function
+
+import argparse
+import collections
+import json
+import random
+import sys
+import threading
+import time
+
+try:
+    from http.server import BaseHTTPRequestHandler, HTTPServer
+    from socketserver import ThreadingMixIn
+except ImportError:  # python 2.x
+    from BaseHTTPServer import BaseHTTPRequestHandler, HTTPServer
+    from SocketServer import ThreadingMixIn
+
+TRYTE_CHARS = "9ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+HASH_LEN = 81
+TX_LEN = 2673
+CURRENT_INDEX = slice(2331, 2340)
+BUNDLE = slice(2349, 2430)
+
+
+def random_hash(length=HASH_LEN):
+    return "".join(random.choice(TRYTE_CHARS) for _ in range(length))
+
+
+# Curl-P-81 for transaction hashes
+CURL_STATE_LEN = 729
+CURL_ROUNDS = 81
+TRUTH_TABLE = [1, 0, -1, 2, 1, -1, 0, 2, -1, 1, 0]
+
+
+def _curl_indices():
+    indices, index = [], 0
+    for _ in range(CURL_STATE_LEN):
+        next_index = index + (364 if index < 365 else -365)
+        indices.append((index, next_index))
+        index = next_index
+    return indices
+
+
+CURL_INDICES = _curl_indices()
+
+
+def trytes_to_trits(trytes):
+    trits = []
+    for c in trytes:
+        v = TRYTE_CHARS.index(c)
+        v = v - 27 if v > 13 else v
+        for _ in range(3):
+            r = (v + 1) % 3 - 1
+            trits.append(r)
+            v = (v - r) // 3
+    return trits
+
+
+def trits_to_trytes(trits):
+    return "".join(TRYTE_CHARS[(trits[i] + trits[i + 1] * 3 + trits[i + 2] * 9) % 27]
+                   for i in range(0, len(trits), 3))
+
+
+def trits_to_int(trits):
+    return sum(t * 3 ** i for i, t in enumerate(trits))
+
+
+def curl_hash(trytes):
+    state = [0] * CURL_STATE_LEN
+    trits = trytes_to_trits(trytes)
+    for offset in range(0, len(trits), 243):
+        state[0:243] = trits[offset:offset + 243]
+        for _ in range(CURL_ROUNDS):
+            prev = state
+            state = [TRUTH_TABLE[prev[a] + (prev[b] << 2) + 5] for a, b in CURL_INDICES]
+    return trits_to_trytes(state[0:243])
+
+
+def load_bundle(path):
+    with open(path) as f:
+        text = f.read().strip()
+    if text.startswith("["):
+        txs = json.loads(text)
+    else:
+        # trytes per line, or records of `get_bundle --format=json`
+        txs = [json.loads(line)["trytes"] if line.startswith("{") else line
+               for line in text.splitlines() if line.strip()]
+    store = {}
+    for trytes in txs:
+        if len(trytes) != TX_LEN:
+            raise ValueError("invalid transaction length %d" % len(trytes))
+        store[curl_hash(trytes)] = trytes
+    return store
+
+
+class MockNode(object):
+    def __init__(self, latency, find_count=0, txs=None, find_missing=0, used_addresses=0, funded=0, balance=0,
+                 errors=None, error_kind="500", bandwidth=0):
+        self.latency = latency
+        self.errors = errors or {}  # command -> share of failed requests
+        self.error_kind = error_kind
+        self.bandwidth = bandwidth  # kilobytes per second of responses, 0 is unlimited
+        self.requests = collections.Counter()
+        self.failures = collections.Counter()
+        self.tx_bytes = 0
+        self.find_count = find_count
+        self.used_addresses = used_addresses
+        self.funded = funded
+        self.balance = balance
+        self.seen = {}  # address -> order of the first query
+        self.lock = threading.Lock()
+        self.txs = txs or {}
+        # the last transactions of the bundle are not found
+        by_index = sorted(self.txs, key=lambda h: trits_to_int(trytes_to_trits(self.txs[h][CURRENT_INDEX])))
+        self.unfound = set(by_index[len(by_index) - find_missing:]) if find_missing else set()
+        self.milestone_index = 1000000
+        self.milestone = random_hash()
+        self.started = time.time()
+
+    def delay(self, command):
+        ms = self.latency.get(command, self.latency.get("*", 0))
+        if ms:
+            time.sleep(ms / 1000.0)
+
+    def reset_stats(self):
+        with self.lock:
+            self.requests.clear()
+            self.failures.clear()
+            self.tx_bytes = 0
+
+    def fails(self, command):
+        """The kind of error injected into this request, None if it succeeds."""
+        rate = self.errors.get(command, self.errors.get("*", 0))
+        if rate and random.random() < rate:
+            with self.lock:
+                self.failures[command] += 1
+            return self.error_kind
+        return None
+
+    def handle(self, req):
+        command = req.get("command", "")
+        with self.lock:
+            self.requests[command] += 1
+        self.delay(command)
+        handler = getattr(self, "cmd_" + command, None)
+        if handler is None:
+            return 400, {"error": "Command [%s] is unknown" % command}
+        return 200, handler(req)
+
+    def cmd_getNodeInfo(self, req):
+        # a new milestone every 60 seconds
+        index = self.milestone_index + int((time.time() - self.started) / 60)
+        return {
+            "appName": "mock-IRI",
+            "appVersion": "1.8.6",
+            "latestMilestone": self.milestone,
+            "latestMilestoneIndex": index,
+            "latestSolidSubtangleMilestone": self.milestone,
+            "latestSolidSubtangleMilestoneIndex": index,
+            "neighbors": 0,
+            "packetsQueueSize": 0,
+            "time": int(time.time() * 1000),
+            "tips": 0,
+            "transactionsToRequest": 0,
+        }
+
+    def cmd_getTransactionsToApprove(self, req):
+        return {"trunkTransaction": random_hash(), "branchTransaction": random_hash(), "duration": 0}
+
+    def cmd_attachToTangle(self, req):
+        return {"trytes": req.get("trytes", [])}
+
+    def cmd_storeTransactions(self, req):
+        return {}
+
+    def cmd_broadcastTransactions(self, req):
+        return {}
+
+    def address_order(self, address):
+        with self.lock:
+            return self.seen.setdefault(address, len(self.seen))
+
+    def is_funded(self, address):
+        order = self.seen.get(address)
+        return order is not None and self.used_addresses - self.funded <= order < self.used_addresses
+
+    def cmd_getBalances(self, req):
+        addresses = req.get("addresses", [])
+        return {"balances": [str(self.balance if self.is_funded(a) else 0) for a in addresses],
+                "references": [self.milestone], "milestoneIndex": self.milestone_index}
+
+    def cmd_findTransactions(self, req):
+        bundles = req.get("bundles")
+        if bundles:
+            return {"hashes": [h for h, trytes in self.txs.items()
+                               if trytes[BUNDLE] in bundles and h not in self.unfound]}
+        addresses = req.get("addresses")
+        if addresses and self.used_addresses:
+            return {"hashes": [random_hash() for a in addresses
+                               if self.address_order(a) < self.used_addresses]}
+        return {"hashes": [random_hash() for _ in range(self.find_count)]}
+
+    def cmd_getTrytes(self, req):
+        return {"trytes": [self.txs.get(h, "9" * TX_LEN) for h in req.get("hashes", [])]}
+
+    def cmd_getInclusionStates(self, req):
+        return {"states": [False] * len(req.get("transactions", []))}
+
+    def cmd_wereAddressesSpentFrom(self, req):
+        return {"states": [False] * len(req.get("addresses", []))}
+
+    def cmd_checkConsistency(self, req):
+        return {"state": True}
+
+
+def make_handler(node):
+    class Handler(BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def do_POST(self):
+            length = int(self.headers.get("Content-Length", 0))
+            try:
+                req = json.loads(self.rfile.read(length).decode("utf-8"))
+                status, res = node.handle(req)
+            except ValueError:
+                req, status, res = {}, 400, {"error": "Invalid JSON"}
+            error = node.fails(req.get("command", ""))
+            if error == "drop":
+                self.close_connection = True
+                return
+            if error == "500":
+                status, res = 500, {"exception": "injected error"}
+            body = json.dumps(res).encode("utf-8")
+            if error == "invalid":
+                body = body[:len(body) // 2]
+            self.send_response(status)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.write_limited(body)
+
+        def write_limited(self, body):
+            chunk = 1024
+            for i in range(0, len(body), chunk):
+                self.wfile.write(body[i:i + chunk])
+                if node.bandwidth:
+                    time.sleep(float(len(body[i:i + chunk])) / (node.bandwidth * 1024))
+            with node.lock:
+                node.tx_bytes += len(body)
+
+        def log_message(self, fmt, *args):
+            sys.stderr.write("%.3f %s\n" % (time.time(), fmt % args))
+
+    return Handler
+
+
+class ThreadedHTTPServer(ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+
+def parse_latency(items):
+    latency = {}
+    for item in items:
+        command, ms = item.split("=")
+        latency[command] = int(ms)
+    return latency
+
+
+def parse_errors(items):
+    errors = {}
+    for item in items:
+        command, rate = item.split("=")
+        errors[command] = float(rate)
+    return errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description="mock IRI node")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=14265)
+    parser.add_argument("--latency", nargs="*", default=[],
+                        help="per command latency in ms, e.g. getTransactionsToApprove=1500 or *=100")
+    parser.add_argument("--find-count", type=int, default=0,
+                        help="number of hashes in findTransactions responses")
+    parser.add_argument("--bundle-file", help="transactions served by getTrytes and findTransactions")
+    parser.add_argument("--find-missing", type=int, default=0,
+                        help="number of transactions of the bundle findTransactions doesn't find")
+    parser.add_argument("--used-addresses", type=int, default=0,
+                        help="number of addresses with transactions, in the order they are queried")
+    parser.add_argument("--funded", type=int, default=1, help="number of the last used addresses with a balance")
+    parser.add_argument("--balance", type=int, default=1000, help="balance of a funded address")
+    parser.add_argument("--errors", nargs="*", default=[],
+                        help="per command share of failed requests, e.g. getBalances=0.2 or *=0.05")
+    parser.add_argument("--error-kind", choices=["500", "drop", "invalid"], default="500")
+    parser.add_argument("--bandwidth", type=float, default=0, help="response bandwidth in KB/s, 0 is unlimited")
+    args = parser.parse_args()
+
+    txs = {}
+    if args.bundle_file:
+        txs = load_bundle(args.bundle_file)
+        for h in txs:
+            if txs[h][CURRENT_INDEX] == "9" * 9:
+                print("tail: %s" % h)
+    node = MockNode(parse_latency(args.latency), args.find_count, txs, args.find_missing, args.used_addresses,
+                    args.funded, args.balance, parse_errors(args.errors), args.error_kind, args.bandwidth)
+    server = ThreadedHTTPServer((args.host, args.port), make_handler(node))
+    print("mock node listening on %s:%d" % (args.host, args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""Decode binary output records of the wallet(`format bin`) to JSON lines.
+
+Usage:
+    python3 tools/output_decode.py < capture.bin
+    python3 tools/output_decode.py --port /dev/ttyUSB0
+
+Text between records, such as the prompt and logs, is skipped.
+"""
+from __future__ import print_function
+
+import argparse
+import json
+import struct
+import sys
+
+from binproto_gateway import HASH_BYTES, HASH_TRITS, packed_len, unpack
+
+SYNC = 0xA5
+FIELD_HASH = 1
+FIELD_TRITS = 2
+FIELD_UINT = 3
+FIELD_STR = 4
+
+# field names by record type, in the order of main/wallet_output.h
+RECORDS = {
+    1: ("hashes", None),
+    2: ("balance", ["address", "balance"]),
+    3: ("address", ["index", "address", "balance"]),
+    4: ("account", ["balance", "unusedAddress", "addressCount"]),
+    5: ("transaction", ["trytes"]),
+    6: ("node_info", ["appName", "appVersion", "latestMilestone", "latestMilestoneIndex",
+                      "latestSolidSubtangleMilestone", "latestSolidSubtangleMilestoneIndex", "tips"]),
+    7: ("client_conf", ["mwm", "depth", "security"]),
+    8: ("value", ["name", "value"]),
+    9: ("subaccount", ["name", "security", "nextIndex", "fundedCount", "balance"]),
+}
+
+
+def read_varint(payload, offset):
+    value, shift = 0, 0
+    while True:
+        b = payload[offset]
+        offset += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return value, offset
+
+
+def decode_fields(payload):
+    fields = []
+    offset = 0
+    while offset < len(payload):
+        kind = payload[offset]
+        offset += 1
+        if kind == FIELD_HASH:
+            fields.append(unpack(payload[offset:offset + HASH_BYTES], HASH_TRITS))
+            offset += HASH_BYTES
+        elif kind == FIELD_TRITS:
+            num_trits = struct.unpack_from(">H", payload, offset)[0]
+            offset += 2
+            fields.append(unpack(payload[offset:offset + packed_len(num_trits)], num_trits))
+            offset += packed_len(num_trits)
+        elif kind == FIELD_UINT:
+            value, offset = read_varint(payload, offset)
+            fields.append(value)
+        elif kind == FIELD_STR:
+            length, offset = read_varint(payload, offset)
+            fields.append(payload[offset:offset + length].decode("utf-8", "replace"))
+            offset += length
+        else:
+            raise ValueError("unknown field kind %d" % kind)
+    return fields
+
+
+def decode_record(rec_type, payload):
+    name, keys = RECORDS.get(rec_type, ("unknown%d" % rec_type, None))
+    fields = decode_fields(bytearray(payload))
+    record = {"t": name}
+    if keys is None:
+        record[name] = fields
+    else:
+        record.update(zip(keys, fields))
+    return record
+
+
+def records(stream):
+    while True:
+        b = stream.read(1)
+        if not b:
+            return
+        if bytearray(b)[0] != SYNC:
+            continue
+        header = stream.read(3)
+        if len(header) < 3:
+            return
+        rec_type, length = struct.unpack(">BH", header)
+        payload = stream.read(length)
+        if len(payload) < length:
+            return
+        try:
+            yield decode_record(rec_type, payload)
+        except (ValueError, IndexError) as e:
+            sys.stderr.write("skip record %d: %s\n" % (rec_type, e))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="decode binary wallet output")
+    parser.add_argument("--port", help="serial port, stdin if not set")
+    parser.add_argument("--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    if args.port:
+        import serial
+        stream = serial.Serial(args.port, args.baud)
+    else:
+        stream = getattr(sys.stdin, "buffer", sys.stdin)
+
+    for record in records(stream):
+        print(json.dumps(record))
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Run a batch script on the wallet over UART and print the JSON lines results.
+
+Usage:
+    python3 tools/wallet_batch.py --port /dev/ttyUSB0 script.txt
+
+Requires pyserial, it comes with ESP-IDF.
+"""
+from __future__ import print_function
+
+import argparse
+import json
+import sys
+import time
+
+import serial
+
+
+def read_record(uart, deadline):
+    """The next JSON record of the batch, skips the prompt and logs. None on timeout."""
+    while time.time() < deadline:
+        raw = uart.readline().decode("utf-8", "replace").strip()
+        start = raw.find("{")
+        if start < 0:
+            continue
+        try:
+            return json.loads(raw[start:])
+        except ValueError:
+            continue
+    return None
+
+
+def run_batch(uart, lines, timeout):
+    """Send the lines as a batch script and yield the JSON records from the start to the end.
+
+    The script is sent once the batch has started. The wallet reads the whole script before running it,
+    so nothing is left in its 256 byte UART RX buffer while commands run.
+
+    Raises RuntimeError if the batch doesn't end within timeout seconds.
+    """
+    deadline = time.time() + timeout
+    uart.write(b"\rbatch\r")
+    while True:
+        record = read_record(uart, deadline)
+        if record is None:
+            raise RuntimeError("timeout")
+        if record.get("batch") == "start":
+            break
+    yield record
+
+    for line in lines + ["."]:
+        uart.write(line.encode("utf-8") + b"\r")
+        uart.flush()
+
+    while True:
+        record = read_record(uart, deadline)
+        if record is None:
+            raise RuntimeError("timeout")
+        yield record
+        if record.get("batch") == "end":
+            return
+
+
+def main():
+    parser = argparse.ArgumentParser(description="run a batch script on the wallet")
+    parser.add_argument("--port", required=True)
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--timeout", type=float, default=300, help="seconds to wait for the batch end")
+    parser.add_argument("script", help="a command per line, '-' for stdin")
+    args = parser.parse_args()
+
+    script = sys.stdin if args.script == "-" else open(args.script)
+    lines = [l.rstrip("\r\n") for l in script]
+
+    uart = serial.Serial(args.port, args.baud, timeout=1)
+    failed = 0
+    try:
+        for record in run_batch(uart, lines, args.timeout):
+            print(json.dumps(record))
+            if record.get("batch") == "end":
+                failed = record.get("failed", 0)
+    except RuntimeError:
+        sys.stderr.write("timeout\n")
+        return 2
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
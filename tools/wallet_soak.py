@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+"""Soak and load benchmark of the wallet against the mock node.
+
+Usage:
+    python3 tools/wallet_soak.py --port /dev/ttyUSB0 --host-ip 192.168.1.2 --out baseline.json
+    python3 tools/wallet_soak.py --port /dev/ttyUSB0 --host-ip 192.168.1.2 --compare baseline.json
+
+Runs tools/mock_node.py in-process and the scenarios of tools/soak_scenarios.json as batch
+scripts over UART. Each scenario sets the latency, bandwidth, injected errors and fixtures of
+the node, then its commands run `repeat` times. Results are the throughput, latency percentiles
+per command from the `us` of batch results, failures, requests the node served and the low-water
+mark of the heap from the batch records. --restart restarts the wallet before each scenario, so
+min_free is the peak of that scenario. --soak repeats all scenarios for that many seconds and
+reports the drift of free heap between rounds.
+
+--out writes a baseline with sorted keys for CI to keep, --compare fails if a scenario got slower
+or used more heap than the baseline by more than the tolerance. A scenario without a result for
+each of its lines stops the run before anything is written.
+
+Requires pyserial, it comes with ESP-IDF.
+"""
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import sys
+import threading
+import time
+
+import serial
+
+import mock_node
+from wallet_batch import run_batch
+
+DEFAULT_ADDRESS = "RECEIVER9ADDRESS" + "9" * 65
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+def start_node(args):
+    txs = mock_node.load_bundle(args.bundle_file) if args.bundle_file else {}
+    node = mock_node.MockNode({}, txs=txs)
+    server = mock_node.ThreadedHTTPServer(("0.0.0.0", args.node_port), mock_node.make_handler(node))
+    server.RequestHandlerClass.log_message = lambda *a: None
+    thread = threading.Thread(target=server.serve_forever)
+    thread.daemon = True
+    thread.start()
+    tail = None
+    for h, trytes in txs.items():
+        if trytes[mock_node.CURRENT_INDEX] == "9" * 9:
+            tail = h
+    return node, tail
+
+
+def configure_node(node, settings):
+    node.latency = settings.get("latency", {})
+    node.errors = settings.get("errors", {})
+    node.error_kind = settings.get("error_kind", "500")
+    node.bandwidth = settings.get("bandwidth", 0)
+    node.find_count = settings.get("find_count", 0)
+    node.used_addresses = settings.get("used_addresses", 0)
+    node.funded = settings.get("funded", 1)
+    node.balance = settings.get("balance", 1000)
+    with node.lock:
+        node.seen.clear()
+    node.reset_stats()
+
+
+def restart_wallet(uart, timeout=30):
+    uart.write(b"\rrestart\r")
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if b"IOTA>" in uart.readline():
+            return
+    raise RuntimeError("no prompt after restart")
+
+
+def run_scenario(uart, node, scenario, values, args):
+    if args.restart:
+        restart_wallet(uart)
+    # the node is set outside of the measured batch, its getNodeInfo isn't counted
+    list(run_batch(uart, ["node_info_set %s %d 0" % (args.host_ip, args.node_port)], args.timeout))
+    configure_node(node, scenario.get("node", {}))
+
+    lines = [c.format(**values) for c in scenario["commands"]] * scenario.get("repeat", 1)
+    records = list(run_batch(uart, lines, args.timeout))
+    start, end = records[0], records[-1]
+    # a line lost on the UART would make the scenario look faster, it isn't a result
+    ids = sorted(r.get("id", 0) for r in records[1:-1])
+    if ids != list(range(1, len(lines) + 1)):
+        raise RuntimeError("%d results for %d lines, lines were lost" % (len(ids), len(lines)))
+    latency = {}
+    failed = {}
+    for r in records[1:-1]:
+        cmd = r.get("cmd", "?")
+        latency.setdefault(cmd, []).append(r.get("us", 0) / 1000.0)
+        failed[cmd] = failed.get(cmd, 0) + (r.get("ret", -1) != 0)
+
+    seconds = end.get("us", 0) / 1e6
+    result = {
+        "count": end.get("count", 0),
+        "failed": end.get("failed", 0),
+        "seconds": round(seconds, 2),
+        "throughput": round(end.get("count", 0) / seconds, 3) if seconds else 0,
+        "free_end": end.get("free"),
+        "min_free": end.get("min_free"),
+        "heap_peak": None,
+        "commands": {},
+        "node": {"requests": dict(node.requests), "failures": dict(node.failures), "bytes": node.tx_bytes},
+    }
+    # the low-water mark moved during the batch, so it's the peak of this scenario
+    if end.get("min_free", 0) < start.get("min_free", 0):
+        result["heap_peak"] = start["free"] - end["min_free"]
+    for cmd, values_ms in latency.items():
+        result["commands"][cmd] = {
+            "count": len(values_ms),
+            "failed": failed[cmd],
+            "p50_ms": round(percentile(values_ms, 50), 1),
+            "p90_ms": round(percentile(values_ms, 90), 1),
+            "p99_ms": round(percentile(values_ms, 99), 1),
+            "max_ms": round(max(values_ms), 1),
+        }
+    return result
+
+
+def print_result(name, r):
+    peak = "-" if r["heap_peak"] is None else str(r["heap_peak"])
+    print("%-20s %4d cmds %3d failed %8.1fs %7.3f cmd/s  min_free %s peak %s  node requests %d" %
+          (name, r["count"], r["failed"], r["seconds"], r["throughput"], r["min_free"], peak,
+           sum(r["node"]["requests"].values())))
+    for cmd in sorted(r["commands"]):
+        c = r["commands"][cmd]
+        print("    %-16s n=%-4d p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f ms  failed %d" %
+              (cmd, c["count"], c["p50_ms"], c["p90_ms"], c["p99_ms"], c["max_ms"], c["failed"]))
+
+
+def compare(baseline, results, tolerance, heap_tolerance):
+    regressions = []
+    for name, r in sorted(results.items()):
+        b = baseline.get("scenarios", {}).get(name)
+        if b is None:
+            continue
+        if b["throughput"] and r["throughput"] < b["throughput"] * (1 - tolerance):
+            regressions.append("%s: throughput %.3f -> %.3f cmd/s" % (name, b["throughput"], r["throughput"]))
+        if b["min_free"] is not None and r["min_free"] is not None and r["min_free"] < b["min_free"] - heap_tolerance:
+            regressions.append("%s: min_free %d -> %d" % (name, b["min_free"], r["min_free"]))
+        for cmd, c in sorted(r["commands"].items()):
+            bc = b["commands"].get(cmd)
+            if bc and c["p90_ms"] > bc["p90_ms"] * (1 + tolerance):
+                regressions.append("%s/%s: p90 %.1f -> %.1f ms" % (name, cmd, bc["p90_ms"], c["p90_ms"]))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="soak and load benchmark of the wallet")
+    parser.add_argument("--port", required=True, help="serial port of the wallet")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--host-ip", required=True, help="address of this host the wallet reaches the mock node at")
+    parser.add_argument("--node-port", type=int, default=14265)
+    parser.add_argument("--scenarios", default=os.path.join(os.path.dirname(__file__), "soak_scenarios.json"))
+    parser.add_argument("--only", nargs="*", help="names of scenarios to run")
+    parser.add_argument("--address", default=DEFAULT_ADDRESS, help="address of balance, transactions and send")
+    parser.add_argument("--bundle-file", help="a bundle for get_bundle, see tools/mock_node.py")
+    parser.add_argument("--restart", action="store_true", help="restart the wallet before each scenario")
+    parser.add_argument("--soak", type=float, default=0, help="repeat all scenarios for this many seconds")
+    parser.add_argument("--timeout", type=float, default=900, help="seconds to wait for a scenario")
+    parser.add_argument("--out", help="write results as a baseline")
+    parser.add_argument("--compare", help="baseline to compare with")
+    parser.add_argument("--tolerance", type=float, default=0.2, help="allowed slowdown, 0.2 is 20%%")
+    parser.add_argument("--heap-tolerance", type=int, default=4096, help="allowed drop of min_free in bytes")
+    args = parser.parse_args()
+
+    with open(args.scenarios) as f:
+        scenarios = json.load(f)
+    if args.only:
+        scenarios = [s for s in scenarios if s["name"] in args.only]
+
+    node, tail = start_node(args)
+    values = {"address": args.address, "tail": tail}
+    uart = serial.Serial(args.port, args.baud, timeout=1)
+
+    results = {}
+    free_by_round = []
+    last_free = None
+    start = time.time()
+    while True:
+        for scenario in scenarios:
+            if any(values.get(n) is None for n in scenario.get("needs", [])):
+                print("%-20s skipped, needs %s" % (scenario["name"], ", ".join(scenario["needs"])))
+                continue
+            try:
+                r = run_scenario(uart, node, scenario, values, args)
+            except RuntimeError as e:
+                print("%-20s %s" % (scenario["name"], e))
+                return 2
+            print_result(scenario["name"], r)
+            # the first round is the result, later rounds of a soak only track the heap
+            results.setdefault(scenario["name"], r)
+            last_free = r["free_end"]
+        free_by_round.append(last_free)
+        if not args.soak or time.time() - start >= args.soak:
+            break
+
+    if len(free_by_round) > 1:
+        print("soak: %d rounds, free heap after each round %s, drift %+d bytes" %
+              (len(free_by_round), free_by_round, free_by_round[-1] - free_by_round[0]))
+
+    if args.out:
+        baseline = {"version": 1, "scenarios": results}
+        if len(free_by_round) > 1:
+            baseline["soak"] = {"rounds": len(free_by_round), "free_drift": free_by_round[-1] - free_by_round[0]}
+        with open(args.out, "w") as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("baseline written to %s" % args.out)
+
+    if args.compare:
+        with open(args.compare) as f:
+            regressions = compare(json.load(f), results, args.tolerance, args.heap_tolerance)
+        for line in regressions:
+            print("regression: " + line)
+        if regressions:
+            return 1
+        print("no regressions against %s" % args.compare)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())